@@ -5,6 +5,7 @@
 #define __USE_GNU
 
 #include <limits.h>
+#include <pthread.h>
 #include <sys/shm.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -68,6 +69,7 @@ typedef struct {
 
 	struct pw_properties *props;
 	struct pw_context *context;
+	struct connection *conn;
 
 	struct pw_core *core;
 	struct spa_hook core_listener;
@@ -85,8 +87,115 @@ typedef struct {
 	struct spa_audio_info format;
 } snd_pcm_pipewire_t;
 
+/* With the shared option, all PCMs of the process that use the same server
+ * share the thread loop, context and core connection. */
+struct connection {
+	struct spa_list link;
+	int refcount;
+	char *remote;
+
+	struct pw_thread_loop *main_loop;
+	struct pw_context *context;
+
+	struct pw_core *core;
+	struct spa_hook core_listener;
+
+	unsigned int broken:1;
+};
+
+static pthread_mutex_t connections_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct spa_list connections = { &connections, &connections };
+
 static int snd_pcm_pipewire_stop(snd_pcm_ioplug_t *io);
 
+static void connection_core_error(void *data, uint32_t id, int seq, int res, const char *message)
+{
+	struct connection *c = data;
+
+	/* don't give this connection to new PCMs anymore */
+	if (id == PW_ID_CORE && res == -EPIPE) {
+		pthread_mutex_lock(&connections_lock);
+		c->broken = true;
+		pthread_mutex_unlock(&connections_lock);
+	}
+}
+
+static const struct pw_core_events connection_core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.error = connection_core_error,
+};
+
+static void connection_free(struct connection *c)
+{
+	if (c->main_loop)
+		pw_thread_loop_stop(c->main_loop);
+	if (c->context)
+		pw_context_destroy(c->context);
+	if (c->main_loop)
+		pw_thread_loop_destroy(c->main_loop);
+	free(c->remote);
+	free(c);
+}
+
+static struct connection *connection_ref(const char *remote)
+{
+	struct connection *c;
+	int res;
+
+	if (remote == NULL)
+		remote = "";
+
+	pthread_mutex_lock(&connections_lock);
+	spa_list_for_each(c, &connections, link) {
+		if (!c->broken && spa_streq(c->remote, remote)) {
+			c->refcount++;
+			goto done;
+		}
+	}
+	if ((c = calloc(1, sizeof(*c))) == NULL)
+		goto error;
+	c->refcount = 1;
+	if ((c->remote = strdup(remote)) == NULL)
+		goto error_free;
+	if ((c->main_loop = pw_thread_loop_new("alsa-pipewire", NULL)) == NULL)
+		goto error_free;
+	if ((c->context = pw_context_new(pw_thread_loop_get_loop(c->main_loop),
+					pw_properties_new(
+						PW_KEY_CLIENT_API, "alsa",
+						NULL),
+					0)) == NULL)
+		goto error_free;
+	if ((res = pw_thread_loop_start(c->main_loop)) < 0) {
+		errno = -res;
+		goto error_free;
+	}
+	spa_list_append(&connections, &c->link);
+done:
+	pthread_mutex_unlock(&connections_lock);
+	return c;
+
+error_free:
+	res = errno;
+	connection_free(c);
+	errno = res;
+error:
+	pthread_mutex_unlock(&connections_lock);
+	return NULL;
+}
+
+static void connection_unref(struct connection *c)
+{
+	pthread_mutex_lock(&connections_lock);
+	if (--c->refcount > 0) {
+		pthread_mutex_unlock(&connections_lock);
+		return;
+	}
+	spa_list_remove(&c->link);
+	pthread_mutex_unlock(&connections_lock);
+
+	connection_free(c);
+}
+
 static int update_active(snd_pcm_ioplug_t *io)
 {
 	snd_pcm_pipewire_t *pw = io->private_data;
@@ -131,16 +240,29 @@ static void snd_pcm_pipewire_free(snd_pcm_pipewire_t *pw)
 		return;
 
 	pw_log_debug("%p: free", pw);
-	if (pw->main_loop)
-		pw_thread_loop_stop(pw->main_loop);
-	if (pw->stream)
-		pw_stream_destroy(pw->stream);
-	if (pw->context)
-		pw_context_destroy(pw->context);
-	if (pw->fd >= 0)
-		spa_system_close(pw->system, pw->fd);
-	if (pw->main_loop)
-		pw_thread_loop_destroy(pw->main_loop);
+	if (pw->conn) {
+		/* the loop keeps running for the other PCMs */
+		pw_thread_loop_lock(pw->main_loop);
+		if (pw->stream)
+			pw_stream_destroy(pw->stream);
+		if (pw->core)
+			spa_hook_remove(&pw->core_listener);
+		pw_thread_loop_unlock(pw->main_loop);
+		if (pw->fd >= 0)
+			spa_system_close(pw->system, pw->fd);
+		connection_unref(pw->conn);
+	} else {
+		if (pw->main_loop)
+			pw_thread_loop_stop(pw->main_loop);
+		if (pw->stream)
+			pw_stream_destroy(pw->stream);
+		if (pw->context)
+			pw_context_destroy(pw->context);
+		if (pw->fd >= 0)
+			spa_system_close(pw->system, pw->fd);
+		if (pw->main_loop)
+			pw_thread_loop_destroy(pw->main_loop);
+	}
 	pw_properties_free(pw->props);
 	snd_output_close(pw->output);
 	fclose(pw->log_file);
@@ -1292,23 +1414,37 @@ static int snd_pcm_pipewire_open(snd_pcm_t **pcmp,
 		goto error;
 	}
 
-	pw->main_loop = pw_thread_loop_new("alsa-pipewire", NULL);
-	if (pw->main_loop == NULL)
-		goto error_errno;
-
-	loop = pw_thread_loop_get_loop(pw->main_loop);
-	pw->system = loop->system;
-	if ((pw->context = pw_context_new(loop,
-					pw_properties_new(
-						PW_KEY_CLIENT_API, "alsa",
-						NULL),
-					0)) == NULL)
-		goto error_errno;
+	if ((str = pw_properties_get(pw->props, "alsa.shared-connection")) != NULL &&
+	    spa_atob(str)) {
+		pw->conn = connection_ref(pw_properties_get(pw->props, PW_KEY_REMOTE_NAME));
+		if (pw->conn == NULL)
+			goto error_errno;
+		pw->main_loop = pw->conn->main_loop;
+		pw->context = pw->conn->context;
+		loop = pw_thread_loop_get_loop(pw->main_loop);
+		pw->system = loop->system;
+	} else {
+		pw->main_loop = pw_thread_loop_new("alsa-pipewire", NULL);
+		if (pw->main_loop == NULL)
+			goto error_errno;
+
+		loop = pw_thread_loop_get_loop(pw->main_loop);
+		pw->system = loop->system;
+		if ((pw->context = pw_context_new(loop,
+						pw_properties_new(
+							PW_KEY_CLIENT_API, "alsa",
+							NULL),
+						0)) == NULL)
+			goto error_errno;
+	}
 
+	/* the shared connection loop is already running */
+	pw_thread_loop_lock(pw->main_loop);
 	pw_context_conf_update_props(pw->context, "alsa.properties", pw->props);
 
 	pw_context_conf_section_match_rules(pw->context, "alsa.rules",
 			&pw_context_get_properties(pw->context)->dict, execute_match, pw);
+	pw_thread_loop_unlock(pw->main_loop);
 
 	if (pw_properties_get(pw->props, PW_KEY_APP_NAME) == NULL)
 		pw_properties_setf(pw->props, PW_KEY_APP_NAME, "PipeWire ALSA [%s]",
@@ -1349,18 +1485,28 @@ static int snd_pcm_pipewire_open(snd_pcm_t **pcmp,
 	if (pw_properties_get(pw->props, PW_KEY_MEDIA_NAME) == NULL)
 		pw_properties_set(pw->props, PW_KEY_MEDIA_NAME, node_name);
 
-	if ((err = pw_thread_loop_start(pw->main_loop)) < 0)
+	if (pw->conn == NULL &&
+	    (err = pw_thread_loop_start(pw->main_loop)) < 0)
 		goto error;
 
 	pw_thread_loop_lock(pw->main_loop);
-	props2 = pw_properties_copy(pw->props);
-	if (props2 == NULL)
-		goto error_unlock_errno;
-
-	pw->core = pw_context_connect(pw->context, props2, 0);
-	if (pw->core == NULL)
-		goto error_unlock_errno;
-
+	if (pw->conn != NULL && pw->conn->core != NULL) {
+		pw->core = pw->conn->core;
+	} else {
+		props2 = pw_properties_copy(pw->props);
+		if (props2 == NULL)
+			goto error_unlock_errno;
+
+		pw->core = pw_context_connect(pw->context, props2, 0);
+		if (pw->core == NULL)
+			goto error_unlock_errno;
+
+		if (pw->conn != NULL) {
+			pw->conn->core = pw->core;
+			pw_core_add_listener(pw->core, &pw->conn->core_listener,
+					&connection_core_events, pw->conn);
+		}
+	}
 	pw_core_add_listener(pw->core, &pw->core_listener, &core_events, pw);
 	pw_thread_loop_unlock(pw->main_loop);
 
@@ -1472,6 +1618,11 @@ SND_PCM_PLUGIN_DEFINE_FUNC(pipewire)
 				pw_properties_set(props, PW_KEY_NODE_EXCLUSIVE, "true");
 			continue;
 		}
+		if (spa_streq(id, "shared")) {
+			if (snd_config_get_bool(n))
+				pw_properties_set(props, "alsa.shared-connection", "true");
+			continue;
+		}
 		if (spa_streq(id, "rate")) {
 			if (snd_config_get_integer(n, &val) == 0) {
 				if (val != 0)
@@ -40,6 +40,7 @@ enum spa_io_type {
 	SPA_IO_RateMatch,	/**< rate matching between nodes, struct spa_io_rate_match */
 	SPA_IO_Memory,		/**< memory pointer, struct spa_io_memory (currently not used in PipeWire) */
 	SPA_IO_AsyncBuffers,	/**< async area to exchange buffers, struct spa_io_async_buffers */
+	SPA_IO_Meter,		/**< audio level meters, struct spa_io_meter */
 };
 
 /**
@@ -390,6 +391,37 @@ struct spa_io_async_buffers {
 						  *  readers read from (cycle)&1 */
 };
 
+/** Audio level meter values of one channel */
+struct spa_io_meter_channel {
+	float peak;			/**< absolute peak value in the last period */
+	float rms;			/**< RMS value of the last period */
+	float loudness;			/**< momentary loudness (400ms window) in LUFS */
+	float padding;
+};
+
+#define SPA_IO_METER_MAX_CHANNELS	64u
+
+/**
+ * Audio level meters.
+ *
+ * The node updates the values every \a period samples. The update is
+ * done with \ref SPA_SEQ_WRITE on \a seq so that readers in other
+ * threads or processes can get a consistent snapshot without locking.
+ *
+ * Peak and RMS are linear values, loudness is K-weighted as specified
+ * in ITU-R BS.1770 and expressed in LUFS.
+ */
+struct spa_io_meter {
+	uint32_t seq;			/**< sequence number, odd while updating */
+	uint32_t n_channels;		/**< number of valid channels */
+	uint32_t rate;			/**< sample rate of the metered signal */
+	uint32_t period;		/**< number of samples between updates */
+	uint64_t count;			/**< number of updates so far */
+	float loudness;			/**< momentary loudness of all channels in LUFS */
+	uint32_t padding[5];
+	struct spa_io_meter_channel channels[SPA_IO_METER_MAX_CHANNELS];
+};
+
 /**
  * \}
  */
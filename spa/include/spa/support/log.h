@@ -382,6 +382,8 @@ SPA_API_LOG void spa_log_logtv(struct spa_log *l, enum spa_log_level level,
 #define SPA_KEY_LOG_TIMESTAMP		"log.timestamp"		/**< log timestamp type (local, realtime, monotonic, monotonic-raw).
 								 *   boolean true means local. */
 #define SPA_KEY_LOG_LINE		"log.line"		/**< log file and line numbers */
+#define SPA_KEY_LOG_DEFERRED		"log.deferred"		/**< record trace messages and format them
+								  *  later in the logger thread */
 #define SPA_KEY_LOG_PATTERNS		"log.patterns"		/**< Spa:String:JSON array of [ {"pattern" : level}, ... ] */
 
 /**
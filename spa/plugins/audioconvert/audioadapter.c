@@ -963,6 +963,17 @@ static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
 	case SPA_IO_Position:
 		this->io_position = data;
 		break;
+	case SPA_IO_Meter:
+		/* the meters are measured by the converter, also when it is not
+		 * the target. The follower is told as well so that it can pass
+		 * the area on, it is fine if it doesn't know it. */
+		if (this->convert == NULL)
+			return -ENOTSUP;
+		if ((res = spa_node_set_io(this->convert, id, data, size)) < 0)
+			return res;
+		if ((res = spa_node_set_io(this->follower, id, data, size)) == -ENOENT)
+			res = 0;
+		return res;
 	default:
 		break;
 	}
@@ -22,6 +22,7 @@
 #include <spa/utils/names.h>
 #include <spa/utils/string.h>
 #include <spa/utils/ratelimit.h>
+#include <spa/utils/atomic.h>
 #include <spa/node/node.h>
 #include <spa/node/io.h>
 #include <spa/node/utils.h>
@@ -40,6 +41,8 @@
 #include "volume-ops.h"
 #include "fmt-ops.h"
 #include "gaps-ops.h"
+#include "peaks-ops.h"
+#include "biquad.h"
 #include "channelmix-ops.h"
 #include "resample.h"
 #include "wavfile.h"
@@ -260,6 +263,27 @@ struct filter_graph {
 	bool setup;
 };
 
+#define METER_BLOCKS	4	/* 400ms momentary loudness in 100ms blocks */
+
+struct meter_channel {
+	struct biquad kw[2];
+	float weight;
+	float peak;
+	float sum;
+	float ksum;
+	float blocks[METER_BLOCKS];
+};
+
+struct meter {
+	uint32_t n_channels;
+	uint32_t rate;
+	uint32_t period;
+	uint32_t count;
+	uint32_t block;
+	uint32_t remap[MAX_CHANNELS];
+	struct meter_channel channels[MAX_CHANNELS];
+};
+
 struct impl {
 	struct spa_handle handle;
 	struct spa_node node;
@@ -297,6 +321,7 @@ struct impl {
 	struct spa_io_position *io_position;
 	struct spa_io_rate_match *io_rate_match;
 	struct spa_io_latency io_latency;
+	struct spa_io_meter *io_meter;
 
 	uint64_t info_all;
 	struct spa_node_info info;
@@ -316,6 +341,8 @@ struct impl {
 	struct channelmix mix;
 	struct resample resample;
 	struct gaps gaps;
+	struct peaks peaks;
+	struct meter meter;
 	struct volume volume;
 	double rate_scale;
 	struct spa_pod_sequence *vol_ramp_sequence;
@@ -1122,6 +1149,12 @@ static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
 		}
 		break;
 	}
+	case SPA_IO_Meter:
+		if (data != NULL && size < sizeof(struct spa_io_meter))
+			return -EINVAL;
+		this->io_meter = data;
+		this->recalc = true;
+		break;
 	default:
 		return -ENOENT;
 	}
@@ -2638,6 +2671,86 @@ static inline bool resample_is_passthrough(struct impl *this)
 	return true;
 }
 
+static void meter_setup_kweight(struct meter_channel *mc, uint32_t rate)
+{
+	double K, Vh, Vb, a0;
+
+	/* ITU-R BS.1770 K-weighting, a high shelf followed by the RLB highpass,
+	 * with the coefficients recalculated for the given rate */
+	K = tan(M_PI * 1681.974450955533 / rate);
+	Vh = pow(10.0, 3.999843853973347 / 20.0);
+	Vb = pow(Vh, 0.4996667741545416);
+	a0 = 1.0 + K / 0.7071752369554196 + K * K;
+	mc->kw[0].type = BQ_RAW;
+	mc->kw[0].b0 = (float)((Vh + Vb * K / 0.7071752369554196 + K * K) / a0);
+	mc->kw[0].b1 = (float)(2.0 * (K * K - Vh) / a0);
+	mc->kw[0].b2 = (float)((Vh - Vb * K / 0.7071752369554196 + K * K) / a0);
+	mc->kw[0].a1 = (float)(2.0 * (K * K - 1.0) / a0);
+	mc->kw[0].a2 = (float)((1.0 - K / 0.7071752369554196 + K * K) / a0);
+
+	K = tan(M_PI * 38.13547087602444 / rate);
+	a0 = 1.0 + K / 0.5003270373238773 + K * K;
+	mc->kw[1].type = BQ_RAW;
+	mc->kw[1].b0 = 1.0f;
+	mc->kw[1].b1 = -2.0f;
+	mc->kw[1].b2 = 1.0f;
+	mc->kw[1].a1 = (float)(2.0 * (K * K - 1.0) / a0);
+	mc->kw[1].a2 = (float)((1.0 - K / 0.5003270373238773 + K * K) / a0);
+}
+
+static int setup_meter(struct impl *this)
+{
+	struct dir *out = &this->dir[SPA_DIRECTION_OUTPUT];
+	struct meter *m = &this->meter;
+	uint32_t i, pos;
+	int res;
+
+	if (this->peaks.free)
+		peaks_free(&this->peaks);
+
+	this->peaks.log = this->log;
+	this->peaks.cpu_flags = this->cpu_flags;
+	if ((res = peaks_init(&this->peaks)) < 0)
+		return res;
+
+	spa_zero(*m);
+	m->n_channels = SPA_MIN(out->format.info.raw.channels,
+			SPA_MIN(MAX_CHANNELS, SPA_IO_METER_MAX_CHANNELS));
+	m->rate = out->format.info.raw.rate;
+	m->period = m->rate / 10;
+
+	for (i = 0; i < m->n_channels; i++) {
+		struct meter_channel *mc = &m->channels[i];
+
+		/* the meter runs before the output remap, report the values in
+		 * the order of the output channels */
+		m->remap[i] = out->need_remap ? out->remap[i] : i;
+		if (m->remap[i] >= m->n_channels)
+			m->remap[i] = i;
+
+		pos = out->format.info.raw.position[m->remap[i]];
+		switch (pos) {
+		case SPA_AUDIO_CHANNEL_LFE:
+		case SPA_AUDIO_CHANNEL_LFE2:
+			mc->weight = 0.0f;
+			break;
+		case SPA_AUDIO_CHANNEL_SL:
+		case SPA_AUDIO_CHANNEL_SR:
+		case SPA_AUDIO_CHANNEL_RL:
+		case SPA_AUDIO_CHANNEL_RR:
+			mc->weight = 1.41f;
+			break;
+		default:
+			mc->weight = 1.0f;
+			break;
+		}
+		meter_setup_kweight(mc, m->rate);
+	}
+	spa_log_debug(this->log, "%p: meter channels:%u rate:%u period:%u %s", this,
+			m->n_channels, m->rate, m->period, this->peaks.func_name);
+	return 0;
+}
+
 static int setup_convert(struct impl *this)
 {
 	struct dir *in, *out;
@@ -2696,6 +2809,8 @@ static int setup_convert(struct impl *this)
 		return res;
 	if ((res = setup_out_convert(this)) < 0)
 		return res;
+	if ((res = setup_meter(this)) < 0)
+		return res;
 
 	this->maxsize = this->quantum_limit * sizeof(float);
 	for (i = 0; i < in->n_ports; i++) {
@@ -3895,6 +4010,115 @@ static void add_channelmix_stage(struct impl *impl, struct stage_context *ctx)
 	ctx->src_idx = s->out_idx;
 }
 
+static inline float meter_lufs(float ms)
+{
+	return ms > 0.0f ? -0.691f + 10.0f * log10f(ms) : -INFINITY;
+}
+
+static float meter_kweight_sqr_sum(struct meter_channel *mc, const float * SPA_RESTRICT src,
+		uint32_t n_samples, float sum)
+{
+	struct biquad *s = &mc->kw[0], *h = &mc->kw[1];
+	float sb0 = s->b0, sb1 = s->b1, sb2 = s->b2, sa1 = s->a1, sa2 = s->a2;
+	float ha1 = h->a1, ha2 = h->a2;
+	float sx1 = s->x1, sx2 = s->x2, hx1 = h->x1, hx2 = h->x2;
+	float x, y, z;
+	uint32_t n;
+
+	for (n = 0; n < n_samples; n++) {
+		x   = src[n];
+		y   = sb0 * x           + sx1;
+		sx1 = sb1 * x - sa1 * y + sx2;
+		sx2 = sb2 * x - sa2 * y;
+		z   = y                 + hx1;
+		hx1 = -2.0f * y - ha1 * z + hx2;
+		hx2 = y         - ha2 * z;
+		sum += z * z;
+	}
+#define F(x) (isnormal(x) ? (x) : 0.0f)
+	s->x1 = F(sx1);
+	s->x2 = F(sx2);
+	h->x1 = F(hx1);
+	h->x2 = F(hx2);
+#undef F
+	return sum;
+}
+
+static void meter_publish(struct impl *impl, struct spa_io_meter *io)
+{
+	struct meter *m = &impl->meter;
+	uint32_t i, j;
+	float total = 0.0f;
+
+	SPA_SEQ_WRITE(io->seq);
+	for (i = 0; i < m->n_channels; i++) {
+		struct meter_channel *mc = &m->channels[i];
+		struct spa_io_meter_channel *ch = &io->channels[m->remap[i]];
+		float ms = 0.0f;
+
+		mc->blocks[m->block] = mc->ksum / m->period;
+		for (j = 0; j < METER_BLOCKS; j++)
+			ms += mc->blocks[j];
+		ms /= METER_BLOCKS;
+		total += ms * mc->weight;
+
+		ch->peak = mc->peak;
+		ch->rms = sqrtf(mc->sum / m->period);
+		ch->loudness = meter_lufs(ms);
+
+		mc->peak = mc->sum = mc->ksum = 0.0f;
+	}
+	io->n_channels = m->n_channels;
+	io->rate = m->rate;
+	io->period = m->period;
+	io->loudness = meter_lufs(total);
+	io->count++;
+	SPA_SEQ_WRITE(io->seq);
+
+	m->block = (m->block + 1) % METER_BLOCKS;
+	m->count = 0;
+}
+
+static void run_meter_stage(struct stage *s, struct stage_context *c)
+{
+	struct impl *impl = s->impl;
+	struct meter *m = &impl->meter;
+	struct spa_io_meter *io = impl->io_meter;
+	const float **src = (const float **)c->datas[s->in_idx];
+	uint32_t i, chunk, offs = 0;
+
+	if (SPA_UNLIKELY(io == NULL))
+		return;
+
+	spa_log_trace_fp(impl->log, "%p: meter %d", impl, c->n_samples);
+	while (offs < c->n_samples) {
+		chunk = SPA_MIN(c->n_samples - offs, m->period - m->count);
+		for (i = 0; i < m->n_channels; i++) {
+			struct meter_channel *mc = &m->channels[i];
+			const float *d = &src[i][offs];
+
+			mc->peak = peaks_abs_max(&impl->peaks, d, chunk, mc->peak);
+			mc->sum = peaks_sqr_sum(&impl->peaks, d, chunk, mc->sum);
+			mc->ksum = meter_kweight_sqr_sum(mc, d, chunk, mc->ksum);
+		}
+		offs += chunk;
+		m->count += chunk;
+		if (m->count >= m->period)
+			meter_publish(impl, io);
+	}
+}
+static void add_meter_stage(struct impl *impl, struct stage_context *ctx)
+{
+	struct stage *s = &impl->stages[impl->n_stages];
+	s->impl = impl;
+	s->in_idx = ctx->src_idx;
+	s->out_idx = ctx->src_idx;
+	s->data = NULL;
+	s->run = run_meter_stage;
+	spa_log_trace(impl->log, "%p: stage %d", impl, impl->n_stages);
+	impl->n_stages++;
+}
+
 static void run_dst_convert_stage(struct stage *s, struct stage_context *c)
 {
 	struct impl *impl = s->impl;
@@ -3933,7 +4157,7 @@ static void add_dst_convert_stage(struct impl *impl, struct stage_context *ctx)
 static void recalc_stages(struct impl *this, struct stage_context *ctx)
 {
 	struct dir *dir;
-	bool test, do_wav, do_gap;
+	bool test, do_wav, do_gap, do_meter;
 	struct port *ctrlport = ctx->ctrlport;
 	bool in_need_remap, out_need_remap;
 	uint32_t i;
@@ -3973,6 +4197,7 @@ static void recalc_stages(struct impl *this, struct stage_context *ctx)
 		SPA_FLAG_SET(ctx->bits, DST_CONVERT_BIT);
 
 	do_wav = this->props.wav_path[0] || this->wav_file != NULL;
+	do_meter = this->io_meter != NULL && this->meter.period > 0;
 
 	if (!SPA_FLAG_IS_SET(ctx->bits, DST_CONVERT_BIT) && out_need_remap)
 		add_dst_remap_stage(this, ctx);
@@ -4015,6 +4240,10 @@ static void recalc_stages(struct impl *this, struct stage_context *ctx)
 			add_resample_stage(this, ctx);
 	}
 
+	/* the signal is now planar float in the output channel layout */
+	if (do_meter)
+		add_meter_stage(this, ctx);
+
 	if (SPA_FLAG_IS_SET(ctx->bits, DST_CONVERT_BIT))
 		add_dst_convert_stage(this, ctx);
 
@@ -4488,6 +4717,8 @@ static int impl_clear(struct spa_handle *handle)
 		channelmix_free(&this->mix);
 	if (this->resample.free)
 		resample_free(&this->resample);
+	if (this->peaks.free)
+		peaks_free(&this->peaks);
 	if (this->wav_file != NULL)
 		wav_file_close(this->wav_file);
 	free (this->vol_ramp_sequence_data);
@@ -11,6 +11,8 @@
 #include <errno.h>
 #include <time.h>
 
+#include <spa/param/audio/format.h>
+
 #include "test-helper.h"
 #include "fmt-ops.h"
 
@@ -38,13 +40,13 @@ static uint8_t samp_out[MAX_SAMPLES * MAX_CHANNELS * 4];
 static const int sample_sizes[] = { 0, 1, 128, 513, 4096 };
 static const int channel_counts[] = { 1, 2, 4, 6, 8, 11 };
 
-#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * SPA_N_ELEMENTS(channel_counts) * 70
+#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * SPA_N_ELEMENTS(channel_counts) * 130
 
 static uint32_t n_results = 0;
 static struct stats results[MAX_RESULTS];
 
 static void run_test1(const char *name, const char *impl, bool in_packed, bool out_packed,
-		convert_func_t func, int n_channels, int n_samples)
+		convert_func_t func, uint32_t method, int n_channels, int n_samples)
 {
 	int i, j;
 	const void *ip[n_channels];
@@ -55,6 +57,16 @@ static void run_test1(const char *name, const char *impl, bool in_packed, bool o
 		.n_channels = n_channels,
 	};
 
+	if (method != DITHER_METHOD_NONE) {
+		/* only sets up the noise and the shaper state, func does
+		 * the conversion */
+		conv.method = method;
+		conv.src_fmt = SPA_AUDIO_FORMAT_F32P;
+		conv.dst_fmt = SPA_AUDIO_FORMAT_S16P;
+		conv.rate = 48000;
+		spa_assert_se(convert_init(&conv) == 0);
+	}
+
 	for (j = 0; j < n_channels; j++) {
 		ip[j] = &samp_in[j * n_samples * 4];
 		op[j] = &samp_out[j * n_samples * 4];
@@ -71,6 +83,9 @@ static void run_test1(const char *name, const char *impl, bool in_packed, bool o
 	clock_gettime(CLOCK_MONOTONIC, &ts);
 	t2 = SPA_TIMESPEC_TO_NSEC(&ts);
 
+	if (method != DITHER_METHOD_NONE)
+		convert_free(&conv);
+
 	spa_assert(n_results < MAX_RESULTS);
 
 	results[n_results++] = (struct stats) {
@@ -86,8 +101,8 @@ static void run_testc(const char *name, const char *impl, bool in_packed, bool o
 		int channel_count)
 {
 	SPA_FOR_EACH_ELEMENT_VAR(sample_sizes, s) {
-		run_test1(name, impl, in_packed, out_packed, func, channel_count,
-				(*s + (channel_count -1)) / channel_count);
+		run_test1(name, impl, in_packed, out_packed, func, DITHER_METHOD_NONE,
+				channel_count, (*s + (channel_count -1)) / channel_count);
 	}
 }
 
@@ -95,7 +110,19 @@ static void run_test(const char *name, const char *impl, bool in_packed, bool ou
 {
 	SPA_FOR_EACH_ELEMENT_VAR(sample_sizes, s) {
 		SPA_FOR_EACH_ELEMENT_VAR(channel_counts, c) {
-			run_test1(name, impl, in_packed, out_packed, func, *c, (*s + (*c -1)) / *c);
+			run_test1(name, impl, in_packed, out_packed, func, DITHER_METHOD_NONE,
+					*c, (*s + (*c -1)) / *c);
+		}
+	}
+}
+
+static void run_testd(const char *name, const char *impl, bool in_packed, bool out_packed,
+		convert_func_t func, uint32_t method)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(sample_sizes, s) {
+		SPA_FOR_EACH_ELEMENT_VAR(channel_counts, c) {
+			run_test1(name, impl, in_packed, out_packed, func, method,
+					*c, (*s + (*c -1)) / *c);
 		}
 	}
 }
@@ -219,8 +246,19 @@ static void test_f32_s24(void)
 {
 	run_test("test_f32_s24", "c", true, true, conv_f32_to_s24_c);
 	run_test("test_f32d_s24", "c", false, true, conv_f32d_to_s24_c);
+#if defined (HAVE_SSSE3)
+	if (cpu_flags & SPA_CPU_FLAG_SSSE3) {
+		run_test("test_f32d_s24", "ssse3", false, true, conv_f32d_to_s24_ssse3);
+	}
+#endif
 	run_test("test_f32_s24d", "c", true, false, conv_f32_to_s24d_c);
 	run_test("test_f32d_s24d", "c", false, false, conv_f32d_to_s24d_c);
+	run_test("test_f32d_s24s", "c", false, true, conv_f32d_to_s24s_c);
+#if defined (HAVE_SSSE3)
+	if (cpu_flags & SPA_CPU_FLAG_SSSE3) {
+		run_test("test_f32d_s24s", "ssse3", false, true, conv_f32d_to_s24s_ssse3);
+	}
+#endif
 }
 
 static void test_s24_f32(void)
@@ -249,6 +287,12 @@ static void test_s24_f32(void)
 	}
 #endif
 	run_test("test_s24d_f32d", "c", false, false, conv_s24d_to_f32d_c);
+	run_test("test_s24s_f32d", "c", true, false, conv_s24s_to_f32d_c);
+#if defined (HAVE_SSSE3)
+	if (cpu_flags & SPA_CPU_FLAG_SSSE3) {
+		run_test("test_s24s_f32d", "ssse3", true, false, conv_s24s_to_f32d_ssse3);
+	}
+#endif
 }
 
 static void test_f32_s24_32(void)
@@ -267,6 +311,106 @@ static void test_s24_32_f32(void)
 	run_test("test_s24_32d_f32d", "c", false, false, conv_s24_32d_to_f32d_c);
 }
 
+static void test_f32_law(void)
+{
+	run_test("test_f32d_alaw", "c", false, true, conv_f32d_to_alaw_c);
+	run_test("test_f32d_ulaw", "c", false, true, conv_f32d_to_ulaw_c);
+#if defined (HAVE_SSE2)
+	if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+		run_test("test_f32d_alaw", "sse2", false, true, conv_f32d_to_alaw_sse2);
+		run_test("test_f32d_ulaw", "sse2", false, true, conv_f32d_to_ulaw_sse2);
+	}
+#endif
+}
+
+static void test_law_f32(void)
+{
+	run_test("test_alaw_f32d", "c", true, false, conv_alaw_to_f32d_c);
+	run_test("test_ulaw_f32d", "c", true, false, conv_ulaw_to_f32d_c);
+#if defined (HAVE_SSE2)
+	if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+		run_test("test_alaw_f32d", "sse2", true, false, conv_alaw_to_f32d_sse2);
+		run_test("test_ulaw_f32d", "sse2", true, false, conv_ulaw_to_f32d_sse2);
+	}
+#endif
+}
+
+static void test_f32_noise(void)
+{
+	run_testd("test_f32d_u8_noise", "c", false, true, conv_f32d_to_u8_noise_c,
+			DITHER_METHOD_TRIANGULAR);
+	run_testd("test_f32d_s16_noise", "c", false, true, conv_f32d_to_s16_noise_c,
+			DITHER_METHOD_TRIANGULAR);
+	run_testd("test_f32d_s16d_noise", "c", false, false, conv_f32d_to_s16d_noise_c,
+			DITHER_METHOD_TRIANGULAR);
+	run_testd("test_f32d_s16s_noise", "c", false, true, conv_f32d_to_s16s_noise_c,
+			DITHER_METHOD_TRIANGULAR);
+	run_testd("test_f32d_s24_noise", "c", false, true, conv_f32d_to_s24_noise_c,
+			DITHER_METHOD_TRIANGULAR);
+	run_testd("test_f32d_s24_32_noise", "c", false, true, conv_f32d_to_s24_32_noise_c,
+			DITHER_METHOD_TRIANGULAR);
+	run_testd("test_f32d_s32_noise", "c", false, true, conv_f32d_to_s32_noise_c,
+			DITHER_METHOD_TRIANGULAR);
+#if defined (HAVE_SSE2)
+	if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+		run_testd("test_f32d_s16_noise", "sse2", false, true, conv_f32d_to_s16_noise_sse2,
+				DITHER_METHOD_TRIANGULAR);
+		run_testd("test_f32d_s16d_noise", "sse2", false, false, conv_f32d_to_s16d_noise_sse2,
+				DITHER_METHOD_TRIANGULAR);
+		run_testd("test_f32d_s32_noise", "sse2", false, true, conv_f32d_to_s32_noise_sse2,
+				DITHER_METHOD_TRIANGULAR);
+	}
+#endif
+#if defined (HAVE_SSSE3)
+	if (cpu_flags & SPA_CPU_FLAG_SSSE3) {
+		run_testd("test_f32d_s24_noise", "ssse3", false, true, conv_f32d_to_s24_noise_ssse3,
+				DITHER_METHOD_TRIANGULAR);
+	}
+#endif
+#if defined (HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_testd("test_f32d_u8_noise", "avx2", false, true, conv_f32d_to_u8_noise_avx2,
+				DITHER_METHOD_TRIANGULAR);
+		run_testd("test_f32d_s16_noise", "avx2", false, true, conv_f32d_to_s16_noise_avx2,
+				DITHER_METHOD_TRIANGULAR);
+		run_testd("test_f32d_s16d_noise", "avx2", false, false, conv_f32d_to_s16d_noise_avx2,
+				DITHER_METHOD_TRIANGULAR);
+		run_testd("test_f32d_s16s_noise", "avx2", false, true, conv_f32d_to_s16s_noise_avx2,
+				DITHER_METHOD_TRIANGULAR);
+		run_testd("test_f32d_s24_noise", "avx2", false, true, conv_f32d_to_s24_noise_avx2,
+				DITHER_METHOD_TRIANGULAR);
+		run_testd("test_f32d_s24_32_noise", "avx2", false, true, conv_f32d_to_s24_32_noise_avx2,
+				DITHER_METHOD_TRIANGULAR);
+		run_testd("test_f32d_s32_noise", "avx2", false, true, conv_f32d_to_s32_noise_avx2,
+				DITHER_METHOD_TRIANGULAR);
+	}
+#endif
+}
+
+static void test_f32_shaped(void)
+{
+	run_testd("test_f32d_u8_shaped", "c", false, true, conv_f32d_to_u8_shaped_c,
+			DITHER_METHOD_LIPSHITZ);
+	run_testd("test_f32d_s16_shaped", "c", false, true, conv_f32d_to_s16_shaped_c,
+			DITHER_METHOD_LIPSHITZ);
+	run_testd("test_f32d_s16d_shaped", "c", false, false, conv_f32d_to_s16d_shaped_c,
+			DITHER_METHOD_LIPSHITZ);
+	run_testd("test_f32d_s16s_shaped", "c", false, true, conv_f32d_to_s16s_shaped_c,
+			DITHER_METHOD_LIPSHITZ);
+#if defined (HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_testd("test_f32d_u8_shaped", "avx2", false, true, conv_f32d_to_u8_shaped_avx2,
+				DITHER_METHOD_LIPSHITZ);
+		run_testd("test_f32d_s16_shaped", "avx2", false, true, conv_f32d_to_s16_shaped_avx2,
+				DITHER_METHOD_LIPSHITZ);
+		run_testd("test_f32d_s16d_shaped", "avx2", false, false, conv_f32d_to_s16d_shaped_avx2,
+				DITHER_METHOD_LIPSHITZ);
+		run_testd("test_f32d_s16s_shaped", "avx2", false, true, conv_f32d_to_s16s_shaped_avx2,
+				DITHER_METHOD_LIPSHITZ);
+	}
+#endif
+}
+
 static void test_interleave(void)
 {
 	run_test("test_8d_to_8", "c", false, true, conv_8d_to_8_c);
@@ -311,6 +455,10 @@ int main(int argc, char *argv[])
 	test_s24_f32();
 	test_f32_s24_32();
 	test_s24_32_f32();
+	test_f32_law();
+	test_law_f32();
+	test_f32_noise();
+	test_f32_shaped();
 	test_interleave();
 	test_deinterleave();
 
@@ -1368,3 +1368,406 @@ conv_f32d_to_s16s_2_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const
 	}
 }
 
+
+#define _MM256_TRANSPOSE8_PS(r)						\
+({									\
+	__m256 _t[8], _u[8];						\
+	_t[0] = _mm256_unpacklo_ps(r[0], r[1]);				\
+	_t[1] = _mm256_unpackhi_ps(r[0], r[1]);				\
+	_t[2] = _mm256_unpacklo_ps(r[2], r[3]);				\
+	_t[3] = _mm256_unpackhi_ps(r[2], r[3]);				\
+	_t[4] = _mm256_unpacklo_ps(r[4], r[5]);				\
+	_t[5] = _mm256_unpackhi_ps(r[4], r[5]);				\
+	_t[6] = _mm256_unpacklo_ps(r[6], r[7]);				\
+	_t[7] = _mm256_unpackhi_ps(r[6], r[7]);				\
+	_u[0] = _mm256_shuffle_ps(_t[0], _t[2], _MM_SHUFFLE(1,0,1,0));	\
+	_u[1] = _mm256_shuffle_ps(_t[0], _t[2], _MM_SHUFFLE(3,2,3,2));	\
+	_u[2] = _mm256_shuffle_ps(_t[1], _t[3], _MM_SHUFFLE(1,0,1,0));	\
+	_u[3] = _mm256_shuffle_ps(_t[1], _t[3], _MM_SHUFFLE(3,2,3,2));	\
+	_u[4] = _mm256_shuffle_ps(_t[4], _t[6], _MM_SHUFFLE(1,0,1,0));	\
+	_u[5] = _mm256_shuffle_ps(_t[4], _t[6], _MM_SHUFFLE(3,2,3,2));	\
+	_u[6] = _mm256_shuffle_ps(_t[5], _t[7], _MM_SHUFFLE(1,0,1,0));	\
+	_u[7] = _mm256_shuffle_ps(_t[5], _t[7], _MM_SHUFFLE(3,2,3,2));	\
+	r[0] = _mm256_permute2f128_ps(_u[0], _u[4], 0x20);		\
+	r[1] = _mm256_permute2f128_ps(_u[1], _u[5], 0x20);		\
+	r[2] = _mm256_permute2f128_ps(_u[2], _u[6], 0x20);		\
+	r[3] = _mm256_permute2f128_ps(_u[3], _u[7], 0x20);		\
+	r[4] = _mm256_permute2f128_ps(_u[0], _u[4], 0x31);		\
+	r[5] = _mm256_permute2f128_ps(_u[1], _u[5], 0x31);		\
+	r[6] = _mm256_permute2f128_ps(_u[2], _u[6], 0x31);		\
+	r[7] = _mm256_permute2f128_ps(_u[3], _u[7], 0x31);		\
+})
+
+/* The packers take 8 int32 samples and return them converted to the
+ * destination format, packed in the first 8 * sizeof(dtype) bytes. */
+#define _MM256_PACK_32(v)	(v)
+
+#define _MM256_PACK_32S(v)						\
+	_mm256_shuffle_epi8(v, _mm256_setr_epi8(			\
+		 3,  2,  1,  0,  7,  6,  5,  4,			\
+		11, 10,  9,  8, 15, 14, 13, 12,			\
+		 3,  2,  1,  0,  7,  6,  5,  4,			\
+		11, 10,  9,  8, 15, 14, 13, 12))
+
+#define _MM256_PACK_24(v)						\
+	_mm256_permutevar8x32_epi32(					\
+		_mm256_shuffle_epi8(v, _mm256_setr_epi8(		\
+			 0,  1,  2,  4,  5,  6,  8,  9,		\
+			10, 12, 13, 14, -1, -1, -1, -1,		\
+			 0,  1,  2,  4,  5,  6,  8,  9,		\
+			10, 12, 13, 14, -1, -1, -1, -1)),	\
+		_mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7))
+
+#define _MM256_PACK_24S(v)						\
+	_mm256_permutevar8x32_epi32(					\
+		_mm256_shuffle_epi8(v, _mm256_setr_epi8(		\
+			 2,  1,  0,  6,  5,  4, 10,  9,		\
+			 8, 14, 13, 12, -1, -1, -1, -1,		\
+			 2,  1,  0,  6,  5,  4, 10,  9,		\
+			 8, 14, 13, 12, -1, -1, -1, -1)),	\
+		_mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7))
+
+#define _MM256_PACK_16(v)						\
+({									\
+	__m256i _v = v;							\
+	_mm256_permute4x64_epi64(_mm256_packs_epi32(_v, _v),		\
+			_MM_SHUFFLE(0, 0, 2, 0));			\
+})
+
+#define _MM256_PACK_16S(v)						\
+({									\
+	__m256i _p = _MM256_PACK_16(v);					\
+	_MM256_BSWAP_EPI16(_p);						\
+})
+
+#define _MM256_PACK_S8(v)						\
+({									\
+	__m256i _p = _MM256_PACK_16(v);					\
+	_mm256_packs_epi16(_p, _p);					\
+})
+
+#define _MM256_PACK_U8(v)						\
+({									\
+	__m256i _p = _MM256_PACK_16(v);					\
+	_mm256_packus_epi16(_p, _p);					\
+})
+
+struct dither_avx2 {
+	__m256 scale, offs, min, max;
+	/* error history of the shaper, all lanes */
+	__m256 e[NS_MAX * 2];
+	__m256 ns[NS_MAX];
+	uint32_t idx, n_ns;
+};
+
+static inline void
+dither_init_avx2(struct dither_avx2 *dt, float scale, float offs, float min, float max)
+{
+	dt->scale = _mm256_set1_ps(scale);
+	dt->offs = _mm256_set1_ps(offs);
+	dt->min = _mm256_set1_ps(min);
+	dt->max = _mm256_set1_ps(max);
+	dt->idx = dt->n_ns = 0;
+}
+
+static inline void
+shaper_load_avx2(struct dither_avx2 *dt, struct convert *conv, struct shaper *sh,
+		uint32_t n_lanes)
+{
+	uint32_t n, c;
+	float e[8];
+
+	dt->n_ns = conv->n_ns;
+	dt->idx = 0;
+	for (n = 0; n < dt->n_ns; n++) {
+		dt->ns[n] = _mm256_set1_ps(conv->ns[n]);
+		for (c = 0; c < 8; c++)
+			e[c] = c < n_lanes ? sh[c].e[sh[c].idx + n] : 0.0f;
+		dt->e[n] = dt->e[n + NS_MAX] = _mm256_loadu_ps(e);
+	}
+}
+
+static inline void
+shaper_save_avx2(struct dither_avx2 *dt, struct shaper *sh, uint32_t n_lanes)
+{
+	uint32_t n, c;
+	float e[8];
+
+	for (n = 0; n < dt->n_ns; n++) {
+		_mm256_storeu_ps(e, dt->e[dt->idx + n]);
+		for (c = 0; c < n_lanes; c++)
+			sh[c].e[n] = sh[c].e[n + NS_MAX] = e[c];
+	}
+	for (c = 0; c < n_lanes; c++)
+		sh[c].idx = 0;
+}
+
+/* One frame of up to 8 channels. The error of the previous frame is the
+ * only term of the filter that depends on the previous frame, it is added
+ * last to keep the other terms out of the recursion. */
+static inline __m256i
+dither_frame_avx2(struct dither_avx2 *dt, __m256 in, float noise, const bool shaped)
+{
+	__m256 v, t;
+	__m256i out;
+	uint32_t n;
+
+	v = _mm256_add_ps(_mm256_mul_ps(in, dt->scale), dt->offs);
+	if (shaped && dt->n_ns > 0) {
+		for (n = 1; n < dt->n_ns; n++)
+			v = _mm256_add_ps(v, _mm256_mul_ps(dt->e[dt->idx + n], dt->ns[n]));
+		v = _mm256_add_ps(v, _mm256_mul_ps(dt->e[dt->idx], dt->ns[0]));
+	}
+	t = _MM256_CLAMP_PS(_mm256_add_ps(v, _mm256_set1_ps(noise)), dt->min, dt->max);
+	out = _mm256_cvtps_epi32(t);
+	if (shaped) {
+		dt->idx = (dt->idx - 1) & NS_MASK;
+		dt->e[dt->idx] = dt->e[dt->idx + NS_MAX] =
+			_mm256_sub_ps(v, _mm256_cvtepi32_ps(out));
+	}
+	return out;
+}
+
+/* Noise dither without shaping has no state from one sample to the next
+ * and is done one channel at a time, 8 samples per vector.
+ *
+ * The error feedback filter of the shaper is a recursion over the samples
+ * of a channel and can't be vectorized in time. The _8s functions do up to
+ * 8 channels in parallel instead, one frame per vector, with the error
+ * history of all channels in one ring of vectors. Blocks of 8 frames are
+ * loaded and stored with a transpose. d[c] points to the first sample of
+ * channel c, frames are stride samples apart. They are also used for
+ * interleaved noise dither where they store whole frames at once. */
+#define MAKE_DITHER_AVX2(dname,dtype,scale,offs,min,max,pack)			\
+static void									\
+conv_f32_to_##dname##_1s_noise_avx2(dtype * SPA_RESTRICT d,			\
+		const float * SPA_RESTRICT s, const float *noise,		\
+		uint32_t stride, uint32_t n_samples)				\
+{										\
+	uint32_t n, l, len;							\
+	__m256 in;								\
+	__m256i out, mask;							\
+	__m256 int_scale = _mm256_set1_ps(scale);				\
+	__m256 int_offs = _mm256_set1_ps(offs);					\
+	__m256 int_min = _mm256_set1_ps(min);					\
+	__m256 int_max = _mm256_set1_ps(max);					\
+	dtype t[8];								\
+										\
+	for(n = 0; n + 8 <= n_samples; n += 8) {				\
+		in = _mm256_mul_ps(_mm256_loadu_ps(&s[n]), int_scale);		\
+		if (offs != 0.0f)						\
+			in = _mm256_add_ps(in, int_offs);			\
+		in = _mm256_add_ps(in, _mm256_loadu_ps(&noise[n]));		\
+		in = _MM256_CLAMP_PS(in, int_min, int_max);		\
+		out = pack(_mm256_cvtps_epi32(in));				\
+		if (stride == 1) {						\
+			memcpy(&d[n], &out, sizeof(t));				\
+		} else {							\
+			memcpy(t, &out, sizeof(t));				\
+			for (l = 0; l < 8; l++)					\
+				d[(n + l) * stride] = t[l];			\
+		}								\
+	}									\
+	if (n < n_samples) {							\
+		len = n_samples - n;						\
+		mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(len),		\
+				_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));	\
+		in = _mm256_mul_ps(_mm256_maskload_ps(&s[n], mask), int_scale);	\
+		if (offs != 0.0f)						\
+			in = _mm256_add_ps(in, int_offs);			\
+		in = _mm256_add_ps(in, _mm256_maskload_ps(&noise[n], mask));	\
+		in = _MM256_CLAMP_PS(in, int_min, int_max);		\
+		out = pack(_mm256_cvtps_epi32(in));				\
+		memcpy(t, &out, sizeof(t));					\
+		for (l = 0; l < len; l++)					\
+			d[(n + l) * stride] = t[l];				\
+	}									\
+}										\
+										\
+static inline void								\
+conv_f32d_to_##dname##_8s_avx2(struct convert *conv, dtype **d,			\
+		const float **s, struct shaper *sh, uint32_t n_lanes,		\
+		uint32_t stride, const bool planar, const bool shaped,		\
+		uint32_t n_samples)						\
+{										\
+	struct dither_avx2 dt;							\
+	const float *noise = conv->noise;					\
+	uint32_t j, k, f, c, chunk, noise_size = conv->noise_size;		\
+	__m256 in[8];								\
+	__m256i out[8], p;							\
+	dtype t[8];								\
+										\
+	dither_init_avx2(&dt, scale, offs, min, max);				\
+	if (shaped)								\
+		shaper_load_avx2(&dt, conv, sh, n_lanes);			\
+										\
+	for (j = 0; j < n_samples; j += chunk) {				\
+		chunk = SPA_MIN(n_samples - j, noise_size);			\
+		for (k = 0; k + 8 <= chunk; k += 8) {				\
+			for (c = 0; c < 8; c++)					\
+				in[c] = c < n_lanes ?				\
+					_mm256_loadu_ps(&s[c][j + k]) :		\
+					_mm256_setzero_ps();			\
+			_MM256_TRANSPOSE8_PS(in);				\
+			for (f = 0; f < 8; f++)					\
+				out[f] = dither_frame_avx2(&dt, in[f],		\
+						noise[k + f], shaped);		\
+			if (planar) {						\
+				for (f = 0; f < 8; f++)				\
+					in[f] = _mm256_castsi256_ps(out[f]);	\
+				_MM256_TRANSPOSE8_PS(in);			\
+				for (c = 0; c < n_lanes; c++) {			\
+					p = pack(_mm256_castps_si256(in[c]));	\
+					memcpy(&d[c][j + k], &p, sizeof(t));	\
+				}						\
+			} else if (n_lanes == 8) {				\
+				for (f = 0; f < 8; f++) {			\
+					p = pack(out[f]);			\
+					memcpy(&d[0][(j + k + f) * stride], &p, sizeof(t)); \
+				}						\
+			} else {						\
+				for (f = 0; f < 8; f++) {			\
+					p = pack(out[f]);			\
+					memcpy(t, &p, sizeof(t));		\
+					for (c = 0; c < n_lanes; c++)		\
+						d[c][(j + k + f) * stride] = t[c];	\
+				}						\
+			}							\
+		}								\
+		for (; k < chunk; k++) {					\
+			float v[8] = { 0.0f, };					\
+			for (c = 0; c < n_lanes; c++)				\
+				v[c] = s[c][j + k];				\
+			out[0] = dither_frame_avx2(&dt, _mm256_loadu_ps(v),	\
+					noise[k], shaped);			\
+			p = pack(out[0]);					\
+			memcpy(t, &p, sizeof(t));				\
+			for (c = 0; c < n_lanes; c++)				\
+				d[c][(j + k) * stride] = t[c];			\
+		}								\
+	}									\
+	if (shaped)								\
+		shaper_save_avx2(&dt, sh, n_lanes);				\
+}
+
+#define MAKE_D_NOISE_AVX2(dname,dtype)						\
+void										\
+conv_f32d_to_##dname##d_noise_avx2(struct convert *conv, void * SPA_RESTRICT dst[], \
+		const void * SPA_RESTRICT src[], uint32_t n_samples)		\
+{										\
+	uint32_t i, k, chunk, n_channels = conv->n_channels;			\
+	float *noise = conv->noise;						\
+										\
+	convert_update_noise(conv, noise, SPA_MIN(n_samples, conv->noise_size));	\
+										\
+	for(i = 0; i < n_channels; i++) {					\
+		const float *s = src[i];					\
+		dtype *d = dst[i];						\
+		for(k = 0; k < n_samples; k += chunk) {				\
+			chunk = SPA_MIN(n_samples - k, conv->noise_size);	\
+			conv_f32_to_##dname##_1s_noise_avx2(&d[k], &s[k],	\
+					noise, 1, chunk);			\
+		}								\
+	}									\
+}
+
+#define MAKE_I_NOISE_AVX2(dname,dtype)						\
+void										\
+conv_f32d_to_##dname##_noise_avx2(struct convert *conv, void * SPA_RESTRICT dst[], \
+		const void * SPA_RESTRICT src[], uint32_t n_samples)		\
+{										\
+	const float **s = (const float **) src;					\
+	dtype *d0 = dst[0], *d[8];						\
+	uint32_t i, c, k, chunk, n_channels = conv->n_channels;			\
+	float *noise = conv->noise;						\
+										\
+	convert_update_noise(conv, noise, SPA_MIN(n_samples, conv->noise_size));	\
+										\
+	for(i = 0; i + 8 <= n_channels; i += 8) {				\
+		for (c = 0; c < 8; c++)						\
+			d[c] = &d0[i + c];					\
+		conv_f32d_to_##dname##_8s_avx2(conv, d, &s[i], NULL, 8,		\
+				n_channels, false, false, n_samples);		\
+	}									\
+	for(; i < n_channels; i++) {						\
+		for(k = 0; k < n_samples; k += chunk) {				\
+			chunk = SPA_MIN(n_samples - k, conv->noise_size);	\
+			conv_f32_to_##dname##_1s_noise_avx2(&d0[i + k*n_channels],	\
+					&s[i][k], noise, n_channels, chunk);	\
+		}								\
+	}									\
+}
+
+#define MAKE_D_SHAPED_AVX2(dname,dtype)						\
+void										\
+conv_f32d_to_##dname##d_shaped_avx2(struct convert *conv, void * SPA_RESTRICT dst[], \
+		const void * SPA_RESTRICT src[], uint32_t n_samples)		\
+{										\
+	const float **s = (const float **) src;					\
+	uint32_t i, c, n_lanes, n_channels = conv->n_channels;			\
+	dtype *d[8];								\
+										\
+	convert_update_noise(conv, conv->noise, SPA_MIN(n_samples, conv->noise_size));	\
+										\
+	for (i = 0; i < n_channels; i += 8) {					\
+		n_lanes = SPA_MIN(n_channels - i, 8u);				\
+		for (c = 0; c < n_lanes; c++)					\
+			d[c] = dst[i + c];					\
+		conv_f32d_to_##dname##_8s_avx2(conv, d, &s[i], &conv->shaper[i],	\
+				n_lanes, 1, true, true, n_samples);		\
+	}									\
+}
+
+#define MAKE_I_SHAPED_AVX2(dname,dtype)						\
+void										\
+conv_f32d_to_##dname##_shaped_avx2(struct convert *conv, void * SPA_RESTRICT dst[], \
+		const void * SPA_RESTRICT src[], uint32_t n_samples)		\
+{										\
+	const float **s = (const float **) src;					\
+	dtype *d0 = dst[0], *d[8];						\
+	uint32_t i, c, n_lanes, n_channels = conv->n_channels;			\
+										\
+	convert_update_noise(conv, conv->noise, SPA_MIN(n_samples, conv->noise_size));	\
+										\
+	for (i = 0; i < n_channels; i += 8) {					\
+		n_lanes = SPA_MIN(n_channels - i, 8u);				\
+		for (c = 0; c < n_lanes; c++)					\
+			d[c] = &d0[i + c];					\
+		conv_f32d_to_##dname##_8s_avx2(conv, d, &s[i], &conv->shaper[i],	\
+				n_lanes, n_channels, false, true, n_samples);	\
+	}									\
+}
+
+MAKE_DITHER_AVX2(u8, uint8_t, U8_SCALE, U8_OFFS, U8_MIN, U8_MAX, _MM256_PACK_U8);
+MAKE_D_NOISE_AVX2(u8, uint8_t);
+MAKE_I_NOISE_AVX2(u8, uint8_t);
+MAKE_D_SHAPED_AVX2(u8, uint8_t);
+MAKE_I_SHAPED_AVX2(u8, uint8_t);
+MAKE_DITHER_AVX2(s8, int8_t, S8_SCALE, 0.0f, S8_MIN, S8_MAX, _MM256_PACK_S8);
+MAKE_D_NOISE_AVX2(s8, int8_t);
+MAKE_I_NOISE_AVX2(s8, int8_t);
+MAKE_D_SHAPED_AVX2(s8, int8_t);
+MAKE_I_SHAPED_AVX2(s8, int8_t);
+MAKE_DITHER_AVX2(s16, int16_t, S16_SCALE, 0.0f, S16_MIN, S16_MAX, _MM256_PACK_16);
+MAKE_D_NOISE_AVX2(s16, int16_t);
+MAKE_I_NOISE_AVX2(s16, int16_t);
+MAKE_D_SHAPED_AVX2(s16, int16_t);
+MAKE_I_SHAPED_AVX2(s16, int16_t);
+MAKE_DITHER_AVX2(s16s, uint16_t, S16_SCALE, 0.0f, S16_MIN, S16_MAX, _MM256_PACK_16S);
+MAKE_I_NOISE_AVX2(s16s, uint16_t);
+MAKE_I_SHAPED_AVX2(s16s, uint16_t);
+MAKE_DITHER_AVX2(s32, int32_t, S32_SCALE_F2I, 0.0f, S32_MIN_F2I, S32_MAX_F2I, _MM256_PACK_32);
+MAKE_D_NOISE_AVX2(s32, int32_t);
+MAKE_I_NOISE_AVX2(s32, int32_t);
+MAKE_DITHER_AVX2(s32s, uint32_t, S32_SCALE_F2I, 0.0f, S32_MIN_F2I, S32_MAX_F2I, _MM256_PACK_32S);
+MAKE_I_NOISE_AVX2(s32s, uint32_t);
+MAKE_DITHER_AVX2(s24, int24_t, S24_SCALE, 0.0f, S24_MIN, S24_MAX, _MM256_PACK_24);
+MAKE_D_NOISE_AVX2(s24, int24_t);
+MAKE_I_NOISE_AVX2(s24, int24_t);
+MAKE_DITHER_AVX2(s24s, int24_t, S24_SCALE, 0.0f, S24_MIN, S24_MAX, _MM256_PACK_24S);
+MAKE_I_NOISE_AVX2(s24s, int24_t);
+MAKE_DITHER_AVX2(s24_32, int32_t, S24_SCALE, 0.0f, S24_MIN, S24_MAX, _MM256_PACK_32);
+MAKE_D_NOISE_AVX2(s24_32, int32_t);
+MAKE_I_NOISE_AVX2(s24_32, int32_t);
+MAKE_DITHER_AVX2(s24_32s, int32_t, S24_SCALE, 0.0f, S24_MIN, S24_MAX, _MM256_PACK_32S);
+MAKE_I_NOISE_AVX2(s24_32s, int32_t);
@@ -313,7 +313,7 @@ MAKE_I_noise(s32, int32_t, F32_TO_S32_D);
 MAKE_I_noise(s32s, uint32_t, F32_TO_S32S_D);
 MAKE_D_noise(s24, int24_t, F32_TO_S24_D);
 MAKE_I_noise(s24, int24_t, F32_TO_S24_D);
-MAKE_I_noise(s24s, int24_t, F32_TO_S24_D);
+MAKE_I_noise(s24s, int24_t, F32_TO_S24S_D);
 MAKE_D_noise(s24_32, int32_t, F32_TO_S24_32_D);
 MAKE_I_noise(s24_32, int32_t, F32_TO_S24_32_D);
 MAKE_I_noise(s24_32s, int32_t, F32_TO_S24_32S_D);
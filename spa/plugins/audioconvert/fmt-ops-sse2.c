@@ -1716,3 +1716,284 @@ conv_f32d_to_s16s_2_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const
 		d += 2;
 	}
 }
+
+/* G.711 without the tables of law.h. The segment of a code is the exponent
+ * and the 4 bit mantissa the bits below the leading one, so they can be moved
+ * in and out of the exponent and mantissa of a float. The results are the
+ * same as the tables. */
+static inline __m128
+ulaw_to_f32_sse2(__m128i code)
+{
+	__m128i u, seg, sign, mag;
+	__m128 val, exp;
+
+	u = _mm_andnot_si128(code, _mm_set1_epi32(0xff));
+	seg = _mm_and_si128(_mm_srli_epi32(u, 4), _mm_set1_epi32(0x07));
+	sign = _mm_cmpgt_epi32(u, _mm_set1_epi32(0x7f));
+
+	/* ((mant << 3) + 0x84) << seg, minus the bias again */
+	mag = _mm_slli_epi32(_mm_and_si128(u, _mm_set1_epi32(0x0f)), 3);
+	mag = _mm_add_epi32(mag, _mm_set1_epi32(0x84));
+	exp = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(seg, _mm_set1_epi32(127)), 23));
+	val = _mm_mul_ps(_mm_cvtepi32_ps(mag), exp);
+	mag = _mm_sub_epi32(_mm_cvttps_epi32(val), _mm_set1_epi32(0x84));
+
+	mag = _mm_sub_epi32(_mm_xor_si128(mag, sign), sign);
+	return _mm_mul_ps(_mm_cvtepi32_ps(mag), _mm_set1_ps(1.0f / S16_SCALE));
+}
+
+static inline __m128
+alaw_to_f32_sse2(__m128i code)
+{
+	__m128i a, seg, segnz, sign, mag;
+	__m128 val, exp;
+
+	a = _mm_xor_si128(code, _mm_set1_epi32(0x55));
+	seg = _mm_and_si128(_mm_srli_epi32(a, 4), _mm_set1_epi32(0x07));
+	segnz = _mm_cmpgt_epi32(seg, _mm_setzero_si128());
+	sign = _mm_cmpeq_epi32(_mm_and_si128(a, _mm_set1_epi32(0x80)), _mm_setzero_si128());
+
+	/* segment 0 is linear, the others are ((mant << 4) + 0x108) << (seg - 1) */
+	mag = _mm_slli_epi32(_mm_and_si128(a, _mm_set1_epi32(0x0f)), 4);
+	mag = _mm_add_epi32(mag, _mm_set1_epi32(0x08));
+	mag = _mm_add_epi32(mag, _mm_and_si128(segnz, _mm_set1_epi32(0x100)));
+	seg = _mm_add_epi32(seg, segnz);
+	exp = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(seg, _mm_set1_epi32(127)), 23));
+	val = _mm_mul_ps(_mm_cvtepi32_ps(mag), exp);
+	mag = _mm_cvttps_epi32(val);
+
+	mag = _mm_sub_epi32(_mm_xor_si128(mag, sign), sign);
+	return _mm_mul_ps(_mm_cvtepi32_ps(mag), _mm_set1_ps(1.0f / S16_SCALE));
+}
+
+static inline __m128i
+f32_to_s16_sse2(__m128 in)
+{
+	in = _mm_mul_ps(in, _mm_set1_ps(S16_SCALE));
+	in = _MM_CLAMP_PS(in, _mm_set1_ps(S16_MIN), _mm_set1_ps(S16_MAX));
+	return _mm_cvtps_epi32(in);
+}
+
+static inline __m128i
+f32_to_ulaw_sse2(__m128 in)
+{
+	__m128i v, sign, mask, code;
+
+	/* 14 bits magnitude, clipped and biased */
+	v = _mm_srai_epi32(f32_to_s16_sse2(in), 2);
+	sign = _mm_srai_epi32(v, 31);
+	v = _mm_sub_epi32(_mm_xor_si128(v, sign), sign);
+	v = _mm_min_epi16(v, _mm_set1_epi32(8158));
+	v = _mm_add_epi32(v, _mm_set1_epi32(33));
+	mask = _mm_xor_si128(_mm_set1_epi32(0xff), _mm_and_si128(sign, _mm_set1_epi32(0x80)));
+
+	/* exponent - 5 is the segment, the next 4 bits the mantissa */
+	code = _mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(v)), 19);
+	code = _mm_sub_epi32(code, _mm_set1_epi32((127 + 5) << 4));
+	return _mm_xor_si128(code, mask);
+}
+
+static inline __m128i
+f32_to_alaw_sse2(__m128 in)
+{
+	__m128i v, sign, mask, lin, code;
+
+	/* 13 bits, the negative values are one's complement */
+	v = _mm_srai_epi32(f32_to_s16_sse2(in), 3);
+	sign = _mm_srai_epi32(v, 31);
+	v = _mm_xor_si128(v, sign);
+	mask = _mm_xor_si128(_mm_set1_epi32(0xd5), _mm_and_si128(sign, _mm_set1_epi32(0x80)));
+
+	/* the first two segments are linear, above that exponent - 4 is
+	 * the segment and the next 4 bits the mantissa */
+	lin = _mm_cmplt_epi32(v, _mm_set1_epi32(64));
+	code = _mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(v)), 19);
+	code = _mm_sub_epi32(code, _mm_set1_epi32((127 + 4) << 4));
+	code = _mm_or_si128(_mm_and_si128(lin, _mm_srli_epi32(v, 1)),
+			_mm_andnot_si128(lin, code));
+	return _mm_xor_si128(code, mask);
+}
+
+#define MAKE_LAW_TO_F32D(law)								\
+static void										\
+conv_##law##_to_f32d_1s_sse2(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,	\
+		uint32_t n_channels, uint32_t n_samples)				\
+{											\
+	const uint8_t *s = src;								\
+	float *d0 = dst[0];								\
+	uint32_t n, unrolled;								\
+	__m128i in;									\
+											\
+	if (SPA_IS_ALIGNED(d0, 16))							\
+		unrolled = n_samples & ~3;						\
+	else										\
+		unrolled = 0;								\
+											\
+	for(n = 0; n < unrolled; n += 4) {						\
+		in = _mm_setr_epi32(s[0*n_channels], s[1*n_channels],			\
+				s[2*n_channels], s[3*n_channels]);			\
+		_mm_store_ps(&d0[n], law##_to_f32_sse2(in));				\
+		s += 4*n_channels;							\
+	}										\
+	for(; n < n_samples; n++) {							\
+		_mm_store_ss(&d0[n], law##_to_f32_sse2(_mm_cvtsi32_si128(*s)));		\
+		s += n_channels;							\
+	}										\
+}											\
+											\
+static void										\
+conv_##law##_to_f32d_4s_sse2(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,	\
+		uint32_t n_channels, uint32_t n_samples)				\
+{											\
+	const uint8_t *s = src;								\
+	float *d0 = dst[0], *d1 = dst[1], *d2 = dst[2], *d3 = dst[3];			\
+	uint32_t n, unrolled;								\
+	__m128i in, t[2], zero = _mm_setzero_si128();					\
+	__m128 out[4];									\
+											\
+	if (SPA_IS_ALIGNED(d0, 16) &&							\
+	    SPA_IS_ALIGNED(d1, 16) &&							\
+	    SPA_IS_ALIGNED(d2, 16) &&							\
+	    SPA_IS_ALIGNED(d3, 16))							\
+		unrolled = n_samples & ~3;						\
+	else										\
+		unrolled = 0;								\
+											\
+	for(n = 0; n < unrolled; n += 4) {						\
+		/* 4 channels of 4 frames, one frame per vector */			\
+		in = _mm_setr_epi32(							\
+			spa_read_unaligned(&s[0*n_channels], uint32_t),			\
+			spa_read_unaligned(&s[1*n_channels], uint32_t),			\
+			spa_read_unaligned(&s[2*n_channels], uint32_t),			\
+			spa_read_unaligned(&s[3*n_channels], uint32_t));		\
+		t[0] = _mm_unpacklo_epi8(in, zero);					\
+		t[1] = _mm_unpackhi_epi8(in, zero);					\
+		out[0] = law##_to_f32_sse2(_mm_unpacklo_epi16(t[0], zero));		\
+		out[1] = law##_to_f32_sse2(_mm_unpackhi_epi16(t[0], zero));		\
+		out[2] = law##_to_f32_sse2(_mm_unpacklo_epi16(t[1], zero));		\
+		out[3] = law##_to_f32_sse2(_mm_unpackhi_epi16(t[1], zero));		\
+											\
+		_MM_TRANSPOSE4_PS(out[0], out[1], out[2], out[3]);			\
+											\
+		_mm_store_ps(&d0[n], out[0]);						\
+		_mm_store_ps(&d1[n], out[1]);						\
+		_mm_store_ps(&d2[n], out[2]);						\
+		_mm_store_ps(&d3[n], out[3]);						\
+		s += 4*n_channels;							\
+	}										\
+	for(; n < n_samples; n++) {							\
+		in = _mm_setr_epi32(s[0], s[1], s[2], s[3]);				\
+		_MM_STOREM_PS(&d0[n], &d1[n], &d2[n], &d3[n], law##_to_f32_sse2(in));	\
+		s += n_channels;							\
+	}										\
+}											\
+											\
+void											\
+conv_##law##_to_f32d_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],	\
+		uint32_t n_samples)							\
+{											\
+	const uint8_t *s = src[0];							\
+	uint32_t i = 0, n_channels = conv->n_channels;					\
+											\
+	for(; i + 3 < n_channels; i += 4)						\
+		conv_##law##_to_f32d_4s_sse2(conv, &dst[i], &s[i], n_channels, n_samples);	\
+	for(; i < n_channels; i++)							\
+		conv_##law##_to_f32d_1s_sse2(conv, &dst[i], &s[i], n_channels, n_samples);	\
+}
+
+MAKE_LAW_TO_F32D(alaw);
+MAKE_LAW_TO_F32D(ulaw);
+
+#define MAKE_F32D_TO_LAW(law)								\
+static void										\
+conv_f32d_to_##law##_1s_sse2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],	\
+		uint32_t n_channels, uint32_t n_samples)				\
+{											\
+	const float *s0 = src[0];							\
+	uint8_t *d = dst;								\
+	uint32_t n, unrolled, out;							\
+	__m128i code;									\
+											\
+	if (SPA_IS_ALIGNED(s0, 16))							\
+		unrolled = n_samples & ~3;						\
+	else										\
+		unrolled = 0;								\
+											\
+	for(n = 0; n < unrolled; n += 4) {						\
+		code = f32_to_##law##_sse2(_mm_load_ps(&s0[n]));			\
+		code = _mm_packs_epi32(code, code);					\
+		out = _mm_cvtsi128_si32(_mm_packus_epi16(code, code));			\
+		d[0*n_channels] = out;							\
+		d[1*n_channels] = out >> 8;						\
+		d[2*n_channels] = out >> 16;						\
+		d[3*n_channels] = out >> 24;						\
+		d += 4*n_channels;							\
+	}										\
+	for(; n < n_samples; n++) {							\
+		*d = _mm_cvtsi128_si32(f32_to_##law##_sse2(_mm_load_ss(&s0[n])));	\
+		d += n_channels;							\
+	}										\
+}											\
+											\
+static void										\
+conv_f32d_to_##law##_4s_sse2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],	\
+		uint32_t n_channels, uint32_t n_samples)				\
+{											\
+	const float *s0 = src[0], *s1 = src[1], *s2 = src[2], *s3 = src[3];		\
+	uint8_t *d = dst;								\
+	uint32_t n, unrolled;								\
+	__m128i code[4];								\
+	__m128 in[4];									\
+											\
+	if (SPA_IS_ALIGNED(s0, 16) &&							\
+	    SPA_IS_ALIGNED(s1, 16) &&							\
+	    SPA_IS_ALIGNED(s2, 16) &&							\
+	    SPA_IS_ALIGNED(s3, 16))							\
+		unrolled = n_samples & ~3;						\
+	else										\
+		unrolled = 0;								\
+											\
+	for(n = 0; n < unrolled; n += 4) {						\
+		code[0] = f32_to_##law##_sse2(_mm_load_ps(&s0[n]));			\
+		code[1] = f32_to_##law##_sse2(_mm_load_ps(&s1[n]));			\
+		code[2] = f32_to_##law##_sse2(_mm_load_ps(&s2[n]));			\
+		code[3] = f32_to_##law##_sse2(_mm_load_ps(&s3[n]));			\
+											\
+		/* bytes of channel 0, 2, 1, 3, then transpose to frames */		\
+		code[0] = _mm_packs_epi32(code[0], code[2]);				\
+		code[1] = _mm_packs_epi32(code[1], code[3]);				\
+		code[0] = _mm_packus_epi16(code[0], code[1]);				\
+		code[0] = _mm_unpacklo_epi8(code[0], _mm_srli_si128(code[0], 8));	\
+		code[0] = _mm_unpacklo_epi16(code[0], _mm_srli_si128(code[0], 8));	\
+											\
+		_MM_STOREUM_EPI32(&d[0*n_channels],					\
+				&d[1*n_channels],					\
+				&d[2*n_channels],					\
+				&d[3*n_channels], code[0]);				\
+		d += 4*n_channels;							\
+	}										\
+	for(; n < n_samples; n++) {							\
+		in[0] = _mm_setr_ps(s0[n], s1[n], s2[n], s3[n]);			\
+		code[0] = f32_to_##law##_sse2(in[0]);					\
+		code[0] = _mm_packs_epi32(code[0], code[0]);				\
+		code[0] = _mm_packus_epi16(code[0], code[0]);				\
+		spa_write_unaligned(d, uint32_t, _mm_cvtsi128_si32(code[0]));		\
+		d += n_channels;							\
+	}										\
+}											\
+											\
+void											\
+conv_f32d_to_##law##_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],	\
+		uint32_t n_samples)							\
+{											\
+	uint8_t *d = dst[0];								\
+	uint32_t i = 0, n_channels = conv->n_channels;					\
+											\
+	for(; i + 3 < n_channels; i += 4)						\
+		conv_f32d_to_##law##_4s_sse2(conv, &d[i], &src[i], n_channels, n_samples);	\
+	for(; i < n_channels; i++)							\
+		conv_f32d_to_##law##_1s_sse2(conv, &d[i], &src[i], n_channels, n_samples);	\
+}
+
+MAKE_F32D_TO_LAW(alaw);
+MAKE_F32D_TO_LAW(ulaw);
@@ -6,6 +6,25 @@
 
 #include <tmmintrin.h>
 
+#define _MM_CLAMP_PS(r,min,max)				\
+	_mm_min_ps(_mm_max_ps(r, min), max)
+
+#define _MM_CLAMP_SS(r,min,max)				\
+	_mm_min_ss(_mm_max_ss(r, min), max)
+
+#define spa_read_unaligned(ptr, type) \
+__extension__ ({ \
+	__typeof__(type) _val; \
+	memcpy(&_val, (ptr), sizeof(_val)); \
+	_val; \
+})
+
+#define spa_write_unaligned(ptr, type, val) \
+__extension__ ({ \
+	__typeof__(type) _val = (val); \
+	memcpy((ptr), &_val, sizeof(_val)); \
+})
+
 // Non static, referenced by `fmt-ops-sse41.c`.
 void
 conv_s24_to_f32d_4s_ssse3(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
@@ -17,21 +36,26 @@ conv_s24_to_f32d_4s_ssse3(void *data, void * SPA_RESTRICT dst[], const void * SP
 	__m128i in[4];
 	__m128 out[4], factor = _mm_set1_ps(1.0f / S24_SCALE);
 	const __m128i mask = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
-	//const __m128i mask = _mm_set_epi8(15, 14, 13, -1, 12, 11, 10, -1, 9, 8, 7, -1, 6, 5, 4, -1);
 
+	/* the 16 byte loads read 4 bytes past the last frame, leave
+	 * that one to the scalar loop */
 	if (SPA_IS_ALIGNED(d0, 16) &&
 	    SPA_IS_ALIGNED(d1, 16) &&
 	    SPA_IS_ALIGNED(d2, 16) &&
-	    SPA_IS_ALIGNED(d3, 16))
+	    SPA_IS_ALIGNED(d3, 16) &&
+	    n_samples > 0) {
 		unrolled = n_samples & ~3;
+		if ((n_samples & 3) == 0)
+			unrolled -= 4;
+	}
 	else
 		unrolled = 0;
 
 	for(n = 0; n < unrolled; n += 4) {
-                in[0] = _mm_loadu_si128((__m128i*)(s + 0*n_channels));
-                in[1] = _mm_loadu_si128((__m128i*)(s + 1*n_channels));
-                in[2] = _mm_loadu_si128((__m128i*)(s + 2*n_channels));
-                in[3] = _mm_loadu_si128((__m128i*)(s + 3*n_channels));
+		in[0] = _mm_loadu_si128((__m128i*)(s + 0*n_channels));
+		in[1] = _mm_loadu_si128((__m128i*)(s + 1*n_channels));
+		in[2] = _mm_loadu_si128((__m128i*)(s + 2*n_channels));
+		in[3] = _mm_loadu_si128((__m128i*)(s + 3*n_channels));
 		in[0] = _mm_shuffle_epi8(in[0], mask);
 		in[1] = _mm_shuffle_epi8(in[1], mask);
 		in[2] = _mm_shuffle_epi8(in[2], mask);
@@ -90,3 +114,305 @@ conv_s24_to_f32d_ssse3(struct convert *conv, void * SPA_RESTRICT dst[], const vo
 	for(; i < n_channels; i++)
 		conv_s24_to_f32d_1s_sse2(conv, &dst[i], &s[3*i], n_channels, n_samples);
 }
+
+static void
+conv_s24s_to_f32d_1s_ssse3(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const int24_t *s = src;
+	float *d0 = dst[0];
+	uint32_t n, unrolled;
+	__m128i in;
+	__m128 out, factor = _mm_set1_ps(1.0f / S24_SCALE);
+	const __m128i mask = _mm_setr_epi8(-1, 2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12);
+
+	if (SPA_IS_ALIGNED(d0, 16) && n_samples > 0) {
+		unrolled = n_samples & ~3;
+		if ((n_samples & 3) == 0)
+			unrolled -= 4;
+	}
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 4) {
+		in = _mm_setr_epi32(
+			spa_read_unaligned(&s[0 * n_channels], uint32_t),
+			spa_read_unaligned(&s[1 * n_channels], uint32_t),
+			spa_read_unaligned(&s[2 * n_channels], uint32_t),
+			spa_read_unaligned(&s[3 * n_channels], uint32_t));
+		in = _mm_shuffle_epi8(in, mask);
+		in = _mm_srai_epi32(in, 8);
+		out = _mm_cvtepi32_ps(in);
+		out = _mm_mul_ps(out, factor);
+		_mm_store_ps(&d0[n], out);
+		s += 4 * n_channels;
+	}
+	for(; n < n_samples; n++) {
+		out = _mm_cvtsi32_ss(factor, s24_to_s32(bswap_s24(*s)));
+		out = _mm_mul_ss(out, factor);
+		_mm_store_ss(&d0[n], out);
+		s += n_channels;
+	}
+}
+
+static void
+conv_s24s_to_f32d_4s_ssse3(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const int24_t *s = src;
+	float *d0 = dst[0], *d1 = dst[1], *d2 = dst[2], *d3 = dst[3];
+	uint32_t n, unrolled;
+	__m128i in[4];
+	__m128 out[4], factor = _mm_set1_ps(1.0f / S24_SCALE);
+	const __m128i mask = _mm_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9);
+
+	if (SPA_IS_ALIGNED(d0, 16) &&
+	    SPA_IS_ALIGNED(d1, 16) &&
+	    SPA_IS_ALIGNED(d2, 16) &&
+	    SPA_IS_ALIGNED(d3, 16) &&
+	    n_samples > 0) {
+		unrolled = n_samples & ~3;
+		if ((n_samples & 3) == 0)
+			unrolled -= 4;
+	}
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 4) {
+		in[0] = _mm_loadu_si128((__m128i*)(s + 0*n_channels));
+		in[1] = _mm_loadu_si128((__m128i*)(s + 1*n_channels));
+		in[2] = _mm_loadu_si128((__m128i*)(s + 2*n_channels));
+		in[3] = _mm_loadu_si128((__m128i*)(s + 3*n_channels));
+		in[0] = _mm_shuffle_epi8(in[0], mask);
+		in[1] = _mm_shuffle_epi8(in[1], mask);
+		in[2] = _mm_shuffle_epi8(in[2], mask);
+		in[3] = _mm_shuffle_epi8(in[3], mask);
+		in[0] = _mm_srai_epi32(in[0], 8);
+		in[1] = _mm_srai_epi32(in[1], 8);
+		in[2] = _mm_srai_epi32(in[2], 8);
+		in[3] = _mm_srai_epi32(in[3], 8);
+		out[0] = _mm_cvtepi32_ps(in[0]);
+		out[1] = _mm_cvtepi32_ps(in[1]);
+		out[2] = _mm_cvtepi32_ps(in[2]);
+		out[3] = _mm_cvtepi32_ps(in[3]);
+		out[0] = _mm_mul_ps(out[0], factor);
+		out[1] = _mm_mul_ps(out[1], factor);
+		out[2] = _mm_mul_ps(out[2], factor);
+		out[3] = _mm_mul_ps(out[3], factor);
+
+		_MM_TRANSPOSE4_PS(out[0], out[1], out[2], out[3]);
+
+		_mm_store_ps(&d0[n], out[0]);
+		_mm_store_ps(&d1[n], out[1]);
+		_mm_store_ps(&d2[n], out[2]);
+		_mm_store_ps(&d3[n], out[3]);
+		s += 4 * n_channels;
+	}
+	for(; n < n_samples; n++) {
+		out[0] = _mm_cvtsi32_ss(factor, s24_to_s32(bswap_s24(*s)));
+		out[1] = _mm_cvtsi32_ss(factor, s24_to_s32(bswap_s24(*(s+1))));
+		out[2] = _mm_cvtsi32_ss(factor, s24_to_s32(bswap_s24(*(s+2))));
+		out[3] = _mm_cvtsi32_ss(factor, s24_to_s32(bswap_s24(*(s+3))));
+		out[0] = _mm_mul_ss(out[0], factor);
+		out[1] = _mm_mul_ss(out[1], factor);
+		out[2] = _mm_mul_ss(out[2], factor);
+		out[3] = _mm_mul_ss(out[3], factor);
+		_mm_store_ss(&d0[n], out[0]);
+		_mm_store_ss(&d1[n], out[1]);
+		_mm_store_ss(&d2[n], out[2]);
+		_mm_store_ss(&d3[n], out[3]);
+		s += n_channels;
+	}
+}
+
+void
+conv_s24s_to_f32d_ssse3(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const int8_t *s = src[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i + 3 < n_channels; i += 4)
+		conv_s24s_to_f32d_4s_ssse3(conv, &dst[i], &s[3*i], n_channels, n_samples);
+	for(; i < n_channels; i++)
+		conv_s24s_to_f32d_1s_ssse3(conv, &dst[i], &s[3*i], n_channels, n_samples);
+}
+
+/* 4 samples to 12 bytes of packed 24 bits, in native and swapped order */
+#define S24_PACK_MASK	_mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1)
+#define S24S_PACK_MASK	_mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+
+/* store the 12 bytes without touching the next frame */
+#define _MM_STORE_S24(d,v)						\
+({									\
+	_mm_storel_epi64((__m128i*)(d), v);				\
+	spa_write_unaligned((uint8_t*)(d) + 8, uint32_t,		\
+			_mm_cvtsi128_si32(_mm_srli_si128(v, 8)));	\
+})
+
+/* The noise is the same for all channels, the functions are inlined with
+ * a NULL noise for the plain conversion. */
+static inline void
+conv_f32d_to_s24_1s_ssse3(int24_t * SPA_RESTRICT d, const float * SPA_RESTRICT s,
+		const float *noise, uint32_t n_channels, uint32_t n_samples, bool swap)
+{
+	uint32_t n, unrolled;
+	__m128 in;
+	__m128i out;
+	__m128 scale = _mm_set1_ps(S24_SCALE);
+	__m128 int_min = _mm_set1_ps(S24_MIN);
+	__m128 int_max = _mm_set1_ps(S24_MAX);
+	int32_t v[4];
+
+	if (SPA_IS_ALIGNED(s, 16))
+		unrolled = n_samples & ~3;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 4) {
+		in = _mm_mul_ps(_mm_load_ps(&s[n]), scale);
+		if (noise)
+			in = _mm_add_ps(in, _mm_load_ps(&noise[n]));
+		in = _MM_CLAMP_PS(in, int_min, int_max);
+		out = _mm_cvtps_epi32(in);
+		_mm_storeu_si128((__m128i*)v, out);
+		d[0*n_channels] = swap ? bswap_s24(s32_to_s24(v[0])) : s32_to_s24(v[0]);
+		d[1*n_channels] = swap ? bswap_s24(s32_to_s24(v[1])) : s32_to_s24(v[1]);
+		d[2*n_channels] = swap ? bswap_s24(s32_to_s24(v[2])) : s32_to_s24(v[2]);
+		d[3*n_channels] = swap ? bswap_s24(s32_to_s24(v[3])) : s32_to_s24(v[3]);
+		d += 4*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		in = _mm_mul_ss(_mm_load_ss(&s[n]), scale);
+		if (noise)
+			in = _mm_add_ss(in, _mm_load_ss(&noise[n]));
+		in = _MM_CLAMP_SS(in, int_min, int_max);
+		v[0] = _mm_cvtss_si32(in);
+		*d = swap ? bswap_s24(s32_to_s24(v[0])) : s32_to_s24(v[0]);
+		d += n_channels;
+	}
+}
+
+static inline void
+conv_f32d_to_s24_4s_ssse3(int24_t * SPA_RESTRICT d, const float * SPA_RESTRICT s0,
+		const float * SPA_RESTRICT s1, const float * SPA_RESTRICT s2,
+		const float * SPA_RESTRICT s3, const float *noise,
+		uint32_t n_channels, uint32_t n_samples, bool swap)
+{
+	uint32_t n, unrolled;
+	__m128 in[4], nz;
+	__m128i out[4];
+	__m128 scale = _mm_set1_ps(S24_SCALE);
+	__m128 int_min = _mm_set1_ps(S24_MIN);
+	__m128 int_max = _mm_set1_ps(S24_MAX);
+	const __m128i mask = swap ? S24S_PACK_MASK : S24_PACK_MASK;
+
+	if (SPA_IS_ALIGNED(s0, 16) &&
+	    SPA_IS_ALIGNED(s1, 16) &&
+	    SPA_IS_ALIGNED(s2, 16) &&
+	    SPA_IS_ALIGNED(s3, 16))
+		unrolled = n_samples & ~3;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 4) {
+		in[0] = _mm_mul_ps(_mm_load_ps(&s0[n]), scale);
+		in[1] = _mm_mul_ps(_mm_load_ps(&s1[n]), scale);
+		in[2] = _mm_mul_ps(_mm_load_ps(&s2[n]), scale);
+		in[3] = _mm_mul_ps(_mm_load_ps(&s3[n]), scale);
+		if (noise) {
+			nz = _mm_load_ps(&noise[n]);
+			in[0] = _mm_add_ps(in[0], nz);
+			in[1] = _mm_add_ps(in[1], nz);
+			in[2] = _mm_add_ps(in[2], nz);
+			in[3] = _mm_add_ps(in[3], nz);
+		}
+		in[0] = _MM_CLAMP_PS(in[0], int_min, int_max);
+		in[1] = _MM_CLAMP_PS(in[1], int_min, int_max);
+		in[2] = _MM_CLAMP_PS(in[2], int_min, int_max);
+		in[3] = _MM_CLAMP_PS(in[3], int_min, int_max);
+
+		_MM_TRANSPOSE4_PS(in[0], in[1], in[2], in[3]);
+
+		out[0] = _mm_shuffle_epi8(_mm_cvtps_epi32(in[0]), mask);
+		out[1] = _mm_shuffle_epi8(_mm_cvtps_epi32(in[1]), mask);
+		out[2] = _mm_shuffle_epi8(_mm_cvtps_epi32(in[2]), mask);
+		out[3] = _mm_shuffle_epi8(_mm_cvtps_epi32(in[3]), mask);
+
+		_MM_STORE_S24(&d[0*n_channels], out[0]);
+		_MM_STORE_S24(&d[1*n_channels], out[1]);
+		_MM_STORE_S24(&d[2*n_channels], out[2]);
+		_MM_STORE_S24(&d[3*n_channels], out[3]);
+		d += 4*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		in[0] = _mm_setr_ps(s0[n], s1[n], s2[n], s3[n]);
+		in[0] = _mm_mul_ps(in[0], scale);
+		if (noise)
+			in[0] = _mm_add_ps(in[0], _mm_set1_ps(noise[n]));
+		in[0] = _MM_CLAMP_PS(in[0], int_min, int_max);
+		out[0] = _mm_shuffle_epi8(_mm_cvtps_epi32(in[0]), mask);
+		_MM_STORE_S24(d, out[0]);
+		d += n_channels;
+	}
+}
+
+static inline void
+conv_f32d_to_s24_ssse3_impl(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		const float *noise, uint32_t offs, uint32_t n_samples, bool swap)
+{
+	const float **s = (const float **) src;
+	int24_t *d = dst[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	d += offs * n_channels;
+	for(; i + 3 < n_channels; i += 4)
+		conv_f32d_to_s24_4s_ssse3(&d[i], &s[i][offs], &s[i+1][offs], &s[i+2][offs],
+				&s[i+3][offs], noise, n_channels, n_samples, swap);
+	for(; i < n_channels; i++)
+		conv_f32d_to_s24_1s_ssse3(&d[i], &s[i][offs], noise, n_channels, n_samples, swap);
+}
+
+void
+conv_f32d_to_s24_ssse3(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	conv_f32d_to_s24_ssse3_impl(conv, dst, src, NULL, 0, n_samples, false);
+}
+
+void
+conv_f32d_to_s24s_ssse3(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	conv_f32d_to_s24_ssse3_impl(conv, dst, src, NULL, 0, n_samples, true);
+}
+
+void
+conv_f32d_to_s24_noise_ssse3(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t k, chunk;
+	float *noise = conv->noise;
+
+	convert_update_noise(conv, noise, SPA_MIN(n_samples, conv->noise_size));
+
+	for(k = 0; k < n_samples; k += chunk) {
+		chunk = SPA_MIN(n_samples - k, conv->noise_size);
+		conv_f32d_to_s24_ssse3_impl(conv, dst, src, noise, k, chunk, false);
+	}
+}
+
+void
+conv_f32d_to_s24s_noise_ssse3(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t k, chunk;
+	float *noise = conv->noise;
+
+	convert_update_noise(conv, noise, SPA_MIN(n_samples, conv->noise_size));
+
+	for(k = 0; k < n_samples; k += chunk) {
+		chunk = SPA_MIN(n_samples - k, conv->noise_size);
+		conv_f32d_to_s24_ssse3_impl(conv, dst, src, noise, k, chunk, true);
+	}
+}
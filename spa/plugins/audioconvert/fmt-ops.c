@@ -50,6 +50,10 @@ static struct conv_info conv_table[] =
 	MAKE(S8, F32P, 0, conv_s8_to_f32d_c),
 	MAKE(S8P, F32, 0, conv_s8d_to_f32_c),
 
+#if defined (HAVE_SSE2)
+	MAKE(ALAW, F32P, 0, conv_alaw_to_f32d_sse2, SPA_CPU_FLAG_SSE2),
+	MAKE(ULAW, F32P, 0, conv_ulaw_to_f32d_sse2, SPA_CPU_FLAG_SSE2),
+#endif
 	MAKE(ALAW, F32P, 0, conv_alaw_to_f32d_c),
 	MAKE(ULAW, F32P, 0, conv_ulaw_to_f32d_c),
 
@@ -134,7 +138,7 @@ static struct conv_info conv_table[] =
 	MAKE(S24, F32P, 0, conv_s24_to_f32d_avx2, SPA_CPU_FLAG_AVX2),
 #endif
 #if defined (HAVE_SSSE3)
-//	MAKE(S24, F32P, 0, conv_s24_to_f32d_ssse3, SPA_CPU_FLAG_SSSE3),
+	MAKE(S24, F32P, 0, conv_s24_to_f32d_ssse3, SPA_CPU_FLAG_SSSE3),
 #endif
 #if defined (HAVE_SSE41)
 	MAKE(S24, F32P, 0, conv_s24_to_f32d_sse41, SPA_CPU_FLAG_SSE41),
@@ -145,6 +149,9 @@ static struct conv_info conv_table[] =
 	MAKE(S24, F32P, 0, conv_s24_to_f32d_c),
 	MAKE(S24P, F32, 0, conv_s24d_to_f32_c),
 
+#if defined (HAVE_SSSE3)
+	MAKE(S24_OE, F32P, 0, conv_s24s_to_f32d_ssse3, SPA_CPU_FLAG_SSSE3),
+#endif
 	MAKE(S24_OE, F32P, 0, conv_s24s_to_f32d_c),
 
 	MAKE(U24_32, F32, 0, conv_u24_32_to_f32_c),
@@ -166,23 +173,51 @@ static struct conv_info conv_table[] =
 
 	/* from f32 */
 	MAKE(F32, U8, 0, conv_f32_to_u8_c),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, U8P, 0, conv_f32d_to_u8d_shaped_avx2, SPA_CPU_FLAG_AVX2, CONV_SHAPE),
+#endif
 	MAKE(F32P, U8P, 0, conv_f32d_to_u8d_shaped_c, 0, CONV_SHAPE),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, U8P, 0, conv_f32d_to_u8d_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
 	MAKE(F32P, U8P, 0, conv_f32d_to_u8d_noise_c, 0, CONV_NOISE),
 	MAKE(F32P, U8P, 0, conv_f32d_to_u8d_c),
 	MAKE(F32, U8P, 0, conv_f32_to_u8d_c),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, U8, 0, conv_f32d_to_u8_shaped_avx2, SPA_CPU_FLAG_AVX2, CONV_SHAPE),
+#endif
 	MAKE(F32P, U8, 0, conv_f32d_to_u8_shaped_c, 0, CONV_SHAPE),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, U8, 0, conv_f32d_to_u8_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
 	MAKE(F32P, U8, 0, conv_f32d_to_u8_noise_c, 0, CONV_NOISE),
 	MAKE(F32P, U8, 0, conv_f32d_to_u8_c),
 
 	MAKE(F32, S8, 0, conv_f32_to_s8_c),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S8P, 0, conv_f32d_to_s8d_shaped_avx2, SPA_CPU_FLAG_AVX2, CONV_SHAPE),
+#endif
 	MAKE(F32P, S8P, 0, conv_f32d_to_s8d_shaped_c, 0, CONV_SHAPE),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S8P, 0, conv_f32d_to_s8d_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
 	MAKE(F32P, S8P, 0, conv_f32d_to_s8d_noise_c, 0, CONV_NOISE),
 	MAKE(F32P, S8P, 0, conv_f32d_to_s8d_c),
 	MAKE(F32, S8P, 0, conv_f32_to_s8d_c),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S8, 0, conv_f32d_to_s8_shaped_avx2, SPA_CPU_FLAG_AVX2, CONV_SHAPE),
+#endif
 	MAKE(F32P, S8, 0, conv_f32d_to_s8_shaped_c, 0, CONV_SHAPE),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S8, 0, conv_f32d_to_s8_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
 	MAKE(F32P, S8, 0, conv_f32d_to_s8_noise_c, 0, CONV_NOISE),
 	MAKE(F32P, S8, 0, conv_f32d_to_s8_c),
 
+#if defined (HAVE_SSE2)
+	MAKE(F32P, ALAW, 0, conv_f32d_to_alaw_sse2, SPA_CPU_FLAG_SSE2),
+	MAKE(F32P, ULAW, 0, conv_f32d_to_ulaw_sse2, SPA_CPU_FLAG_SSE2),
+#endif
 	MAKE(F32P, ALAW, 0, conv_f32d_to_alaw_c),
 	MAKE(F32P, ULAW, 0, conv_f32d_to_ulaw_c),
 
@@ -199,7 +234,13 @@ static struct conv_info conv_table[] =
 #endif
 	MAKE(F32, S16, 0, conv_f32_to_s16_c),
 
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S16P, 0, conv_f32d_to_s16d_shaped_avx2, SPA_CPU_FLAG_AVX2, CONV_SHAPE),
+#endif
 	MAKE(F32P, S16P, 0, conv_f32d_to_s16d_shaped_c, 0, CONV_SHAPE),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S16P, 0, conv_f32d_to_s16d_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
 #if defined (HAVE_SSE2)
 	MAKE(F32P, S16P, 0, conv_f32d_to_s16d_noise_sse2, SPA_CPU_FLAG_SSE2, CONV_NOISE),
 #endif
@@ -211,7 +252,13 @@ static struct conv_info conv_table[] =
 
 	MAKE(F32, S16P, 0, conv_f32_to_s16d_c),
 
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S16, 0, conv_f32d_to_s16_shaped_avx2, SPA_CPU_FLAG_AVX2, CONV_SHAPE),
+#endif
 	MAKE(F32P, S16, 0, conv_f32d_to_s16_shaped_c, 0, CONV_SHAPE),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S16, 0, conv_f32d_to_s16_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
 #if defined (HAVE_SSE2)
 	MAKE(F32P, S16, 0, conv_f32d_to_s16_noise_sse2, SPA_CPU_FLAG_SSE2, CONV_NOISE),
 #endif
@@ -230,7 +277,13 @@ static struct conv_info conv_table[] =
 #endif
 	MAKE(F32P, S16, 0, conv_f32d_to_s16_c),
 
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S16_OE, 0, conv_f32d_to_s16s_shaped_avx2, SPA_CPU_FLAG_AVX2, CONV_SHAPE),
+#endif
 	MAKE(F32P, S16_OE, 0, conv_f32d_to_s16s_shaped_c, 0, CONV_SHAPE),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S16_OE, 0, conv_f32d_to_s16s_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
 	MAKE(F32P, S16_OE, 0, conv_f32d_to_s16s_noise_c, 0, CONV_NOISE),
 #if defined (HAVE_SSE2)
 	MAKE(F32P, S16_OE, 2, conv_f32d_to_s16s_2_sse2, SPA_CPU_FLAG_SSE2),
@@ -242,10 +295,16 @@ static struct conv_info conv_table[] =
 	MAKE(F32P, U32, 0, conv_f32d_to_u32_c),
 
 	MAKE(F32, S32, 0, conv_f32_to_s32_c),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S32P, 0, conv_f32d_to_s32d_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
 	MAKE(F32P, S32P, 0, conv_f32d_to_s32d_noise_c, 0, CONV_NOISE),
 	MAKE(F32P, S32P, 0, conv_f32d_to_s32d_c),
 	MAKE(F32, S32P, 0, conv_f32_to_s32d_c),
 
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S32, 0, conv_f32d_to_s32_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
 #if defined (HAVE_SSE2)
 	MAKE(F32P, S32, 0, conv_f32d_to_s32_noise_sse2, SPA_CPU_FLAG_SSE2, CONV_NOISE),
 #endif
@@ -262,6 +321,9 @@ static struct conv_info conv_table[] =
 #endif
 	MAKE(F32P, S32, 0, conv_f32d_to_s32_c),
 
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S32_OE, 0, conv_f32d_to_s32s_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
 	MAKE(F32P, S32_OE, 0, conv_f32d_to_s32s_noise_c, 0, CONV_NOISE),
 	MAKE(F32P, S32_OE, 0, conv_f32d_to_s32s_c),
 
@@ -269,25 +331,55 @@ static struct conv_info conv_table[] =
 	MAKE(F32P, U24, 0, conv_f32d_to_u24_c),
 
 	MAKE(F32, S24, 0, conv_f32_to_s24_c),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S24P, 0, conv_f32d_to_s24d_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
 	MAKE(F32P, S24P, 0, conv_f32d_to_s24d_noise_c, 0, CONV_NOISE),
 	MAKE(F32P, S24P, 0, conv_f32d_to_s24d_c),
 	MAKE(F32, S24P, 0, conv_f32_to_s24d_c),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S24, 0, conv_f32d_to_s24_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
+#if defined (HAVE_SSSE3)
+	MAKE(F32P, S24, 0, conv_f32d_to_s24_noise_ssse3, SPA_CPU_FLAG_SSSE3, CONV_NOISE),
+#endif
 	MAKE(F32P, S24, 0, conv_f32d_to_s24_noise_c, 0, CONV_NOISE),
+#if defined (HAVE_SSSE3)
+	MAKE(F32P, S24, 0, conv_f32d_to_s24_ssse3, SPA_CPU_FLAG_SSSE3),
+#endif
 	MAKE(F32P, S24, 0, conv_f32d_to_s24_c),
 
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S24_OE, 0, conv_f32d_to_s24s_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
+#if defined (HAVE_SSSE3)
+	MAKE(F32P, S24_OE, 0, conv_f32d_to_s24s_noise_ssse3, SPA_CPU_FLAG_SSSE3, CONV_NOISE),
+#endif
 	MAKE(F32P, S24_OE, 0, conv_f32d_to_s24s_noise_c, 0, CONV_NOISE),
+#if defined (HAVE_SSSE3)
+	MAKE(F32P, S24_OE, 0, conv_f32d_to_s24s_ssse3, SPA_CPU_FLAG_SSSE3),
+#endif
 	MAKE(F32P, S24_OE, 0, conv_f32d_to_s24s_c),
 
 	MAKE(F32, U24_32, 0, conv_f32_to_u24_32_c),
 	MAKE(F32P, U24_32, 0, conv_f32d_to_u24_32_c),
 
 	MAKE(F32, S24_32, 0, conv_f32_to_s24_32_c),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S24_32P, 0, conv_f32d_to_s24_32d_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
 	MAKE(F32P, S24_32P, 0, conv_f32d_to_s24_32d_noise_c, 0, CONV_NOISE),
 	MAKE(F32P, S24_32P, 0, conv_f32d_to_s24_32d_c),
 	MAKE(F32, S24_32P, 0, conv_f32_to_s24_32d_c),
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S24_32, 0, conv_f32d_to_s24_32_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
 	MAKE(F32P, S24_32, 0, conv_f32d_to_s24_32_noise_c, 0, CONV_NOISE),
 	MAKE(F32P, S24_32, 0, conv_f32d_to_s24_32_c),
 
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S24_32_OE, 0, conv_f32d_to_s24_32s_noise_avx2, SPA_CPU_FLAG_AVX2, CONV_NOISE),
+#endif
 	MAKE(F32P, S24_32_OE, 0, conv_f32d_to_s24_32s_noise_c, 0, CONV_NOISE),
 	MAKE(F32P, S24_32_OE, 0, conv_f32d_to_s24_32s_c),
 
@@ -69,6 +69,7 @@
 #define F32_TO_S24_D(v,d)	s32_to_s24(FTOI(int32_t, v, S24_SCALE, 0.0f, d, S24_MIN, S24_MAX))
 #define F32_TO_S24(v)		F32_TO_S24_D(v, 0.0f)
 #define F32_TO_S24S(v)		bswap_s24(F32_TO_S24(v))
+#define F32_TO_S24S_D(v,d)	bswap_s24(F32_TO_S24_D(v,d))
 
 #define U24_32_TO_U32(v)	(((uint32_t)(v)) << 8)
 
@@ -477,9 +478,18 @@ DEFINE_FUNCTION(32_to_32d, sse2);
 DEFINE_FUNCTION(32s_to_32d, sse2);
 DEFINE_FUNCTION(32d_to_32, sse2);
 DEFINE_FUNCTION(32d_to_32s, sse2);
+DEFINE_FUNCTION(alaw_to_f32d, sse2);
+DEFINE_FUNCTION(ulaw_to_f32d, sse2);
+DEFINE_FUNCTION(f32d_to_alaw, sse2);
+DEFINE_FUNCTION(f32d_to_ulaw, sse2);
 #endif
 #if defined(HAVE_SSSE3)
 DEFINE_FUNCTION(s24_to_f32d, ssse3);
+DEFINE_FUNCTION(s24s_to_f32d, ssse3);
+DEFINE_FUNCTION(f32d_to_s24, ssse3);
+DEFINE_FUNCTION(f32d_to_s24_noise, ssse3);
+DEFINE_FUNCTION(f32d_to_s24s, ssse3);
+DEFINE_FUNCTION(f32d_to_s24s_noise, ssse3);
 #endif
 #if defined(HAVE_SSE41)
 DEFINE_FUNCTION(s24_to_f32d, sse41);
@@ -495,6 +505,29 @@ DEFINE_FUNCTION(f32d_to_s32, avx2);
 DEFINE_FUNCTION(f32d_to_s16_4, avx2);
 DEFINE_FUNCTION(f32d_to_s16_2, avx2);
 DEFINE_FUNCTION(f32d_to_s16, avx2);
+DEFINE_FUNCTION(f32d_to_u8d_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_u8_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_s8d_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_s8_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_s16d_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_s16_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_s16s_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_u8d_noise, avx2);
+DEFINE_FUNCTION(f32d_to_u8_noise, avx2);
+DEFINE_FUNCTION(f32d_to_s8d_noise, avx2);
+DEFINE_FUNCTION(f32d_to_s8_noise, avx2);
+DEFINE_FUNCTION(f32d_to_s16d_noise, avx2);
+DEFINE_FUNCTION(f32d_to_s16_noise, avx2);
+DEFINE_FUNCTION(f32d_to_s16s_noise, avx2);
+DEFINE_FUNCTION(f32d_to_s32d_noise, avx2);
+DEFINE_FUNCTION(f32d_to_s32_noise, avx2);
+DEFINE_FUNCTION(f32d_to_s32s_noise, avx2);
+DEFINE_FUNCTION(f32d_to_s24d_noise, avx2);
+DEFINE_FUNCTION(f32d_to_s24_noise, avx2);
+DEFINE_FUNCTION(f32d_to_s24s_noise, avx2);
+DEFINE_FUNCTION(f32d_to_s24_32d_noise, avx2);
+DEFINE_FUNCTION(f32d_to_s24_32_noise, avx2);
+DEFINE_FUNCTION(f32d_to_s24_32s_noise, avx2);
 #endif
 
 #undef DEFINE_FUNCTION
@@ -26,6 +26,15 @@ static inline float hmax_ps(__m128 val)
 	return _mm_cvtss_f32(val);
 }
 
+static inline float hadd_ps(__m128 val)
+{
+	__m128 t = _mm_movehl_ps(val, val);
+	t = _mm_add_ps(t, val);
+	val = _mm_shuffle_ps(t, t, 0x55);
+	val = _mm_add_ss(t, val);
+	return _mm_cvtss_f32(val);
+}
+
 void peaks_min_max_sse(struct peaks *peaks, const float * SPA_RESTRICT src,
 		uint32_t n_samples, float *min, float *max)
 {
@@ -100,3 +109,35 @@ float peaks_abs_max_sse(struct peaks *peaks, const float * SPA_RESTRICT src,
 	}
 	return hmax_ps(ma);
 }
+
+float peaks_sqr_sum_sse(struct peaks *peaks, const float * SPA_RESTRICT src,
+		uint32_t n_samples, float sum)
+{
+	uint32_t n;
+	__m128 in;
+	__m128 s[4];
+	float r = sum;
+
+	for (n = 0; n < n_samples; n++) {
+		if (SPA_IS_ALIGNED(&src[n], 16))
+			break;
+		r += src[n] * src[n];
+	}
+	s[0] = s[1] = s[2] = s[3] = _mm_setzero_ps();
+	for (; n + 15 < n_samples; n += 16) {
+		in = _mm_load_ps(&src[n + 0]);
+		s[0] = _mm_add_ps(s[0], _mm_mul_ps(in, in));
+		in = _mm_load_ps(&src[n + 4]);
+		s[1] = _mm_add_ps(s[1], _mm_mul_ps(in, in));
+		in = _mm_load_ps(&src[n + 8]);
+		s[2] = _mm_add_ps(s[2], _mm_mul_ps(in, in));
+		in = _mm_load_ps(&src[n + 12]);
+		s[3] = _mm_add_ps(s[3], _mm_mul_ps(in, in));
+	}
+	for (; n < n_samples; n++)
+		r += src[n] * src[n];
+
+	s[0] = _mm_add_ps(s[0], s[1]);
+	s[2] = _mm_add_ps(s[2], s[3]);
+	return r + hadd_ps(_mm_add_ps(s[0], s[2]));
+}
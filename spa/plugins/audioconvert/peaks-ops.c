@@ -17,21 +17,24 @@ typedef void (*peaks_min_max_func_t) (struct peaks *peaks, const float * SPA_RES
 		uint32_t n_samples, float *min, float *max);
 typedef float (*peaks_abs_max_func_t) (struct peaks *peaks, const float * SPA_RESTRICT src,
 			uint32_t n_samples, float max);
+typedef float (*peaks_sqr_sum_func_t) (struct peaks *peaks, const float * SPA_RESTRICT src,
+			uint32_t n_samples, float sum);
 
-#define MAKE(min_max,abs_max,...) \
-	{ min_max, abs_max, #min_max , __VA_ARGS__ }
+#define MAKE(min_max,abs_max,sqr_sum,...) \
+	{ min_max, abs_max, sqr_sum, #min_max , __VA_ARGS__ }
 
 static const struct peaks_info {
 	peaks_min_max_func_t min_max;
 	peaks_abs_max_func_t abs_max;
+	peaks_sqr_sum_func_t sqr_sum;
 	const char *name;
 	uint32_t cpu_flags;
 } peaks_table[] =
 {
 #if defined (HAVE_SSE)
-	MAKE(peaks_min_max_sse, peaks_abs_max_sse, SPA_CPU_FLAG_SSE),
+	MAKE(peaks_min_max_sse, peaks_abs_max_sse, peaks_sqr_sum_sse, SPA_CPU_FLAG_SSE),
 #endif
-	MAKE(peaks_min_max_c, peaks_abs_max_c),
+	MAKE(peaks_min_max_c, peaks_abs_max_c, peaks_sqr_sum_c),
 };
 #undef MAKE
 
@@ -50,6 +53,7 @@ static void impl_peaks_free(struct peaks *peaks)
 {
 	peaks->min_max = NULL;
 	peaks->abs_max = NULL;
+	peaks->sqr_sum = NULL;
 }
 
 int peaks_init(struct peaks *peaks)
@@ -65,5 +69,6 @@ int peaks_init(struct peaks *peaks)
 	peaks->free = impl_peaks_free;
 	peaks->min_max = info->min_max;
 	peaks->abs_max = info->abs_max;
+	peaks->sqr_sum = info->sqr_sum;
 	return 0;
 }
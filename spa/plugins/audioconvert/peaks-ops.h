@@ -25,6 +25,8 @@ struct peaks {
 		uint32_t n_samples, float *min, float *max);
 	float (*abs_max) (struct peaks *peaks, const float * SPA_RESTRICT src,
 			uint32_t n_samples, float max);
+	float (*sqr_sum) (struct peaks *peaks, const float * SPA_RESTRICT src,
+			uint32_t n_samples, float sum);
 
 	void (*free) (struct peaks *peaks);
 };
@@ -33,6 +35,7 @@ int peaks_init(struct peaks *peaks);
 
 #define peaks_min_max(peaks,...)	(peaks)->min_max(peaks, __VA_ARGS__)
 #define peaks_abs_max(peaks,...)	(peaks)->abs_max(peaks, __VA_ARGS__)
+#define peaks_sqr_sum(peaks,...)	(peaks)->sqr_sum(peaks, __VA_ARGS__)
 #define peaks_free(peaks)		(peaks)->free(peaks)
 
 #define DEFINE_MIN_MAX_FUNCTION(arch)				\
@@ -45,15 +48,23 @@ float peaks_abs_max_##arch(struct peaks *peaks,			\
 		const float * SPA_RESTRICT src,			\
 		uint32_t n_samples, float max);
 
+#define DEFINE_SQR_SUM_FUNCTION(arch)				\
+float peaks_sqr_sum_##arch(struct peaks *peaks,			\
+		const float * SPA_RESTRICT src,			\
+		uint32_t n_samples, float sum);
+
 #define PEAKS_OPS_MAX_ALIGN	16
 
 DEFINE_MIN_MAX_FUNCTION(c);
 DEFINE_ABS_MAX_FUNCTION(c);
+DEFINE_SQR_SUM_FUNCTION(c);
 
 #if defined (HAVE_SSE)
 DEFINE_MIN_MAX_FUNCTION(sse);
 DEFINE_ABS_MAX_FUNCTION(sse);
+DEFINE_SQR_SUM_FUNCTION(sse);
 #endif
 
 #undef DEFINE_MIN_MAX_FUNCTION
 #undef DEFINE_ABS_MAX_FUNCTION
+#undef DEFINE_SQR_SUM_FUNCTION
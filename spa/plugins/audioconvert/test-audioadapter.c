@@ -16,6 +16,7 @@
 #include <spa/param/audio/format.h>
 #include <spa/param/audio/format-utils.h>
 #include <spa/node/node.h>
+#include <spa/node/io.h>
 #include <spa/debug/mem.h>
 #include <spa/support/log-impl.h>
 
@@ -263,6 +264,23 @@ static int test_passthrough_setup(struct context *ctx)
 	return 0;
 }
 
+static int test_set_io_meter(struct context *ctx)
+{
+	struct spa_io_meter meter;
+	int res;
+
+	/* the converter measures, the follower doesn't know the area */
+	res = spa_node_set_io(ctx->adapter_node, SPA_IO_Meter, &meter, sizeof(meter));
+	spa_assert_se(res == 0);
+
+	res = spa_node_set_io(ctx->adapter_node, SPA_IO_Meter, &meter, sizeof(meter) - 1);
+	spa_assert_se(res == -EINVAL);
+
+	res = spa_node_set_io(ctx->adapter_node, SPA_IO_Meter, NULL, 0);
+	spa_assert_se(res == 0);
+
+	return 0;
+}
 
 int main(int argc, char *argv[])
 {
@@ -275,6 +293,7 @@ int main(int argc, char *argv[])
 	test_init_state(&ctx);
 	test_split_setup(&ctx);
 	test_passthrough_setup(&ctx);
+	test_set_io_meter(&ctx);
 
 	clean_context(&ctx);
 
@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
+#include <math.h>
 
 #include <spa/utils/names.h>
 #include <spa/utils/string.h>
@@ -1122,6 +1123,127 @@ static int test_convert_remap_conv(struct context *ctx)
 	return 0;
 }
 
+#define METER_SAMPLES	4800
+
+static int test_meter(struct context *ctx)
+{
+	struct spa_audio_info_raw in_info = SPA_AUDIO_INFO_RAW_INIT(
+		.format = SPA_AUDIO_FORMAT_F32P,
+		.rate = 48000,
+		.channels = 2,
+		.position = { SPA_AUDIO_CHANNEL_FL, SPA_AUDIO_CHANNEL_FR });
+	struct spa_audio_info_raw out_info = in_info;
+	static float in_data[2][METER_SAMPLES], out_data[2][METER_SAMPLES];
+	struct spa_io_meter meter;
+	struct spa_command cmd;
+	struct buffer in_buffer, out_buffers[2];
+	struct spa_buffer *buffers[1];
+	struct spa_io_buffers in_io, out_io[2];
+	uint32_t i, j;
+	int res;
+
+	/* a 1kHz sine at -6dB on the left and silence on the right */
+	for (i = 0; i < METER_SAMPLES; i++) {
+		in_data[0][i] = 0.5f * sinf(2.0f * (float)M_PI * 1000.0f * i / 48000.0f);
+		in_data[1][i] = 0.0f;
+	}
+
+	setup_direction(ctx, SPA_DIRECTION_INPUT, SPA_PARAM_PORT_CONFIG_MODE_convert, &in_info);
+	setup_direction(ctx, SPA_DIRECTION_OUTPUT, SPA_PARAM_PORT_CONFIG_MODE_dsp, &out_info);
+
+	spa_zero(meter);
+	res = spa_node_set_io(ctx->convert_node, SPA_IO_Meter, &meter, sizeof(meter) - 1);
+	spa_assert_se(res == -EINVAL);
+	res = spa_node_set_io(ctx->convert_node, SPA_IO_Meter, &meter, sizeof(meter));
+	spa_assert_se(res == 0);
+
+	cmd = SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Start);
+	res = spa_node_send_command(ctx->convert_node, &cmd);
+	spa_assert_se(res == 0);
+
+	spa_zero(in_buffer);
+	in_buffer.buffer.datas = in_buffer.datas;
+	in_buffer.buffer.n_datas = 2;
+	for (j = 0; j < 2; j++) {
+		in_buffer.datas[j].type = SPA_DATA_MemPtr;
+		in_buffer.datas[j].flags = SPA_DATA_FLAG_READABLE;
+		in_buffer.datas[j].fd = -1;
+		in_buffer.datas[j].maxsize = sizeof(in_data[j]);
+		in_buffer.datas[j].data = in_data[j];
+		in_buffer.datas[j].chunk = &in_buffer.chunks[j];
+		in_buffer.datas[j].chunk->size = sizeof(in_data[j]);
+	}
+	buffers[0] = &in_buffer.buffer;
+	res = spa_node_port_use_buffers(ctx->convert_node, SPA_DIRECTION_INPUT, 0,
+			0, buffers, 1);
+	spa_assert_se(res == 0);
+	res = spa_node_port_set_io(ctx->convert_node, SPA_DIRECTION_INPUT, 0,
+			SPA_IO_Buffers, &in_io, sizeof(in_io));
+	spa_assert_se(res == 0);
+
+	for (i = 0; i < 2; i++) {
+		struct buffer *b = &out_buffers[i];
+
+		spa_zero(*b);
+		b->buffer.datas = b->datas;
+		b->buffer.n_datas = 1;
+		b->datas[0].type = SPA_DATA_MemPtr;
+		b->datas[0].flags = SPA_DATA_FLAG_READWRITE;
+		b->datas[0].fd = -1;
+		b->datas[0].maxsize = sizeof(out_data[i]);
+		b->datas[0].data = out_data[i];
+		b->datas[0].chunk = &b->chunks[0];
+		buffers[0] = &b->buffer;
+		res = spa_node_port_use_buffers(ctx->convert_node, SPA_DIRECTION_OUTPUT, i,
+				0, buffers, 1);
+		spa_assert_se(res == 0);
+
+		out_io[i].buffer_id = -1;
+		res = spa_node_port_set_io(ctx->convert_node, SPA_DIRECTION_OUTPUT, i,
+				SPA_IO_Buffers, &out_io[i], sizeof(out_io[i]));
+		spa_assert_se(res == 0);
+	}
+
+	/* run for 4 periods of 100ms to fill the momentary loudness window */
+	for (j = 0; j < 4; j++) {
+		in_io.status = SPA_STATUS_HAVE_DATA;
+		in_io.buffer_id = 0;
+		for (i = 0; i < 2; i++)
+			out_io[i].status = SPA_STATUS_NEED_DATA;
+
+		res = spa_node_process(ctx->convert_node);
+		spa_assert_se(res == (SPA_STATUS_NEED_DATA | SPA_STATUS_HAVE_DATA));
+
+		for (i = 0; i < 2; i++)
+			out_io[i].buffer_id = 0;
+	}
+
+	spa_assert_se((meter.seq & 1) == 0);
+	spa_assert_se(meter.count == 4);
+	spa_assert_se(meter.n_channels == 2);
+	spa_assert_se(meter.rate == 48000);
+	spa_assert_se(meter.period == METER_SAMPLES);
+
+	spa_assert_se(fabsf(meter.channels[0].peak - 0.5f) < 1e-4f);
+	spa_assert_se(fabsf(meter.channels[0].rms - 0.5f / sqrtf(2.0f)) < 1e-3f);
+	/* a full scale 1kHz sine in one channel measures -3 LUFS */
+	spa_assert_se(fabsf(meter.channels[0].loudness - (-3.01f - 6.02f)) < 0.5f);
+	spa_assert_se(fabsf(meter.loudness - meter.channels[0].loudness) < 0.01f);
+
+	spa_assert_se(meter.channels[1].peak == 0.0f);
+	spa_assert_se(meter.channels[1].rms == 0.0f);
+	spa_assert_se(isinf(meter.channels[1].loudness));
+
+	res = spa_node_set_io(ctx->convert_node, SPA_IO_Meter, NULL, 0);
+	spa_assert_se(res == 0);
+
+	cmd = SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Suspend);
+	res = spa_node_send_command(ctx->convert_node, &cmd);
+	spa_assert_se(res == 0);
+
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	struct context ctx;
@@ -1146,6 +1268,8 @@ int main(int argc, char *argv[])
 	test_convert_remap_dsp(&ctx);
 	test_convert_remap_conv(&ctx);
 
+	test_meter(&ctx);
+
 	clean_context(&ctx);
 
 	return 0;
@@ -23,8 +23,9 @@ static uint32_t cpu_flags;
 
 static uint8_t samp_in[N_SAMPLES * 8];
 static uint8_t samp_out[N_SAMPLES * 8];
-static uint8_t temp_in[N_SAMPLES * N_CHANNELS * 8];
-static uint8_t temp_out[N_SAMPLES * N_CHANNELS * 8];
+static uint8_t temp_in[N_SAMPLES * N_CHANNELS * 8] SPA_ALIGNED(16);
+static uint8_t temp_out[N_SAMPLES * N_CHANNELS * 8] SPA_ALIGNED(16);
+static uint8_t temp_ref[N_SAMPLES * N_CHANNELS * 8] SPA_ALIGNED(16);
 
 static void compare_mem(int i, int j, const void *m1, const void *m2, size_t size)
 {
@@ -105,6 +106,39 @@ static void run_test(const char *name,
 	}
 }
 
+/* compare func against the reference implementation for all samples of in,
+ * n_frames at a time, the planar channels are aligned when n_frames is */
+static void run_test_ref(const char *name, const void *in, size_t in_size, size_t out_size,
+		size_t n_samples, uint32_t n_frames, bool in_packed,
+		convert_func_t func, convert_func_t ref)
+{
+	const void *ip[N_CHANNELS];
+	void *tp[N_CHANNELS], *rp[N_CHANNELS];
+	const uint8_t *in8 = in;
+	size_t i, j, block = n_frames * N_CHANNELS;
+	struct convert conv = {
+		.n_channels = N_CHANNELS,
+	};
+
+	spa_assert_se(n_frames <= N_SAMPLES);
+
+	fprintf(stderr, "test %s %u:\n", name, n_frames);
+	for (i = 0; i < n_samples; i += block) {
+		for (j = 0; j < block; j++)
+			memcpy(&temp_in[j * in_size], &in8[((i + j) % n_samples) * in_size], in_size);
+
+		for (j = 0; j < N_CHANNELS; j++) {
+			ip[j] = in_packed ? temp_in : &temp_in[j * n_frames * in_size];
+			tp[j] = &temp_out[j * n_frames * out_size];
+			rp[j] = &temp_ref[j * n_frames * out_size];
+		}
+		func(&conv, tp, ip, n_frames);
+		ref(&conv, rp, ip, n_frames);
+
+		compare_mem(i, 0, temp_out, temp_ref, block * out_size);
+	}
+}
+
 static void test_f32_s8(void)
 {
 	static const float in[] = { 0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 1.1f, -1.1f,
@@ -439,6 +473,12 @@ static void test_f32_s24(void)
 			true, false, conv_f32_to_s24d_c);
 	run_test("test_f32d_s24d", in, sizeof(in[0]), out, 3, SPA_N_ELEMENTS(in),
 			false, false, conv_f32d_to_s24d_c);
+#if defined(HAVE_SSSE3)
+	if (cpu_flags & SPA_CPU_FLAG_SSSE3) {
+		run_test("test_f32d_s24_ssse3", in, sizeof(in[0]), out, 3, SPA_N_ELEMENTS(in),
+			false, true, conv_f32d_to_s24_ssse3);
+	}
+#endif
 }
 
 static void test_s24_f32(void)
@@ -481,6 +521,87 @@ static void test_s24_f32(void)
 #endif
 }
 
+static void test_f32_s24s(void)
+{
+	static const float in[] = { 0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 1.1f, -1.1f,
+		1.0f/0xa00000, 1.0f/0x1000000, -1.0f/0xa00000, -1.0f/0x1000000 };
+	static const int24_t out[] = { S32_TO_S24(0), S32_TO_S24(0xffff7f),
+		S32_TO_S24(0x000080), S32_TO_S24(0x000040), S32_TO_S24(0x0000c0),
+		S32_TO_S24(0xffff7f), S32_TO_S24(0x000080),
+		S32_TO_S24(0x010000), S32_TO_S24(0x000000), S32_TO_S24(0xffffffff),
+		S32_TO_S24(0x000000) };
+
+	run_test("test_f32d_s24s", in, sizeof(in[0]), out, 3, SPA_N_ELEMENTS(in),
+			false, true, conv_f32d_to_s24s_c);
+#if defined(HAVE_SSSE3)
+	if (cpu_flags & SPA_CPU_FLAG_SSSE3) {
+		run_test("test_f32d_s24s_ssse3", in, sizeof(in[0]), out, 3, SPA_N_ELEMENTS(in),
+			false, true, conv_f32d_to_s24s_ssse3);
+	}
+#endif
+}
+
+static void test_s24s_f32(void)
+{
+	static const int24_t in[] = { S32_TO_S24(0), S32_TO_S24(0xffff7f),
+		S32_TO_S24(0x000080), S32_TO_S24(0x000040), S32_TO_S24(0x0000c0) };
+	static const float out[] = { 0.0f, 0.999999880791f, -1.0f, 0.5f, -0.5f, };
+
+	run_test("test_s24s_f32d", in, 3, out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_s24s_to_f32d_c);
+#if defined(HAVE_SSSE3)
+	if (cpu_flags & SPA_CPU_FLAG_SSSE3) {
+		run_test("test_s24s_f32d_ssse3", in, 3, out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_s24s_to_f32d_ssse3);
+	}
+#endif
+}
+
+static void test_s24_ref(void)
+{
+	static uint8_t in_s24[N_SAMPLES * N_CHANNELS * 3];
+	static float in_f32[N_SAMPLES * N_CHANNELS * 4];
+	uint32_t i;
+
+	srand(0);
+	for (i = 0; i < SPA_N_ELEMENTS(in_s24); i++)
+		in_s24[i] = rand();
+	for (i = 0; i < SPA_N_ELEMENTS(in_f32); i++)
+		in_f32[i] = (rand() / (float)RAND_MAX) * 2.2f - 1.1f;
+	/* all the rounding cases around 0 */
+	for (i = 0; i < 64; i++)
+		in_f32[i] = ((int32_t)i - 32) / (2.0f * S24_SCALE);
+
+#if defined(HAVE_SSSE3)
+	if (cpu_flags & SPA_CPU_FLAG_SSSE3) {
+		run_test_ref("test_s24_f32d_ssse3", in_s24, 3, sizeof(float),
+				SPA_N_ELEMENTS(in_s24) / 3, N_SAMPLES, true,
+				conv_s24_to_f32d_ssse3, conv_s24_to_f32d_c);
+		run_test_ref("test_s24_f32d_ssse3", in_s24, 3, sizeof(float),
+				SPA_N_ELEMENTS(in_s24) / 3, 248, true,
+				conv_s24_to_f32d_ssse3, conv_s24_to_f32d_c);
+		run_test_ref("test_s24s_f32d_ssse3", in_s24, 3, sizeof(float),
+				SPA_N_ELEMENTS(in_s24) / 3, N_SAMPLES, true,
+				conv_s24s_to_f32d_ssse3, conv_s24s_to_f32d_c);
+		run_test_ref("test_s24s_f32d_ssse3", in_s24, 3, sizeof(float),
+				SPA_N_ELEMENTS(in_s24) / 3, 248, true,
+				conv_s24s_to_f32d_ssse3, conv_s24s_to_f32d_c);
+		run_test_ref("test_f32d_s24_ssse3", in_f32, sizeof(float), 3,
+				SPA_N_ELEMENTS(in_f32), N_SAMPLES, false,
+				conv_f32d_to_s24_ssse3, conv_f32d_to_s24_c);
+		run_test_ref("test_f32d_s24_ssse3", in_f32, sizeof(float), 3,
+				SPA_N_ELEMENTS(in_f32), 248, false,
+				conv_f32d_to_s24_ssse3, conv_f32d_to_s24_c);
+		run_test_ref("test_f32d_s24s_ssse3", in_f32, sizeof(float), 3,
+				SPA_N_ELEMENTS(in_f32), N_SAMPLES, false,
+				conv_f32d_to_s24s_ssse3, conv_f32d_to_s24s_c);
+		run_test_ref("test_f32d_s24s_ssse3", in_f32, sizeof(float), 3,
+				SPA_N_ELEMENTS(in_f32), 248, false,
+				conv_f32d_to_s24s_ssse3, conv_f32d_to_s24s_c);
+	}
+#endif
+}
+
 static void test_f32_u24_32(void)
 {
 	static const float in[] = { 0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 1.1f, -1.1f,
@@ -569,6 +690,90 @@ static void test_f32_f64(void)
 			false, false, conv_f32d_to_f64d_c);
 }
 
+static void test_f32_law(void)
+{
+	static const float in[] = { 0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 1.1f, -1.1f,
+		8.0f/32768.f, -8.0f/32768.f };
+	static const uint8_t out_alaw[] = { 0xd5, 0xaa, 0x2a, 0xa5, 0x3a, 0xaa, 0x2a, 0xd5, 0x55 };
+	static const uint8_t out_ulaw[] = { 0xff, 0x80, 0x00, 0x8f, 0x0f, 0x80, 0x00, 0xfe, 0x7e };
+
+	run_test("test_f32d_alaw", in, sizeof(in[0]), out_alaw, 1, SPA_N_ELEMENTS(in),
+			false, true, conv_f32d_to_alaw_c);
+	run_test("test_f32d_ulaw", in, sizeof(in[0]), out_ulaw, 1, SPA_N_ELEMENTS(in),
+			false, true, conv_f32d_to_ulaw_c);
+#if defined(HAVE_SSE2)
+	if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+		run_test("test_f32d_alaw_sse2", in, sizeof(in[0]), out_alaw, 1, SPA_N_ELEMENTS(in),
+			false, true, conv_f32d_to_alaw_sse2);
+		run_test("test_f32d_ulaw_sse2", in, sizeof(in[0]), out_ulaw, 1, SPA_N_ELEMENTS(in),
+			false, true, conv_f32d_to_ulaw_sse2);
+	}
+#endif
+}
+
+static void test_law_f32(void)
+{
+	static const uint8_t in_alaw[] = { 0xd5, 0x55, 0xaa, 0x2a };
+	static const float out_alaw[] = { 8.0f/32768.f, -8.0f/32768.f, 32256.f/32768.f, -32256.f/32768.f };
+	static const uint8_t in_ulaw[] = { 0xff, 0x7f, 0x80, 0x00 };
+	static const float out_ulaw[] = { 0.0f, 0.0f, 32124.f/32768.f, -32124.f/32768.f };
+
+	run_test("test_alaw_f32d", in_alaw, 1, out_alaw, sizeof(out_alaw[0]), SPA_N_ELEMENTS(out_alaw),
+			true, false, conv_alaw_to_f32d_c);
+	run_test("test_ulaw_f32d", in_ulaw, 1, out_ulaw, sizeof(out_ulaw[0]), SPA_N_ELEMENTS(out_ulaw),
+			true, false, conv_ulaw_to_f32d_c);
+#if defined(HAVE_SSE2)
+	if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+		run_test("test_alaw_f32d_sse2", in_alaw, 1, out_alaw, sizeof(out_alaw[0]), SPA_N_ELEMENTS(out_alaw),
+			true, false, conv_alaw_to_f32d_sse2);
+		run_test("test_ulaw_f32d_sse2", in_ulaw, 1, out_ulaw, sizeof(out_ulaw[0]), SPA_N_ELEMENTS(out_ulaw),
+			true, false, conv_ulaw_to_f32d_sse2);
+	}
+#endif
+}
+
+static void test_law_ref(void)
+{
+	static uint8_t codes[256];
+	/* every 16 bits value, the values halfway and some clipping */
+	static float in[2 * 65536 + 8192];
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(codes); i++)
+		codes[i] = i;
+	for (i = 0; i < SPA_N_ELEMENTS(in); i++)
+		in[i] = ((int32_t)i - (int32_t)SPA_N_ELEMENTS(in) / 2) / (2.0f * S16_SCALE);
+
+#if defined(HAVE_SSE2)
+	if (cpu_flags & SPA_CPU_FLAG_SSE2) {
+		run_test_ref("test_alaw_f32d_sse2", codes, 1, sizeof(float),
+				SPA_N_ELEMENTS(codes), N_SAMPLES, true,
+				conv_alaw_to_f32d_sse2, conv_alaw_to_f32d_c);
+		run_test_ref("test_alaw_f32d_sse2", codes, 1, sizeof(float),
+				SPA_N_ELEMENTS(codes), 248, true,
+				conv_alaw_to_f32d_sse2, conv_alaw_to_f32d_c);
+		run_test_ref("test_ulaw_f32d_sse2", codes, 1, sizeof(float),
+				SPA_N_ELEMENTS(codes), N_SAMPLES, true,
+				conv_ulaw_to_f32d_sse2, conv_ulaw_to_f32d_c);
+		run_test_ref("test_ulaw_f32d_sse2", codes, 1, sizeof(float),
+				SPA_N_ELEMENTS(codes), 248, true,
+				conv_ulaw_to_f32d_sse2, conv_ulaw_to_f32d_c);
+		run_test_ref("test_f32d_alaw_sse2", in, sizeof(float), 1,
+				SPA_N_ELEMENTS(in), N_SAMPLES, false,
+				conv_f32d_to_alaw_sse2, conv_f32d_to_alaw_c);
+		run_test_ref("test_f32d_alaw_sse2", in, sizeof(float), 1,
+				SPA_N_ELEMENTS(in), 248, false,
+				conv_f32d_to_alaw_sse2, conv_f32d_to_alaw_c);
+		run_test_ref("test_f32d_ulaw_sse2", in, sizeof(float), 1,
+				SPA_N_ELEMENTS(in), N_SAMPLES, false,
+				conv_f32d_to_ulaw_sse2, conv_f32d_to_ulaw_c);
+		run_test_ref("test_f32d_ulaw_sse2", in, sizeof(float), 1,
+				SPA_N_ELEMENTS(in), 248, false,
+				conv_f32d_to_ulaw_sse2, conv_f32d_to_ulaw_c);
+	}
+#endif
+}
+
 static void test_lossless_s8(void)
 {
 	int8_t i;
@@ -824,6 +1029,15 @@ static void run_test_noise(uint32_t fmt, uint32_t noise, uint32_t flags)
 			spa_assert_se(SPA_ABS(t - 0) <= (int32_t)range);
 			break;
 		}
+		case SPA_AUDIO_FORMAT_S24_OE:
+		{
+			int24_t *d = (int24_t *)samp_out;
+			int32_t t = s24_to_s32(bswap_s24(d[i]));
+			if (t != 0)
+				all_zero = false;
+			spa_assert_se(SPA_ABS(t - 0) <= (int32_t)range);
+			break;
+		}
 		case SPA_AUDIO_FORMAT_S32:
 		{
 			int32_t *d = (int32_t *)samp_out;
@@ -841,6 +1055,54 @@ static void run_test_noise(uint32_t fmt, uint32_t noise, uint32_t flags)
 	convert_free(&conv);
 }
 
+/* the pattern noise is the same for all implementations, the output of
+ * the optimized functions must match the C version */
+static void run_test_noise_ref(uint32_t fmt, uint32_t method, uint32_t noise,
+		uint32_t size, uint32_t flags)
+{
+	struct convert conv, ref;
+	const void *ip[N_CHANNELS];
+	void *op[N_CHANNELS], *rp[N_CHANNELS];
+	float *in = (float *)temp_in;
+	uint32_t i;
+
+	spa_zero(conv);
+	conv.method = method;
+	conv.noise_bits = noise;
+	conv.src_fmt = SPA_AUDIO_FORMAT_F32P;
+	conv.dst_fmt = fmt;
+	conv.n_channels = N_CHANNELS;
+	conv.rate = 44100;
+	ref = conv;
+	conv.cpu_flags = flags;
+	spa_assert_se(convert_init(&conv) == 0);
+	spa_assert_se(convert_init(&ref) == 0);
+	fprintf(stderr, "test noise %s against %s:\n", conv.func_name, ref.func_name);
+
+	/* the noise generator of both is the C version, start it from
+	 * the same state */
+	memcpy(conv.random, ref.random, RANDOM_SIZE * sizeof(uint32_t));
+	memcpy(conv.prev, ref.prev, RANDOM_SIZE * sizeof(int32_t));
+
+	srand(0);
+	for (i = 0; i < N_SAMPLES * N_CHANNELS; i++)
+		in[i] = (rand() / (float)RAND_MAX) * 2.2f - 1.1f;
+	for (i = 0; i < N_CHANNELS; i++) {
+		ip[i] = &in[i * N_SAMPLES];
+		op[i] = &temp_out[i * N_SAMPLES * size];
+		rp[i] = &temp_ref[i * N_SAMPLES * size];
+	}
+
+	/* twice to also use the noise state of the previous run */
+	for (i = 0; i < 2; i++) {
+		convert_process(&conv, op, ip, N_SAMPLES);
+		convert_process(&ref, rp, ip, N_SAMPLES);
+		compare_mem(i, 0, temp_out, temp_ref, N_SAMPLES * N_CHANNELS * size);
+	}
+	convert_free(&conv);
+	convert_free(&ref);
+}
+
 static void test_noise(void)
 {
 	run_test_noise(SPA_AUDIO_FORMAT_S8, 1, 0);
@@ -851,8 +1113,190 @@ static void test_noise(void)
 	run_test_noise(SPA_AUDIO_FORMAT_S16, 2, 0);
 	run_test_noise(SPA_AUDIO_FORMAT_S24, 1, 0);
 	run_test_noise(SPA_AUDIO_FORMAT_S24, 2, 0);
+	run_test_noise(SPA_AUDIO_FORMAT_S24_OE, 1, 0);
+	run_test_noise(SPA_AUDIO_FORMAT_S24_OE, 2, 0);
+#if defined(HAVE_SSSE3)
+	if (cpu_flags & SPA_CPU_FLAG_SSSE3) {
+		run_test_noise(SPA_AUDIO_FORMAT_S24, 1, SPA_CPU_FLAG_SSSE3);
+		run_test_noise(SPA_AUDIO_FORMAT_S24_OE, 1, SPA_CPU_FLAG_SSSE3);
+		run_test_noise_ref(SPA_AUDIO_FORMAT_S24, DITHER_METHOD_NONE, 2, 3,
+				SPA_CPU_FLAG_SSSE3);
+		run_test_noise_ref(SPA_AUDIO_FORMAT_S24_OE, DITHER_METHOD_NONE, 2, 3,
+				SPA_CPU_FLAG_SSSE3);
+	}
+#endif
 	run_test_noise(SPA_AUDIO_FORMAT_S32, 1, 0);
 	run_test_noise(SPA_AUDIO_FORMAT_S32, 2, 0);
+#if defined(HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		static const struct {
+			uint32_t fmt;
+			uint32_t size;
+		} formats[] = {
+			{ SPA_AUDIO_FORMAT_U8, 1 },
+			{ SPA_AUDIO_FORMAT_U8P, 1 },
+			{ SPA_AUDIO_FORMAT_S8, 1 },
+			{ SPA_AUDIO_FORMAT_S8P, 1 },
+			{ SPA_AUDIO_FORMAT_S16, 2 },
+			{ SPA_AUDIO_FORMAT_S16P, 2 },
+			{ SPA_AUDIO_FORMAT_S16_OE, 2 },
+			{ SPA_AUDIO_FORMAT_S24, 3 },
+			{ SPA_AUDIO_FORMAT_S24P, 3 },
+			{ SPA_AUDIO_FORMAT_S24_OE, 3 },
+			{ SPA_AUDIO_FORMAT_S24_32, 4 },
+			{ SPA_AUDIO_FORMAT_S24_32P, 4 },
+			{ SPA_AUDIO_FORMAT_S24_32_OE, 4 },
+			{ SPA_AUDIO_FORMAT_S32, 4 },
+			{ SPA_AUDIO_FORMAT_S32P, 4 },
+			{ SPA_AUDIO_FORMAT_S32_OE, 4 },
+		};
+		SPA_FOR_EACH_ELEMENT_VAR(formats, f) {
+			run_test_noise_ref(f->fmt, DITHER_METHOD_NONE, 2, f->size,
+					SPA_CPU_FLAG_AVX2);
+			run_test_noise_ref(f->fmt, DITHER_METHOD_TRIANGULAR, 0, f->size,
+					SPA_CPU_FLAG_AVX2);
+		}
+	}
+#endif
+}
+
+/* the error feedback of the shapers, the SIMD versions add the error of
+ * the previous sample last. fmt-ops-c.c is built with -Ofast so the C
+ * shapers are free to add up the error terms in any order and can't be
+ * used as reference for the exact output. */
+static int32_t shaper_ref(struct convert *conv, struct shaper *sh,
+		float v, float noise, float min, float max)
+{
+	uint32_t n;
+	int32_t t;
+
+	for (n = 1; n < conv->n_ns; n++)
+		v += sh->e[sh->idx + n] * conv->ns[n];
+	v += sh->e[sh->idx] * conv->ns[0];
+	t = (int32_t)lrintf(SPA_CLAMPF(v + noise, min, max));
+	sh->idx = (sh->idx - 1) & NS_MASK;
+	sh->e[sh->idx] = sh->e[sh->idx + NS_MAX] = v - t;
+	return t;
+}
+
+static void run_test_shaped_ref(uint32_t fmt, uint32_t method, uint32_t flags)
+{
+	struct convert conv;
+	struct shaper sh[N_CHANNELS];
+	const void *ip[N_CHANNELS];
+	void *op[N_CHANNELS];
+	float *in = (float *)temp_in, scale, offs = 0.0f, min, max;
+	uint32_t i, j, k, idx, size;
+	bool planar = false;
+	int32_t t, v;
+
+	switch (fmt) {
+	case SPA_AUDIO_FORMAT_U8P:
+		planar = true;
+		SPA_FALLTHROUGH;
+	case SPA_AUDIO_FORMAT_U8:
+		scale = U8_SCALE, offs = U8_OFFS, min = U8_MIN, max = U8_MAX, size = 1;
+		break;
+	case SPA_AUDIO_FORMAT_S8P:
+		planar = true;
+		SPA_FALLTHROUGH;
+	case SPA_AUDIO_FORMAT_S8:
+		scale = S8_SCALE, min = S8_MIN, max = S8_MAX, size = 1;
+		break;
+	case SPA_AUDIO_FORMAT_S16P:
+		planar = true;
+		SPA_FALLTHROUGH;
+	case SPA_AUDIO_FORMAT_S16:
+	case SPA_AUDIO_FORMAT_S16_OE:
+		scale = S16_SCALE, min = S16_MIN, max = S16_MAX, size = 2;
+		break;
+	default:
+		spa_assert_not_reached();
+	}
+
+	spa_zero(conv);
+	conv.method = method;
+	conv.src_fmt = SPA_AUDIO_FORMAT_F32P;
+	conv.dst_fmt = fmt;
+	conv.n_channels = N_CHANNELS;
+	conv.rate = 44100;
+	conv.cpu_flags = flags;
+	spa_assert_se(convert_init(&conv) == 0);
+	spa_assert_se(conv.n_ns > 0);
+	spa_assert_se(conv.noise_size >= N_SAMPLES);
+	fprintf(stderr, "test shaped %s:\n", conv.func_name);
+
+	srand(0);
+	for (i = 0; i < N_SAMPLES * N_CHANNELS; i++)
+		in[i] = (rand() / (float)RAND_MAX) * 2.2f - 1.1f;
+	for (i = 0; i < N_CHANNELS; i++) {
+		ip[i] = &in[i * N_SAMPLES];
+		op[i] = &temp_out[i * N_SAMPLES * size];
+	}
+
+	/* twice to also use the shaper state of the previous run */
+	for (k = 0; k < 2; k++) {
+		memcpy(sh, conv.shaper, sizeof(sh));
+		convert_process(&conv, op, ip, N_SAMPLES);
+
+		for (i = 0; i < N_CHANNELS; i++) {
+			for (j = 0; j < N_SAMPLES; j++) {
+				t = shaper_ref(&conv, &sh[i],
+						in[i * N_SAMPLES + j] * scale + offs,
+						conv.noise[j], min, max);
+				idx = planar ? i * N_SAMPLES + j : j * N_CHANNELS + i;
+				switch (fmt) {
+				case SPA_AUDIO_FORMAT_U8:
+				case SPA_AUDIO_FORMAT_U8P:
+					v = ((uint8_t *)temp_out)[idx];
+					break;
+				case SPA_AUDIO_FORMAT_S8:
+				case SPA_AUDIO_FORMAT_S8P:
+					v = ((int8_t *)temp_out)[idx];
+					break;
+				case SPA_AUDIO_FORMAT_S16_OE:
+					v = (int16_t)bswap_16(((uint16_t *)temp_out)[idx]);
+					break;
+				default:
+					v = ((int16_t *)temp_out)[idx];
+					break;
+				}
+				if (v != t)
+					fprintf(stderr, "%d %d %d: %d != %d\n", k, i, j, v, t);
+				spa_assert_se(v == t);
+			}
+		}
+		for (i = 0; i < N_CHANNELS; i++) {
+			for (j = 0; j < conv.n_ns; j++)
+				spa_assert_se(sh[i].e[sh[i].idx + j] ==
+						conv.shaper[i].e[conv.shaper[i].idx + j]);
+		}
+	}
+	convert_free(&conv);
+}
+
+static void test_shaped(void)
+{
+	static const uint32_t formats[] = {
+		SPA_AUDIO_FORMAT_U8,
+		SPA_AUDIO_FORMAT_U8P,
+		SPA_AUDIO_FORMAT_S8,
+		SPA_AUDIO_FORMAT_S8P,
+		SPA_AUDIO_FORMAT_S16,
+		SPA_AUDIO_FORMAT_S16P,
+		SPA_AUDIO_FORMAT_S16_OE,
+	};
+
+#if defined(HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		SPA_FOR_EACH_ELEMENT_VAR(formats, f) {
+			run_test_shaped_ref(*f, DITHER_METHOD_WANNAMAKER_3,
+					SPA_CPU_FLAG_AVX2);
+			run_test_shaped_ref(*f, DITHER_METHOD_LIPSHITZ,
+					SPA_CPU_FLAG_AVX2);
+		}
+	}
+#endif
 }
 
 int main(int argc, char *argv[])
@@ -876,12 +1320,18 @@ int main(int argc, char *argv[])
 	test_u24_f32();
 	test_f32_s24();
 	test_s24_f32();
+	test_f32_s24s();
+	test_s24s_f32();
+	test_s24_ref();
 	test_f32_u24_32();
 	test_u24_32_f32();
 	test_f32_s24_32();
 	test_s24_32_f32();
 	test_f32_f64();
 	test_f64_f32();
+	test_f32_law();
+	test_law_f32();
+	test_law_ref();
 
 	test_lossless_s8();
 	test_lossless_u8();
@@ -900,6 +1350,7 @@ int main(int argc, char *argv[])
 	test_swaps();
 
 	test_noise();
+	test_shaped();
 
 	return 0;
 }
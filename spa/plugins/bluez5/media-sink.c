@@ -5,6 +5,8 @@
 #include <unistd.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
 
@@ -12,11 +14,14 @@
 #include <spa/support/loop.h>
 #include <spa/support/log.h>
 #include <spa/support/system.h>
+#include <spa/support/thread.h>
 #include <spa/utils/list.h>
 #include <spa/utils/keys.h>
 #include <spa/utils/names.h>
 #include <spa/utils/result.h>
 #include <spa/utils/string.h>
+#include <spa/utils/atomic.h>
+#include <spa/utils/ringbuffer.h>
 #include <spa/monitor/device.h>
 
 #include <spa/node/node.h>
@@ -121,6 +126,56 @@ struct spa_bt_asha {
 	unsigned int set_timer:1;
 };
 
+#define ENCODE_PACKETS		16
+#define ENCODE_PACKETS_MASK	(ENCODE_PACKETS - 1)
+#define ENCODE_PACKET_SIZE	8192
+#define ENCODE_PCM_QUANTA	4
+#define ENCODE_REPORT_PERIOD	(5 * SPA_NSEC_PER_SEC)
+
+struct encode_packet {
+	uint32_t size;
+	uint32_t frames;
+	unsigned int fragment:1;
+	uint8_t data[ENCODE_PACKET_SIZE];
+};
+
+/* Encoder running on a separate thread. The data loop writes raw audio into
+ * the pcm ringbuffer and sends complete packets from the packet ringbuffer on
+ * the flush timer. The worker owns the packet assembly state of the impl
+ * (buffer, tmp_buffer, block_count, seqnum, ...) while running. */
+struct spa_bt_encode_thread {
+	struct impl *impl;
+	struct spa_thread *thread;
+	sem_t sem;
+	int running;
+
+	struct spa_source source;
+	int eventfd;
+
+	struct spa_ringbuffer pcm;
+	uint8_t *pcm_data;
+	uint32_t pcm_size;
+
+	struct spa_ringbuffer packets;
+	struct encode_packet packet[ENCODE_PACKETS];
+
+	/* codec adjustments requested by the data loop, applied by the worker */
+	int abr_unsent;
+	int bitpool_adjust;
+
+	/* data loop */
+	uint64_t frames_in;
+	uint64_t frames_sent;
+	unsigned int wait_packet:1;
+
+	/* worker */
+	uint64_t stat_time;
+	uint64_t stat_max;
+	uint64_t stat_frames;
+	uint32_t stat_packets;
+	uint64_t stat_start;
+};
+
 struct impl {
 	struct spa_handle handle;
 	struct spa_node node;
@@ -129,6 +184,7 @@ struct impl {
 	struct spa_loop *data_loop;
 	struct spa_system *data_system;
 	struct spa_loop_utils *loop_utils;
+	struct spa_thread_utils *thread_utils;
 
 	struct spa_hook_list hooks;
 	struct spa_callbacks callbacks;
@@ -160,6 +216,7 @@ struct impl {
 	unsigned int is_duplex:1;
 	unsigned int is_internal:1;
 	unsigned int iso_debug_mono:1;
+	unsigned int encode_thread:1;
 
 	struct spa_source source;
 	int timerfd;
@@ -187,6 +244,9 @@ struct impl {
 	uint32_t encoder_delay;
 
 	const struct media_codec *codec;
+	/* codec_props are changed from the main thread and applied when a
+	 * packet is started, which can be on the encoder thread */
+	pthread_mutex_t codec_props_lock;
 	bool codec_props_changed;
 	void *codec_props;
 	void *codec_data;
@@ -212,6 +272,8 @@ struct impl {
 	struct spa_bt_asha *asha;
 	struct spa_list asha_link;
 
+	struct spa_bt_encode_thread *encode;
+
 	struct spa_bt_latency tx_latency;
 };
 
@@ -571,9 +633,11 @@ static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 		int res, codec_res = 0;
 		res = apply_props(this, param);
 		if (this->codec_props && this->codec->set_props) {
+			pthread_mutex_lock(&this->codec_props_lock);
 			codec_res = this->codec->set_props(this->codec_props, param);
 			if (codec_res > 0)
-				this->codec_props_changed = true;
+				SPA_ATOMIC_STORE(this->codec_props_changed, true);
+			pthread_mutex_unlock(&this->codec_props_lock);
 		}
 		if (res > 0 || codec_res > 0) {
 			this->info.change_mask |= SPA_NODE_CHANGE_MASK_PARAMS;
@@ -608,9 +672,14 @@ static uint32_t get_queued_frames(struct impl *this)
 
 	bytes += this->silence_frames * this->block_size;
 
-	/* Count (partially) encoded packet */
-	bytes += this->tmp_buffer_used;
-	bytes += this->block_count * this->block_size;
+	if (this->encode) {
+		/* Count everything handed to the encoder thread and not sent yet */
+		bytes += (this->encode->frames_in - this->encode->frames_sent) * port->frame_size;
+	} else {
+		/* Count (partially) encoded packet */
+		bytes += this->tmp_buffer_used;
+		bytes += this->block_count * this->block_size;
+	}
 
 	return bytes / port->frame_size;
 }
@@ -659,13 +728,24 @@ static uint64_t get_reference_time(struct impl *this, uint64_t *duration_ns_ret)
 	return this->process_time + t;
 }
 
+static void update_codec_props(struct impl *this)
+{
+	if (!SPA_ATOMIC_LOAD(this->codec_props_changed) || this->codec_props == NULL
+			|| this->codec->update_props == NULL)
+		return;
+
+	/* don't block the data loop or the encoder thread on set_param,
+	 * the update is retried when the next packet is started */
+	if (pthread_mutex_trylock(&this->codec_props_lock) != 0)
+		return;
+	this->codec->update_props(this->codec_data, this->codec_props);
+	SPA_ATOMIC_STORE(this->codec_props_changed, false);
+	pthread_mutex_unlock(&this->codec_props_lock);
+}
+
 static int reset_buffer(struct impl *this)
 {
-	if (this->codec_props_changed && this->codec_props
-			&& this->codec->update_props) {
-		this->codec->update_props(this->codec_data, this->codec_props);
-		this->codec_props_changed = false;
-	}
+	update_codec_props(this);
 	this->need_flush = 0;
 	this->block_count = 0;
 	this->fragment = false;
@@ -729,10 +809,22 @@ static int get_transport_unsent_size(struct impl *this)
 	return value;
 }
 
+static int send_data(struct impl *this, const void *data, uint32_t size)
+{
+	struct timespec ts_pre;
+
+	spa_system_clock_gettime(this->data_system, CLOCK_REALTIME, &ts_pre);
+
+	if (this->codec->kind == MEDIA_CODEC_HFP)
+		return spa_bt_sco_io_write(this->transport->sco_io, data, size);
+
+	return spa_bt_send(this->flush_source.fd, data, size,
+			&this->tx_latency, SPA_TIMESPEC_TO_NSEC(&ts_pre));
+}
+
 static int send_buffer(struct impl *this)
 {
 	int written, unsent;
-	struct timespec ts_pre;
 
 	if (this->codec->abr_process) {
 		unsent = get_transport_unsent_size(this);
@@ -740,14 +832,7 @@ static int send_buffer(struct impl *this)
 			this->codec->abr_process(this->codec_data, unsent);
 	}
 
-	spa_system_clock_gettime(this->data_system, CLOCK_REALTIME, &ts_pre);
-
-	if (this->codec->kind == MEDIA_CODEC_HFP) {
-		written = spa_bt_sco_io_write(this->transport->sco_io, this->buffer, this->buffer_used);
-	} else {
-		written = spa_bt_send(this->flush_source.fd, this->buffer, this->buffer_used,
-				&this->tx_latency, SPA_TIMESPEC_TO_NSEC(&ts_pre));
-	}
+	written = send_data(this, this->buffer, this->buffer_used);
 
 	if (SPA_UNLIKELY(spa_log_level_topic_enabled(this->log, SPA_LOG_TOPIC_DEFAULT, SPA_LOG_LEVEL_TRACE))) {
 		struct timespec ts;
@@ -901,6 +986,342 @@ static void enable_flush_timer(struct impl *this, bool enabled)
 	this->flush_pending = enabled;
 }
 
+static uint64_t get_monotonic_time(struct impl *this)
+{
+	struct timespec ts;
+	spa_system_clock_gettime(this->data_system, CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void encode_thread_report(struct impl *this, struct spa_bt_encode_thread *enc, uint64_t now)
+{
+	uint32_t rate = this->port.current_format.info.raw.rate;
+	double load;
+
+	if (enc->stat_start == 0) {
+		enc->stat_start = now;
+		return;
+	}
+	if (now - enc->stat_start < ENCODE_REPORT_PERIOD)
+		return;
+
+	if (enc->stat_packets > 0 && enc->stat_frames > 0 && rate > 0) {
+		load = (double)enc->stat_time * rate / ((double)enc->stat_frames * SPA_NSEC_PER_SEC);
+		spa_log_debug(this->log, "%p: encoder packets:%u avg:%.3f ms max:%.3f ms load:%.1f%%",
+				this, enc->stat_packets,
+				(double)enc->stat_time / enc->stat_packets / SPA_NSEC_PER_MSEC,
+				(double)enc->stat_max / SPA_NSEC_PER_MSEC, load * 100.0);
+	}
+	enc->stat_time = 0;
+	enc->stat_max = 0;
+	enc->stat_frames = 0;
+	enc->stat_packets = 0;
+	enc->stat_start = now;
+}
+
+static void encode_thread_adjust(struct impl *this, struct spa_bt_encode_thread *enc)
+{
+	int unsent, adjust, res = 0;
+
+	unsent = SPA_ATOMIC_XCHG(enc->abr_unsent, -1);
+	if (unsent >= 0 && this->codec->abr_process)
+		this->codec->abr_process(this->codec_data, unsent);
+
+	adjust = SPA_ATOMIC_XCHG(enc->bitpool_adjust, 0);
+	if (adjust < 0 && this->codec->reduce_bitpool) {
+		res = this->codec->reduce_bitpool(this->codec_data);
+		spa_log_debug(this->log, "%p: reduce bitpool: %i", this, res);
+	} else if (adjust > 0 && this->codec->increase_bitpool) {
+		res = this->codec->increase_bitpool(this->codec_data);
+		spa_log_debug(this->log, "%p: increase bitpool: %i", this, res);
+	}
+}
+
+/* Called from the encoder thread: encode as many packets as the queued audio
+ * and the free packet slots allow. */
+static void encode_thread_process(struct impl *this, struct spa_bt_encode_thread *enc)
+{
+	struct port *port = &this->port;
+	bool produced = false;
+
+	while (SPA_ATOMIC_LOAD(enc->running)) {
+		struct encode_packet *pkt;
+		uint32_t pindex, index, offs, avail, l0;
+		int32_t filled;
+		uint64_t t0, dt;
+		int written;
+		bool fragment;
+
+		filled = spa_ringbuffer_get_write_index(&enc->packets, &pindex);
+		if (filled >= ENCODE_PACKETS)
+			break;
+
+		encode_thread_adjust(this, enc);
+
+		t0 = get_monotonic_time(this);
+
+		if (this->fragment && !this->need_flush) {
+			this->fragment = false;
+			if (encode_fragment(this) < 0) {
+				spa_log_warn(this->log, "%p: fragment encode failed", this);
+				reset_buffer(this);
+				continue;
+			}
+		}
+
+		if (!this->need_flush) {
+			filled = spa_ringbuffer_get_read_index(&enc->pcm, &index);
+			if (filled <= 0)
+				break;
+
+			avail = filled;
+			offs = index % enc->pcm_size;
+			l0 = SPA_MIN(avail, enc->pcm_size - offs);
+
+			written = add_data(this, enc->pcm_data + offs, l0);
+			if (written == (int)l0 && avail > l0) {
+				int res = add_data(this, enc->pcm_data, avail - l0);
+				if (res > 0)
+					written += res;
+			}
+			if (written < 0) {
+				spa_log_warn(this->log, "%p: encode error %s, drop %u bytes",
+						this, spa_strerror(written), avail);
+				written = avail;
+				reset_buffer(this);
+			}
+			spa_ringbuffer_read_update(&enc->pcm, index + written);
+		}
+
+		dt = get_monotonic_time(this) - t0;
+		enc->stat_time += dt;
+		enc->stat_max = SPA_MAX(enc->stat_max, dt);
+
+		if (!this->need_flush)
+			break;
+
+		pkt = &enc->packet[pindex & ENCODE_PACKETS_MASK];
+		pkt->size = SPA_MIN(this->buffer_used, sizeof(pkt->data));
+		pkt->frames = this->block_count * this->block_size / port->frame_size;
+		pkt->fragment = this->need_flush == NEED_FLUSH_FRAGMENT;
+		memcpy(pkt->data, this->buffer, pkt->size);
+
+		spa_ringbuffer_write_update(&enc->packets, pindex + 1);
+
+		enc->stat_frames += pkt->frames;
+		enc->stat_packets++;
+
+		fragment = pkt->fragment;
+		reset_buffer(this);
+		this->fragment = fragment;
+		produced = true;
+	}
+
+	if (produced) {
+		spa_system_eventfd_write(this->data_system, enc->eventfd, 1);
+		if (SPA_UNLIKELY(spa_log_level_topic_enabled(this->log, SPA_LOG_TOPIC_DEFAULT, SPA_LOG_LEVEL_DEBUG)))
+			encode_thread_report(this, enc, get_monotonic_time(this));
+	}
+}
+
+static void *encode_thread_func(void *data)
+{
+	struct spa_bt_encode_thread *enc = data;
+	struct impl *this = enc->impl;
+
+	spa_log_debug(this->log, "%p: encoder thread started", this);
+
+	while (true) {
+		sem_wait(&enc->sem);
+		if (!SPA_ATOMIC_LOAD(enc->running))
+			break;
+		encode_thread_process(this, enc);
+	}
+
+	spa_log_debug(this->log, "%p: encoder thread stopped", this);
+	return NULL;
+}
+
+/* Called from the data loop: move the ready input buffers and silence into
+ * the pcm ringbuffer of the encoder thread. */
+static void encode_queue_data(struct impl *this)
+{
+	struct spa_bt_encode_thread *enc = this->encode;
+	struct port *port = &this->port;
+	uint32_t index, avail, total = 0;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&enc->pcm, &index);
+	avail = enc->pcm_size - SPA_CLAMP(filled, 0, (int32_t)enc->pcm_size);
+	avail -= avail % port->frame_size;
+
+	while (this->silence_frames && avail > 0) {
+		uint32_t n_bytes, offs, l0;
+
+		n_bytes = SPA_MIN(this->silence_frames * port->frame_size, avail);
+		offs = index % enc->pcm_size;
+		l0 = SPA_MIN(n_bytes, enc->pcm_size - offs);
+
+		memset(enc->pcm_data + offs, 0, l0);
+		memset(enc->pcm_data, 0, n_bytes - l0);
+
+		this->silence_frames -= n_bytes / port->frame_size;
+		index += n_bytes;
+		avail -= n_bytes;
+		total += n_bytes;
+	}
+
+	while (!spa_list_is_empty(&port->ready) && avail > 0) {
+		struct buffer *b;
+		struct spa_data *d;
+		uint32_t n_bytes, offs, l0, l1;
+		uint8_t *src;
+
+		b = spa_list_first(&port->ready, struct buffer, link);
+		d = b->buf->datas;
+		src = d[0].data;
+
+		n_bytes = d[0].chunk->size - port->ready_offset;
+		n_bytes -= n_bytes % port->frame_size;
+		n_bytes = SPA_MIN(n_bytes, avail);
+
+		offs = (d[0].chunk->offset + port->ready_offset) % d[0].maxsize;
+		l0 = SPA_MIN(n_bytes, d[0].maxsize - offs);
+		l1 = n_bytes - l0;
+
+		spa_ringbuffer_write_data(&enc->pcm, enc->pcm_data, enc->pcm_size,
+				index % enc->pcm_size, src + offs, l0);
+		if (l1 > 0)
+			spa_ringbuffer_write_data(&enc->pcm, enc->pcm_data, enc->pcm_size,
+					(index + l0) % enc->pcm_size, src, l1);
+
+		index += n_bytes;
+		avail -= n_bytes;
+		total += n_bytes;
+		port->ready_offset += n_bytes;
+
+		if (port->ready_offset + port->frame_size > d[0].chunk->size) {
+			spa_list_remove(&b->link);
+			SPA_FLAG_SET(b->flags, BUFFER_FLAG_OUT);
+			spa_log_trace(this->log, "%p: reuse buffer %u", this, b->id);
+			this->port.io->buffer_id = b->id;
+
+			spa_node_call_reuse_buffer(&this->callbacks, 0, b->id);
+			port->ready_offset = 0;
+		}
+	}
+
+	if (total == 0)
+		return;
+
+	spa_ringbuffer_write_update(&enc->pcm, index);
+	enc->frames_in += total / port->frame_size;
+
+	spa_log_trace(this->log, "%p: queued %u frames for encoding", this,
+			total / port->frame_size);
+
+	sem_post(&enc->sem);
+}
+
+/* Called from the data loop: send the next packet prepared by the encoder
+ * thread and schedule the flush timer for the one after it. */
+static int flush_encoded(struct impl *this, uint64_t now_time)
+{
+	struct spa_bt_encode_thread *enc = this->encode;
+	struct port *port = &this->port;
+	struct encode_packet *pkt;
+	uint32_t pindex;
+	int32_t filled;
+	int written, unsent_buffer;
+	uint64_t packet_time;
+
+	encode_queue_data(this);
+
+again:
+	if (this->flush_pending) {
+		spa_log_trace(this->log, "%p: wait for flush timer", this);
+		return 0;
+	}
+
+	filled = spa_ringbuffer_get_read_index(&enc->packets, &pindex);
+	if (filled <= 0) {
+		/* Flushed again when the encoder thread has a packet ready */
+		spa_log_trace(this->log, "%p: wait for encoder", this);
+		enc->wait_packet = true;
+		enable_flush_timer(this, false);
+		return 0;
+	}
+	enc->wait_packet = false;
+
+	pkt = &enc->packet[pindex & ENCODE_PACKETS_MASK];
+
+	unsent_buffer = get_transport_unsent_size(this);
+	if (this->codec->abr_process && unsent_buffer >= 0)
+		SPA_ATOMIC_STORE(enc->abr_unsent, unsent_buffer);
+
+	written = send_data(this, pkt->data, pkt->size);
+
+	spa_log_trace(this->log, "%p: send encoded size:%u frames:%u wrote:%d",
+			this, pkt->size, pkt->frames, written);
+
+	if (written == -EAGAIN) {
+		spa_log_trace(this->log, "%p: fail flush", this);
+		if (now_time - this->last_error > SPA_NSEC_PER_SEC / 2) {
+			SPA_ATOMIC_STORE(enc->bitpool_adjust, -1);
+			this->last_error = now_time;
+		}
+		/* Socket buffer is full, skip this packet */
+		written = pkt->size;
+	}
+
+	packet_time = (uint64_t)pkt->frames * SPA_NSEC_PER_SEC
+		/ port->current_format.info.raw.rate;
+
+	if (written >= 0) {
+		if (SPA_LIKELY(this->position)) {
+			uint64_t duration_ns;
+
+			/* Same scheduling as flush_data(): flush at the time position
+			 * of the next buffered sample, delayed by one packet. */
+			this->next_flush_time = get_reference_time(this, &duration_ns)
+				+ packet_time;
+			this->next_flush_time += SPA_MIN(packet_time,
+					duration_ns * (SPA_MAX(port->n_buffers, 2u) - 2));
+		} else {
+			if (this->next_flush_time == 0)
+				this->next_flush_time = this->process_time;
+			this->next_flush_time += packet_time;
+		}
+	}
+
+	enc->frames_sent += pkt->frames;
+	spa_ringbuffer_read_update(&enc->packets, pindex + 1);
+	sem_post(&enc->sem);
+
+	if (written < 0) {
+		spa_log_trace(this->log, "%p: error flushing %s", this,
+				spa_strerror(written));
+		enable_flush_timer(this, false);
+		return written;
+	}
+
+	update_packet_delay(this, packet_time);
+
+	if (pkt->fragment)
+		goto again;
+
+	if (now_time - this->last_error > SPA_NSEC_PER_SEC) {
+		if (unsent_buffer == 0)
+			SPA_ATOMIC_STORE(enc->bitpool_adjust, 1);
+		this->last_error = now_time;
+	}
+
+	spa_log_trace(this->log, "%p: flush at:%"PRIu64" process:%"PRIu64, this,
+			this->next_flush_time, this->process_time);
+	enable_flush_timer(this, true);
+	return 0;
+}
+
 static int flush_data(struct impl *this, uint64_t now_time)
 {
 	struct port *port = &this->port;
@@ -923,6 +1344,9 @@ static int flush_data(struct impl *this, uint64_t now_time)
 	if (this->transport->iso_io && !this->iso_pending)
 		return 0;
 
+	if (this->encode)
+		return flush_encoded(this, now_time);
+
 	total_frames = 0;
 again:
 	written = 0;
@@ -1511,6 +1935,99 @@ static void media_asha_cb(struct spa_source *source)
 	}
 }
 
+static void media_on_encoded(struct spa_source *source)
+{
+	struct impl *this = source->data;
+	uint64_t count;
+
+	if (spa_system_eventfd_read(this->data_system, source->fd, &count) < 0)
+		return;
+
+	if (this->transport_started && this->encode && this->encode->wait_packet)
+		flush_data(this, this->current_time);
+}
+
+static void encode_thread_free(struct impl *this, struct spa_bt_encode_thread *enc)
+{
+	if (SPA_ATOMIC_LOAD(enc->running)) {
+		SPA_ATOMIC_STORE(enc->running, 0);
+		sem_post(&enc->sem);
+		spa_thread_utils_join(this->thread_utils, enc->thread, NULL);
+	}
+	sem_destroy(&enc->sem);
+	if (enc->eventfd >= 0)
+		spa_system_close(this->data_system, enc->eventfd);
+	free(enc->pcm_data);
+	free(enc);
+}
+
+static struct spa_bt_encode_thread *encode_thread_new(struct impl *this)
+{
+	struct spa_bt_encode_thread *enc;
+	struct port *port = &this->port;
+	struct spa_dict_item items[1];
+	int res;
+
+	if (this->thread_utils == NULL) {
+		errno = ENOTSUP;
+		return NULL;
+	}
+	if (this->transport->write_mtu > ENCODE_PACKET_SIZE) {
+		spa_log_warn(this->log, "%p: MTU %u too large for encoder thread",
+				this, this->transport->write_mtu);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	enc = calloc(1, sizeof(*enc));
+	if (enc == NULL)
+		return NULL;
+
+	enc->impl = this;
+	enc->eventfd = -1;
+	enc->abr_unsent = -1;
+	sem_init(&enc->sem, 0, 0);
+
+	enc->pcm_size = this->quantum_limit * port->frame_size * ENCODE_PCM_QUANTA;
+	enc->pcm_data = calloc(1, enc->pcm_size);
+	if (enc->pcm_data == NULL) {
+		res = -errno;
+		goto error;
+	}
+	spa_ringbuffer_init(&enc->pcm);
+	spa_ringbuffer_init(&enc->packets);
+
+	if ((res = spa_system_eventfd_create(this->data_system,
+			SPA_FD_CLOEXEC | SPA_FD_NONBLOCK)) < 0)
+		goto error;
+	enc->eventfd = res;
+
+	enc->source.data = this;
+	enc->source.fd = enc->eventfd;
+	enc->source.func = media_on_encoded;
+	enc->source.mask = SPA_IO_IN;
+	enc->source.rmask = 0;
+
+	items[0] = SPA_DICT_ITEM_INIT(SPA_KEY_THREAD_NAME, "bluez5-encode");
+
+	enc->running = 1;
+	enc->thread = spa_thread_utils_create(this->thread_utils,
+			&SPA_DICT_INIT_ARRAY(items), encode_thread_func, enc);
+	if (enc->thread == NULL) {
+		enc->running = 0;
+		res = -errno;
+		goto error;
+	}
+	/* the packets must be ready when the data loop flushes */
+	spa_thread_utils_acquire_rt(this->thread_utils, enc->thread, -1);
+	return enc;
+
+error:
+	encode_thread_free(this, enc);
+	errno = -res;
+	return NULL;
+}
+
 static int do_start_transport(struct spa_loop *loop, bool async, uint32_t seq,
 		const void *data, size_t size, void *user_data)
 {
@@ -1570,7 +2087,7 @@ static int transport_start(struct impl *this)
 	} else {
 		this->own_codec_data = false;
 		this->codec_data = this->transport->iso_io->codec_data;
-		this->codec_props_changed = true;
+		SPA_ATOMIC_STORE(this->codec_props_changed, true);
 		this->transport->iso_io->debug_mono = this->iso_debug_mono;
 	}
 
@@ -1617,6 +2134,16 @@ static int transport_start(struct impl *this)
 
 	reset_buffer(this);
 
+	if (this->encode_thread && this->codec->kind == MEDIA_CODEC_A2DP &&
+			!this->transport->iso_io) {
+		this->encode = encode_thread_new(this);
+		if (this->encode == NULL)
+			spa_log_warn(this->log, "%p: can't start encoder thread, encoding "
+					"on data loop: %m", this);
+		else
+			spa_loop_add_source(this->data_loop, &this->encode->source);
+	}
+
 	spa_bt_rate_control_init(&port->ratectl, 0);
 
 	this->update_delay_event = spa_loop_utils_add_event(this->loop_utils, update_delay_event, this);
@@ -1685,6 +2212,12 @@ static int transport_start(struct impl *this)
 	return 0;
 
 fail:
+	if (this->encode) {
+		if (this->encode->source.loop)
+			spa_loop_remove_source(this->data_loop, &this->encode->source);
+		encode_thread_free(this, this->encode);
+		this->encode = NULL;
+	}
 	if (this->update_delay_event) {
 		spa_loop_utils_destroy_source(this->loop_utils, this->update_delay_event);
 		this->update_delay_event = NULL;
@@ -1778,6 +2311,11 @@ static int do_remove_transport_source(struct spa_loop *loop,
 
 	if (this->flush_timer_source.loop)
 		spa_loop_remove_source(this->data_loop, &this->flush_timer_source);
+	if (this->encode) {
+		if (this->encode->source.loop)
+			spa_loop_remove_source(this->data_loop, &this->encode->source);
+		this->encode = NULL;
+	}
 	if (this->codec->kind == MEDIA_CODEC_ASHA) {
 		if (this->asha->timer_source.loop)
 			spa_loop_remove_source(this->data_loop, &this->asha->timer_source);
@@ -1798,6 +2336,8 @@ static int do_remove_transport_source(struct spa_loop *loop,
 
 static void transport_stop(struct impl *this)
 {
+	struct spa_bt_encode_thread *encode = this->encode;
+
 	if (!this->transport_started)
 		return;
 
@@ -1805,6 +2345,10 @@ static void transport_stop(struct impl *this)
 
 	spa_loop_locked(this->data_loop, do_remove_transport_source, 0, NULL, 0, this);
 
+	/* Stop the encoder before the codec data goes away */
+	if (encode)
+		encode_thread_free(this, encode);
+
 	if (this->codec_data && this->own_codec_data)
 		this->codec->deinit(this->codec_data);
 	this->codec_data = NULL;
@@ -2525,6 +3069,7 @@ static int impl_clear(struct spa_handle *handle)
 	do_stop(this);
 	if (this->codec_props && this->codec->clear_props)
 		this->codec->clear_props(this->codec_props);
+	pthread_mutex_destroy(&this->codec_props_lock);
 	if (this->transport)
 		spa_hook_remove(&this->transport_listener);
 	if (this->timerfd > 0)
@@ -2566,10 +3111,13 @@ impl_init(const struct spa_handle_factory *factory,
 
 	this = (struct impl *) handle;
 
+	pthread_mutex_init(&this->codec_props_lock, NULL);
+
 	this->log = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Log);
 	this->data_loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_DataLoop);
 	this->data_system = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_DataSystem);
 	this->loop_utils = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_LoopUtils);
+	this->thread_utils = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_ThreadUtils);
 
 	spa_log_topic_init(this->log, &log_topic);
 
@@ -2638,6 +3186,9 @@ impl_init(const struct spa_handle_factory *factory,
 	if (info && (str = spa_dict_lookup(info, "bluez5.debug.iso-mono")) != NULL)
 		this->iso_debug_mono = spa_atob(str);
 
+	if (info && (str = spa_dict_lookup(info, "bluez5.encode-thread")) != NULL)
+		this->encode_thread = spa_atob(str);
+
 	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_BLUEZ5_TRANSPORT)))
 		sscanf(str, "pointer:%p", &this->transport);
 
@@ -77,6 +77,11 @@ struct spa_fga_descriptor {
 	void (*deactivate) (void *instance);
 
 	void (*run) (void *instance, unsigned long SampleCount);
+
+	/* optional, let instance also do the processing of next, an instance of
+	 * next_desc that is linked to the output of instance. next is not run
+	 * anymore after this. With NULL next, undo all fusing. */
+	int (*fuse) (void *instance, const struct spa_fga_descriptor *next_desc, void *next);
 };
 
 static inline void spa_fga_descriptor_free(const struct spa_fga_descriptor *desc)
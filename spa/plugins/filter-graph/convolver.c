@@ -6,6 +6,7 @@
 
 #include "convolver.h"
 
+#include <errno.h>
 #include <math.h>
 #include <pthread.h>
 #include <semaphore.h>
@@ -15,6 +16,7 @@
 
 struct ir {
 	float **segments;
+	float **active;
 	float *time_buffer[2];
 	float *precalc[2];
 };
@@ -34,11 +36,17 @@ struct partition {
 
 	int block_fill;
 	int n_ir;
+	int iroffset;
 	struct ir *ir;
 	int time_idx;
 	int precalc_idx;
 };
 
+struct convolver_spectrum {
+	int n_segments;
+	float *segments[];
+};
+
 struct convolver
 {
 	struct spa_fga_dsp *dsp;
@@ -52,6 +60,9 @@ struct convolver
 	struct partition *partition[16];
 	int n_partition;
 
+	int n_ir;
+	int ir_len;
+
 	bool threaded;
 	bool running;
 	pthread_t thread;
@@ -117,6 +128,19 @@ static void partition_free(struct spa_fga_dsp *dsp, struct partition *part)
 	free(part);
 }
 
+static void partition_transform(struct spa_fga_dsp *dsp, struct partition *part, float *tmp,
+		const struct convolver_ir *ir, int iroffset, int segment, float *freq)
+{
+	int offset = iroffset + (segment * part->block_size);
+	int copy = ir->ir ? SPA_CLAMP(ir->len - offset, 0, part->block_size) : 0;
+
+	if (copy > 0)
+		spa_fga_dsp_copy(dsp, tmp, &ir->ir[offset], copy);
+	spa_fga_dsp_fft_memclear(dsp, tmp + copy, part->time_size - copy, true);
+
+	spa_fga_dsp_fft_run(dsp, part->fft, 1, tmp, freq);
+}
+
 static struct partition *partition_new(struct convolver *conv, int block,
 		const struct convolver_ir ir[], int n_ir, int iroffset, int irlen)
 {
@@ -138,6 +162,7 @@ static struct partition *partition_new(struct convolver *conv, int block,
 	part->n_segments = (irlen + part->block_size-1) / part->block_size;
 	part->freq_size = (part->time_size / 2) + 1;
 	part->n_ir = n_ir;
+	part->iroffset = iroffset;
 
 	part->fft = spa_fga_dsp_fft_new(dsp, part->time_size, true);
 	if (part->fft == NULL)
@@ -168,18 +193,14 @@ static struct partition *partition_new(struct convolver *conv, int block,
 			goto error;
 
 		for (j = 0; j < part->n_segments; j++) {
-			int left = ir[i].len - iroffset - (j * part->block_size);
-			int copy = SPA_CLAMP(left, 0, part->block_size);
-
 			r->segments[j] = spa_fga_dsp_fft_memalloc(dsp, part->freq_size, false);
 			if (r->segments[j] == NULL)
 				goto error;
 
-			spa_fga_dsp_copy(dsp, r->time_buffer[0], &ir[i].ir[iroffset + (j * part->block_size)], copy);
-			spa_fga_dsp_fft_memclear(dsp, r->time_buffer[0] + copy, part->time_size - copy, true);
-
-		        spa_fga_dsp_fft_run(dsp, part->fft, 1, r->time_buffer[0], r->segments[j]);
+			partition_transform(dsp, part, r->time_buffer[0], &ir[i], iroffset, j,
+					r->segments[j]);
 		}
+		r->active = r->segments;
 	}
 	partition_reset(dsp, part);
 
@@ -206,7 +227,7 @@ static int partition_run(struct spa_fga_dsp *dsp, struct partition *part, const
 		spa_fga_dsp_fft_cmul(dsp, part->fft,
 				part->freq,
 				part->segments[current],
-				r->segments[0],
+				r->active[0],
 				part->freq_size);
 
 		for (j = 1; j < part->n_segments; j++) {
@@ -217,7 +238,7 @@ static int partition_run(struct spa_fga_dsp *dsp, struct partition *part, const
 					part->freq,
 					part->freq,
 					part->segments[current],
-					r->segments[j],
+					r->active[j],
 					part->freq_size);
 		}
 		spa_fga_dsp_fft_run(dsp, part->fft, -1, part->freq, r->time_buffer[idx]);
@@ -273,12 +294,11 @@ void convolver_reset(struct convolver *conv)
 	conv->delay_fill = 0;
 }
 
-struct convolver *convolver_new_many(struct spa_fga_dsp *dsp, int head_block, int tail_block,
-		const struct convolver_ir ir[], int n_ir)
+static struct convolver *convolver_create(struct spa_fga_dsp *dsp, int head_block, int tail_block,
+		const struct convolver_ir tmp[], int n_ir, int irlen)
 {
 	struct convolver *conv;
-	int i, irlen, head_ir_len, min_size, max_size, ir_consumed = 0;
-	struct convolver_ir tmp[n_ir];
+	int head_ir_len, min_size, max_size, ir_consumed = 0;
 
 	if (head_block == 0 || tail_block == 0)
 		return NULL;
@@ -292,17 +312,9 @@ struct convolver *convolver_new_many(struct spa_fga_dsp *dsp, int head_block, in
 	if (conv == NULL)
 		return NULL;
 
-	irlen = 0;
-	for (i = 0; i < n_ir; i++) {
-		int l = ir[i].len;
-		while (l > 0 && fabs(ir[i].ir[l-1]) < 0.000001f)
-			l--;
-		tmp[i].ir = ir[i].ir;
-		tmp[i].len = l;
-		irlen = SPA_MAX(irlen, l);
-	}
-
 	conv->dsp = dsp;
+	conv->n_ir = n_ir;
+	conv->ir_len = irlen;
 	conv->min_size = next_power_of_two(head_block);
 	conv->max_size = next_power_of_two(tail_block);
 
@@ -358,6 +370,37 @@ error:
 	return NULL;
 }
 
+struct convolver *convolver_new_many(struct spa_fga_dsp *dsp, int head_block, int tail_block,
+		const struct convolver_ir ir[], int n_ir)
+{
+	int i, irlen;
+	struct convolver_ir tmp[n_ir];
+
+	irlen = 0;
+	for (i = 0; i < n_ir; i++) {
+		int l = ir[i].len;
+		while (l > 0 && fabs(ir[i].ir[l-1]) < 0.000001f)
+			l--;
+		tmp[i].ir = ir[i].ir;
+		tmp[i].len = l;
+		irlen = SPA_MAX(irlen, l);
+	}
+	return convolver_create(dsp, head_block, tail_block, tmp, n_ir, irlen);
+}
+
+struct convolver *convolver_new_layout(struct spa_fga_dsp *dsp, int head_block, int tail_block,
+		int n_ir, int irlen)
+{
+	struct convolver_ir tmp[n_ir];
+	int i;
+
+	for (i = 0; i < n_ir; i++) {
+		tmp[i].ir = NULL;
+		tmp[i].len = 0;
+	}
+	return convolver_create(dsp, head_block, tail_block, tmp, n_ir, irlen);
+}
+
 struct convolver *convolver_new(struct spa_fga_dsp *dsp, int head_block, int tail_block, const float *ir, int irlen)
 {
 	const struct convolver_ir tmp = { ir, irlen };
@@ -433,6 +476,115 @@ int convolver_run_many(struct convolver *conv, const float *input, float *output
 	return processed;
 }
 
+struct convolver_spectrum *convolver_spectrum_new(struct convolver *conv)
+{
+	struct spa_fga_dsp *dsp = conv->dsp;
+	struct convolver_spectrum *spec;
+	int i, j, n = 0, n_segments = 0;
+
+	for (i = 0; i < conv->n_partition; i++)
+		n_segments += conv->partition[i]->n_segments * conv->n_ir;
+
+	spec = calloc(1, sizeof(*spec) + n_segments * sizeof(float*));
+	if (spec == NULL)
+		return NULL;
+
+	spec->n_segments = n_segments;
+	for (i = 0; i < conv->n_partition; i++) {
+		struct partition *part = conv->partition[i];
+
+		for (j = 0; j < part->n_segments * conv->n_ir; j++, n++) {
+			spec->segments[n] = spa_fga_dsp_fft_memalloc(dsp, part->freq_size, false);
+			if (spec->segments[n] == NULL)
+				goto error;
+			spa_fga_dsp_fft_memclear(dsp, spec->segments[n], part->freq_size, false);
+		}
+	}
+	return spec;
+error:
+	convolver_spectrum_free(conv, spec);
+	return NULL;
+}
+
+void convolver_spectrum_free(struct convolver *conv, struct convolver_spectrum *spec)
+{
+	int i;
+	for (i = 0; i < spec->n_segments; i++) {
+		if (spec->segments[i])
+			spa_fga_dsp_fft_memfree(conv->dsp, spec->segments[i]);
+	}
+	free(spec);
+}
+
+int convolver_spectrum_fill(struct convolver *conv, struct convolver_spectrum *spec,
+		const struct convolver_ir ir[], int n_ir)
+{
+	struct spa_fga_dsp *dsp = conv->dsp;
+	int i, j, k, n = 0;
+
+	if (n_ir != conv->n_ir)
+		return -EINVAL;
+
+	for (i = 0; i < conv->n_partition; i++) {
+		struct partition *part = conv->partition[i];
+		float *tmp;
+
+		/* don't touch the time buffers of the partition, they can be
+		 * in use by the data thread */
+		tmp = spa_fga_dsp_fft_memalloc(dsp, part->time_size, true);
+		if (tmp == NULL)
+			return -ENOMEM;
+
+		for (j = 0; j < n_ir; j++) {
+			for (k = 0; k < part->n_segments; k++)
+				partition_transform(dsp, part, tmp, &ir[j], part->iroffset, k,
+						spec->segments[n++]);
+		}
+		spa_fga_dsp_fft_memfree(dsp, tmp);
+	}
+	return 0;
+}
+
+void convolver_spectrum_mix(struct convolver *conv, struct convolver_spectrum *dst,
+		struct convolver_spectrum *src[], float weight[], int n_src)
+{
+	struct spa_fga_dsp *dsp = conv->dsp;
+	const float *s[n_src];
+	int i, j, k, n = 0;
+
+	for (i = 0; i < conv->n_partition; i++) {
+		struct partition *part = conv->partition[i];
+
+		for (j = 0; j < part->n_segments * conv->n_ir; j++, n++) {
+			for (k = 0; k < n_src; k++)
+				s[k] = src[k]->segments[n];
+			/* the spectrum is linear in the IR, so this is the same
+			 * as mixing the IRs in the time domain */
+			spa_fga_dsp_mix_gain(dsp, dst->segments[n], s, n_src,
+					weight, n_src, part->freq_size * 2);
+		}
+	}
+}
+
+void convolver_set_spectrum(struct convolver *conv, struct convolver_spectrum *spec)
+{
+	int i, j, n = 0;
+
+	for (i = 0; i < conv->n_partition; i++) {
+		struct partition *part = conv->partition[i];
+
+		for (j = 0; j < part->n_ir; j++) {
+			struct ir *r = &part->ir[j];
+			if (spec) {
+				r->active = &spec->segments[n];
+				n += part->n_segments;
+			} else {
+				r->active = r->segments;
+			}
+		}
+	}
+}
+
 int convolver_run(struct convolver *conv, const float *input, float *output, int length)
 {
 	float *tmp[1] = { output };
@@ -22,3 +22,23 @@ int convolver_run(struct convolver *conv, const float *input, float *output, int
 struct convolver *convolver_new_many(struct spa_fga_dsp *dsp, int block, int tail,
 		const struct convolver_ir *ir, int n_ir);
 int convolver_run_many(struct convolver *conv, const float *input, float **output, int length);
+
+/* A convolver with the partition layout for n_ir IRs of irlen samples but
+ * without filters. Use a spectrum to give it filters. */
+struct convolver *convolver_new_layout(struct spa_fga_dsp *dsp, int block, int tail,
+		int n_ir, int irlen);
+
+/* The frequency domain segments of a set of IRs, in the partition layout of
+ * a convolver. Spectra can be shared between convolvers with the same
+ * layout. */
+struct convolver_spectrum;
+
+struct convolver_spectrum *convolver_spectrum_new(struct convolver *conv);
+void convolver_spectrum_free(struct convolver *conv, struct convolver_spectrum *spec);
+int convolver_spectrum_fill(struct convolver *conv, struct convolver_spectrum *spec,
+		const struct convolver_ir *ir, int n_ir);
+void convolver_spectrum_mix(struct convolver *conv, struct convolver_spectrum *dst,
+		struct convolver_spectrum *src[], float weight[], int n_src);
+/* use spec for the filters, NULL to use the filters of the convolver. This
+ * should be called from the data thread. */
+void convolver_set_spectrum(struct convolver *conv, struct convolver_spectrum *spec);
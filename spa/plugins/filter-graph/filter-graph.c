@@ -128,6 +128,10 @@ struct node {
 
 	unsigned int disabled:1;
 	unsigned int control_changed:1;
+	unsigned int elided:1;
+
+	/* the node that does the processing of this node */
+	struct node *fused_into;
 
 	unsigned int n_sort_deps;
 	unsigned int sorted:1;
@@ -212,6 +216,7 @@ struct graph {
 
 	unsigned activated:1;
 	unsigned setup:1;
+	unsigned optimize:1;
 };
 
 struct impl {
@@ -701,16 +706,22 @@ static int impl_reset(void *object)
 {
 	struct impl *impl = object;
 	struct graph *graph = &impl->graph;
+	struct node *node;
 	uint32_t i;
-	for (i = 0; i < graph->n_hndl; i++) {
-		struct graph_hndl *hndl = &graph->hndl[i];
-		const struct spa_fga_descriptor *d = hndl->desc;
-		if (hndl->hndl == NULL || *hndl->hndl == NULL)
+
+	/* also reset the nodes that are fused into others */
+	spa_list_for_each(node, &graph->node_list, link) {
+		const struct spa_fga_descriptor *d = node->desc->desc;
+		if (node->disabled || node->elided)
 			continue;
-		if (d->deactivate)
-			d->deactivate(*hndl->hndl);
-		if (d->activate)
-			d->activate(*hndl->hndl);
+		for (i = 0; i < node->n_hndl; i++) {
+			if (node->hndl[i] == NULL)
+				continue;
+			if (d->deactivate)
+				d->deactivate(node->hndl[i]);
+			if (d->activate)
+				d->activate(node->hndl[i]);
+		}
 	}
 	return 0;
 }
@@ -1657,6 +1668,181 @@ static struct node *sort_next_node(struct graph *graph)
 	return NULL;
 }
 
+static bool port_is_external(struct graph *graph, struct port *port)
+{
+	struct node *node = port->node;
+
+	if (port->external != SPA_ID_INVALID)
+		return true;
+	/* without explicit inputs and outputs, all the input ports of the first
+	 * node and all output ports of the last node are used */
+	if (graph->n_input_names == 0 && port >= node->input_port &&
+	    port < node->input_port + node->desc->n_input &&
+	    node == spa_list_first(&graph->node_list, struct node, link))
+		return true;
+	if (graph->n_output_names == 0 && port >= node->output_port &&
+	    port < node->output_port + node->desc->n_output &&
+	    node == spa_list_last(&graph->node_list, struct node, link))
+		return true;
+	return false;
+}
+
+/* the output port that provides the data for an input port, skipping
+ * elided copy nodes */
+static struct port *port_source(struct port *port)
+{
+	struct link *link;
+
+	do {
+		link = spa_list_first(&port->link_list, struct link, input_link);
+		port = &link->output->node->input_port[0];
+	} while (link->output->node->elided);
+
+	return link->output;
+}
+
+/* the node linked to the only output of node that can be processed by
+ * node, it can have no other links */
+static struct node *fuse_peer(struct graph *graph, struct node *node)
+{
+	struct port *port;
+	struct node *peer, *n;
+	struct link *link;
+	uint32_t i;
+
+	if (node->desc->n_output != 1)
+		return NULL;
+	port = &node->output_port[0];
+	if (port->n_links != 1 || port_is_external(graph, port))
+		return NULL;
+
+	link = spa_list_first(&port->link_list, struct link, output_link);
+	peer = link->input->node;
+	if (peer->disabled || peer->elided || peer->fused_into != NULL ||
+	    peer->desc->n_input != 1 || peer->desc->n_output != 1 ||
+	    peer->latency_index != SPA_IDX_INVALID ||
+	    port_is_external(graph, &peer->input_port[0]))
+		return NULL;
+
+	/* the peer already runs other nodes */
+	spa_list_for_each(n, &graph->node_list, link)
+		if (n->fused_into == peer)
+			return NULL;
+
+	/* controls from other nodes would need to be updated before node
+	 * runs */
+	for (i = 0; i < peer->desc->n_control; i++)
+		if (peer->control_port[i].n_links > 0)
+			return NULL;
+	for (i = 0; i < peer->desc->n_notify; i++)
+		if (peer->notify_port[i].n_links > 0)
+			return NULL;
+	return peer;
+}
+
+static void node_unfuse(struct graph *graph, struct node *head)
+{
+	const struct spa_fga_descriptor *d = head->desc->desc;
+	struct node *node;
+	uint32_t i;
+
+	for (i = 0; i < head->n_hndl; i++)
+		d->fuse(head->hndl[i], NULL, NULL);
+	spa_list_for_each(node, &graph->node_list, link) {
+		if (node->fused_into == head)
+			node->fused_into = NULL;
+	}
+}
+
+/* Elide copy nodes between other nodes and let nodes do the processing of
+ * the nodes that follow them when they can. This needs the instances. */
+static void optimize_graph(struct graph *graph)
+{
+	struct impl *impl = graph->impl;
+	struct node *node, *tail, *next;
+	uint32_t i;
+	int res = 0;
+
+	spa_list_for_each(node, &graph->node_list, link) {
+		node->elided = false;
+		node->fused_into = NULL;
+	}
+	if (!graph->optimize)
+		return;
+
+	spa_list_for_each(node, &graph->node_list, link) {
+		struct descriptor *desc = node->desc;
+
+		if (!(desc->desc->flags & SPA_FGA_DESCRIPTOR_COPY) || node->disabled ||
+		    desc->n_input != 1 || desc->n_output != 1)
+			continue;
+		if (node->input_port[0].n_links == 0 ||
+		    port_is_external(graph, &node->input_port[0]) ||
+		    port_is_external(graph, &node->output_port[0]))
+			continue;
+		node->elided = true;
+	}
+
+	/* go over the nodes in processing order so that a chain is always
+	 * fused into its first node */
+	sort_reset(graph);
+	while ((node = sort_next_node(graph)) != NULL) {
+		const struct spa_fga_descriptor *d = node->desc->desc;
+
+		if (d->fuse == NULL || node->disabled || node->elided ||
+		    node->fused_into != NULL)
+			continue;
+
+		for (tail = node; (next = fuse_peer(graph, tail)) != NULL; tail = next) {
+			for (i = 0; i < node->n_hndl; i++) {
+				if ((res = d->fuse(node->hndl[i], next->desc->desc, next->hndl[i])) < 0)
+					break;
+			}
+			if (res == -ENOTSUP && i == 0)
+				break;
+			if (res < 0) {
+				spa_log_warn(impl->log, "can't fuse %s into %s: %s",
+						next->name, node->name, spa_strerror(res));
+				node_unfuse(graph, node);
+				break;
+			}
+			next->fused_into = node;
+		}
+	}
+}
+
+static void setup_run_list(struct graph *graph)
+{
+	struct impl *impl = graph->impl;
+	struct node *node;
+	struct graph_hndl *gh;
+	uint32_t i;
+
+	graph->n_hndl = 0;
+	sort_reset(graph);
+	while ((node = sort_next_node(graph)) != NULL) {
+		if (node->elided) {
+			spa_log_info(impl->log, "graph: %s: elided copy", node->name);
+			continue;
+		} else if (node->fused_into) {
+			spa_log_info(impl->log, "graph: %s: fused into %s", node->name,
+					node->fused_into->name);
+			continue;
+		} else if (node->disabled) {
+			spa_log_info(impl->log, "graph: %s: disabled", node->name);
+			continue;
+		}
+		spa_log_info(impl->log, "graph: %s: run %s[%d]", node->name,
+				node->desc->desc->name, node->n_hndl);
+
+		for (i = 0; i < node->n_hndl; i++) {
+			gh = &graph->hndl[graph->n_hndl++];
+			gh->hndl = &node->hndl[i];
+			gh->desc = node->desc->desc;
+		}
+	}
+}
+
 static int setup_graph(struct graph *graph);
 
 static int impl_activate(void *object, const struct spa_dict *props)
@@ -1724,6 +1910,9 @@ static int impl_activate(void *object, const struct spa_dict *props)
 		node->control_changed = true;
 	}
 
+	optimize_graph(graph);
+	setup_run_list(graph);
+
 	/* then link ports */
 	spa_list_for_each(node, &graph->node_list, link) {
 		desc = node->desc;
@@ -1739,10 +1928,10 @@ static int impl_activate(void *object, const struct spa_dict *props)
 			for (j = 0; j < desc->n_input; j++) {
 				port = &node->input_port[j];
 				if (!spa_list_is_empty(&port->link_list)) {
-					link = spa_list_first(&port->link_list, struct link, input_link);
-					if ((res = port_ensure_data(link->output, i, max_samples)) < 0)
+					struct port *source = port_source(port);
+					if ((res = port_ensure_data(source, i, max_samples)) < 0)
 						goto error;
-					data = link->output->audio_data[i];
+					data = source->audio_data[i];
 				} else if (SPA_FGA_SUPPORTS_NULL_DATA(d->ports[port->p].flags)) {
 					data = NULL;
 				} else {
@@ -1895,7 +2084,6 @@ static int setup_graph(struct graph *graph)
 	struct node *node, *first, *last;
 	struct port *port;
 	struct graph_port *gp;
-	struct graph_hndl *gh;
 	uint32_t i, j, n, n_input, n_output, n_hndl = 0, n_out_hndl;
 	int res;
 	struct descriptor *desc;
@@ -2152,21 +2340,14 @@ static int setup_graph(struct graph *graph)
 	while ((node = sort_next_node(graph)) != NULL) {
 		node->n_hndl = n_hndl;
 		desc = node->desc;
-		d = desc->desc;
 
-		if (!node->disabled) {
-			for (i = 0; i < n_hndl; i++) {
-				gh = &graph->hndl[graph->n_hndl++];
-				gh->hndl = &node->hndl[i];
-				gh->desc = d;
-			}
-		}
 		for (i = 0; i < desc->n_control; i++) {
 			struct port *port = &node->control_port[i];
 			port_set_control_value(port,
 				port->control_initialized ? &port->control_current : NULL);
 		}
 	}
+	setup_run_list(graph);
 	res = 0;
 error:
 	return res;
@@ -2221,6 +2402,7 @@ static int load_graph(struct graph *graph, const struct spa_dict *props)
 
 	spa_list_init(&graph->node_list);
 	spa_list_init(&graph->link_list);
+	graph->optimize = true;
 
 	if ((json = spa_dict_lookup(props, "filter.graph")) == NULL) {
 		spa_log_error(impl->log, "missing filter.graph property");
@@ -2247,6 +2429,14 @@ static int load_graph(struct graph *graph, const struct spa_dict *props)
 			}
 			impl->info.n_outputs = res;
 		}
+		else if (spa_streq("optimize", key)) {
+			bool optimize;
+			if (spa_json_parse_bool(val, len, &optimize) <= 0) {
+				spa_log_error(impl->log, "%s expects a boolean", key);
+				return -EINVAL;
+			}
+			graph->optimize = optimize;
+		}
 		else if (spa_streq("inputs.audio.position", key)) {
 			if (!spa_json_is_array(val, len) ||
 			    (len = spa_json_container_len(&it[0], val, len)) < 0) {
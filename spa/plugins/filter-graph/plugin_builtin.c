@@ -33,6 +33,7 @@
 #include "audio-dsp.h"
 
 #define MAX_RATES	32u
+#define MAX_FUSED	64u
 #define GAIN_MAX	(20 * FLT_MAX_10_EXP)
 
 struct plugin {
@@ -43,6 +44,8 @@ struct plugin {
 	struct spa_log *log;
 };
 
+struct fused;
+
 struct builtin {
 	struct plugin *plugin;
 
@@ -67,6 +70,17 @@ struct builtin {
 
 	float gate;
 	float hold;
+
+	struct fused *fused;
+};
+
+/* biquads that are run as one cascade by the first one, optionally followed
+ * by a linear */
+struct fused {
+	uint32_t n_bq;
+	struct builtin *bq[MAX_FUSED];
+	struct biquad cascade[MAX_FUSED];
+	struct builtin *linear;
 };
 
 static int instantiate_helper(const struct spa_fga_plugin *plugin, const struct spa_fga_descriptor *desc,
@@ -114,6 +128,7 @@ static void builtin_connect_port(void *Instance, unsigned long Port, void * Data
 static void builtin_cleanup(void * Instance)
 {
 	struct builtin *impl = Instance;
+	free(impl->fused);
 	free(impl);
 }
 
@@ -564,15 +579,84 @@ static void bq_activate(void * Instance)
 	}
 }
 
+static void linear_run(void * Instance, unsigned long SampleCount);
+
+static void bq_run_fused(struct builtin *impl, struct fused *f, unsigned long samples)
+{
+	struct builtin *linear = f->linear;
+	float *out = f->bq[f->n_bq - 1]->port[0];
+	float *in = impl->port[1];
+	uint32_t i;
+
+	/* write the cascade directly into the output of the linear */
+	if (linear && linear->port[0] != NULL)
+		out = linear->port[0];
+
+	/* the biquads are updated by the controls of their instances */
+	for (i = 0; i < f->n_bq; i++)
+		f->cascade[i] = f->bq[i]->bq;
+
+	spa_fga_dsp_biquad_run(impl->dsp, f->cascade, f->n_bq, f->n_bq,
+			&out, (const float **)&in, 1, samples);
+
+	for (i = 0; i < f->n_bq; i++) {
+		f->bq[i]->bq.x1 = f->cascade[i].x1;
+		f->bq[i]->bq.x2 = f->cascade[i].x2;
+	}
+	if (linear) {
+		float *lin = linear->port[1];
+		linear->port[1] = out;
+		linear_run(linear, samples);
+		linear->port[1] = lin;
+	}
+}
+
 static void bq_run(void *Instance, unsigned long samples)
 {
 	struct builtin *impl = Instance;
 	struct biquad *bq = &impl->bq;
 	float *out = impl->port[0];
 	float *in = impl->port[1];
+
+	if (impl->fused) {
+		bq_run_fused(impl, impl->fused, samples);
+		return;
+	}
 	spa_fga_dsp_biquad_run(impl->dsp, bq, 1, 0, &out, (const float **)&in, 1, samples);
 }
 
+static int bq_fuse(void *Instance, const struct spa_fga_descriptor *next_desc, void *next)
+{
+	struct builtin *impl = Instance;
+	struct fused *f = impl->fused;
+
+	if (next == NULL) {
+		free(impl->fused);
+		impl->fused = NULL;
+		return 0;
+	}
+	/* a linear ends the cascade and a full cascade can't take more, the
+	 * chain simply stops there */
+	if (next_desc->run != bq_run && next_desc->run != linear_run)
+		return -ENOTSUP;
+	if (f != NULL && (f->linear != NULL ||
+	    (next_desc->run == bq_run && f->n_bq >= MAX_FUSED)))
+		return -ENOTSUP;
+
+	if (f == NULL) {
+		f = calloc(1, sizeof(*f));
+		if (f == NULL)
+			return -errno;
+		f->bq[f->n_bq++] = impl;
+		impl->fused = f;
+	}
+	if (next_desc->run == bq_run)
+		f->bq[f->n_bq++] = next;
+	else
+		f->linear = next;
+	return 0;
+}
+
 static void bq_control_sync(void * Instance)
 {
 	struct builtin *impl = Instance;
@@ -610,6 +694,7 @@ static const struct spa_fga_descriptor bq_lowpass_desc = {
 	.activate = bq_activate,
 	.run = bq_run,
 	.cleanup = builtin_cleanup,
+	.fuse = bq_fuse,
 };
 
 /** bq_highpass */
@@ -625,6 +710,7 @@ static const struct spa_fga_descriptor bq_highpass_desc = {
 	.activate = bq_activate,
 	.run = bq_run,
 	.cleanup = builtin_cleanup,
+	.fuse = bq_fuse,
 };
 
 /** bq_bandpass */
@@ -640,6 +726,7 @@ static const struct spa_fga_descriptor bq_bandpass_desc = {
 	.activate = bq_activate,
 	.run = bq_run,
 	.cleanup = builtin_cleanup,
+	.fuse = bq_fuse,
 };
 
 /** bq_lowshelf */
@@ -655,6 +742,7 @@ static const struct spa_fga_descriptor bq_lowshelf_desc = {
 	.activate = bq_activate,
 	.run = bq_run,
 	.cleanup = builtin_cleanup,
+	.fuse = bq_fuse,
 };
 
 /** bq_highshelf */
@@ -670,6 +758,7 @@ static const struct spa_fga_descriptor bq_highshelf_desc = {
 	.activate = bq_activate,
 	.run = bq_run,
 	.cleanup = builtin_cleanup,
+	.fuse = bq_fuse,
 };
 
 /** bq_peaking */
@@ -685,6 +774,7 @@ static const struct spa_fga_descriptor bq_peaking_desc = {
 	.activate = bq_activate,
 	.run = bq_run,
 	.cleanup = builtin_cleanup,
+	.fuse = bq_fuse,
 };
 
 /** bq_notch */
@@ -700,6 +790,7 @@ static const struct spa_fga_descriptor bq_notch_desc = {
 	.activate = bq_activate,
 	.run = bq_run,
 	.cleanup = builtin_cleanup,
+	.fuse = bq_fuse,
 };
 
 
@@ -716,6 +807,7 @@ static const struct spa_fga_descriptor bq_allpass_desc = {
 	.activate = bq_activate,
 	.run = bq_run,
 	.cleanup = builtin_cleanup,
+	.fuse = bq_fuse,
 };
 
 /* bq_raw */
@@ -731,6 +823,7 @@ static const struct spa_fga_descriptor bq_raw_desc = {
 	.activate = bq_activate,
 	.run = bq_run,
 	.cleanup = builtin_cleanup,
+	.fuse = bq_fuse,
 };
 
 /** convolver */
@@ -8,8 +8,12 @@
 #include <math.h>
 #include <limits.h>
 #include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
 
+#include <spa/utils/atomic.h>
 #include <spa/utils/result.h>
+#include <spa/utils/ringbuffer.h>
 #include <spa/utils/defs.h>
 #include <spa/utils/list.h>
 #include <spa/utils/string.h>
@@ -22,6 +26,8 @@
 
 #define MAX_PORTS	256
 #define MAX_CTX		64
+#define MAX_SETS	4
+#define MAX_JOBS	64
 
 const OrtApi* ort = NULL;
 
@@ -59,14 +65,66 @@ struct tensor_info {
 	uint32_t data_size;
 };
 
+struct group;
+
+struct job {
+	struct group *group;
+	uint32_t set;
+};
+
 struct descriptor {
 	struct spa_fga_descriptor desc;
 	struct plugin *p;
 
 	int blocksize;
 	OrtSession *session;
+	OrtSessionOptions *session_options;
 	struct tensor_info tensors[MAX_PORTS];
 	size_t n_tensors;
+
+	int threads;
+	unsigned int async:1;
+	unsigned int batch:1;
+	uint32_t delay;
+	uint32_t latency_index;
+
+	/* the inference thread for async mode */
+	pthread_t thread;
+	bool running;
+	sem_t sem;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct spa_ringbuffer queue;
+	struct job jobs[MAX_JOBS];
+};
+
+#define SET_DONE	0
+#define SET_QUEUED	1
+
+/* a set of input and output tensors for one block */
+struct tensor_set {
+	int state;
+	bool failed;		/* no output for the input, only used in process */
+	OrtValue *tensor[MAX_PORTS];
+	void *data[MAX_PORTS];
+};
+
+/* Instances that are run together in async mode. Without batching, this
+ * has only one instance. With batching, the tensors have one slice for
+ * each instance in the first dimension. */
+struct group {
+	struct descriptor *desc;
+	uint32_t n_instances;
+	uint32_t n_refs;
+	uint32_t n_sets;
+
+	int pending;
+	uint32_t n_ready;
+	uint32_t checked;
+	bool skip;
+	uint32_t late;
+
+	struct tensor_set sets[MAX_SETS];
 };
 
 struct instance {
@@ -79,6 +137,10 @@ struct instance {
 
 	uint32_t offset;
 	float *data[MAX_PORTS];
+
+	struct group *group;
+	uint32_t batch_index;
+	uint32_t block;
 };
 
 static struct tensor_info *find_tensor(struct descriptor *d, const char *name, enum spa_direction direction)
@@ -258,6 +320,29 @@ static int set_value(void *data, enum ONNXTensorElementDataType type, double val
 	}
 	return 0;
 }
+
+static size_t type_size(enum ONNXTensorElementDataType type)
+{
+	switch (type) {
+	case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
+	case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8:
+	case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:
+		return 1;
+	case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16:
+	case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16:
+		return 2;
+	case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
+	case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32:
+	case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+		return 4;
+	case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
+	case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64:
+	case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:
+		return 8;
+	default:
+		return 0;
+	}
+}
 /*
  * config = {
  *   blocksize = 512
@@ -302,6 +387,9 @@ static int onnx_instantiate1(const struct spa_fga_plugin *plugin, const struct s
 				ti->data_size *= ti->dimensions[j];
 
 		}
+		if (d->async)
+			continue;
+
 		CHECK(ort->CreateTensorAsOrtValue(p->allocator, ti->dimensions, ti->n_dimensions,
 				ti->type, &i->tensor[n]));
 		CHECK(ort->GetTensorMutableData(i->tensor[n], (void**)&data));
@@ -324,13 +412,114 @@ error:
 	return res;
 }
 
+static void group_free(struct group *g)
+{
+	uint32_t i, n;
+
+	for (i = 0; i < g->n_sets; i++) {
+		for (n = 0; n < g->desc->n_tensors; n++) {
+			if (g->sets[i].tensor[n])
+				ort->ReleaseValue(g->sets[i].tensor[n]);
+		}
+	}
+	free(g);
+}
+
+static struct group *group_new(struct descriptor *d, uint32_t n_instances, uint32_t rate)
+{
+	struct plugin *p = d->p;
+	OrtStatus *status;
+	struct group *g;
+	uint32_t i, k;
+	size_t n;
+	int res;
+
+	g = calloc(1, sizeof(*g));
+	if (g == NULL)
+		return NULL;
+
+	g->desc = d;
+	g->n_instances = n_instances;
+	g->n_sets = d->delay + 1;
+
+	for (i = 0; i < g->n_sets; i++) {
+		struct tensor_set *set = &g->sets[i];
+
+		set->state = SET_DONE;
+
+		for (n = 0; n < d->n_tensors; n++) {
+			struct tensor_info *ti = &d->tensors[n];
+			int64_t dimensions[64];
+			size_t size = ti->data_size * type_size(ti->type);
+
+			memcpy(dimensions, ti->dimensions, sizeof(dimensions));
+			if (ti->n_dimensions > 0)
+				dimensions[0] *= n_instances;
+
+			CHECK(ort->CreateTensorAsOrtValue(p->allocator, dimensions, ti->n_dimensions,
+					ti->type, &set->tensor[n]));
+			CHECK(ort->GetTensorMutableData(set->tensor[n], &set->data[n]));
+
+			memset(set->data[n], 0, size * n_instances);
+
+			if (ti->data_type == DATA_PARAM_RATE) {
+				for (k = 0; k < n_instances; k++) {
+					res = set_value(SPA_PTROFF(set->data[n], k * size, void),
+							ti->type, (double)rate);
+					if (res < 0) {
+						errno = -res;
+						goto error;
+					}
+				}
+			}
+		}
+	}
+	return g;
+
+error_onnx:
+	const char* msg = ort->GetErrorMessage(status);
+	spa_log_error(p->log, "%s", msg);
+	ort->ReleaseStatus(status);
+	errno = EINVAL;
+error:
+	group_free(g);
+	return NULL;
+}
+
+static void group_wait(struct group *g)
+{
+	struct descriptor *d = g->desc;
+
+	pthread_mutex_lock(&d->lock);
+	while (SPA_ATOMIC_LOAD(g->pending) > 0)
+		pthread_cond_wait(&d->cond, &d->lock);
+	pthread_mutex_unlock(&d->lock);
+}
+
 static int onnx_instantiate(const struct spa_fga_plugin *plugin, const struct spa_fga_descriptor *desc,
 		uint32_t rate, const char *config, uint32_t n_hndl, void *hndl[])
 {
+	struct descriptor *d = (struct descriptor *)desc;
+	struct group *g = NULL;
 	int res;
+
 	for (uint32_t i = 0; i < n_hndl; i++) {
+		struct instance *inst;
+
 		if ((res = onnx_instantiate1(plugin, desc, rate, i, config, &hndl[i])) < 0)
 			return res;
+
+		if (!d->async)
+			continue;
+
+		if (g == NULL || !d->batch) {
+			if ((g = group_new(d, d->batch ? n_hndl : 1, rate)) == NULL)
+				return -errno;
+		}
+		inst = hndl[i];
+		inst->group = g;
+		inst->batch_index = d->batch ? i : 0;
+		g->n_refs++;
 	}
 	return 0;
 }
@@ -338,12 +527,59 @@ static int onnx_instantiate(const struct spa_fga_plugin *plugin, const struct sp
 static void onnx_cleanup(void *instance)
 {
 	struct instance *i = instance;
+	struct group *g = i->group;
+	size_t n;
+
+	if (g && --g->n_refs == 0) {
+		group_wait(g);
+		group_free(g);
+	}
+	for (n = 0; n < i->desc->n_tensors; n++) {
+		if (i->tensor[n])
+			ort->ReleaseValue(i->tensor[n]);
+	}
 	free(i);
 }
 
+static void onnx_activate(void *instance)
+{
+	struct instance *i = instance;
+	struct descriptor *d = i->desc;
+	struct group *g = i->group;
+	uint32_t n;
+
+	if (d->latency_index != SPA_IDX_INVALID && i->data[d->latency_index])
+		i->data[d->latency_index][0] = (float)(d->delay * d->blocksize);
+
+	i->offset = 0;
+	i->block = 0;
+	if (g == NULL)
+		return;
+
+	group_wait(g);
+	for (n = 0; n < g->n_sets; n++) {
+		g->sets[n].state = SET_DONE;
+		g->sets[n].failed = true;
+	}
+	g->n_ready = 0;
+	g->checked = 0;
+	g->skip = false;
+}
+
 static void onnx_free(const struct spa_fga_descriptor *desc)
 {
 	struct descriptor *d = (struct descriptor*)desc;
+
+	if (SPA_ATOMIC_LOAD(d->running)) {
+		SPA_ATOMIC_STORE(d->running, false);
+		sem_post(&d->sem);
+		pthread_join(d->thread, NULL);
+		sem_destroy(&d->sem);
+		pthread_mutex_destroy(&d->lock);
+		pthread_cond_destroy(&d->cond);
+	}
+	if (d->session_options)
+		ort->ReleaseSessionOptions(d->session_options);
 	free((char*)d->desc.name);
 	free(d->desc.ports);
 	free(d);
@@ -447,6 +683,208 @@ error_onnx:
 	ort->ReleaseStatus(status);
 }
 
+static void group_process(struct group *g, uint32_t set)
+{
+	struct descriptor *d = g->desc;
+	struct plugin *p = d->p;
+	struct tensor_set *cur = &g->sets[set];
+	struct tensor_set *prev = &g->sets[(set + g->n_sets - 1) % g->n_sets];
+	const char *input_names[MAX_PORTS];
+	const OrtValue *inputs[MAX_PORTS];
+	const char *output_names[MAX_PORTS];
+	OrtValue *outputs[MAX_PORTS];
+	size_t n, n_inputs = 0, n_outputs = 0;
+	OrtStatus *status;
+
+	for (n = 0; n < d->n_tensors; n++) {
+		struct tensor_info *ti = &d->tensors[n];
+		if (ti->direction == SPA_DIRECTION_INPUT) {
+			input_names[n_inputs] = ti->name;
+			inputs[n_inputs++] = cur->tensor[ti->index];
+
+			/* the previous set was processed before this one so its
+			 * output state is ready */
+			if (ti->data_type == DATA_TENSOR)
+				memcpy(cur->data[ti->index], prev->data[ti->data_index],
+						ti->data_size * type_size(ti->type) * g->n_instances);
+		} else {
+			output_names[n_outputs] = ti->name;
+			outputs[n_outputs++] = cur->tensor[ti->index];
+		}
+	}
+	CHECK(ort->Run(d->session, NULL,
+			input_names, (const OrtValue *const*)inputs, n_inputs,
+			output_names, n_outputs, (OrtValue **)outputs));
+	return;
+
+error_onnx:
+	const char* msg = ort->GetErrorMessage(status);
+	spa_log_error(p->log, "%s", msg);
+	ort->ReleaseStatus(status);
+}
+
+static void *do_inference(void *data)
+{
+	struct descriptor *d = data;
+	struct job *job;
+	uint32_t index;
+
+	while (SPA_ATOMIC_LOAD(d->running)) {
+		sem_wait(&d->sem);
+
+		while (spa_ringbuffer_get_read_index(&d->queue, &index) > 0) {
+			struct group *g;
+
+			job = &d->jobs[index & (MAX_JOBS - 1)];
+			g = job->group;
+
+			group_process(g, job->set);
+			SPA_ATOMIC_STORE(g->sets[job->set].state, SET_DONE);
+
+			spa_ringbuffer_read_update(&d->queue, index + 1);
+
+			SPA_ATOMIC_DEC(g->pending);
+			pthread_mutex_lock(&d->lock);
+			pthread_cond_broadcast(&d->cond);
+			pthread_mutex_unlock(&d->lock);
+		}
+	}
+	return NULL;
+}
+
+static int start_inference(struct descriptor *d)
+{
+	int res;
+
+	spa_ringbuffer_init(&d->queue);
+	sem_init(&d->sem, 0, 0);
+	pthread_mutex_init(&d->lock, NULL);
+	pthread_cond_init(&d->cond, NULL);
+	SPA_ATOMIC_STORE(d->running, true);
+
+	if ((res = pthread_create(&d->thread, NULL, do_inference, d)) != 0) {
+		SPA_ATOMIC_STORE(d->running, false);
+		sem_destroy(&d->sem);
+		pthread_mutex_destroy(&d->lock);
+		pthread_cond_destroy(&d->cond);
+		return -res;
+	}
+	return 0;
+}
+
+static void group_submit(struct group *g, uint32_t set)
+{
+	struct descriptor *d = g->desc;
+	struct plugin *p = d->p;
+	uint32_t index;
+
+	if (spa_ringbuffer_get_write_index(&d->queue, &index) >= MAX_JOBS) {
+		/* the block is lost, the output will be silent */
+		g->sets[set].failed = true;
+		if (g->late++ % 256 == 0)
+			spa_log_warn(p->log, "onnx: inference queue full (%u)", g->late);
+		return;
+	}
+	d->jobs[index & (MAX_JOBS - 1)] = (struct job) { g, set };
+	g->sets[set].failed = false;
+
+	SPA_ATOMIC_INC(g->pending);
+	SPA_ATOMIC_STORE(g->sets[set].state, SET_QUEUED);
+	spa_ringbuffer_write_update(&d->queue, index + 1);
+	sem_post(&d->sem);
+}
+
+/* The input of block N is given to the inference thread and the output of
+ * block N - delay is produced. When the inference thread is late or its queue
+ * is full, the input of the block is dropped and its output is silent. */
+static void onnx_run_async(void *instance, unsigned long SampleCount)
+{
+	struct instance *i = instance;
+	struct descriptor *d = i->desc;
+	struct group *g = i->group;
+	struct plugin *p = d->p;
+	uint32_t offset = i->offset, blocksize = d->blocksize;
+	size_t n;
+
+	while (SampleCount > 0) {
+		uint32_t chunk = SPA_MIN(SampleCount, blocksize - offset);
+		struct tensor_set *w = &g->sets[i->block % g->n_sets];
+		struct tensor_set *r = &g->sets[(i->block + 1) % g->n_sets];
+		struct tensor_set *prev = &g->sets[(i->block + g->n_sets - 1) % g->n_sets];
+		bool done;
+
+		if (offset == 0 && g->checked != i->block + 1) {
+			/* first instance of the group in this block, check if the
+			 * set we need to fill is available */
+			g->checked = i->block + 1;
+			g->skip = SPA_ATOMIC_LOAD(w->state) != SET_DONE;
+			if (g->skip) {
+				/* the set still has the previous block, which
+				 * was already played as silence */
+				w->failed = true;
+				if (g->late++ % 256 == 0)
+					spa_log_warn(p->log, "onnx: inference is late (%u)", g->late);
+			}
+		}
+
+		for (n = 0; n < d->n_tensors && !g->skip; n++) {
+			struct tensor_info *ti = &d->tensors[n];
+			float *data, *pdata;
+
+			if (ti->direction != SPA_DIRECTION_INPUT || ti->data_type != DATA_PORT)
+				continue;
+
+			data = SPA_PTROFF(w->data[ti->index],
+					i->batch_index * ti->data_size * sizeof(float), float);
+			if (ti->retain > 0 && offset == 0) {
+				pdata = SPA_PTROFF(prev->data[ti->index],
+						i->batch_index * ti->data_size * sizeof(float), float);
+				move_samples(data, 0, pdata, ti->data_size - ti->retain, ti->retain);
+			}
+			move_samples(data, ti->retain + offset,
+					i->data[ti->data_index], offset, chunk);
+		}
+
+		done = !r->failed && SPA_ATOMIC_LOAD(r->state) == SET_DONE;
+		for (n = 0; n < d->n_tensors; n++) {
+			struct tensor_info *ti = &d->tensors[n];
+			float *src, *dst = i->data[ti->data_index];
+
+			if (ti->direction != SPA_DIRECTION_OUTPUT || dst == NULL)
+				continue;
+
+			src = SPA_PTROFF(r->data[ti->index],
+					i->batch_index * ti->data_size * sizeof(float), float);
+			if (ti->data_type == DATA_CONTROL) {
+				if (done)
+					dst[0] = src[0];
+			}
+			else if (ti->data_type == DATA_PORT) {
+				if (done)
+					move_samples(dst, offset, src, offset, chunk);
+				else
+					memset(&dst[offset], 0, chunk * sizeof(float));
+			}
+		}
+
+		offset += chunk;
+		if (offset == blocksize) {
+			offset = 0;
+			if (++g->n_ready == g->n_instances) {
+				if (!g->skip)
+					group_submit(g, i->block % g->n_sets);
+				g->n_ready = 0;
+			}
+			i->block++;
+		}
+		SampleCount -= chunk;
+	}
+	i->offset = offset;
+
+	if (d->latency_index != SPA_IDX_INVALID && i->data[d->latency_index])
+		i->data[d->latency_index][0] = (float)(d->delay * blocksize);
+}
+
 static const struct spa_fga_descriptor *onnx_plugin_make_desc(void *plugin, const char *name)
 {
 	OrtStatus *status;
@@ -456,9 +894,11 @@ static const struct spa_fga_descriptor *onnx_plugin_make_desc(void *plugin, cons
 	OrtTypeInfo *tinfo;
 	const OrtTensorTypeAndShapeInfo *tt;
 	char path[PATH_MAX];
+	int res;
 	struct spa_json it[2];
 	const char *val;
-	int len;
+	int len, delay = 1;
+	bool async = false, batch = false;
 	char key[256];
 
 	if (spa_json_begin_object(&it[0], name, strlen(name)) <= 0) {
@@ -475,11 +915,13 @@ static const struct spa_fga_descriptor *onnx_plugin_make_desc(void *plugin, cons
 		return NULL;
 
 	desc->p = p;
+	desc->latency_index = SPA_IDX_INVALID;
 
 	desc->desc.instantiate = onnx_instantiate;
 	desc->desc.cleanup = onnx_cleanup;
 	desc->desc.free = onnx_free;
 	desc->desc.connect_port = onnx_connect_port;
+	desc->desc.activate = onnx_activate;
 	desc->desc.run = onnx_run;
 
 	desc->desc.name = strdup(name);
@@ -487,8 +929,52 @@ static const struct spa_fga_descriptor *onnx_plugin_make_desc(void *plugin, cons
 		goto error;
 	desc->desc.flags = 0;
 
+	/* the execution options are needed before the session is made */
+	while ((len = spa_json_object_next(&it[0], key, sizeof(key), &val)) > 0) {
+		if (spa_streq(key, "threads")) {
+			if (spa_json_parse_int(val, len, &desc->threads) <= 0) {
+				spa_log_error(p->log, "onnx:threads requires a number");
+				errno = EINVAL;
+				goto error;
+			}
+		}
+		else if (spa_streq(key, "async")) {
+			if (spa_json_parse_bool(val, len, &async) <= 0) {
+				spa_log_error(p->log, "onnx:async requires a boolean");
+				errno = EINVAL;
+				goto error;
+			}
+		}
+		else if (spa_streq(key, "batch")) {
+			if (spa_json_parse_bool(val, len, &batch) <= 0) {
+				spa_log_error(p->log, "onnx:batch requires a boolean");
+				errno = EINVAL;
+				goto error;
+			}
+		}
+		else if (spa_streq(key, "delay")) {
+			if (spa_json_parse_int(val, len, &delay) <= 0) {
+				spa_log_error(p->log, "onnx:delay requires a number");
+				errno = EINVAL;
+				goto error;
+			}
+		}
+	}
+	desc->async = async;
+	desc->batch = async && batch;
+	desc->delay = async ? SPA_CLAMP(delay, 1, MAX_SETS - 1) : 0;
+	if (async && desc->delay != (uint32_t)delay)
+		spa_log_warn(p->log, "onnx:delay %d is clamped to %u", delay, desc->delay);
+
+	if (desc->threads > 0) {
+		CHECK(ort->CloneSessionOptions(p->session_options, &desc->session_options));
+		CHECK(ort->SetIntraOpNumThreads(desc->session_options, desc->threads));
+	}
+
 	spa_log_info(p->log, "onnx: loading model %s", path);
-	CHECK(ort->CreateSession(p->env, path, p->session_options, &desc->session));
+	CHECK(ort->CreateSession(p->env, path,
+			desc->session_options ? desc->session_options : p->session_options,
+			&desc->session));
 
 	CHECK(ort->SessionGetInputCount(desc->session, &n_inputs));
 	CHECK(ort->SessionGetOutputCount(desc->session, &n_outputs));
@@ -549,6 +1035,7 @@ static const struct spa_fga_descriptor *onnx_plugin_make_desc(void *plugin, cons
 	desc->n_tensors = n_inputs + n_outputs;
 
 	/* enhance the tensor info */
+	spa_json_begin_object(&it[0], name, strlen(name));
 	while ((len = spa_json_object_next(&it[0], key, sizeof(key), &val)) > 0) {
 		if (spa_streq(key, "blocksize")) {
 			if (spa_json_parse_int(val, len, &desc->blocksize) <= 0) {
@@ -577,7 +1064,13 @@ static const struct spa_fga_descriptor *onnx_plugin_make_desc(void *plugin, cons
 		}
 	}
 
-	desc->desc.ports = calloc(desc->n_tensors, sizeof(struct spa_fga_port));
+	if (desc->async && desc->blocksize <= 0) {
+		spa_log_error(p->log, "onnx: async needs a blocksize");
+		errno = EINVAL;
+		goto error;
+	}
+
+	desc->desc.ports = calloc(desc->n_tensors + 1, sizeof(struct spa_fga_port));
 	if (desc->desc.ports == NULL)
 		goto error;
 	desc->desc.n_ports = 0;
@@ -618,6 +1111,27 @@ static const struct spa_fga_descriptor *onnx_plugin_make_desc(void *plugin, cons
 			goto error;
 		}
 	}
+	if (desc->async) {
+		struct spa_fga_port *fp = &desc->desc.ports[desc->desc.n_ports];
+
+		/* the output of a block is produced delay blocks later */
+		fp->index = desc->desc.n_ports;
+		fp->name = "latency";
+		fp->hint = SPA_FGA_HINT_LATENCY;
+		fp->flags = SPA_FGA_PORT_OUTPUT | SPA_FGA_PORT_CONTROL;
+		desc->latency_index = desc->desc.n_ports++;
+
+		desc->desc.run = onnx_run_async;
+
+		if ((res = start_inference(desc)) < 0) {
+			spa_log_error(p->log, "onnx: can't start inference thread: %s",
+					spa_strerror(res));
+			errno = -res;
+			goto error;
+		}
+		spa_log_info(p->log, "onnx: async inference with %u blocks delay%s",
+				desc->delay, desc->batch ? ", batched" : "");
+	}
 	return &desc->desc;
 
 error_onnx:
@@ -1,8 +1,10 @@
 #include "config.h"
 
 #include <limits.h>
+#include <math.h>
 
 #include <spa/utils/json.h>
+#include <spa/utils/list.h>
 #include <spa/support/loop.h>
 #include <spa/support/log.h>
 
@@ -21,6 +23,23 @@ struct plugin {
 	struct spa_loop *data_loop;
 	struct spa_loop *main_loop;
 	uint32_t quantum_limit;
+
+	struct spa_list grids;
+};
+
+/* The filters for all positions of a SOFA file, shared between the
+ * spatializers with the same file and settings. */
+struct sofa_grid {
+	struct spa_list link;
+	int ref;
+
+	struct MYSOFA_EASY *sofa;
+	int n_samples, blocksize, tailsize;
+	float gain;
+
+	struct convolver *layout;
+	uint32_t n_spectra;
+	struct convolver_spectrum **spectra;
 };
 
 struct spatializer_impl {
@@ -39,8 +58,168 @@ struct spatializer_impl {
 	struct MYSOFA_EASY *sofa;
 	unsigned int interpolate:1;
 	struct convolver *conv[3];
+
+	struct sofa_grid *grid;
+	struct convolver_spectrum *spec[2];
 };
 
+static void grid_unref(struct plugin *pl, struct sofa_grid *grid)
+{
+	uint32_t i;
+
+	if (--grid->ref > 0)
+		return;
+
+	spa_list_remove(&grid->link);
+	for (i = 0; i < grid->n_spectra; i++) {
+		if (grid->spectra[i])
+			convolver_spectrum_free(grid->layout, grid->spectra[i]);
+	}
+	free(grid->spectra);
+	if (grid->layout)
+		convolver_free(grid->layout);
+	free(grid);
+}
+
+static struct sofa_grid *grid_ref(struct spatializer_impl *impl)
+{
+	struct plugin *pl = impl->plugin;
+	struct MYSOFA_HRTF *hrtf = impl->sofa->hrtf;
+	struct sofa_grid *grid;
+	struct convolver_ir ir[2];
+	float *tmp = NULL;
+	uint32_t i;
+	int j;
+
+	spa_list_for_each(grid, &pl->grids, link) {
+		if (grid->sofa == impl->sofa &&
+		    grid->n_samples == impl->n_samples &&
+		    grid->blocksize == impl->blocksize &&
+		    grid->tailsize == impl->tailsize &&
+		    grid->gain == impl->gain) {
+			grid->ref++;
+			return grid;
+		}
+	}
+
+	if (hrtf->R != 2 || hrtf->N < (unsigned int)impl->n_samples) {
+		spa_log_error(impl->log, "spatializer: unsupported grid with %u receivers",
+				hrtf->R);
+		errno = ENOTSUP;
+		return NULL;
+	}
+
+	grid = calloc(1, sizeof(*grid));
+	if (grid == NULL)
+		return NULL;
+
+	grid->ref = 1;
+	grid->sofa = impl->sofa;
+	grid->n_samples = impl->n_samples;
+	grid->blocksize = impl->blocksize;
+	grid->tailsize = impl->tailsize;
+	grid->gain = impl->gain;
+	spa_list_append(&pl->grids, &grid->link);
+
+	grid->layout = convolver_new_layout(impl->dsp, impl->blocksize, impl->tailsize,
+			2, impl->n_samples);
+	grid->spectra = calloc(hrtf->M, sizeof(struct convolver_spectrum *));
+	tmp = calloc(2 * impl->n_samples, sizeof(float));
+	if (grid->layout == NULL || grid->spectra == NULL || tmp == NULL)
+		goto error;
+
+	grid->n_spectra = hrtf->M;
+	for (i = 0; i < hrtf->M; i++) {
+		const float *data = &hrtf->DataIR.values[i * hrtf->R * hrtf->N];
+
+		for (j = 0; j < impl->n_samples; j++) {
+			tmp[j] = data[j] * impl->gain;
+			tmp[impl->n_samples + j] = data[hrtf->N + j] * impl->gain;
+		}
+		ir[0].ir = tmp;
+		ir[0].len = impl->n_samples;
+		ir[1].ir = tmp + impl->n_samples;
+		ir[1].len = impl->n_samples;
+
+		grid->spectra[i] = convolver_spectrum_new(grid->layout);
+		if (grid->spectra[i] == NULL ||
+		    convolver_spectrum_fill(grid->layout, grid->spectra[i], ir, 2) < 0)
+			goto error;
+	}
+	free(tmp);
+
+	spa_log_info(impl->log, "spatializer: made grid with %u positions", hrtf->M);
+
+	return grid;
+error:
+	free(tmp);
+	grid_unref(pl, grid);
+	errno = ENOMEM;
+	return NULL;
+}
+
+static float grid_distance(const float *a, const float *b)
+{
+	return sqrtf((a[0] - b[0]) * (a[0] - b[0]) +
+			(a[1] - b[1]) * (a[1] - b[1]) +
+			(a[2] - b[2]) * (a[2] - b[2]));
+}
+
+/* Inverse distance weights of the nearest position and the closest
+ * neighbour along each axis, like mysofa_interpolate() */
+static uint32_t grid_weights(struct spatializer_impl *impl, float *coords,
+		uint32_t index[7], float weight[7])
+{
+	struct MYSOFA_HRTF *hrtf = impl->sofa->hrtf;
+	const float *pos = hrtf->SourcePosition.values;
+	int nearest, *neighbours, i;
+	uint32_t n = 0;
+	float d, total;
+
+	nearest = mysofa_lookup(impl->sofa->lookup, coords);
+	if (nearest < 0)
+		return 0;
+
+	d = grid_distance(coords, &pos[nearest * hrtf->C]);
+	index[n] = nearest;
+	weight[n++] = 1.0f;
+	if (d < 1e-5f)
+		return n;
+
+	weight[0] = total = 1.0f / d;
+
+	neighbours = mysofa_neighborhood(impl->sofa->neighborhood, nearest);
+	for (i = 0; neighbours && i < 6; i += 2) {
+		int a = neighbours[i], b = neighbours[i + 1], use = -1;
+		float da = 0.0f, db = 0.0f;
+
+		if (a >= 0)
+			da = grid_distance(coords, &pos[a * hrtf->C]);
+		if (b >= 0)
+			db = grid_distance(coords, &pos[b * hrtf->C]);
+
+		if (a >= 0 && b >= 0) {
+			if (fabsf(da - db) >= 1e-5f)
+				use = da < db ? a : b;
+		} else if (a >= 0) {
+			use = a;
+		} else if (b >= 0) {
+			use = b;
+		}
+		if (use < 0)
+			continue;
+
+		d = use == a ? da : db;
+		index[n] = use;
+		weight[n] = 1.0f / d;
+		total += weight[n++];
+	}
+	for (i = 0; i < (int)n; i++)
+		weight[i] /= total;
+
+	return n;
+}
+
 static int spatializer_instantiate1(const struct spa_fga_plugin *plugin, const struct spa_fga_descriptor * Descriptor,
 		uint32_t rate, uint32_t index, const char *config, void **hndl)
 {
@@ -50,7 +229,7 @@ static int spatializer_instantiate1(const struct spa_fga_plugin *plugin, const s
 	const char *val;
 	char key[256];
 	char filename[PATH_MAX] = "";
-	bool normalize = false;
+	bool normalize = false, grid = false;
 	float normalized;
 	int res, len;
 
@@ -105,6 +284,12 @@ static int spatializer_instantiate1(const struct spa_fga_plugin *plugin, const s
 				goto error_inval;
 			}
 		}
+		else if (spa_streq(key, "grid")) {
+			if (spa_json_parse_bool(val, len, &grid) <= 0) {
+				spa_log_error(impl->log, "spatializer:grid requires a bool");
+				goto error_inval;
+			}
+		}
 		else if (spa_streq(key, "latency")) {
 			if (spa_json_parse_float(val, len, &impl->latency) <= 0) {
 				spa_log_error(impl->log, "spatializer:latency requires a number");
@@ -216,18 +401,42 @@ static int spatializer_instantiate1(const struct spa_fga_plugin *plugin, const s
 	impl->tmp[0] = calloc(impl->plugin->quantum_limit, sizeof(float));
 	impl->tmp[1] = calloc(impl->plugin->quantum_limit, sizeof(float));
 	if (impl->tmp[0] == NULL || impl->tmp[1] == NULL)
-		goto error;
+		goto error_errno;
 	impl->rate = rate;
 
+	if (grid) {
+		if ((impl->grid = grid_ref(impl)) == NULL)
+			goto error_errno;
+
+		impl->conv[0] = convolver_new_layout(impl->dsp, impl->blocksize, impl->tailsize,
+				2, impl->n_samples);
+		impl->spec[0] = convolver_spectrum_new(impl->grid->layout);
+		impl->spec[1] = convolver_spectrum_new(impl->grid->layout);
+		if (impl->conv[0] == NULL || impl->spec[0] == NULL || impl->spec[1] == NULL)
+			goto error_errno;
+		convolver_set_spectrum(impl->conv[0], impl->spec[0]);
+	}
+
 	*hndl = impl;
 	return 0;
 
+error_errno:
+	res = -errno;
+	goto error;
 error_inval:
 	res = -EINVAL;
 	goto error;
 error:
 	free(impl->tmp[0]);
 	free(impl->tmp[1]);
+	if (impl->conv[0])
+		convolver_free(impl->conv[0]);
+	for (uint8_t i = 0; i < 2; i++) {
+		if (impl->spec[i])
+			convolver_spectrum_free(impl->grid->layout, impl->spec[i]);
+	}
+	if (impl->grid)
+		grid_unref(pl, impl->grid);
 	if (impl->sofa)
 		mysofa_close_cached(impl->sofa);
 	free(impl);
@@ -261,6 +470,39 @@ do_switch(struct spa_loop *loop, bool async, uint32_t seq, const void *data,
 	return 0;
 }
 
+static int
+do_switch_grid(struct spa_loop *loop, bool async, uint32_t seq, const void *data,
+		size_t size, void *user_data)
+{
+	struct spatializer_impl *impl = user_data;
+
+	SPA_SWAP(impl->spec[0], impl->spec[1]);
+	convolver_set_spectrum(impl->conv[0], impl->spec[0]);
+
+	return 0;
+}
+
+static void spatializer_reload_grid(struct spatializer_impl *impl)
+{
+	struct convolver_spectrum *src[7];
+	uint32_t i, n, index[7];
+	float coords[3], weight[7];
+
+	for (i = 0; i < 3; i++)
+		coords[i] = impl->port[3 + i][0];
+
+	spa_log_debug(impl->log, "moving spatializer to %f %f %f", coords[0], coords[1], coords[2]);
+
+	mysofa_s2c(coords);
+	n = grid_weights(impl, coords, index, weight);
+	for (i = 0; i < n; i++)
+		src[i] = impl->grid->spectra[index[i]];
+
+	convolver_spectrum_mix(impl->grid->layout, impl->spec[1], src, weight, n);
+
+	spa_loop_locked(impl->plugin->data_loop, do_switch_grid, 1, NULL, 0, impl);
+}
+
 static void spatializer_reload(void * Instance)
 {
 	struct spatializer_impl *impl = Instance;
@@ -382,6 +624,12 @@ static void spatializer_cleanup(void * Instance)
 		if (impl->conv[i])
 			convolver_free(impl->conv[i]);
 	}
+	for (uint8_t i = 0; i < 2; i++) {
+		if (impl->spec[i])
+			convolver_spectrum_free(impl->grid->layout, impl->spec[i]);
+	}
+	if (impl->grid)
+		grid_unref(impl->plugin, impl->grid);
 	if (impl->sofa)
 		mysofa_close_cached(impl->sofa);
 	free(impl->tmp[0]);
@@ -392,7 +640,12 @@ static void spatializer_cleanup(void * Instance)
 
 static void spatializer_control_changed(void * Instance)
 {
-	spatializer_reload(Instance);
+	struct spatializer_impl *impl = Instance;
+
+	if (impl->grid)
+		spatializer_reload_grid(impl);
+	else
+		spatializer_reload(impl);
 }
 
 static void spatializer_activate(void * Instance)
@@ -537,6 +790,7 @@ impl_init(const struct spa_handle_factory *factory,
 			&impl_plugin, impl);
 
 	impl->quantum_limit = 8192u;
+	spa_list_init(&impl->grids);
 
 	impl->log = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Log);
 	impl->data_loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_DataLoop);
@@ -6,6 +6,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
@@ -40,6 +41,48 @@ SPA_LOG_TOPIC_DEFINE_STATIC(log_topic, "spa.logger");
 
 #define TRACE_BUFFER (16*1024)
 
+/* deferred trace messages are recorded per thread */
+#define TRACE_RING_SIZE		(64*1024)
+#define TRACE_RECORD_MAX	(4*1024)
+#define TRACE_MAX_ARGS		32
+#define TRACE_MAX_STRING	512
+/* rings that are allocated up front, threads only allocate one when they
+ * are all in use */
+#define TRACE_RINGS		8
+
+union trace_arg {
+	int64_t i;
+	uint64_t u;
+	double d;
+	const void *p;
+	uint32_t offset;	/* of the string data in the record */
+};
+
+/* the strings are copied into the record, the caller might be unloaded
+ * before the record is written */
+struct trace_record {
+	uint32_t size;
+	int32_t line;
+	int32_t tid;
+	int32_t err;
+	struct timespec time;
+	uint32_t topic;		/* offsets of the strings in the record */
+	uint32_t file;
+	uint32_t func;
+	uint32_t fmt;
+	uint32_t text;		/* fmt is the formatted text */
+	union trace_arg args[];
+};
+
+struct trace_ring {
+	struct trace_ring *next;
+	int used;
+	struct spa_ringbuffer rb;
+	uint32_t dropped;
+	uint32_t reported;
+	uint8_t data[TRACE_RING_SIZE];
+};
+
 struct impl {
 	struct spa_handle handle;
 	struct spa_log log;
@@ -52,33 +95,40 @@ struct impl {
 	struct spa_ringbuffer trace_rb;
 	uint8_t trace_data[TRACE_BUFFER];
 
+	uint32_t id;
+	struct trace_ring *rings;
+	tss_t ring_key;
+
 	clockid_t clock_id;
 
 	unsigned int have_source:1;
+	unsigned int have_ring_key:1;
+	unsigned int deferred:1;
 	unsigned int colors:1;
 	unsigned int timestamp:1;
 	unsigned int local_timestamp:1;
 	unsigned int line:1;
 };
 
-static SPA_PRINTF_FUNC(7,0) void
-impl_log_logtv(void *object,
-	      enum spa_log_level level,
-	      const struct spa_log_topic *topic,
-	      const char *file,
-	      int line,
-	      const char *func,
-	      const char *fmt,
-	      va_list args)
+static inline pid_t get_tid(void)
+{
+#ifdef HAVE_GETTID
+	static thread_local pid_t tid;
+	if (SPA_UNLIKELY(tid == 0))
+		tid = gettid();
+	return tid;
+#else
+	return 0;
+#endif
+}
+
+static const char *format_prefix(struct impl *impl, struct spa_strbuf *msg,
+		enum spa_log_level level, pid_t tid, const struct timespec *now,
+		const char *topic, const char *file, int line,
+		const char *func)
 {
-	struct impl *impl = object;
-	char location[1024];
 	static const char * const levels[] = { "-", "E", "W", "I", "D", "T", "*T*" };
 	const char *prefix = "", *suffix = "";
-	bool do_trace;
-
-	if ((do_trace = (level == SPA_LOG_LEVEL_TRACE && impl->have_source)))
-		level++;
 
 	if (impl->colors) {
 		if (level <= SPA_LOG_LEVEL_ERROR)
@@ -91,60 +141,629 @@ impl_log_logtv(void *object,
 			suffix = SPA_ANSI_RESET;
 	}
 
-	struct spa_strbuf msg;
-	spa_strbuf_init(&msg, location, sizeof(location));
-
-	spa_strbuf_append(&msg, "%s[%s]", prefix, levels[level]);
+	spa_strbuf_append(msg, "%s[%s]", prefix, levels[level]);
 
 #ifdef HAVE_GETTID
-	static thread_local pid_t tid;
-	if (SPA_UNLIKELY(tid == 0))
-		tid = gettid();
-
-	spa_strbuf_append(&msg, "[%jd]", (intmax_t) tid);
+	spa_strbuf_append(msg, "[%jd]", (intmax_t) tid);
 #endif
 
 	if (impl->local_timestamp) {
 		char buf[64];
-		struct timespec now;
 		struct tm now_tm;
 
-		clock_gettime(impl->clock_id, &now);
-		localtime_r(&now.tv_sec, &now_tm);
+		localtime_r(&now->tv_sec, &now_tm);
 		strftime(buf, sizeof(buf), "%H:%M:%S", &now_tm);
-		spa_strbuf_append(&msg, "[%s.%06d]", buf,
-				(int)(now.tv_nsec / SPA_NSEC_PER_USEC));
+		spa_strbuf_append(msg, "[%s.%06d]", buf,
+				(int)(now->tv_nsec / SPA_NSEC_PER_USEC));
 	} else if (impl->timestamp) {
-		struct timespec now;
-		clock_gettime(impl->clock_id, &now);
-		spa_strbuf_append(&msg, "[%05jd.%06jd]",
-			(intmax_t) (now.tv_sec & 0x1FFFFFFF) % 100000, (intmax_t) now.tv_nsec / 1000);
+		spa_strbuf_append(msg, "[%05jd.%06jd]",
+			(intmax_t) (now->tv_sec & 0x1FFFFFFF) % 100000, (intmax_t) now->tv_nsec / 1000);
 	}
 
-	if (topic && topic->topic)
-		spa_strbuf_append(&msg, " %-12s | ", topic->topic);
+	if (topic && topic[0])
+		spa_strbuf_append(msg, " %-12s | ", topic);
 
 
 	if (impl->line && line != 0) {
 		const char *s = strrchr(file, '/');
-		spa_strbuf_append(&msg, "[%16.16s:%5i %s()]",
+		spa_strbuf_append(msg, "[%16.16s:%5i %s()]",
 			s ? s + 1 : file, line, func);
 	}
 
-	spa_strbuf_append(&msg, " ");
-	spa_strbuf_appendv(&msg, fmt, args);
-	spa_strbuf_append(&msg, "%s\n", suffix);
+	spa_strbuf_append(msg, " ");
 
-	if (SPA_UNLIKELY(msg.pos >= msg.maxsize)) {
+	return suffix;
+}
+
+static void format_finish(struct spa_strbuf *msg, const char *suffix)
+{
+	spa_strbuf_append(msg, "%s\n", suffix);
+
+	if (SPA_UNLIKELY(msg->pos >= msg->maxsize)) {
 		static const char truncated_text[] = "... (truncated)";
 		size_t suffix_length = strlen(suffix) + strlen(truncated_text) + 1 + 1;
 
-		spa_assert(msg.maxsize >= suffix_length);
-		msg.pos = msg.maxsize - suffix_length;
+		spa_assert(msg->maxsize >= suffix_length);
+		msg->pos = msg->maxsize - suffix_length;
+
+		spa_strbuf_append(msg, "%s%s\n", truncated_text, suffix);
+		spa_assert(msg->pos < msg->maxsize);
+	}
+}
+
+/* The deferred trace messages store the format and the arguments. They are
+ * formatted in the logger thread, one conversion at a time. */
+enum {
+	LEN_NONE,
+	LEN_HH,
+	LEN_H,
+	LEN_L,
+	LEN_LL,
+	LEN_J,
+	LEN_Z,
+	LEN_T,
+	LEN_LD,
+};
+
+enum {
+	CONV_PERCENT,
+	CONV_INT,
+	CONV_UINT,
+	CONV_CHAR,
+	CONV_DOUBLE,
+	CONV_STRING,
+	CONV_POINTER,
+	CONV_ERRNO,
+};
+
+struct conv_spec {
+	const char *flags;
+	int n_flags;
+	const char *width;
+	int n_width;
+	const char *prec;
+	int n_prec;
+	bool star_width;
+	bool has_prec;
+	bool star_prec;
+	int length;
+	int conv;
+	char type;
+	int size;
+};
+
+/* parse the conversion spec at fmt, which points to a %. Returns false for
+ * the conversions that can't be deferred */
+static bool parse_spec(const char *fmt, struct conv_spec *s)
+{
+	const char *p = fmt + 1;
+
+	spa_zero(*s);
+
+	s->flags = p;
+	while (*p && strchr("-+ #0'I", *p))
+		p++;
+	s->n_flags = p - s->flags;
+
+	if (*p == '*') {
+		s->star_width = true;
+		p++;
+	} else {
+		s->width = p;
+		while (*p >= '0' && *p <= '9')
+			p++;
+		s->n_width = p - s->width;
+		if (*p == '$')
+			return false;
+	}
+	if (*p == '.') {
+		s->has_prec = true;
+		p++;
+		if (*p == '*') {
+			s->star_prec = true;
+			p++;
+		} else {
+			s->prec = p;
+			while (*p >= '0' && *p <= '9')
+				p++;
+			s->n_prec = p - s->prec;
+		}
+	}
+	switch (*p) {
+	case 'h':
+		s->length = p[1] == 'h' ? LEN_HH : LEN_H;
+		p += s->length == LEN_HH ? 2 : 1;
+		break;
+	case 'l':
+		s->length = p[1] == 'l' ? LEN_LL : LEN_L;
+		p += s->length == LEN_LL ? 2 : 1;
+		break;
+	case 'q':
+		s->length = LEN_LL;
+		p++;
+		break;
+	case 'j':
+		s->length = LEN_J;
+		p++;
+		break;
+	case 'z':
+	case 'Z':
+		s->length = LEN_Z;
+		p++;
+		break;
+	case 't':
+		s->length = LEN_T;
+		p++;
+		break;
+	case 'L':
+		s->length = LEN_LD;
+		p++;
+		break;
+	}
+	s->type = *p;
+	switch (*p) {
+	case '%':
+		s->conv = CONV_PERCENT;
+		break;
+	case 'd': case 'i':
+		s->conv = CONV_INT;
+		break;
+	case 'u': case 'o': case 'x': case 'X':
+		s->conv = CONV_UINT;
+		break;
+	case 'c':
+		if (s->length != LEN_NONE)
+			return false;
+		s->conv = CONV_CHAR;
+		break;
+	case 'e': case 'E': case 'f': case 'F':
+	case 'g': case 'G': case 'a': case 'A':
+		s->conv = CONV_DOUBLE;
+		break;
+	case 's':
+		if (s->length != LEN_NONE)
+			return false;
+		s->conv = CONV_STRING;
+		break;
+	case 'p':
+		s->conv = CONV_POINTER;
+		break;
+	case 'm':
+		s->conv = CONV_ERRNO;
+		break;
+	default:
+		return false;
+	}
+	s->size = p + 1 - fmt;
+	return true;
+}
+
+static int64_t arg_int(va_list *args, int length)
+{
+	switch (length) {
+	case LEN_HH:
+		return (signed char)va_arg(*args, int);
+	case LEN_H:
+		return (short)va_arg(*args, int);
+	case LEN_L:
+		return va_arg(*args, long);
+	case LEN_LL:
+		return va_arg(*args, long long);
+	case LEN_J:
+		return va_arg(*args, intmax_t);
+	case LEN_Z:
+		return va_arg(*args, ssize_t);
+	case LEN_T:
+		return va_arg(*args, ptrdiff_t);
+	default:
+		return va_arg(*args, int);
+	}
+}
+
+static uint64_t arg_uint(va_list *args, int length)
+{
+	switch (length) {
+	case LEN_HH:
+		return (unsigned char)va_arg(*args, unsigned int);
+	case LEN_H:
+		return (unsigned short)va_arg(*args, unsigned int);
+	case LEN_L:
+		return va_arg(*args, unsigned long);
+	case LEN_LL:
+		return va_arg(*args, unsigned long long);
+	case LEN_J:
+		return va_arg(*args, uintmax_t);
+	case LEN_Z:
+		return va_arg(*args, size_t);
+	case LEN_T:
+		return va_arg(*args, ptrdiff_t);
+	default:
+		return va_arg(*args, unsigned int);
+	}
+}
+
+/* store the format arguments in the record, returns the size of the record
+ * or 0 when the format can't be deferred */
+static uint32_t record_args(struct trace_record *r, uint32_t maxsize, const char *fmt, va_list *args)
+{
+	struct conv_spec s;
+	const char *p;
+	uint32_t n_args = 0, size;
+	const char *str;
+	size_t len, max;
+	int prec;
+
+	/* first count the arguments */
+	for (p = fmt; (p = strchr(p, '%')) != NULL; p += s.size) {
+		if (!parse_spec(p, &s))
+			return 0;
+		n_args += s.star_width + s.star_prec + (s.conv != CONV_PERCENT);
+	}
+	if (n_args > TRACE_MAX_ARGS)
+		return 0;
 
-		spa_strbuf_append(&msg, "%s%s\n", truncated_text, suffix);
-		spa_assert(msg.pos < msg.maxsize);
+	size = sizeof(*r) + n_args * sizeof(union trace_arg);
+	n_args = 0;
+	for (p = fmt; (p = strchr(p, '%')) != NULL; p += s.size) {
+		parse_spec(p, &s);
+		if (s.star_width)
+			r->args[n_args++].i = va_arg(*args, int);
+		prec = -1;
+		if (s.star_prec)
+			prec = r->args[n_args++].i = va_arg(*args, int);
+		else if (s.has_prec)
+			prec = s.n_prec > 0 ? atoi(s.prec) : 0;
+
+		switch (s.conv) {
+		case CONV_INT:
+			r->args[n_args++].i = arg_int(args, s.length);
+			break;
+		case CONV_UINT:
+			r->args[n_args++].u = arg_uint(args, s.length);
+			break;
+		case CONV_CHAR:
+			r->args[n_args++].i = va_arg(*args, int);
+			break;
+		case CONV_DOUBLE:
+			if (s.length == LEN_LD)
+				r->args[n_args++].d = (double)va_arg(*args, long double);
+			else
+				r->args[n_args++].d = va_arg(*args, double);
+			break;
+		case CONV_STRING:
+			if ((str = va_arg(*args, const char *)) == NULL)
+				str = "(null)";
+			/* with a precision the string does not need to be
+			 * terminated, don't read beyond it */
+			max = TRACE_MAX_STRING;
+			if (prec >= 0 && (size_t)prec < max)
+				max = prec;
+			len = strnlen(str, max);
+			if (size + len + 1 > maxsize)
+				return 0;
+			memcpy(SPA_PTROFF(r, size, char), str, len);
+			*SPA_PTROFF(r, size + len, char) = '\0';
+			r->args[n_args++].offset = size;
+			size += len + 1;
+			break;
+		case CONV_POINTER:
+			r->args[n_args++].p = va_arg(*args, void *);
+			break;
+		case CONV_ERRNO:
+			r->args[n_args++].i = r->err;
+			break;
+		}
 	}
+	return size;
+}
+
+/* append a string to the record, returns false when there is no space */
+static bool record_string(struct trace_record *r, uint32_t *size, uint32_t maxsize,
+		const char *str, size_t max, uint32_t *offset)
+{
+	size_t len = str ? strnlen(str, max) : 0;
+
+	if (*size + len + 1 > maxsize)
+		return false;
+	if (len > 0)
+		memcpy(SPA_PTROFF(r, *size, char), str, len);
+	*SPA_PTROFF(r, *size + len, char) = '\0';
+	*offset = *size;
+	*size += len + 1;
+	return true;
+}
+
+static void format_args(struct spa_strbuf *msg, const struct trace_record *r)
+{
+	struct conv_spec s;
+	const char *fmt = SPA_PTROFF(r, r->fmt, const char), *p;
+	const union trace_arg *a = r->args;
+	char spec[64];
+	struct spa_strbuf sb;
+
+	while ((p = strchr(fmt, '%')) != NULL) {
+		spa_strbuf_append(msg, "%.*s", (int)(p - fmt), fmt);
+		parse_spec(p, &s);
+		fmt = p + s.size;
+
+		if (s.conv == CONV_PERCENT) {
+			spa_strbuf_append(msg, "%%");
+			continue;
+		}
+		/* rebuild the spec with the widths filled in and a length
+		 * that matches the stored argument */
+		spa_strbuf_init(&sb, spec, sizeof(spec));
+		spa_strbuf_append(&sb, "%%%.*s", s.n_flags, s.flags);
+		if (s.star_width)
+			spa_strbuf_append(&sb, "%d", (int)(a++)->i);
+		else
+			spa_strbuf_append(&sb, "%.*s", s.n_width, s.width);
+		if (s.star_prec)
+			spa_strbuf_append(&sb, ".%d", (int)(a++)->i);
+		else if (s.has_prec)
+			spa_strbuf_append(&sb, ".%.*s", s.n_prec, s.prec);
+
+		switch (s.conv) {
+		case CONV_INT:
+			spa_strbuf_append(&sb, "ll%c", s.type);
+			spa_strbuf_append(msg, spec, (long long)(a++)->i);
+			break;
+		case CONV_UINT:
+			spa_strbuf_append(&sb, "ll%c", s.type);
+			spa_strbuf_append(msg, spec, (unsigned long long)(a++)->u);
+			break;
+		case CONV_CHAR:
+			spa_strbuf_append(&sb, "c");
+			spa_strbuf_append(msg, spec, (int)(a++)->i);
+			break;
+		case CONV_DOUBLE:
+			spa_strbuf_append(&sb, "%c", s.type);
+			spa_strbuf_append(msg, spec, (a++)->d);
+			break;
+		case CONV_STRING:
+			spa_strbuf_append(&sb, "s");
+			spa_strbuf_append(msg, spec, SPA_PTROFF(r, (a++)->offset, const char));
+			break;
+		case CONV_POINTER:
+			spa_strbuf_append(&sb, "p");
+			spa_strbuf_append(msg, spec, (a++)->p);
+			break;
+		case CONV_ERRNO:
+			spa_strbuf_append(&sb, "s");
+			spa_strbuf_append(msg, spec, strerror((int)(a++)->i));
+			break;
+		}
+	}
+	spa_strbuf_append(msg, "%s", fmt);
+}
+
+static uint32_t impl_ids;
+static thread_local struct {
+	uint32_t id;
+	struct trace_ring *ring;
+} trace_cache;
+
+static struct trace_ring *alloc_trace_ring(struct impl *impl, int used)
+{
+	struct trace_ring *ring;
+
+	if ((ring = calloc(1, sizeof(*ring))) == NULL)
+		return NULL;
+	ring->used = used;
+	spa_ringbuffer_init(&ring->rb);
+
+	ring->next = __atomic_load_n(&impl->rings, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&impl->rings, &ring->next, ring,
+				true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	return ring;
+}
+
+/* called when a thread exits, the ring can be taken by another thread. The
+ * records that are still in the ring are written by the logger thread. */
+static void release_trace_ring(void *data)
+{
+	struct trace_ring *ring = data;
+	__atomic_store_n(&ring->used, 0, __ATOMIC_RELEASE);
+}
+
+static struct trace_ring *get_trace_ring(struct impl *impl)
+{
+	struct trace_ring *ring;
+	int unused;
+
+	if (SPA_LIKELY(trace_cache.id == impl->id))
+		return trace_cache.ring;
+
+	/* the thread used another logger since its last message */
+	if (impl->have_ring_key &&
+	    (ring = tss_get(impl->ring_key)) != NULL)
+		goto done;
+
+	/* first message of this thread, take one of the free rings. The ring
+	 * stays with the thread until it exits or the logger is cleared */
+	for (ring = __atomic_load_n(&impl->rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+		unused = 0;
+		if (__atomic_compare_exchange_n(&ring->used, &unused, 1,
+				false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+	}
+	if (ring == NULL && (ring = alloc_trace_ring(impl, 1)) == NULL)
+		return NULL;
+
+	if (impl->have_ring_key)
+		tss_set(impl->ring_key, ring);
+done:
+	trace_cache.id = impl->id;
+	trace_cache.ring = ring;
+	return ring;
+}
+
+static SPA_PRINTF_FUNC(6,0) void
+trace_deferred(struct impl *impl, const struct spa_log_topic *topic,
+		const char *file, int line, const char *func,
+		const char *fmt, va_list args)
+{
+	struct trace_ring *ring;
+	union trace_arg buffer[TRACE_RECORD_MAX / sizeof(union trace_arg)];
+	struct trace_record *r = (struct trace_record *)buffer;
+	uint32_t index, size;
+	int32_t filled;
+	va_list copy;
+
+	if ((ring = get_trace_ring(impl)) == NULL)
+		return;
+
+	r->err = errno;
+	r->line = line;
+	r->tid = get_tid();
+	clock_gettime(impl->clock_id, &r->time);
+	r->text = false;
+
+	va_copy(copy, args);
+	size = record_args(r, sizeof(buffer), fmt, &copy);
+	va_end(copy);
+
+	if (SPA_LIKELY(size != 0) &&
+	    (!record_string(r, &size, sizeof(buffer), topic ? topic->topic : NULL,
+			    TRACE_MAX_STRING, &r->topic) ||
+	     !record_string(r, &size, sizeof(buffer), file, TRACE_MAX_STRING, &r->file) ||
+	     !record_string(r, &size, sizeof(buffer), func, TRACE_MAX_STRING, &r->func) ||
+	     !record_string(r, &size, sizeof(buffer), fmt, SIZE_MAX, &r->fmt)))
+		size = 0;
+
+	if (SPA_UNLIKELY(size == 0)) {
+		/* can't defer, store the text */
+		struct spa_strbuf msg;
+
+		size = sizeof(*r);
+		record_string(r, &size, sizeof(buffer), topic ? topic->topic : NULL,
+				TRACE_MAX_STRING, &r->topic);
+		record_string(r, &size, sizeof(buffer), file, TRACE_MAX_STRING, &r->file);
+		record_string(r, &size, sizeof(buffer), func, TRACE_MAX_STRING, &r->func);
+
+		spa_strbuf_init(&msg, SPA_PTROFF(r, size, char), sizeof(buffer) - size);
+		spa_strbuf_appendv(&msg, fmt, args);
+		r->fmt = size;
+		r->text = true;
+		size += SPA_MIN(msg.pos, msg.maxsize - 1) + 1;
+	}
+	size = SPA_ROUND_UP_N(size, sizeof(union trace_arg));
+	r->size = size;
+
+	filled = spa_ringbuffer_get_write_index(&ring->rb, &index);
+	if (filled < 0 || filled + size > TRACE_RING_SIZE) {
+		__atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+		return;
+	}
+	spa_ringbuffer_write_data(&ring->rb, ring->data, TRACE_RING_SIZE,
+			index & (TRACE_RING_SIZE - 1), r, size);
+	spa_ringbuffer_write_update(&ring->rb, index + size);
+
+	/* the logger thread reads until the rings are empty, only wake it up
+	 * when there was nothing to read */
+	if (filled == 0 &&
+	    spa_system_eventfd_write(impl->system, impl->source.fd, 1) < 0)
+		fprintf(impl->file, "error signaling eventfd: %s\n", strerror(errno));
+}
+
+static void write_record(struct impl *impl, const struct trace_record *r)
+{
+	char location[1024];
+	struct spa_strbuf msg;
+	const char *suffix;
+
+	spa_strbuf_init(&msg, location, sizeof(location));
+	suffix = format_prefix(impl, &msg, SPA_LOG_LEVEL_TRACE + 1, r->tid, &r->time,
+			SPA_PTROFF(r, r->topic, const char),
+			SPA_PTROFF(r, r->file, const char), r->line,
+			SPA_PTROFF(r, r->func, const char));
+	if (r->text)
+		spa_strbuf_append(&msg, "%s", SPA_PTROFF(r, r->fmt, const char));
+	else
+		format_args(&msg, r);
+	format_finish(&msg, suffix);
+
+	fputs(msg.buffer, impl->file);
+}
+
+static void flush_deferred(struct impl *impl)
+{
+	struct trace_ring *ring, *first;
+	union trace_arg buffer[TRACE_RECORD_MAX / sizeof(union trace_arg)];
+	struct trace_record *r = (struct trace_record *)buffer;
+	struct timespec t, min = { 0, 0 };
+	uint32_t index, dropped;
+
+	/* write the records of all threads in the order of their time */
+	while (true) {
+		first = NULL;
+		for (ring = __atomic_load_n(&impl->rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+			dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+			if (SPA_UNLIKELY(dropped != ring->reported)) {
+				fprintf(impl->file, "[*T*] %u trace messages dropped\n",
+						dropped - ring->reported);
+				ring->reported = dropped;
+			}
+			if (spa_ringbuffer_get_read_index(&ring->rb, &index) <= 0)
+				continue;
+
+			spa_ringbuffer_read_data(&ring->rb, ring->data, TRACE_RING_SIZE,
+					(index + offsetof(struct trace_record, time)) & (TRACE_RING_SIZE - 1),
+					&t, sizeof(t));
+			if (first == NULL || t.tv_sec < min.tv_sec ||
+			    (t.tv_sec == min.tv_sec && t.tv_nsec < min.tv_nsec)) {
+				first = ring;
+				min = t;
+			}
+		}
+		if (first == NULL)
+			break;
+
+		spa_ringbuffer_get_read_index(&first->rb, &index);
+		spa_ringbuffer_read_data(&first->rb, first->data, TRACE_RING_SIZE,
+				index & (TRACE_RING_SIZE - 1), r, sizeof(*r));
+		spa_ringbuffer_read_data(&first->rb, first->data, TRACE_RING_SIZE,
+				index & (TRACE_RING_SIZE - 1), r, r->size);
+		spa_ringbuffer_read_update(&first->rb, index + r->size);
+
+		write_record(impl, r);
+	}
+}
+
+static SPA_PRINTF_FUNC(7,0) void
+impl_log_logtv(void *object,
+	      enum spa_log_level level,
+	      const struct spa_log_topic *topic,
+	      const char *file,
+	      int line,
+	      const char *func,
+	      const char *fmt,
+	      va_list args)
+{
+	struct impl *impl = object;
+	char location[1024];
+	const char *suffix;
+	struct timespec now = { 0, 0 };
+	bool do_trace;
+
+	if ((do_trace = (level == SPA_LOG_LEVEL_TRACE && impl->have_source))) {
+		if (impl->deferred) {
+			trace_deferred(impl, topic, file, line, func, fmt, args);
+			return;
+		}
+		level++;
+	}
+
+	struct spa_strbuf msg;
+	spa_strbuf_init(&msg, location, sizeof(location));
+
+	if (impl->local_timestamp || impl->timestamp)
+		clock_gettime(impl->clock_id, &now);
+
+	suffix = format_prefix(impl, &msg, level, get_tid(), &now,
+			topic ? topic->topic : NULL, file, line, func);
+	spa_strbuf_appendv(&msg, fmt, args);
+	format_finish(&msg, suffix);
 
 	if (SPA_UNLIKELY(do_trace)) {
 		uint32_t index;
@@ -211,6 +830,9 @@ static void on_trace_event(struct spa_source *source)
 	if (spa_system_eventfd_read(impl->system, source->fd, &count) < 0)
 		fprintf(impl->file, "failed to read event fd: %s", strerror(errno));
 
+	if (impl->deferred)
+		flush_deferred(impl);
+
 	while ((avail = spa_ringbuffer_get_read_index(&impl->trace_rb, &index)) > 0) {
 		int32_t offset, first;
 
@@ -262,6 +884,20 @@ static int impl_clear(struct spa_handle *handle)
 
 	this = (struct impl *) handle;
 
+	if (this->have_ring_key) {
+		tss_delete(this->ring_key);
+		this->have_ring_key = false;
+	}
+	if (this->rings != NULL) {
+		struct trace_ring *ring;
+
+		flush_deferred(this);
+		while ((ring = this->rings) != NULL) {
+			this->rings = ring->next;
+			free(ring);
+		}
+	}
+
 	if (this->close_file && this->file != NULL)
 		fclose(this->file);
 
@@ -341,6 +977,8 @@ impl_init(const struct spa_handle_factory *factory,
 		}
 		if ((str = spa_dict_lookup(info, SPA_KEY_LOG_LINE)) != NULL)
 			this->line = spa_atob(str);
+		if ((str = spa_dict_lookup(info, SPA_KEY_LOG_DEFERRED)) != NULL)
+			this->deferred = spa_atob(str);
 		if ((str = spa_dict_lookup(info, SPA_KEY_LOG_COLORS)) != NULL) {
 			if (spa_streq(str, "force")) {
 				this->colors = true;
@@ -380,6 +1018,14 @@ impl_init(const struct spa_handle_factory *factory,
 	}
 
 	spa_ringbuffer_init(&this->trace_rb);
+	this->id = __atomic_add_fetch(&impl_ids, 1, __ATOMIC_RELAXED);
+
+	if (this->deferred && this->have_source) {
+		for (int i = 0; i < TRACE_RINGS; i++)
+			alloc_trace_ring(this, 0);
+		this->have_ring_key = tss_create(&this->ring_key,
+				release_trace_ring) == thrd_success;
+	}
 
 	spa_log_debug(&this->log, "%p: initialized to %s linebuf:%u", this, dest, linebuf);
 
@@ -0,0 +1,264 @@
+/* Spa */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <spa/support/plugin.h>
+#include <spa/support/thread.h>
+#include <spa/utils/names.h>
+#include <spa/utils/string.h>
+#include <spa/utils/result.h>
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/param/video/format-utils.h>
+#include <spa/debug/log.h>
+#include <spa/support/log-impl.h>
+
+SPA_LOG_IMPL(logger);
+
+static struct spa_thread *impl_create(void *object, const struct spa_dict *props,
+		void *(*start)(void*), void *arg)
+{
+	pthread_t pt;
+	int res;
+	if ((res = pthread_create(&pt, NULL, start, arg)) != 0) {
+		errno = res;
+		return NULL;
+	}
+	return (struct spa_thread*)pt;
+}
+
+static int impl_join(void *object, struct spa_thread *thread, void **retval)
+{
+	return -pthread_join((pthread_t)thread, retval);
+}
+
+static const struct spa_thread_utils_methods thread_utils_impl = {
+	SPA_VERSION_THREAD_UTILS_METHODS,
+	.create = impl_create,
+	.join = impl_join,
+};
+
+static struct spa_thread_utils thread_utils = {
+	{ SPA_TYPE_INTERFACE_ThreadUtils, SPA_VERSION_THREAD_UTILS,
+		SPA_CALLBACKS_INIT(&thread_utils_impl, NULL) },
+};
+
+extern const struct spa_handle_factory spa_videoconvert_ffmpeg_factory;
+
+#define MAX_PLANES	4
+#define MAX_COUNT	100
+
+struct format {
+	const char *name;
+	uint32_t format;
+	uint32_t n_planes;
+	/* stride in bytes per pixel and height divisor of each plane */
+	struct {
+		uint32_t bpp_num;
+		uint32_t bpp_den;
+		uint32_t vsub;
+	} planes[MAX_PLANES];
+};
+
+static const struct format format_BGRx = {
+	"BGRx", SPA_VIDEO_FORMAT_BGRx, 1, { { 4, 1, 1 } }
+};
+static const struct format format_YUY2 = {
+	"YUY2", SPA_VIDEO_FORMAT_YUY2, 1, { { 2, 1, 1 } }
+};
+static const struct format format_NV12 = {
+	"NV12", SPA_VIDEO_FORMAT_NV12, 2, { { 1, 1, 1 }, { 1, 1, 2 } }
+};
+static const struct format format_I420 = {
+	"I420", SPA_VIDEO_FORMAT_I420, 3, { { 1, 1, 1 }, { 1, 2, 2 }, { 1, 2, 2 } }
+};
+
+static const struct spa_rectangle sizes[] = {
+	{ 1920, 1080 },
+	{ 3840, 2160 },
+};
+static const uint32_t thread_counts[] = { 1, 2, 4, 8 };
+
+struct buffer {
+	struct spa_buffer buffer;
+	struct spa_data datas[MAX_PLANES];
+	struct spa_chunk chunks[MAX_PLANES];
+};
+
+static void init_buffer(struct buffer *b, const struct format *f,
+		const struct spa_rectangle *size, bool input)
+{
+	uint32_t i;
+
+	spa_zero(*b);
+	b->buffer.datas = b->datas;
+	b->buffer.n_datas = f->n_planes;
+
+	for (i = 0; i < f->n_planes; i++) {
+		uint32_t stride = size->width * f->planes[i].bpp_num / f->planes[i].bpp_den;
+		uint32_t plane_size = stride * size->height / f->planes[i].vsub;
+
+		b->datas[i].type = SPA_DATA_MemPtr;
+		b->datas[i].flags = input ? SPA_DATA_FLAG_READABLE : SPA_DATA_FLAG_READWRITE;
+		b->datas[i].fd = -1;
+		b->datas[i].maxsize = plane_size;
+		b->datas[i].data = calloc(1, plane_size);
+		spa_assert_se(b->datas[i].data != NULL);
+		b->datas[i].chunk = &b->chunks[i];
+		b->datas[i].chunk->offset = 0;
+		b->datas[i].chunk->size = input ? plane_size : 0;
+		b->datas[i].chunk->stride = input ? stride : 0;
+		if (input)
+			memset(b->datas[i].data, 0x80 + i, plane_size);
+	}
+}
+
+static void clear_buffer(struct buffer *b)
+{
+	uint32_t i;
+	for (i = 0; i < b->buffer.n_datas; i++)
+		free(b->datas[i].data);
+}
+
+static int set_format(struct spa_node *node, enum spa_direction direction,
+		const struct format *f, const struct spa_rectangle *size)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_video_info_raw info;
+	struct spa_pod *param;
+
+	spa_zero(info);
+	info.format = f->format;
+	info.size = *size;
+	info.framerate = SPA_FRACTION(60, 1);
+
+	param = spa_format_video_raw_build(&b, SPA_PARAM_Format, &info);
+	return spa_node_port_set_param(node, direction, 0, SPA_PARAM_Format, 0, param);
+}
+
+static void run_test1(const struct format *in, const struct format *out,
+		const struct spa_rectangle *size, uint32_t n_threads)
+{
+	struct spa_handle *handle;
+	struct spa_node *node;
+	struct spa_dict_item items[1];
+	struct spa_io_buffers in_io, out_io;
+	struct buffer in_buffer, out_buffer;
+	struct spa_buffer *buffers[1];
+	struct spa_command cmd;
+	struct timespec ts;
+	uint64_t t1, t2, count;
+	char threads[16];
+	void *iface;
+	size_t hsize;
+	int i, res;
+
+	hsize = spa_handle_factory_get_size(&spa_videoconvert_ffmpeg_factory, NULL);
+	handle = calloc(1, hsize);
+	spa_assert_se(handle != NULL);
+
+	snprintf(threads, sizeof(threads), "%u", n_threads);
+	items[0] = SPA_DICT_ITEM_INIT("convert.threads", threads);
+
+	const struct spa_support support[] = {
+		SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_Log, &logger),
+		SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_ThreadUtils, &thread_utils),
+	};
+	res = spa_handle_factory_init(&spa_videoconvert_ffmpeg_factory, handle,
+			&SPA_DICT_INIT_ARRAY(items), support, SPA_N_ELEMENTS(support));
+	spa_assert_se(res >= 0);
+
+	res = spa_handle_get_interface(handle, SPA_TYPE_INTERFACE_Node, &iface);
+	spa_assert_se(res >= 0);
+	node = iface;
+
+	res = set_format(node, SPA_DIRECTION_INPUT, in, size);
+	spa_assert_se(res >= 0);
+	res = set_format(node, SPA_DIRECTION_OUTPUT, out, size);
+	spa_assert_se(res >= 0);
+
+	init_buffer(&in_buffer, in, size, true);
+	buffers[0] = &in_buffer.buffer;
+	res = spa_node_port_use_buffers(node, SPA_DIRECTION_INPUT, 0, 0, buffers, 1);
+	spa_assert_se(res == 0);
+
+	init_buffer(&out_buffer, out, size, false);
+	buffers[0] = &out_buffer.buffer;
+	res = spa_node_port_use_buffers(node, SPA_DIRECTION_OUTPUT, 0, 0, buffers, 1);
+	spa_assert_se(res == 0);
+
+	res = spa_node_port_set_io(node, SPA_DIRECTION_INPUT, 0,
+			SPA_IO_Buffers, &in_io, sizeof(in_io));
+	spa_assert_se(res == 0);
+	res = spa_node_port_set_io(node, SPA_DIRECTION_OUTPUT, 0,
+			SPA_IO_Buffers, &out_io, sizeof(out_io));
+	spa_assert_se(res == 0);
+
+	cmd = SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Start);
+	res = spa_node_send_command(node, &cmd);
+	spa_assert_se(res == 0);
+
+	out_io.buffer_id = SPA_ID_INVALID;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	count = 0;
+	for (i = 0; i < MAX_COUNT; i++) {
+		in_io.status = SPA_STATUS_HAVE_DATA;
+		in_io.buffer_id = 0;
+		out_io.status = SPA_STATUS_NEED_DATA;
+
+		res = spa_node_process(node);
+		spa_assert_se(res == SPA_STATUS_HAVE_DATA);
+		spa_assert_se(out_io.buffer_id == 0);
+		count++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	fprintf(stderr, "%-12."PRIu64" \t%s -> %s %ux%u \t threads %u\n",
+			count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1),
+			in->name, out->name, size->width, size->height, n_threads);
+
+	cmd = SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Suspend);
+	res = spa_node_send_command(node, &cmd);
+	spa_assert_se(res == 0);
+
+	spa_handle_clear(handle);
+	free(handle);
+
+	clear_buffer(&in_buffer);
+	clear_buffer(&out_buffer);
+}
+
+static void run_test(const struct format *in, const struct format *out)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(sizes, s) {
+		SPA_FOR_EACH_ELEMENT_VAR(thread_counts, t)
+			run_test1(in, out, s, *t);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	logger.log.level = SPA_LOG_LEVEL_WARN;
+
+	fprintf(stderr, "frames/sec\n");
+
+	run_test(&format_BGRx, &format_NV12);
+	run_test(&format_BGRx, &format_I420);
+	run_test(&format_YUY2, &format_I420);
+	run_test(&format_YUY2, &format_NV12);
+
+	return 0;
+}
@@ -6,6 +6,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <limits.h>
+#include <semaphore.h>
 #include <sys/mman.h>
 
 #include <libavcodec/avcodec.h>
@@ -17,6 +18,7 @@
 #include <spa/support/cpu.h>
 #include <spa/support/loop.h>
 #include <spa/support/log.h>
+#include <spa/support/thread.h>
 #include <spa/utils/result.h>
 #include <spa/utils/list.h>
 #include <spa/utils/json.h>
@@ -48,6 +50,7 @@ SPA_LOG_TOPIC_DEFINE_STATIC(log_topic, "spa.videoconvert.ffmpeg");
 #define MAX_BUFFERS	32u
 #define MAX_DATAS	4
 #define MAX_PORTS	(1+1)
+#define MAX_THREADS	16u
 
 struct props {
 	unsigned int dummy:1;
@@ -136,13 +139,24 @@ struct dir {
 	unsigned int control:1;
 };
 
+struct slice {
+	struct impl *impl;
+	struct SwsContext *context;
+	int y;
+	int height;
+	struct spa_thread *thread;
+	sem_t sem_start;
+};
+
 struct impl {
 	struct spa_handle handle;
 	struct spa_node node;
 
 	struct spa_log *log;
 	struct spa_cpu *cpu;
+	struct spa_loop *main_loop;
 	struct spa_loop *data_loop;
+	struct spa_thread_utils *thread_utils;
 
 	uint32_t cpu_flags;
 	uint32_t max_align;
@@ -153,6 +167,8 @@ struct impl {
 
 	struct props props;
 
+	struct spa_process_latency_info latency;
+
 	struct spa_io_position *io_position;
 	struct spa_io_rate_match *io_rate_match;
 
@@ -180,19 +196,37 @@ struct impl {
 
 	char group_name[128];
 
+	struct {
+		uint32_t threads;
+		unsigned int pipeline:1;
+	} codec;
 	struct {
 		AVCodecContext *context;
 		AVPacket *packet;
 		AVFrame *frame;
+		uint32_t delay;
+		uint32_t rt_delay;	/* last delay seen in the data thread */
 	} decoder;
 	struct {
 		struct SwsContext *context;
 		AVFrame *frame;
+
+		/* sliced conversion straight into the output buffer */
+		uint32_t n_threads;
+		uint32_t n_workers;
+		uint32_t n_slices;
+		struct slice slices[MAX_THREADS];
+		bool running;
+		sem_t sem_finish;
+		const AVFrame *src;
+		uint8_t *dst[4];
+		int dst_stride[4];
 	} convert;
 	struct {
 		AVCodecContext *context;
 		AVFrame *frame;
 		AVPacket *packet;
+		uint32_t delay;
 	} encoder;
 };
 
@@ -326,7 +360,7 @@ static struct format_info format_info[] =
 	//{ AV_PIX_FMT_NONE,  SPA_VIDEO_FORMAT_v210 },
 	//{ AV_PIX_FMT_NONE,  SPA_VIDEO_FORMAT_v216 },
 
-	//{ AV_PIX_FMT_NV12,    SPA_VIDEO_FORMAT_NV12 },
+	{ AV_PIX_FMT_NV12,  SPA_VIDEO_FORMAT_NV12, VIDEO_FORMAT_DSP_AYUV, FORMAT_COMMON },
 	//{ AV_PIX_FMT_NV21,    SPA_VIDEO_FORMAT_NV21 },
 	//{ AV_PIX_FMT_GRAY8,    SPA_VIDEO_FORMAT_GRAY8 },
 	//{ AV_PIX_FMT_GRAY16BE, SPA_VIDEO_FORMAT_GRAY16_BE },
@@ -874,6 +908,7 @@ static inline void free_decoder(struct impl *this)
 {
 	avcodec_free_context(&this->decoder.context);
 	av_packet_free(&this->decoder.packet);
+	this->decoder.delay = 0;
 }
 
 static inline void free_encoder(struct impl *this)
@@ -881,6 +916,296 @@ static inline void free_encoder(struct impl *this)
 	avcodec_free_context(&this->encoder.context);
 	av_packet_free(&this->encoder.packet);
 	av_frame_free(&this->encoder.frame);
+	this->encoder.delay = 0;
+}
+
+/* Let the codec run on its own threads when asked for. Slice threading has
+ * no extra latency and is used when the codec supports it. Frame threading
+ * pipelines the frames over the threads and delays the output with
+ * threads-1 frames so it is only used when the pipeline is allowed. */
+static void setup_codec_threads(struct impl *this, const AVCodec *codec,
+		AVCodecContext *context)
+{
+	context->thread_count = this->codec.threads;
+	if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS)
+		context->thread_type = FF_THREAD_SLICE;
+	else if (this->codec.pipeline &&
+	    (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS))
+		context->thread_type = FF_THREAD_FRAME;
+	else
+		context->thread_count = 1;
+}
+
+static uint32_t codec_delay(AVCodecContext *context)
+{
+	uint32_t delay = SPA_MAX(context->delay, context->has_b_frames);
+	if (context->active_thread_type & FF_THREAD_FRAME)
+		delay += context->thread_count - 1;
+	return delay;
+}
+
+static void recalc_latency(struct impl *this, enum spa_direction direction)
+{
+	enum spa_direction other = SPA_DIRECTION_REVERSE(direction);
+	struct spa_latency_info info;
+	struct port *port;
+	uint32_t i;
+
+	spa_latency_info_combine_start(&info, other);
+	for (i = 0; i < this->dir[direction].n_ports; i++) {
+		port = GET_PORT(this, direction, i);
+		if ((port->is_monitor) || !port->have_latency)
+			continue;
+		spa_log_debug(this->log, "%p: combine %d", this, i);
+		spa_latency_info_combine(&info, &port->latency[other]);
+	}
+	spa_latency_info_combine_finish(&info);
+
+	spa_process_latency_info_add(&this->latency, &info);
+
+	spa_log_debug(this->log, "%p: combined %s latency %f-%f %d-%d %"PRIu64"-%"PRIu64, this,
+			info.direction == SPA_DIRECTION_INPUT ? "input" : "output",
+			info.min_quantum, info.max_quantum,
+			info.min_rate, info.max_rate,
+			info.min_ns, info.max_ns);
+
+	for (i = 0; i < this->dir[other].n_ports; i++) {
+		port = GET_PORT(this, other, i);
+		if (port->is_monitor)
+			continue;
+		spa_log_debug(this->log, "%p: change %d", this, i);
+		if (spa_latency_info_compare(&info, &port->latency[other]) != 0) {
+			port->latency[other] = info;
+			port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+			port->params[IDX_Latency].user++;
+		}
+	}
+}
+
+static inline uint64_t frames_to_ns(uint32_t frames, struct spa_fraction *framerate)
+{
+	if (frames == 0 || framerate->num == 0)
+		return 0;
+	return (uint64_t)frames * SPA_NSEC_PER_SEC * framerate->denom / framerate->num;
+}
+
+/* The codecs can hold on to frames, add their delay to the latency we
+ * report on the ports */
+static void update_codec_latency(struct impl *this)
+{
+	int64_t ns;
+
+	ns = frames_to_ns(this->decoder.delay, &this->dir[SPA_DIRECTION_INPUT].framerate) +
+		frames_to_ns(this->encoder.delay, &this->dir[SPA_DIRECTION_OUTPUT].framerate);
+	if (this->latency.ns == ns)
+		return;
+
+	spa_log_info(this->log, "%p: codec latency %"PRIi64" ns", this, ns);
+	this->latency.ns = ns;
+	recalc_latency(this, SPA_DIRECTION_INPUT);
+	recalc_latency(this, SPA_DIRECTION_OUTPUT);
+	emit_info(this, false);
+}
+
+static int do_update_decoder_delay(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct impl *this = user_data;
+	const uint32_t *delay = data;
+
+	if (this->decoder.context == NULL)
+		return 0;
+	this->decoder.delay = *delay;
+	update_codec_latency(this);
+	return 0;
+}
+
+/* The decoder only knows how many frames it reorders after it parsed the
+ * stream, update the latency when it changes. Called from the data thread. */
+static void check_decoder_delay(struct impl *this)
+{
+	uint32_t delay = codec_delay(this->decoder.context);
+
+	if (SPA_LIKELY(delay == this->decoder.rt_delay))
+		return;
+
+	spa_log_debug(this->log, "%p: decoder delay %u -> %u", this,
+			this->decoder.rt_delay, delay);
+	this->decoder.rt_delay = delay;
+	if (this->main_loop)
+		spa_loop_invoke(this->main_loop, do_update_decoder_delay, 0,
+				&delay, sizeof(delay), false, this);
+}
+
+static inline void free_slices(struct impl *this)
+{
+	uint32_t i;
+	for (i = 0; i < this->convert.n_slices; i++) {
+		sws_freeContext(this->convert.slices[i].context);
+		this->convert.slices[i].context = NULL;
+	}
+	this->convert.n_slices = 0;
+}
+
+static void convert_slice(struct impl *this, struct slice *s)
+{
+	const AVFrame *f = this->convert.src;
+	const AVPixFmtDescriptor *in_fmt = av_pix_fmt_desc_get(f->format);
+	const AVPixFmtDescriptor *out_fmt = av_pix_fmt_desc_get(this->dir[SPA_DIRECTION_OUTPUT].pix_fmt);
+	const uint8_t *src[4];
+	uint8_t *dst[4];
+	int i;
+
+	/* planes 1 and 2 are the chroma planes, they are vertically
+	 * subsampled, the other planes are full height */
+	for (i = 0; i < 4; i++) {
+		int in_y = (i == 1 || i == 2) ? s->y >> in_fmt->log2_chroma_h : s->y;
+		int out_y = (i == 1 || i == 2) ? s->y >> out_fmt->log2_chroma_h : s->y;
+
+		src[i] = f->data[i] ? f->data[i] + in_y * f->linesize[i] : NULL;
+		dst[i] = this->convert.dst[i] ?
+			this->convert.dst[i] + out_y * this->convert.dst_stride[i] : NULL;
+	}
+	sws_scale(s->context, src, f->linesize, 0, s->height,
+			dst, this->convert.dst_stride);
+}
+
+static void *convert_thread(void *data)
+{
+	struct slice *s = data;
+	struct impl *this = s->impl;
+
+	while (true) {
+		sem_wait(&s->sem_start);
+
+		if (!this->convert.running)
+			break;
+
+		convert_slice(this, s);
+
+		sem_post(&this->convert.sem_finish);
+	}
+	return NULL;
+}
+
+static void start_workers(struct impl *this)
+{
+	uint32_t i;
+
+	if (this->convert.n_threads <= 1)
+		return;
+
+	if (this->thread_utils == NULL) {
+		spa_log_warn(this->log, "%p: no thread utils, can't use %d convert threads",
+				this, this->convert.n_threads);
+		return;
+	}
+
+	sem_init(&this->convert.sem_finish, 0, 0);
+	this->convert.running = true;
+
+	for (i = 1; i < this->convert.n_threads; i++) {
+		struct slice *s = &this->convert.slices[i];
+		struct spa_dict_item items[1];
+		char name[64];
+
+		snprintf(name, sizeof(name), "videoconvert-%u", i);
+		items[0] = SPA_DICT_ITEM_INIT(SPA_KEY_THREAD_NAME, name);
+
+		s->impl = this;
+		sem_init(&s->sem_start, 0, 0);
+		s->thread = spa_thread_utils_create(this->thread_utils,
+				&SPA_DICT_INIT_ARRAY(items), convert_thread, s);
+		if (s->thread == NULL) {
+			spa_log_warn(this->log, "%p: can't create convert thread: %m",
+					this);
+			sem_destroy(&s->sem_start);
+			break;
+		}
+		/* the data thread blocks until all slices are done, make the
+		 * workers realtime as well to avoid a priority inversion */
+		spa_thread_utils_acquire_rt(this->thread_utils, s->thread, -1);
+		this->convert.n_workers++;
+	}
+	spa_log_info(this->log, "%p: using %d convert threads", this,
+			this->convert.n_workers + 1);
+}
+
+static void stop_workers(struct impl *this)
+{
+	uint32_t i;
+
+	if (!this->convert.running)
+		return;
+
+	this->convert.running = false;
+	for (i = 1; i <= this->convert.n_workers; i++) {
+		struct slice *s = &this->convert.slices[i];
+		sem_post(&s->sem_start);
+		spa_thread_utils_join(this->thread_utils, s->thread, NULL);
+		sem_destroy(&s->sem_start);
+	}
+	this->convert.n_workers = 0;
+	sem_destroy(&this->convert.sem_finish);
+}
+
+/* Split the conversion into horizontal bands, one for each thread. Every
+ * band gets its own scaler so that they can run concurrently. This only
+ * works when there is no vertical scaling, the bands are aligned to the
+ * vertical chroma subsampling of both formats. */
+static int setup_slices(struct impl *this, const AVFrame *f)
+{
+	struct dir *out = &this->dir[SPA_DIRECTION_OUTPUT];
+	const AVPixFmtDescriptor *in_fmt = av_pix_fmt_desc_get(f->format);
+	const AVPixFmtDescriptor *out_fmt = av_pix_fmt_desc_get(out->pix_fmt);
+	uint32_t i, n_slices = this->convert.n_workers + 1;
+	int y, align, height;
+
+	if (n_slices <= 1 || f->height != (int)out->size.height)
+		return 0;
+
+	align = 1 << SPA_MAX(in_fmt->log2_chroma_h, out_fmt->log2_chroma_h);
+	height = SPA_ROUND_UP((f->height + (int)n_slices - 1) / (int)n_slices, align);
+
+	for (i = 0, y = 0; i < n_slices && y < f->height; i++, y += height) {
+		struct slice *s = &this->convert.slices[i];
+
+		s->y = y;
+		s->height = SPA_MIN(height, f->height - y);
+		s->context = sws_getContext(
+				f->width, s->height, f->format,
+				out->size.width, s->height, out->pix_fmt,
+				0, NULL, NULL, NULL);
+		this->convert.n_slices = i + 1;
+		if (s->context == NULL) {
+			free_slices(this);
+			return -EIO;
+		}
+	}
+	spa_log_info(this->log, "%p: using %d slices of %d lines", this,
+			this->convert.n_slices, height);
+	return 0;
+}
+
+static void convert_direct(struct impl *this, const AVFrame *f)
+{
+	uint32_t i;
+
+	this->convert.src = f;
+
+	if (this->convert.n_slices == 0) {
+		sws_scale(this->convert.context, (const uint8_t * const *)f->data,
+				f->linesize, 0, f->height,
+				this->convert.dst, this->convert.dst_stride);
+		return;
+	}
+	for (i = 1; i < this->convert.n_slices; i++)
+		sem_post(&this->convert.slices[i].sem_start);
+
+	convert_slice(this, &this->convert.slices[0]);
+
+	for (i = 1; i < this->convert.n_slices; i++)
+		sem_wait(&this->convert.sem_finish);
 }
 
 static int setup_convert(struct impl *this)
@@ -998,12 +1323,17 @@ static int setup_convert(struct impl *this)
 			return -EIO;
 
 		this->decoder.context->flags2 |= AV_CODEC_FLAG2_FAST;
+		setup_codec_threads(this, codec, this->decoder.context);
 
 		if (avcodec_open2(this->decoder.context, codec, NULL) < 0) {
 			spa_log_error(this->log, "failed to open decoder codec");
 			return -EIO;
 		}
-		spa_log_info(this->log, "%p: using decoder %s", this, codec->name);
+		this->decoder.delay = codec_delay(this->decoder.context);
+		this->decoder.rt_delay = this->decoder.delay;
+		spa_log_info(this->log, "%p: using decoder %s threads:%d delay:%u", this,
+				codec->name, this->decoder.context->thread_count,
+				this->decoder.delay);
 	} else {
 		free_decoder(this);
 	}
@@ -1028,17 +1358,23 @@ static int setup_convert(struct impl *this)
 		this->encoder.context->width = out->size.width;
 		this->encoder.context->height = out->size.height;
 		this->encoder.context->pix_fmt = out->pix_fmt;
+		setup_codec_threads(this, codec, this->encoder.context);
 
 		if (avcodec_open2(this->encoder.context, codec, NULL) < 0) {
 			spa_log_error(this->log, "failed to open encoder codec");
 			return -EIO;
 		}
-		spa_log_info(this->log, "%p: using encoder %s", this, codec->name);
+		this->encoder.delay = codec_delay(this->encoder.context);
+		spa_log_info(this->log, "%p: using encoder %s threads:%d delay:%u", this,
+				codec->name, this->encoder.context->thread_count,
+				this->encoder.delay);
 	} else {
 		free_encoder(this);
 	}
+	update_codec_latency(this);
 	sws_freeContext(this->convert.context);
 	this->convert.context = NULL;
+	free_slices(this);
 	av_frame_free(&this->convert.frame);
 	if ((this->convert.frame = av_frame_alloc()) == NULL)
 		return -EIO;
@@ -1050,6 +1386,12 @@ static int setup_convert(struct impl *this)
 
 static void reset_node(struct impl *this)
 {
+	/* drop the frames that are still in flight in the codecs */
+	if (this->decoder.context)
+		avcodec_flush_buffers(this->decoder.context);
+	if (this->encoder.context &&
+	    (this->encoder.context->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH))
+		avcodec_flush_buffers(this->encoder.context);
 }
 
 static int impl_node_send_command(void *object, const struct spa_command *command)
@@ -1727,7 +2069,6 @@ static int port_set_latency(void *object,
 	enum spa_direction other = SPA_DIRECTION_REVERSE(direction);
 	struct spa_latency_info info;
 	bool have_latency, emit = false;;
-	uint32_t i;
 
 	spa_log_debug(this->log, "%p: set latency direction:%d id:%d %p",
 			this, direction, port_id, latency);
@@ -1769,33 +2110,7 @@ static int port_set_latency(void *object,
 			oport->params[IDX_Latency].user++;
 		}
 	} else {
-		spa_latency_info_combine_start(&info, other);
-		for (i = 0; i < this->dir[direction].n_ports; i++) {
-			oport = GET_PORT(this, direction, i);
-			if ((oport->is_monitor) || !oport->have_latency)
-				continue;
-			spa_log_debug(this->log, "%p: combine %d", this, i);
-			spa_latency_info_combine(&info, &oport->latency[other]);
-		}
-		spa_latency_info_combine_finish(&info);
-
-		spa_log_debug(this->log, "%p: combined %s latency %f-%f %d-%d %"PRIu64"-%"PRIu64, this,
-				info.direction == SPA_DIRECTION_INPUT ? "input" : "output",
-				info.min_quantum, info.max_quantum,
-				info.min_rate, info.max_rate,
-				info.min_ns, info.max_ns);
-
-		for (i = 0; i < this->dir[other].n_ports; i++) {
-			oport = GET_PORT(this, other, i);
-			if (oport->is_monitor)
-				continue;
-			spa_log_debug(this->log, "%p: change %d", this, i);
-			if (spa_latency_info_compare(&info, &oport->latency[other]) != 0) {
-				oport->latency[other] = info;
-				oport->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
-				oport->params[IDX_Latency].user++;
-			}
-		}
+		recalc_latency(this, direction);
 	}
 	if (emit) {
 		port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
@@ -2298,6 +2613,7 @@ static int impl_node_process(void *object)
 	struct AVFrame *f;
 	void *datas[8];
 	uint32_t sizes[8], strides[8];
+	int64_t pts;
 	int res;
 
 	spa_return_val_if_fail(this != NULL, -EINVAL);
@@ -2344,25 +2660,48 @@ static int impl_node_process(void *object)
 			dbuf->buf->datas[0].chunk, sbuf->buf->datas[0].chunk->size,
 			sbuf->id, dbuf->id);
 
-	/* do decoding */
+	pts = sbuf->h ? (int64_t)sbuf->h->pts : AV_NOPTS_VALUE;
+
+	/* do decoding, the decoder can keep frames in flight so we don't
+	 * necessarily get a frame for each packet */
 	if (this->decoder.context) {
+		bool have_frame = false;
+
 		this->decoder.packet->data = sbuf->datas[0];
 		this->decoder.packet->size = sbuf->buf->datas[0].chunk->size;
+		this->decoder.packet->pts = pts;
 
 		spa_log_trace(this->log, "decode %p:%d", this->decoder.packet->data,
 				this->decoder.packet->size);
 
-		if ((res = avcodec_send_packet(this->decoder.context, this->decoder.packet)) < 0) {
+		f = this->decoder.frame;
+		res = avcodec_send_packet(this->decoder.context, this->decoder.packet);
+		if (res == AVERROR(EAGAIN)) {
+			/* decoder is full, take a frame out first */
+			if ((res = avcodec_receive_frame(this->decoder.context, f)) >= 0) {
+				have_frame = true;
+				res = avcodec_send_packet(this->decoder.context,
+						this->decoder.packet);
+			}
+		}
+		if (res < 0) {
 			spa_log_error(this->log, "failed to send frame to codec: %d %p:%d",
 					res, this->decoder.packet->data, this->decoder.packet->size);
 			return -EIO;
 		}
-
-		f = this->decoder.frame;
-		if (avcodec_receive_frame(this->decoder.context, f) < 0) {
-			spa_log_error(this->log, "failed to receive frame from codec");
-			return -EIO;
+		if (!have_frame) {
+			res = avcodec_receive_frame(this->decoder.context, f);
+			if (res == AVERROR(EAGAIN)) {
+				spa_log_trace(this->log, "decoder delay");
+				return SPA_STATUS_NEED_DATA;
+			}
+			if (res < 0) {
+				spa_log_error(this->log, "failed to receive frame from codec: %d", res);
+				return -EIO;
+			}
 		}
+		check_decoder_delay(this);
+		pts = f->pts;
 
 		in->pix_fmt = f->format;
 		in->size.width = f->width;
@@ -2377,6 +2716,7 @@ static int impl_node_process(void *object)
 		f->format = in->pix_fmt;
 		f->width = in->size.width;
 		f->height = in->size.height;
+		f->pts = pts;
 		for (uint32_t i = 0; i < sbuf->buf->n_datas; ++i) {
 			datas[i] = f->data[i] = sbuf->datas[i];
 			strides[i] = f->linesize[i] = sbuf->buf->datas[i].chunk->stride;
@@ -2388,36 +2728,87 @@ static int impl_node_process(void *object)
 	if (f->format != out->pix_fmt ||
 	    f->width != (int)out->size.width ||
 	    f->height != (int)out->size.height) {
-		if (this->convert.context == NULL) {
+		/* we can write straight into the output buffer when it is
+		 * mapped and we don't need to encode the frame afterwards */
+		bool direct = this->encoder.context == NULL;
+
+		for (uint32_t i = 0; i < dbuf->buf->n_datas && direct; ++i) {
+			if (SPA_FLAG_IS_SET(dbuf->buf->datas[i].flags, SPA_DATA_FLAG_DYNAMIC) ||
+			    dbuf->datas[i] == NULL ||
+			    dbuf->buf->datas[i].maxsize < out->plane_size[i])
+				direct = false;
+		}
+		if (this->convert.context == NULL && this->convert.n_slices == 0) {
 			const AVPixFmtDescriptor *in_fmt = av_pix_fmt_desc_get(f->format);
 			const AVPixFmtDescriptor *out_fmt = av_pix_fmt_desc_get(out->pix_fmt);
+			spa_log_info(this->log, "%p: using convert %dx%d:%s -> %dx%d:%s",
+					this, f->width, f->height, in_fmt->name,
+					out->size.width, out->size.height, out_fmt->name);
+			if ((res = setup_slices(this, f)) < 0)
+				spa_log_warn(this->log, "%p: can't setup slices: %s",
+						this, spa_strerror(res));
+		}
+		if ((!direct || this->convert.n_slices == 0) &&
+		    this->convert.context == NULL) {
 			this->convert.context = sws_getContext(
 					f->width, f->height, f->format,
 					out->size.width, out->size.height, out->pix_fmt,
 					0, NULL, NULL, NULL);
-			spa_log_info(this->log, "%p: using convert %dx%d:%s -> %dx%d:%s",
-					this, f->width, f->height, in_fmt->name,
-					out->size.width, out->size.height, out_fmt->name);
+			if (this->convert.context == NULL) {
+				spa_log_error(this->log, "%p: can't create scaler", this);
+				return -EIO;
+			}
 		}
-		spa_log_trace(this->log, "convert");
-		sws_scale_frame(this->convert.context, this->convert.frame, f);
-		f = this->convert.frame;
-		for (uint32_t i = 0; i < 4; ++i) {
-			datas[i] = f->data[i];
-			strides[i] = f->linesize[i];
-			sizes[i] = out->plane_size[i];
+		if (direct) {
+			spa_log_trace(this->log, "convert direct");
+			for (uint32_t i = 0; i < 4; ++i) {
+				bool valid = i < dbuf->buf->n_datas;
+				this->convert.dst[i] = valid ? dbuf->datas[i] : NULL;
+				this->convert.dst_stride[i] = valid ? out->linesizes[i] : 0;
+				datas[i] = this->convert.dst[i];
+				strides[i] = this->convert.dst_stride[i];
+				sizes[i] = out->plane_size[i];
+			}
+			convert_direct(this, f);
+		} else {
+			spa_log_trace(this->log, "convert");
+			sws_scale_frame(this->convert.context, this->convert.frame, f);
+			f = this->convert.frame;
+			for (uint32_t i = 0; i < 4; ++i) {
+				datas[i] = f->data[i];
+				strides[i] = f->linesize[i];
+				sizes[i] = out->plane_size[i];
+			}
 		}
 	}
-	/* do encoding */
+	/* do encoding, like the decoder, the encoder can delay packets */
 	if (this->encoder.context) {
-		if ((res = avcodec_send_frame(this->encoder.context, f)) < 0) {
+		bool have_packet = false;
+
+		res = avcodec_send_frame(this->encoder.context, f);
+		if (res == AVERROR(EAGAIN)) {
+			if ((res = avcodec_receive_packet(this->encoder.context,
+						this->encoder.packet)) >= 0) {
+				have_packet = true;
+				res = avcodec_send_frame(this->encoder.context, f);
+			}
+		}
+		if (res < 0) {
 			spa_log_error(this->log, "failed to send frame to codec: %d", res);
 			return -EIO;
 		}
-		if (avcodec_receive_packet(this->encoder.context, this->encoder.packet) < 0) {
-			spa_log_error(this->log, "failed to receive frame from codec");
-			return -EIO;
+		if (!have_packet) {
+			res = avcodec_receive_packet(this->encoder.context, this->encoder.packet);
+			if (res == AVERROR(EAGAIN)) {
+				spa_log_trace(this->log, "encoder delay");
+				return SPA_STATUS_NEED_DATA;
+			}
+			if (res < 0) {
+				spa_log_error(this->log, "failed to receive packet from codec: %d", res);
+				return -EIO;
+			}
 		}
+		pts = this->encoder.packet->pts;
 		datas[0] = this->encoder.packet->data;
 		sizes[0] = this->encoder.packet->size;
 		strides[0] = 1;
@@ -2441,8 +2832,12 @@ static int impl_node_process(void *object)
 	}
 	dequeue_buffer(this, out_port, dbuf);
 
-	if (sbuf->h && dbuf->h)
+	if (sbuf->h && dbuf->h) {
 		*dbuf->h = *sbuf->h;
+		/* with codec delay, the output is an older frame */
+		if (pts != AV_NOPTS_VALUE)
+			dbuf->h->pts = pts;
+	}
 
 	output->buffer_id = dbuf->id;
 	output->status = SPA_STATUS_HAVE_DATA;
@@ -2501,8 +2896,12 @@ static int impl_clear(struct spa_handle *handle)
 
 	this = (struct impl *) handle;
 
+	stop_workers(this);
+
 	free_decoder(this);
 	free_encoder(this);
+	free_slices(this);
+	sws_freeContext(this->convert.context);
 	av_frame_free(&this->decoder.frame);
 	av_frame_free(&this->convert.frame);
 
@@ -2536,9 +2935,11 @@ impl_init(const struct spa_handle_factory *factory,
 
 	this = (struct impl *) handle;
 
+	this->main_loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Loop);
 	this->data_loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_DataLoop);
 	this->log = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Log);
 	spa_log_topic_init(this->log, &log_topic);
+	this->thread_utils = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_ThreadUtils);
 
 	this->cpu = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_CPU);
 	if (this->cpu) {
@@ -2546,6 +2947,7 @@ impl_init(const struct spa_handle_factory *factory,
 		this->max_align = SPA_MIN(MAX_ALIGN, spa_cpu_get_max_align(this->cpu));
 	}
 	props_reset(&this->props);
+	this->codec.threads = 1;
 
 	this->rate_limit.interval = 2 * SPA_NSEC_PER_SEC;
 	this->rate_limit.burst = 1;
@@ -2567,9 +2969,18 @@ impl_init(const struct spa_handle_factory *factory,
 			else
 				this->direction = SPA_DIRECTION_INPUT;
 		}
+		else if (spa_streq(k, "convert.codec-threads"))
+			spa_atou32(s, &this->codec.threads, 0);
+		else if (spa_streq(k, "convert.codec-pipeline"))
+			this->codec.pipeline = spa_atob(s);
+		else if (spa_streq(k, "convert.threads")) {
+			spa_atou32(s, &this->convert.n_threads, 0);
+			this->convert.n_threads = SPA_MIN(this->convert.n_threads, MAX_THREADS);
+		}
 		else
 			videoconvert_set_param(this, k, s);
 	}
+	start_workers(this);
 
 	this->dir[SPA_DIRECTION_INPUT].direction = SPA_DIRECTION_INPUT;
 	this->dir[SPA_DIRECTION_OUTPUT].direction = SPA_DIRECTION_OUTPUT;
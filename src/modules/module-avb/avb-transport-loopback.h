@@ -30,8 +30,32 @@ struct avb_loopback_transport {
 	struct avb_loopback_packet packets[AVB_LOOPBACK_MAX_PACKETS];
 	int packet_count;
 	int packet_read;
+
+	/* kernel side of the TX ring of a packet_mmap talker stream */
+	uint32_t ring_tx_tail;
+	uint32_t ring_kicks;
 };
 
+static inline int avb_loopback_capture(struct avb_loopback_transport *t,
+		const uint8_t dest[6], uint16_t type, const void *data, size_t size)
+{
+	struct avb_loopback_packet *pkt;
+
+	if (t->packet_count >= AVB_LOOPBACK_MAX_PACKETS)
+		return -ENOSPC;
+	if (size > AVB_LOOPBACK_MAX_PACKET_SIZE)
+		return -EMSGSIZE;
+
+	pkt = &t->packets[t->packet_count % AVB_LOOPBACK_MAX_PACKETS];
+	memcpy(pkt->dest, dest, 6);
+	pkt->type = type;
+	pkt->size = size;
+	memcpy(pkt->data, data, size);
+	t->packet_count++;
+
+	return 0;
+}
+
 static inline int avb_loopback_setup(struct server *server)
 {
 	struct avb_loopback_transport *t;
@@ -61,7 +85,6 @@ static inline int avb_loopback_send_packet(struct server *server,
 		const uint8_t dest[6], uint16_t type, void *data, size_t size)
 {
 	struct avb_loopback_transport *t = server->transport_data;
-	struct avb_loopback_packet *pkt;
 	struct avb_ethernet_header *hdr = (struct avb_ethernet_header*)data;
 
 	if (t->packet_count >= AVB_LOOPBACK_MAX_PACKETS)
@@ -74,14 +97,7 @@ static inline int avb_loopback_send_packet(struct server *server,
 	memcpy(hdr->src, server->mac_addr, 6);
 	hdr->type = htons(type);
 
-	pkt = &t->packets[t->packet_count % AVB_LOOPBACK_MAX_PACKETS];
-	memcpy(pkt->dest, dest, 6);
-	pkt->type = type;
-	pkt->size = size;
-	memcpy(pkt->data, data, size);
-	t->packet_count++;
-
-	return 0;
+	return avb_loopback_capture(t, dest, type, data, size);
 }
 
 /**
@@ -109,10 +125,12 @@ static inline void avb_loopback_destroy(struct server *server)
 /**
  * Create a dummy stream socket using eventfd.
  * No AF_PACKET, no ioctls, no privileges needed.
+ * With packet_mmap, the TX ring of a talker is allocated instead of mapped.
  */
 static inline int avb_loopback_stream_setup_socket(struct server *server,
 		struct stream *stream)
 {
+	struct avb_loopback_transport *t = server->transport_data;
 	int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
 	if (fd < 0)
 		return -errno;
@@ -121,22 +139,92 @@ static inline int avb_loopback_stream_setup_socket(struct server *server,
 	stream->sock_addr.sll_family = AF_PACKET;
 	stream->sock_addr.sll_halen = ETH_ALEN;
 
+	spa_zero(stream->packet_ring);
+	if (server->packet_mmap && stream->direction == SPA_DIRECTION_OUTPUT) {
+		struct tpacket_req3 req;
+		void *data;
+
+		avb_packet_ring_req(&req);
+		if ((data = calloc(1, avb_packet_ring_req_size(&req))) == NULL) {
+			close(fd);
+			return -errno;
+		}
+		avb_packet_ring_init(&stream->packet_ring, data, &req);
+
+		t->ring_tx_tail = 0;
+	}
 	return fd;
 }
 
 /**
- * No-op stream send — pretend the send succeeded.
- * Audio data is consumed from the ringbuffer but goes nowhere.
+ * Play the kernel side of a TX ring kick: capture every frame that was
+ * handed over, in order, and give the slots back.
+ */
+static inline int avb_loopback_stream_flush(struct server *server,
+		struct stream *stream)
+{
+	struct avb_loopback_transport *t = server->transport_data;
+	struct avb_packet_ring *r = &stream->packet_ring;
+
+	if (r->data == NULL || r->pending == 0)
+		return 0;
+
+	r->pending = 0;
+	t->ring_kicks++;
+
+	while (true) {
+		struct tpacket3_hdr *h = avb_packet_ring_frame(r, t->ring_tx_tail);
+		uint8_t *frame = SPA_PTROFF(h, AVB_PACKET_RING_TX_OFFSET, uint8_t);
+
+		if (__atomic_load_n(&h->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_SEND_REQUEST)
+			break;
+
+		if (avb_loopback_capture(t, frame, ntohs(*(uint16_t*)&frame[12]),
+					frame, h->tp_len) < 0)
+			break;
+
+		__atomic_store_n(&h->tp_status, TP_STATUS_AVAILABLE, __ATOMIC_RELEASE);
+		t->ring_tx_tail = (t->ring_tx_tail + 1) % r->frame_nr;
+	}
+	return 0;
+}
+
+/**
+ * Stream send. Without a packet ring, pretend the send succeeded: audio
+ * data is consumed from the ringbuffer but goes nowhere. With a ring the
+ * frame is queued until the next flush, like the raw transport does.
  */
 static inline ssize_t avb_loopback_stream_send(struct server *server,
 		struct stream *stream, struct msghdr *msg, int flags)
 {
+	struct avb_packet_ring *r = &stream->packet_ring;
 	ssize_t total = 0;
+
+	if (r->data != NULL) {
+		total = avb_packet_ring_tx_queue(r, msg->msg_iov, msg->msg_iovlen);
+		if (total == -EAGAIN) {
+			avb_loopback_stream_flush(server, stream);
+			total = avb_packet_ring_tx_queue(r, msg->msg_iov, msg->msg_iovlen);
+		}
+		if (total < 0) {
+			errno = -total;
+			return -1;
+		}
+		return total;
+	}
+
 	for (size_t i = 0; i < msg->msg_iovlen; i++)
 		total += msg->msg_iov[i].iov_len;
 	return total;
 }
 
+static inline void avb_loopback_stream_close(struct server *server,
+		struct stream *stream)
+{
+	free(stream->packet_ring.data);
+	spa_zero(stream->packet_ring);
+}
+
 static const struct avb_transport_ops avb_transport_loopback = {
 	.setup = avb_loopback_setup,
 	.send_packet = avb_loopback_send_packet,
@@ -144,6 +232,8 @@ static const struct avb_transport_ops avb_transport_loopback = {
 	.destroy = avb_loopback_destroy,
 	.stream_setup_socket = avb_loopback_stream_setup_socket,
 	.stream_send = avb_loopback_stream_send,
+	.stream_flush = avb_loopback_stream_flush,
+	.stream_close = avb_loopback_stream_close,
 };
 
 /** Get the number of captured sent packets */
@@ -173,6 +263,13 @@ static inline int avb_loopback_get_packet(struct server *server,
 	return pkt->size;
 }
 
+/** Get the number of TX ring kicks */
+static inline uint32_t avb_loopback_get_ring_kicks(struct server *server)
+{
+	struct avb_loopback_transport *t = server->transport_data;
+	return t->ring_kicks;
+}
+
 /** Clear all captured packets */
 static inline void avb_loopback_clear_packets(struct server *server)
 {
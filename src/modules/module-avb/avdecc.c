@@ -13,6 +13,7 @@
 #include <net/if.h>
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include <spa/support/cpu.h>
@@ -429,6 +430,44 @@ static int milan_ensure_vlan_iface(const char *parent_ifname, uint16_t vid,
 	return 0;
 }
 
+static int raw_stream_setup_ring(struct server *server, struct stream *stream, int fd)
+{
+	struct tpacket_req3 req;
+	struct sockaddr_ll addr;
+	int version = TPACKET_V3;
+	void *data;
+
+	if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+		return -errno;
+
+	/* the TX ring has no per frame address, frames go out on the
+	 * bound interface. Protocol 0 keeps the socket from receiving. */
+	addr = stream->sock_addr;
+	addr.sll_protocol = 0;
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		return -errno;
+
+	avb_packet_ring_req(&req);
+	if (setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0)
+		return -errno;
+
+	data = mmap(NULL, avb_packet_ring_req_size(&req), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, 0);
+	if (data == MAP_FAILED) {
+		int res = -errno;
+		/* drop the ring again or sendmsg() would go through it */
+		spa_zero(req);
+		setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req));
+		return res;
+	}
+
+	avb_packet_ring_init(&stream->packet_ring, data, &req);
+
+	pw_log_info("stream %p: using TX ring of %u blocks of %u bytes", stream,
+			req.tp_block_nr, req.tp_block_size);
+	return 0;
+}
+
 static int raw_stream_setup_socket(struct server *server, struct stream *stream)
 {
 	int res;
@@ -437,8 +476,14 @@ static int raw_stream_setup_socket(struct server *server, struct stream *stream)
 	const char *bind_ifname = server->ifname;
 	char vlan_ifname[IFNAMSIZ];
 	bool used_vlan_subiface = false;
+	/* a talker with a TX ring never binds to a protocol so it does not
+	 * need to tap all traffic */
+	int protocol = server->packet_mmap && stream->direction == SPA_DIRECTION_OUTPUT ?
+		0 : htons(ETH_P_ALL);
 
-	spa_autoclose int fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, htons(ETH_P_ALL));
+	spa_zero(stream->packet_ring);
+
+	spa_autoclose int fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, protocol);
 	if (fd < 0) {
 		pw_log_error("socket() failed: %m");
 		return -errno;
@@ -525,13 +570,56 @@ static int raw_stream_setup_socket(struct server *server, struct stream *stream)
 				pw_log_warn("setsockopt(PACKET_MR_PROMISC) fallback failed: %m");
 		}
 	}
+
+	/* listeners don't use an RX ring, see packet-ring.h */
+	if (server->packet_mmap && stream->direction == SPA_DIRECTION_OUTPUT &&
+	    (res = raw_stream_setup_ring(server, stream, fd)) < 0)
+		pw_log_warn("stream %p: can't set up packet ring, using plain socket: %s",
+				stream, spa_strerror(res));
+
 	return spa_steal_fd(fd);
 }
 
+static int raw_stream_flush(struct server *server, struct stream *stream)
+{
+	struct avb_packet_ring *r = &stream->packet_ring;
+
+	if (r->data == NULL || r->pending == 0)
+		return 0;
+
+	r->pending = 0;
+	if (send(stream->source->fd, NULL, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN)
+		return -errno;
+	return 0;
+}
+
 static ssize_t raw_stream_send(struct server *server, struct stream *stream,
 		struct msghdr *msg, int flags)
 {
-	return sendmsg(stream->source->fd, msg, flags);
+	struct avb_packet_ring *r = &stream->packet_ring;
+	ssize_t res;
+
+	if (r->data == NULL)
+		return sendmsg(stream->source->fd, msg, flags);
+
+	res = avb_packet_ring_tx_queue(r, msg->msg_iov, msg->msg_iovlen);
+	if (res == -EAGAIN) {
+		/* ring full, let the kernel catch up and try once more */
+		raw_stream_flush(server, stream);
+		res = avb_packet_ring_tx_queue(r, msg->msg_iov, msg->msg_iovlen);
+	}
+	if (res < 0) {
+		errno = -res;
+		return -1;
+	}
+	return res;
+}
+
+static void raw_stream_close(struct server *server, struct stream *stream)
+{
+	if (stream->packet_ring.data != NULL)
+		munmap(stream->packet_ring.data, stream->packet_ring.size);
+	spa_zero(stream->packet_ring);
 }
 
 int avb_server_stream_setup_socket(struct server *server, struct stream *stream)
@@ -545,6 +633,19 @@ ssize_t avb_server_stream_send(struct server *server, struct stream *stream,
 	return server->transport->stream_send(server, stream, msg, flags);
 }
 
+int avb_server_stream_flush(struct server *server, struct stream *stream)
+{
+	if (server->transport->stream_flush == NULL)
+		return 0;
+	return server->transport->stream_flush(server, stream);
+}
+
+void avb_server_stream_close(struct server *server, struct stream *stream)
+{
+	if (server->transport->stream_close != NULL)
+		server->transport->stream_close(server, stream);
+}
+
 static void raw_transport_destroy(struct server *server)
 {
 	struct impl *impl = server->impl;
@@ -560,6 +661,8 @@ const struct avb_transport_ops avb_transport_raw = {
 	.destroy = raw_transport_destroy,
 	.stream_setup_socket = raw_stream_setup_socket,
 	.stream_send = raw_stream_send,
+	.stream_flush = raw_stream_flush,
+	.stream_close = raw_stream_close,
 };
 
 struct server *avdecc_server_new(struct impl *impl, struct spa_dict *props)
@@ -582,6 +685,9 @@ struct server *avdecc_server_new(struct impl *impl, struct spa_dict *props)
 	else
 		server->avb_mode = AVB_MODE_LEGACY;
 
+	if ((str = spa_dict_lookup(props, "packet-mmap")) != NULL)
+		server->packet_mmap = spa_atob(str);
+
 	spa_hook_list_init(&server->listener_list);
 	spa_list_init(&server->descriptors);
 	spa_list_init(&server->streams);
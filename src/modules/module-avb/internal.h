@@ -36,6 +36,10 @@ struct avb_transport_ops {
 	int (*stream_setup_socket)(struct server *server, struct stream *stream);
 	ssize_t (*stream_send)(struct server *server, struct stream *stream,
 			struct msghdr *msg, int flags);
+	/* optional, hand the frames queued with stream_send to the kernel */
+	int (*stream_flush)(struct server *server, struct stream *stream);
+	/* optional, release what stream_setup_socket set up next to the fd */
+	void (*stream_close)(struct server *server, struct stream *stream);
 };
 
 struct impl {
@@ -124,6 +128,8 @@ struct server {
 	struct spa_list streams;
 
 	unsigned debug_messages:1;
+	/* use TPACKET_V3 mmap rings for the stream sockets, see packet-ring.h */
+	unsigned packet_mmap:1;
 
 	struct avb_gptp *gptp;
 	struct avb_mrp *mrp;
@@ -200,6 +206,8 @@ int avb_server_send_packet(struct server *server, const uint8_t dest[6],
 int avb_server_stream_setup_socket(struct server *server, struct stream *stream);
 ssize_t avb_server_stream_send(struct server *server, struct stream *stream,
 		struct msghdr *msg, int flags);
+int avb_server_stream_flush(struct server *server, struct stream *stream);
+void avb_server_stream_close(struct server *server, struct stream *stream);
 
 void avb_log_state(struct server *server, const char *label);
 
@@ -0,0 +1,136 @@
+/* AVB support */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire contributors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef AVB_PACKET_RING_H
+#define AVB_PACKET_RING_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <linux/if_packet.h>
+
+#include <spa/utils/defs.h>
+
+/*
+ * AF_PACKET TPACKET_V3 TX ring for the stream data plane.
+ *
+ * The ring is a sequence of fixed size frames, each starting with a
+ * struct tpacket3_hdr. A filled frame is handed to the kernel by setting
+ * TP_STATUS_SEND_REQUEST. The kernel only walks the ring when it is kicked
+ * with send(), so all PDUs of one flush tick leave with a single syscall.
+ * The kernel gives the frame back (TP_STATUS_AVAILABLE) when the skb is
+ * freed after transmission.
+ *
+ * There is no RX ring. The kernel hands an RX block over when it is full or
+ * when its retire timer expires. That timer counts in jiffies, so a block
+ * of class A PDUs, one every 125us, would wait up to several ms, and even
+ * the smallest block holds many PDU periods. Listeners receive with recv().
+ *
+ * The code here only knows the layout, not where the memory comes from:
+ * the raw transport maps it from the socket, the loopback transport
+ * allocates it and plays the kernel side itself.
+ */
+
+#define AVB_PACKET_RING_FRAME_SIZE	4096u
+#define AVB_PACKET_RING_BLOCK_SIZE	(1u << 16)
+#define AVB_PACKET_RING_BLOCK_NR	8u
+
+/* where the kernel expects the frame data in a TX slot */
+#define AVB_PACKET_RING_TX_OFFSET	(TPACKET3_HDRLEN - sizeof(struct sockaddr_ll))
+
+struct avb_packet_ring {
+	void *data;
+	size_t size;
+
+	uint32_t block_size;
+	uint32_t block_nr;
+	uint32_t frame_size;
+	uint32_t frame_nr;
+	uint32_t frames_per_block;
+
+	uint32_t head;		/**< next frame to fill */
+	uint32_t pending;	/**< frames queued since the last kick */
+};
+
+static inline void avb_packet_ring_req(struct tpacket_req3 *req)
+{
+	memset(req, 0, sizeof(*req));
+	req->tp_block_size = AVB_PACKET_RING_BLOCK_SIZE;
+	req->tp_block_nr = AVB_PACKET_RING_BLOCK_NR;
+	req->tp_frame_size = AVB_PACKET_RING_FRAME_SIZE;
+	req->tp_frame_nr = req->tp_block_nr *
+		(req->tp_block_size / req->tp_frame_size);
+}
+
+static inline size_t avb_packet_ring_req_size(const struct tpacket_req3 *req)
+{
+	return (size_t)req->tp_block_size * req->tp_block_nr;
+}
+
+static inline void avb_packet_ring_init(struct avb_packet_ring *r, void *data,
+		const struct tpacket_req3 *req)
+{
+	memset(r, 0, sizeof(*r));
+	r->data = data;
+	r->size = avb_packet_ring_req_size(req);
+	r->block_size = req->tp_block_size;
+	r->block_nr = req->tp_block_nr;
+	r->frame_size = req->tp_frame_size;
+	r->frame_nr = req->tp_frame_nr;
+	r->frames_per_block = req->tp_block_size / req->tp_frame_size;
+}
+
+static inline struct tpacket3_hdr *avb_packet_ring_frame(struct avb_packet_ring *r,
+		uint32_t index)
+{
+	uint32_t block = index / r->frames_per_block;
+	uint32_t frame = index % r->frames_per_block;
+
+	return SPA_PTROFF(r->data, (size_t)block * r->block_size +
+			(size_t)frame * r->frame_size, struct tpacket3_hdr);
+}
+
+/**
+ * Copy one frame into the next free TX slot. Returns the frame size,
+ * -EAGAIN when the kernel still owns the slot or -EMSGSIZE when the frame
+ * does not fit in a slot. The frame is only sent after the next kick.
+ */
+static inline ssize_t avb_packet_ring_tx_queue(struct avb_packet_ring *r,
+		const struct iovec *iov, size_t iovcnt)
+{
+	struct tpacket3_hdr *h = avb_packet_ring_frame(r, r->head);
+	uint32_t status = __atomic_load_n(&h->tp_status, __ATOMIC_ACQUIRE);
+	uint8_t *dst;
+	size_t i, len = 0;
+
+	/* the kernel refused the frame in this slot, it is lost but the
+	 * slot can be reused */
+	if (status & TP_STATUS_WRONG_FORMAT)
+		status = TP_STATUS_AVAILABLE;
+	if (status != TP_STATUS_AVAILABLE)
+		return -EAGAIN;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+	if (len > r->frame_size - AVB_PACKET_RING_TX_OFFSET)
+		return -EMSGSIZE;
+
+	dst = SPA_PTROFF(h, AVB_PACKET_RING_TX_OFFSET, uint8_t);
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+		dst += iov[i].iov_len;
+	}
+	h->tp_next_offset = 0;
+	h->tp_len = len;
+	h->tp_snaplen = len;
+	__atomic_store_n(&h->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+	r->head = (r->head + 1) % r->frame_nr;
+	r->pending++;
+	return len;
+}
+
+#endif /* AVB_PACKET_RING_H */
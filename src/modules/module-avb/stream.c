@@ -57,6 +57,13 @@
  *   no longer calls flush_write_*. Calling both would double-send each
  *   PDU.
  *
+ *   When the server has packet-mmap enabled, the socket has a TPACKET_V3
+ *   TX ring (packet-ring.h): stream_send only queues the PDU in the ring
+ *   and flush_write_* kicks the kernel once at the end of the tick, so a
+ *   tick costs one syscall instead of one per PDU. Listeners don't get an
+ *   RX ring: the kernel only hands over a block when it is full or after a
+ *   timeout counted in jiffies, far more than the 125us class A interval.
+ *
  * --------------------------------------------------------------------------
  * Counter unsolicited notifications
  * --------------------------------------------------------------------------
@@ -549,6 +556,9 @@ static int flush_write_milan_v12(struct stream *stream, uint64_t current_time, i
 	/* M2: keep the accumulator monotonic across ticks (advance by emitted PDUs). */
 	stream->tx_pts = ptime;
 
+	if (avb_server_stream_flush(stream->server, stream) < 0)
+		pw_log_error("stream flush failed: %m");
+
 	stream_out_mark_counters_dirty(stream);
 	spa_ringbuffer_read_update(&stream->ring, index);
 	return 0;
@@ -600,6 +610,9 @@ static int flush_write_legacy(struct stream *stream, uint64_t current_time)
 	}
 	stream->dbc = dbc;
 
+	if (avb_server_stream_flush(stream->server, stream) < 0)
+		pw_log_error("stream flush failed: %m");
+
 	stream_out_mark_counters_dirty(stream);
 	spa_ringbuffer_read_update(&stream->ring, index);
 	return 0;
@@ -1434,6 +1447,43 @@ static void handle_iec61883_packet(struct stream *stream,
 	}
 }
 
+static void handle_stream_frame(void *data, uint8_t *buffer, uint32_t len)
+{
+	struct stream *stream = data;
+	struct avb_ethernet_header *h = (void*)buffer;
+	struct avb_packet_header *ph = SPA_PTROFF(h, sizeof(*h), void);
+
+	if (len < sizeof(struct avb_ethernet_header) +
+			sizeof(struct avb_packet_iec61883)) {
+		pw_log_warn("short packet received (%u < %d)", len,
+				(int)(sizeof(struct avb_ethernet_header) +
+				sizeof(struct avb_packet_iec61883)));
+		return;
+	}
+
+	if (memcmp(h->dest, stream->addr, 6) != 0)
+		return;
+
+	switch (ph->subtype) {
+	case AVB_SUBTYPE_AAF:
+		handle_aaf_packet(stream,
+				(struct avb_packet_aaf *)ph,
+				(int)len - (int)sizeof(*h));
+		break;
+	case AVB_SUBTYPE_61883_IIDC:
+		handle_iec61883_packet(stream,
+				(struct avb_packet_iec61883 *)ph,
+				(int)len - (int)sizeof(*h));
+		break;
+	case AVB_SUBTYPE_CRF:
+		/* CRF clock-reference stream: no audio data plane; consume and ignore (clock recovery is future work). */
+		break;
+	default:
+		pw_log_warn("unsupported subtype 0x%02x", ph->subtype);
+		break;
+	}
+}
+
 /* TODO: RX is on the main loop, not the RT data_loop — preemption can drop PDUs (SEQ_NUM_MISMATCH); move it to data_loop + a big SO_RCVBUF, like the flush_timer. */
 static void on_socket_data(void *data, int fd, uint32_t mask)
 {
@@ -1445,40 +1495,10 @@ static void on_socket_data(void *data, int fd, uint32_t mask)
 
 		len = recv(fd, buffer, sizeof(buffer), 0);
 
-		if (len < 0) {
+		if (len < 0)
 			pw_log_warn("got recv error: %m");
-		}
-		else if (len < (int)(sizeof(struct avb_ethernet_header) +
-				  sizeof(struct avb_packet_iec61883))) {
-			pw_log_warn("short packet received (%d < %d)", len,
-					(int)(sizeof(struct avb_ethernet_header) +
-					sizeof(struct avb_packet_iec61883)));
-		} else {
-			struct avb_ethernet_header *h = (void*)buffer;
-			struct avb_packet_header *ph = SPA_PTROFF(h, sizeof(*h), void);
-
-			if (memcmp(h->dest, stream->addr, 6) != 0)
-				return;
-
-			switch (ph->subtype) {
-			case AVB_SUBTYPE_AAF:
-				handle_aaf_packet(stream,
-						(struct avb_packet_aaf *)ph,
-						len - (int)sizeof(*h));
-				break;
-			case AVB_SUBTYPE_61883_IIDC:
-				handle_iec61883_packet(stream,
-						(struct avb_packet_iec61883 *)ph,
-						len - (int)sizeof(*h));
-				break;
-			case AVB_SUBTYPE_CRF:
-				/* CRF clock-reference stream: no audio data plane; consume and ignore (clock recovery is future work). */
-				break;
-			default:
-				pw_log_warn("unsupported subtype 0x%02x", ph->subtype);
-				break;
-			}
-		}
+		else
+			handle_stream_frame(stream, buffer, len);
 	}
 }
 
@@ -1692,14 +1712,15 @@ int stream_deactivate(struct stream *stream, uint64_t now)
 
 	pw_stream_set_active(stream->stream, false);
 
-	if (stream->source != NULL) {
-		pw_loop_destroy_source(stream->server->impl->loop, stream->source);
-		stream->source = NULL;
-	}
 	if (stream->flush_timer != NULL) {
 		pw_loop_invoke(stream->server->impl->data_loop, do_remove_flush_timer,
 				0, NULL, 0, true, stream);
 	}
+	if (stream->source != NULL) {
+		pw_loop_destroy_source(stream->server->impl->loop, stream->source);
+		stream->source = NULL;
+		avb_server_stream_close(stream->server, stream);
+	}
 	/* milan-avb: withdraw ALL of this stream's declarations so the bridge frees the reservation immediately (Leave) instead of holding stale state until its LeaveAll timer — otherwise a stop/restart or replug to another port can't re-register (the old port's Talker/Listener/VLAN entry still pins the stream). */
 	if (stream->direction == SPA_DIRECTION_INPUT) {
 		si = SPA_CONTAINER_OF(common, struct aecp_aem_stream_input_state, common);
@@ -16,6 +16,7 @@
 
 #include "mc-recover.h"
 #include "play-loop.h"
+#include "packet-ring.h"
 
 #include <pipewire/pipewire.h>
 
@@ -76,6 +77,9 @@ struct stream {
 	char control[CMSG_SPACE(sizeof(uint64_t))];
 	struct cmsghdr *cmsg;
 
+	/* TX ring of a talker socket when the server uses packet_mmap */
+	struct avb_packet_ring packet_ring;
+
 	struct spa_ringbuffer ring;
 	void *buffer_data;
 	size_t buffer_size;
@@ -294,6 +294,15 @@ struct impl {
 
 	struct spa_list streams;
 	uint32_t n_streams;
+
+	uint32_t quantum_limit;
+
+	/* in sink mode, the history of the combine input for latency
+	 * compensation, shared by all streams */
+	void *historybuf;
+	uint32_t history_size;		/* for data loop */
+	uint32_t history_idx;
+	uint32_t history_channels;
 };
 
 struct ringbuffer {
@@ -320,6 +329,7 @@ struct stream {
 
 	void *delaybuf;
 	struct ringbuffer delay[MAX_CHANNELS];
+	uint32_t history_delay;		/* bytes, for data loop */
 
 	int64_t delay_samples;		/* for main loop */
 	int64_t data_delay_samples;	/* for data loop */
@@ -564,6 +574,76 @@ static void resize_delay(struct stream *stream, uint32_t size)
 	free(info.buf);
 }
 
+struct replace_history_info {
+	struct impl *impl;
+	void *buf;
+	uint32_t size;
+	uint32_t channels;
+};
+
+static int do_replace_history(struct spa_loop *loop, bool async, uint32_t seq,
+                const void *data, size_t size, void *user_data)
+{
+	struct replace_history_info *info = user_data;
+	struct impl *impl = info->impl;
+	struct stream *s;
+	uint32_t i, n_bytes;
+
+	if (info->size != impl->history_size || info->channels != impl->history_channels) {
+		/* keep the most recent samples at the end of the new history */
+		n_bytes = SPA_MIN(info->size, impl->history_size);
+		for (i = 0; i < SPA_MIN(info->channels, impl->history_channels) && n_bytes > 0; i++)
+			spa_ringbuffer_read_data(NULL,
+					SPA_PTROFF(impl->historybuf, i * impl->history_size, void),
+					impl->history_size,
+					(impl->history_idx + impl->history_size - n_bytes) % impl->history_size,
+					SPA_PTROFF(info->buf, i * info->size + info->size - n_bytes, void),
+					n_bytes);
+
+		SPA_SWAP(impl->historybuf, info->buf);
+		impl->history_size = info->size;
+		impl->history_channels = info->channels;
+		impl->history_idx = 0;
+	}
+	spa_list_for_each(s, &impl->streams, link)
+		s->history_delay = impl->history_size ?
+			(uint32_t)(s->compensate_samples * sizeof(float)) : 0;
+	return 0;
+}
+
+static void update_history(struct impl *impl)
+{
+	struct replace_history_info info;
+	struct stream *s;
+	int64_t max_compensate = 0;
+
+	spa_zero(info);
+	info.impl = impl;
+
+	spa_list_for_each(s, &impl->streams, link)
+		max_compensate = SPA_MAX(max_compensate, s->compensate_samples);
+
+	/* room for the largest delay and one cycle */
+	if (max_compensate > 0) {
+		info.size = (uint32_t)((max_compensate + impl->quantum_limit) * sizeof(float));
+		info.channels = SPA_MIN(impl->info.channels, MAX_CHANNELS);
+		if (info.size == impl->history_size && info.channels == impl->history_channels) {
+			info.buf = NULL;
+		} else if ((info.buf = calloc(info.channels, info.size)) == NULL) {
+			pw_log_warn("can't allocate latency compensation history: %m");
+			info.size = 0;
+			info.channels = 0;
+		}
+	}
+	if (info.size != impl->history_size)
+		pw_log_info("latency compensation history samples:%u",
+				(unsigned int)(info.size / sizeof(float)));
+
+	pw_loop_locked(impl->data_loop, do_replace_history, 0, NULL, 0, &info);
+
+	free(info.buf);
+}
+
 static void update_delay(struct impl *impl)
 {
 	struct stream *s;
@@ -595,8 +675,12 @@ static void update_delay(struct impl *impl)
 			s->compensate_samples = delay;
 			size = delay * sizeof(float);
 		}
-		resize_delay(s, size);
+		/* in sink mode, all streams read from the shared history */
+		if (get_combine_direction(impl) == PW_DIRECTION_OUTPUT)
+			resize_delay(s, size);
 	}
+	if (get_combine_direction(impl) == PW_DIRECTION_INPUT)
+		update_history(impl);
 
 	update_latency(impl);
 }
@@ -621,6 +705,8 @@ static int do_clear_delaybuf(struct spa_loop *loop, bool async, uint32_t seq,
 			if (s->delay[i].size)
 				memset(s->delay[i].buf, 0, s->delay[i].size);
 	}
+	if (impl->history_size)
+		memset(impl->historybuf, 0, (size_t)impl->history_size * impl->history_channels);
 
 	return 0;
 }
@@ -1183,6 +1269,9 @@ static void combine_input_process(void *d)
 	struct pw_buffer *in, *out;
 	struct stream *s;
 	bool delay_changed = false;
+	const void *src[MAX_CHANNELS];
+	uint32_t i, n_src, size = UINT32_MAX, idx = 0;
+	int32_t stride = 0;
 
 	in = NULL;
 	while (true) {
@@ -1198,6 +1287,30 @@ static void combine_input_process(void *d)
 		return;
 	}
 
+	n_src = SPA_MIN(in->buffer->n_datas, MAX_CHANNELS);
+	for (i = 0; i < n_src; i++) {
+		struct spa_data *ds = &in->buffer->datas[i];
+		uint32_t offs = SPA_MIN(ds->chunk->offset, ds->maxsize);
+
+		src[i] = SPA_PTROFF(ds->data, offs, void);
+		size = SPA_MIN(size, SPA_MIN(ds->chunk->size, ds->maxsize - offs));
+		stride = SPA_MAX(stride, ds->chunk->stride);
+	}
+	if (n_src == 0)
+		size = 0;
+
+	/* write the input once in the history, the streams that need latency
+	 * compensation read from it with their own delay */
+	if (impl->history_size > 0) {
+		size = SPA_MIN(size, impl->quantum_limit * sizeof(float));
+		idx = impl->history_idx;
+		for (i = 0; i < SPA_MIN(n_src, impl->history_channels); i++)
+			spa_ringbuffer_write_data(NULL,
+					SPA_PTROFF(impl->historybuf, i * impl->history_size, void),
+					impl->history_size, idx, src[i], size);
+		impl->history_idx = (idx + size) % impl->history_size;
+	}
+
 	spa_list_for_each(s, &impl->streams, link) {
 		uint32_t j;
 
@@ -1213,27 +1326,23 @@ static void combine_input_process(void *d)
 		}
 
 		for (j = 0; j < out->buffer->n_datas; j++) {
-			struct spa_data *ds, *dd;
+			struct spa_data *dd;
 			uint32_t outsize = 0, remap;
-			int32_t stride = 0;
 
 			dd = &out->buffer->datas[j];
 
 			remap = s->remap[j];
-			if (remap < in->buffer->n_datas) {
-				uint32_t offs, size;
-
-				ds = &in->buffer->datas[remap];
-
-				offs = SPA_MIN(ds->chunk->offset, ds->maxsize);
-				size = SPA_MIN(ds->chunk->size, ds->maxsize - offs);
-				size = SPA_MIN(size, dd->maxsize);
-
-				ringbuffer_memcpy(&s->delay[j],
-					dd->data, SPA_PTROFF(ds->data, offs, void), size);
-
-				outsize = SPA_MAX(outsize, size);
-				stride = SPA_MAX(stride, ds->chunk->stride);
+			if (remap < n_src) {
+				outsize = SPA_MIN(size, dd->maxsize);
+
+				if (s->history_delay > 0 && remap < impl->history_channels)
+					spa_ringbuffer_read_data(NULL,
+						SPA_PTROFF(impl->historybuf, remap * impl->history_size, void),
+						impl->history_size,
+						(idx + impl->history_size - s->history_delay) % impl->history_size,
+						dd->data, outsize);
+				else
+					memcpy(dd->data, src[remap], outsize);
 			} else {
 				memset(dd->data, 0, outsize);
 			}
@@ -1513,6 +1622,7 @@ static void impl_destroy(struct impl *impl)
 	pw_properties_free(impl->combine_props);
 	pw_properties_free(impl->props);
 
+	free(impl->historybuf);
 	free(impl);
 }
 
@@ -1606,6 +1716,9 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 
 	if ((str = pw_properties_get(props, "combine.latency-compensate")) != NULL)
 		impl->latency_compensate = spa_atob(str);
+	impl->quantum_limit = pw_properties_get_uint32(
+			pw_context_get_properties(impl->context),
+			"default.clock.quantum-limit", 8192u);
 	if ((str = pw_properties_get(props, "combine.on-demand-streams")) != NULL)
 		impl->on_demand_streams = spa_atob(str);
 
@@ -89,6 +89,7 @@ extern struct spa_handle_factory spa_filter_graph_factory;
  *         playback.volumes = [
  *             { control = <portname>  min = <value>  max = <value>  scale = <scale> } ...
  *         ]
+ *         optimize = <bool>
  *    }
  *\endcode
  *
@@ -218,6 +219,16 @@ extern struct spa_handle_factory spa_filter_graph_factory;
  * default this is linear but it can be set to cubic when the control applies a
  * cubic transformation.
  *
+ * ### Optimize
+ *
+ * When the graph is activated, some nodes are merged to reduce the per-node
+ * overhead. Copy nodes between two other nodes are skipped and their peers use
+ * the same buffer. A chain of biquads, optionally ending in a linear node, where
+ * each node only links to the next one, is processed as one cascade by the first
+ * biquad. The result is the same as running the nodes separately.
+ *
+ * Set optimize to false to run all nodes as they are described. The default is true.
+ *
  * ## Builtin filters
  *
  * There are some useful builtin filters available. The type should be `builtin` and
@@ -745,6 +756,7 @@ extern struct spa_handle_factory spa_filter_graph_factory;
  *                 gain = ...
  *                 latency = ...
  *                 normalize = ...
+ *                 grid = ...
  *             }
  *             control = {
  *                 "Azimuth" = ...
@@ -767,6 +779,11 @@ extern struct spa_handle_factory spa_filter_graph_factory;
  * - `gain`      the overall gain to apply to the IR file, default 1.0.
  * - `latency`   the latency introduced by the filter, default 0
  * - `normalize` automatically normalize the loudness of the IR, default false
+ * - `grid`      precompute the filters for all positions in the file when loading and
+ *               interpolate between them when the position changes. This uses more
+ *               memory but makes position changes cheap, which is useful when the
+ *               position is updated often. The filters are shared between the
+ *               spatializers with the same file and settings, default false
  *
  * - `Azimuth`   controls the azimuth, this is the direction the sound is coming from
  *               in degrees between 0 and 360. 0 is straight ahead. 90 is left, 180
@@ -967,6 +984,10 @@ extern struct spa_handle_factory spa_filter_graph_factory;
  *             label = {
  *                 filename = "..."
  *                 blocksize = 512
+ *                 #threads = 1
+ *                 #async = false
+ *                 #delay = 1
+ *                 #batch = false
  *                 input-tensors = {
  *                     "<name>" = {
  *                         dimensions = [ ... ]
@@ -995,6 +1016,16 @@ extern struct spa_handle_factory spa_filter_graph_factory;
  * - `filename` the ONNX model to load. It must point to an existing onnx file.
  * - `blocksize` the number of samples to give to the model. This depends on the model
  *               and the input/output tensor sizes.
+ * - `threads` the number of threads the model can use to run one inference, default 1.
+ * - `async` run the model in a separate thread instead of in the processing thread,
+ *           default false. The output of a block is then produced `delay` blocks later,
+ *           this is reported as the latency of the filter. When the model did not
+ *           complete in time, silence is produced and the block is dropped.
+ * - `delay` the number of blocks of delay in async mode, between 1 and 3, default 1.
+ *           A larger delay gives the model more time to complete.
+ * - `batch` in async mode, run all the instances of the filter in one inference
+ *           with the first dimension of the tensors used as the batch dimension,
+ *           default false. The model must accept a variable first dimension.
  * - `input-tensors` an object of input tensors of the model and how they should be
  *                   used. Unlisted tensors will not be used.
  * - `output-tensors` an object of output tensors of the model and how they should be
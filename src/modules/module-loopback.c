@@ -297,8 +297,11 @@ struct impl {
 
 	unsigned int do_disconnect:1;
 	unsigned int recalc_delay:1;
+	unsigned int direct:1;
 
 	struct spa_io_position *position;
+	struct spa_io_position *capture_position;
+	struct spa_io_position *playback_position;
 
 	uint32_t target_rate;
 	uint32_t rate;
@@ -331,6 +334,13 @@ static void recalculate_delay(struct impl *impl)
 	delay = target - SPA_MIN(target, pdelay + cdelay);
 	delay = SPA_MIN(delay, impl->buffer_size / 4);
 
+	/* when the streams already have enough latency, the delay buffer is
+	 * not used and the samples are copied directly. Clear the old data
+	 * when we start to use it again. */
+	if (impl->direct && delay > 0)
+		memset(impl->buffer_data, 0, (size_t)impl->buffer_size * impl->channels);
+	impl->direct = delay == 0;
+
 	spa_ringbuffer_get_write_index(&impl->buffer, &w);
 	spa_ringbuffer_read_update(&impl->buffer, w - (delay * 4));
 
@@ -353,11 +363,21 @@ static void capture_process(void *d)
 	}
 }
 
+static void restore_buffer(struct pw_buffer *b)
+{
+	void **orig = b->user_data;
+	uint32_t i;
+
+	for (i = 0; i < b->buffer->n_datas; i++)
+		b->buffer->datas[i].data = orig[i];
+}
+
 static void playback_process(void *d)
 {
 	struct impl *impl = d;
 	struct pw_buffer *in, *out;
 	uint32_t i;
+	bool zero_copy;
 
 	if (impl->recalc_delay) {
 		recalculate_delay(impl);
@@ -378,6 +398,8 @@ static void playback_process(void *d)
 
 	if ((out = pw_stream_dequeue_buffer(impl->playback)) == NULL)
 		pw_log_debug("%p: out of playback buffers: %m", impl);
+	else if (out->user_data != NULL)
+		restore_buffer(out);
 
 	if (in != NULL && out != NULL) {
 		uint32_t outsize = UINT32_MAX;
@@ -397,7 +419,7 @@ static void playback_process(void *d)
 			outsize = SPA_MIN(outsize, size);
 			stride = SPA_MAX(stride, d->chunk->stride);
 		}
-		if (impl->buffer_size > 0) {
+		if (impl->buffer_size > 0 && !impl->direct) {
 			buffer_size = impl->buffer_size;
 			spa_ringbuffer_get_write_index(&impl->buffer, &w);
 			for (i = 0; i < in->buffer->n_datas; i++) {
@@ -414,12 +436,24 @@ static void playback_process(void *d)
 			r = 0;
 			buffer_size = outsize;
 		}
+		/* without delay, when both streams are scheduled by the same driver
+		 * and the playback buffers are dynamic, let the playback converter
+		 * read the capture samples directly. The capture buffer is only
+		 * refilled in the next cycle, after the playback node has run. */
+		zero_copy = (impl->buffer_size == 0 || impl->direct) &&
+			out->user_data != NULL &&
+			impl->playback_position != NULL &&
+			impl->playback_position == impl->capture_position &&
+			in->buffer->n_datas == out->buffer->n_datas;
+
 		for (i = 0; i < out->buffer->n_datas; i++) {
 			d = &out->buffer->datas[i];
 
 			outsize = SPA_MIN(outsize, d->maxsize);
 
-			if (i < in->buffer->n_datas)
+			if (zero_copy)
+				d->data = (void*)src[i];
+			else if (i < in->buffer->n_datas)
 				spa_ringbuffer_read_data(&impl->buffer,
 						src[i], buffer_size,
 						r % buffer_size,
@@ -431,7 +465,7 @@ static void playback_process(void *d)
 			d->chunk->size = outsize;
 			d->chunk->stride = stride;
 		}
-		if (impl->buffer_size > 0) {
+		if (impl->buffer_size > 0 && !impl->direct) {
 			r += outsize;
 			spa_ringbuffer_read_update(&impl->buffer, r);
 		}
@@ -596,6 +630,7 @@ static void recalculate_buffer(struct impl *impl)
 		}
 		impl->buffer_data = data;
 		spa_ringbuffer_init(&impl->buffer);
+		impl->direct = false;
 	} else {
 		impl->buffer_size = 0;
 		free(impl->buffer_data);
@@ -664,12 +699,12 @@ static void capture_param_changed(void *data, uint32_t id, const struct spa_pod
 	}
 }
 
-static void io_changed(void *data, uint32_t id, void *area, uint32_t size)
+static void capture_io_changed(void *data, uint32_t id, void *area, uint32_t size)
 {
 	struct impl *impl = data;
 	switch (id) {
 	case SPA_IO_Position:
-		impl->position = area;
+		impl->position = impl->capture_position = area;
 		break;
 	default:
 		break;
@@ -682,7 +717,7 @@ static const struct pw_stream_events in_stream_events = {
 	.process = capture_process,
 	.state_changed = stream_state_changed,
 	.param_changed = capture_param_changed,
-	.io_changed = io_changed,
+	.io_changed = capture_io_changed,
 };
 
 static void playback_destroy(void *d)
@@ -692,6 +727,44 @@ static void playback_destroy(void *d)
 	impl->playback = NULL;
 }
 
+static void playback_io_changed(void *data, uint32_t id, void *area, uint32_t size)
+{
+	struct impl *impl = data;
+	switch (id) {
+	case SPA_IO_Position:
+		impl->position = impl->playback_position = area;
+		break;
+	default:
+		break;
+	}
+}
+
+static void playback_add_buffer(void *data, struct pw_buffer *b)
+{
+	struct spa_buffer *buf = b->buffer;
+	void **orig;
+	uint32_t i;
+
+	for (i = 0; i < buf->n_datas; i++)
+		if (!SPA_FLAG_IS_SET(buf->datas[i].flags, SPA_DATA_FLAG_DYNAMIC))
+			return;
+	if (buf->n_datas == 0 || (orig = calloc(buf->n_datas, sizeof(void*))) == NULL)
+		return;
+	/* remember the data pointers to restore when we need to copy */
+	for (i = 0; i < buf->n_datas; i++)
+		orig[i] = buf->datas[i].data;
+	b->user_data = orig;
+}
+
+static void playback_remove_buffer(void *data, struct pw_buffer *b)
+{
+	if (b->user_data == NULL)
+		return;
+	restore_buffer(b);
+	free(b->user_data);
+	b->user_data = NULL;
+}
+
 static void playback_param_changed(void *data, uint32_t id, const struct spa_pod *param)
 {
 	struct impl *impl = data;
@@ -720,7 +793,9 @@ static const struct pw_stream_events out_stream_events = {
 	.process = playback_process,
 	.state_changed = stream_state_changed,
 	.param_changed = playback_param_changed,
-	.io_changed = io_changed,
+	.io_changed = playback_io_changed,
+	.add_buffer = playback_add_buffer,
+	.remove_buffer = playback_remove_buffer,
 };
 
 static int setup_streams(struct impl *impl)
@@ -762,7 +837,8 @@ static int setup_streams(struct impl *impl)
 			PW_STREAM_FLAG_AUTOCONNECT |
 			PW_STREAM_FLAG_MAP_BUFFERS |
 			PW_STREAM_FLAG_RT_PROCESS |
-			PW_STREAM_FLAG_TRIGGER,
+			PW_STREAM_FLAG_TRIGGER |
+			PW_STREAM_FLAG_DYNAMIC_DATA,
 			params, n_params)) < 0)
 		return res;
 
@@ -66,6 +66,14 @@
  *     - `type`: an optional metadata value type
  *     - `value`: a JSON item, the metadata value.
  *
+ * - `metadata.shm`: Also publish the metadata in read-only shared memory
+ *                   snapshots, default false. Every client that binds the
+ *                   object gets its own snapshot with the items it can see.
+ *                   The `metadata.shm.mem-id` and `metadata.shm.size` keys
+ *                   in the bound_props of the proxy give the memory in the
+ *                   core mempool, values can then be looked up with
+ *                   \ref pw_metadata_shm_get() without a roundtrip.
+ *
  * ## Example configuration
  *
  * The module is usually added to the config file of the main PipeWire daemon and the
@@ -88,6 +88,9 @@
  * - `source.port =<int>`: port to bind to, default 0 (allocate)
  * - `netjack2.client-name`: the name of the NETJACK2 client.
  * - `netjack2.latency`: the latency in cycles, default 2
+ * - `netjack2.codec-threads`: the number of threads to encode and decode opus
+ *      channels with, default 0. Values larger than 1 code the channels in parallel,
+ *      the data thread takes a share of the channels.
  * - `audio.ports`: the number of audio ports. Can also be added to the stream props.
  *      A value of -1 will configure to the number of audio ports on the manager.
  * - `midi.ports`: the number of midi ports. Can also be added to the stream props.
@@ -152,6 +155,7 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 #define DEFAULT_SOURCE_PORT	0
 
 #define DEFAULT_NETWORK_LATENCY	2
+#define DEFAULT_CODEC_THREADS	0
 #define NETWORK_MAX_LATENCY	30
 
 #define DEFAULT_CLIENT_NAME	"PipeWire"
@@ -173,6 +177,7 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 			"( source.port=<port to bind, default 0> ) "		\
 			"( netjack2.client-name=<name of the NETJACK2 client> ) "	\
 			"( netjack2.latency=<latency in cycles, default 2> ) "	\
+			"( netjack2.codec-threads=<opus coding threads, default 0> ) "	\
 			"( audio.ports=<number of midi ports, default -1> ) "	\
 			"( midi.ports=<number of midi ports, default -1> ) "	\
 			"( audio.channels=<number of channels, default 0> ) "	\
@@ -240,6 +245,7 @@ struct impl {
 	int mtu;
 	uint32_t latency;
 	uint32_t quantum_limit;
+	uint32_t codec_threads;
 
 	struct pw_impl_module *module;
 	struct spa_hook module_listener;
@@ -917,6 +923,7 @@ static int handle_follower_setup(struct impl *impl, struct nj2_session_params *p
 	peer->send_volume = &impl->sink.volume;
 	peer->recv_volume = &impl->source.volume;
 	peer->quantum_limit = impl->quantum_limit;
+	peer->codec_threads = impl->codec_threads;
 	if ((res = netjack2_init(peer)) < 0) {
 		pw_log_error("can't init peer: %s", spa_strerror(res));
 		return res;
@@ -1309,6 +1316,8 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 
 	impl->latency = pw_properties_get_uint32(impl->props, "netjack2.latency",
 			DEFAULT_NETWORK_LATENCY);
+	impl->codec_threads = pw_properties_get_uint32(impl->props, "netjack2.codec-threads",
+			DEFAULT_CODEC_THREADS);
 
 	pw_properties_set(props, PW_KEY_NODE_LOOP_NAME, impl->data_loop->name);
 	if (pw_properties_get(props, PW_KEY_NODE_VIRTUAL) == NULL)
@@ -81,6 +81,9 @@
  * - `netjack2.period-size`: the buffer size to use, default 1024
  * - `netjack2.encoding`: the encoding, float|opus|int, default float
  * - `netjack2.kbps`: the number of kilobits per second when encoding, default 64
+ * - `netjack2.codec-threads`: the number of threads to encode and decode opus
+ *      channels with, default 0. Values larger than 1 code the channels in parallel,
+ *      the data thread takes a share of the channels.
  * - `netjack2.max-followers`: the maximum number of concurrent followers, default 64
  * - `audio.ports`: the number of audio ports. Can also be added to the stream props. This
  *     is the default suggestion for drivers that don't specify any number of audio channels.
@@ -156,6 +159,7 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 #define DEFAULT_PERIOD_SIZE	1024
 #define DEFAULT_ENCODING	"float"
 #define DEFAULT_KBPS		64
+#define DEFAULT_CODEC_THREADS	0
 #define DEFAULT_AUDIO_PORTS	2
 #define DEFAULT_MIDI_PORTS	1
 #define DEFAULT_MAX_FOLLOWERS	64
@@ -171,6 +175,7 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 			"( netjack2.sample-rate=<sampl erate, default 48000> ) "\
 			"( netjack2.period-size=<period size, default 1024> ) "	\
 			"( netjack2.max-followers=<max followers, default 64> ) "	\
+			"( netjack2.codec-threads=<opus coding threads, default 0> ) "	\
 			"( midi.ports=<number of midi ports, default 1> ) "	\
 			"( audio.channels=<number of channels, default 2> ) "	\
 			"( audio.position=<channel map> ) "			\
@@ -275,6 +280,7 @@ struct impl {
 	uint32_t encoding;
 	uint32_t kbps;
 	uint32_t quantum_limit;
+	uint32_t codec_threads;
 
 	struct pw_impl_module *module;
 	struct spa_hook module_listener;
@@ -1116,6 +1122,7 @@ static int handle_follower_available(struct impl *impl, struct nj2_session_param
 	peer->send_volume = &follower->sink.volume;
 	peer->recv_volume = &follower->source.volume;
 	peer->quantum_limit = impl->quantum_limit;
+	peer->codec_threads = impl->codec_threads;
 	if ((res = netjack2_init(peer)) < 0) {
 		pw_log_error("can't init peer: %s", spa_strerror(res));
 		goto cleanup;
@@ -1403,6 +1410,8 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	}
 	impl->kbps = pw_properties_get_uint32(impl->props, "netjack2.kbps",
 			DEFAULT_KBPS);
+	impl->codec_threads = pw_properties_get_uint32(impl->props, "netjack2.codec-threads",
+			DEFAULT_CODEC_THREADS);
 	impl->max_followers = pw_properties_get_uint32(impl->props, "netjack2.max-followers",
 			DEFAULT_MAX_FOLLOWERS);
 
@@ -1,8 +1,13 @@
 
+#include <semaphore.h>
+#include <time.h>
+
 #include <spa/utils/endian.h>
 #include <spa/utils/overflow.h>
 #include <spa/control/ump-utils.h>
 
+#include <pipewire/thread.h>
+
 #ifdef HAVE_OPUS_CUSTOM
 #include <opus/opus.h>
 #include <opus/opus_custom.h>
@@ -12,6 +17,10 @@
 #define MAX_MIDI	128u
 #define MAX_PORTS	(MAX_CHANNELS > MAX_MIDI ? MAX_CHANNELS : MAX_MIDI)
 
+#define MAX_CODEC_THREADS	16u
+#define CODEC_STATS_CYCLES	4096u
+#define CODEC_JOB_IDLE		(UINT32_MAX / 2)
+
 struct volume {
 	bool mute;
 	uint32_t n_volumes;
@@ -106,6 +115,41 @@ static inline void do_volume_from_s16(float *dst, const int16_t *src, struct vol
 	}
 }
 
+struct data_info {
+	uint32_t id;
+	void *data;
+	bool filled;
+};
+
+#ifdef HAVE_OPUS_CUSTOM
+struct netjack2_peer;
+
+struct codec_stats {
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint32_t count;
+};
+
+struct codec_worker {
+	struct netjack2_peer *peer;
+	struct spa_thread *thread;
+	sem_t sem_start;
+};
+
+/* the channels of one encode or decode run. Channels are claimed by
+ * incrementing next, which is CODEC_JOB_IDLE between runs so that late
+ * woken workers don't pick up anything */
+struct codec_job {
+	bool encode;
+	uint32_t nframes;
+	struct data_info *info;
+	uint32_t n_info;
+	uint32_t n_channels;
+	uint32_t next;
+	uint32_t done;
+};
+#endif
+
 struct netjack2_peer {
 	int fd;
 
@@ -130,11 +174,239 @@ struct netjack2_peer {
 	OpusCustomMode *opus_config;
 	OpusCustomEncoder **opus_enc;
 	OpusCustomDecoder **opus_dec;
+
+	struct codec_job job;
+	uint32_t n_workers;
+	struct codec_worker workers[MAX_CODEC_THREADS];
+	sem_t sem_finish;
+	bool running;
+
+	struct codec_stats *enc_stats;
+	struct codec_stats *dec_stats;
+	uint32_t stats_cycle;
 #endif
+	uint32_t codec_threads;
 
 	unsigned fix_midi:1;
 };
 
+#ifdef HAVE_OPUS_CUSTOM
+static void encode_channel(struct netjack2_peer *peer, uint32_t i)
+{
+	struct codec_job *job = &peer->job;
+	uint32_t max_encoded = peer->max_encoded_size;
+	uint16_t *ap = SPA_PTROFF(peer->encoded_data, i * max_encoded, uint16_t);
+	void *pcm;
+	int res;
+
+	if (i >= job->n_info || (pcm = job->info[i].data) == NULL)
+		pcm = peer->empty;
+
+	res = opus_custom_encode_float(peer->opus_enc[i],
+			pcm, job->nframes, (unsigned char*)&ap[1], max_encoded - 2);
+
+	if (res < 0 || res > 0xffff) {
+		pw_log_warn("encoding error %d", res);
+		ap[0] = 0;
+	} else {
+		ap[0] = htons(res);
+	}
+}
+
+static void decode_channel(struct netjack2_peer *peer, uint32_t i)
+{
+	struct codec_job *job = &peer->job;
+	uint32_t max_encoded = peer->max_encoded_size;
+	uint16_t *ap = SPA_PTROFF(peer->encoded_data, i * max_encoded, uint16_t);
+	uint16_t encoded_len = ntohs(ap[0]);
+	void *pcm;
+	int res;
+
+	if (i >= job->n_info || (pcm = job->info[i].data) == NULL)
+		return;
+
+	if (encoded_len > max_encoded - sizeof(uint16_t))
+		return;
+
+	res = opus_custom_decode_float(peer->opus_dec[i],
+			(unsigned char*)&ap[1], encoded_len,
+			pcm, job->nframes);
+
+	if (res < 0 || res > 0xffff || res != (int)job->nframes)
+		pw_log_warn("decoding error %d", res);
+	else
+		job->info[i].filled = true;
+}
+
+static void codec_channel(struct netjack2_peer *peer, uint32_t i)
+{
+	struct codec_stats *s;
+	struct timespec ts;
+	uint64_t t1, t2;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	if (peer->job.encode) {
+		encode_channel(peer, i);
+		s = &peer->enc_stats[i];
+	} else {
+		decode_channel(peer, i);
+		s = &peer->dec_stats[i];
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	s->total_ns += t2 - t1;
+	s->max_ns = SPA_MAX(s->max_ns, t2 - t1);
+	s->count++;
+}
+
+/* claim and process channels until none are left, returns the number
+ * of channels done */
+static uint32_t codec_claim_channels(struct netjack2_peer *peer, bool worker)
+{
+	struct codec_job *job = &peer->job;
+	uint32_t i, n = 0;
+
+	while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_ACQUIRE)) < job->n_channels) {
+		codec_channel(peer, i);
+		n++;
+		/* a worker reports each channel, it might otherwise claim
+		 * a channel of the next run while holding a count */
+		if (worker && __atomic_add_fetch(&job->done, 1, __ATOMIC_ACQ_REL) == job->n_channels)
+			sem_post(&peer->sem_finish);
+	}
+	return n;
+}
+
+static void *codec_thread(void *data)
+{
+	struct codec_worker *w = data;
+	struct netjack2_peer *peer = w->peer;
+
+	while (true) {
+		sem_wait(&w->sem_start);
+		if (!__atomic_load_n(&peer->running, __ATOMIC_ACQUIRE))
+			break;
+		codec_claim_channels(peer, true);
+	}
+	return NULL;
+}
+
+static void codec_dump_stats(struct netjack2_peer *peer)
+{
+	uint32_t i;
+
+	if (++peer->stats_cycle < CODEC_STATS_CYCLES)
+		return;
+	peer->stats_cycle = 0;
+
+	if (pw_log_level_enabled(SPA_LOG_LEVEL_DEBUG)) {
+		for (i = 0; i < peer->params.send_audio_channels; i++) {
+			struct codec_stats *s = &peer->enc_stats[i];
+			if (s->count > 0)
+				pw_log_debug("%p: encode channel %u: avg %"PRIu64"ns max %"PRIu64"ns",
+						peer, i, s->total_ns / s->count, s->max_ns);
+		}
+		for (i = 0; i < peer->params.recv_audio_channels; i++) {
+			struct codec_stats *s = &peer->dec_stats[i];
+			if (s->count > 0)
+				pw_log_debug("%p: decode channel %u: avg %"PRIu64"ns max %"PRIu64"ns",
+						peer, i, s->total_ns / s->count, s->max_ns);
+		}
+	}
+	memset(peer->enc_stats, 0, peer->params.send_audio_channels * sizeof(struct codec_stats));
+	memset(peer->dec_stats, 0, peer->params.recv_audio_channels * sizeof(struct codec_stats));
+}
+
+/* Encode or decode all audio channels. With workers, the channels are
+ * handed out one by one and the calling thread takes its share. It never
+ * waits for a worker that did not start yet, only for the channels that
+ * are still being coded, so the cycle is never slower than coding serially
+ * plus one channel. */
+static void codec_process(struct netjack2_peer *peer, bool encode, uint32_t nframes,
+		struct data_info *info, uint32_t n_info, uint32_t n_channels)
+{
+	struct codec_job *job = &peer->job;
+	uint32_t i, n;
+
+	job->encode = encode;
+	job->nframes = nframes;
+	job->info = info;
+	job->n_info = n_info;
+	job->n_channels = n_channels;
+
+	if (peer->n_workers == 0 || n_channels < 2) {
+		for (i = 0; i < n_channels; i++)
+			codec_channel(peer, i);
+	} else {
+		__atomic_store_n(&job->done, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&job->next, 0, __ATOMIC_RELEASE);
+
+		n = SPA_MIN(peer->n_workers, n_channels - 1);
+		for (i = 0; i < n; i++)
+			sem_post(&peer->workers[i].sem_start);
+
+		n = codec_claim_channels(peer, false);
+		if (__atomic_add_fetch(&job->done, n, __ATOMIC_ACQ_REL) < n_channels)
+			sem_wait(&peer->sem_finish);
+
+		__atomic_store_n(&job->next, CODEC_JOB_IDLE, __ATOMIC_RELAXED);
+	}
+	codec_dump_stats(peer);
+}
+
+static void codec_start_workers(struct netjack2_peer *peer)
+{
+	struct spa_thread *thread;
+	uint32_t i, n_workers;
+
+	peer->job.next = CODEC_JOB_IDLE;
+	if (peer->codec_threads < 2)
+		return;
+
+	n_workers = SPA_MIN(peer->codec_threads - 1, MAX_CODEC_THREADS);
+	sem_init(&peer->sem_finish, 0, 0);
+	peer->running = true;
+
+	for (i = 0; i < n_workers; i++) {
+		struct codec_worker *w = &peer->workers[i];
+
+		w->peer = peer;
+		sem_init(&w->sem_start, 0, 0);
+		if ((thread = pw_thread_utils_create(NULL, codec_thread, w)) == NULL) {
+			pw_log_warn("%p: can't create codec thread: %m", peer);
+			sem_destroy(&w->sem_start);
+			break;
+		}
+		pw_thread_utils_acquire_rt(thread, -1);
+		w->thread = thread;
+	}
+	peer->n_workers = i;
+	pw_log_info("%p: using %u codec workers", peer, peer->n_workers);
+}
+
+static void codec_stop_workers(struct netjack2_peer *peer)
+{
+	uint32_t i;
+
+	if (!peer->running)
+		return;
+
+	__atomic_store_n(&peer->running, false, __ATOMIC_RELEASE);
+	for (i = 0; i < peer->n_workers; i++)
+		sem_post(&peer->workers[i].sem_start);
+	for (i = 0; i < peer->n_workers; i++) {
+		pw_thread_utils_join(peer->workers[i].thread, NULL);
+		sem_destroy(&peer->workers[i].sem_start);
+	}
+	sem_destroy(&peer->sem_finish);
+	peer->n_workers = 0;
+}
+#endif
+
 static int netjack2_init(struct netjack2_peer *peer)
 {
 	int res = 0;
@@ -216,6 +488,13 @@ static int netjack2_init(struct netjack2_peer *peer)
 					1, &res)) == NULL)
 				goto error_opus;
 		}
+		if ((peer->enc_stats = calloc(peer->params.send_audio_channels,
+				sizeof(struct codec_stats))) == NULL ||
+		    (peer->dec_stats = calloc(peer->params.recv_audio_channels,
+				sizeof(struct codec_stats))) == NULL)
+			goto error_errno;
+
+		codec_start_workers(peer);
 #else
 		return -ENOTSUP;
 #endif
@@ -239,6 +518,9 @@ static void netjack2_cleanup(struct netjack2_peer *peer)
 	free(peer->midi_data);
 #ifdef HAVE_OPUS_CUSTOM
 	int32_t i;
+	codec_stop_workers(peer);
+	free(peer->enc_stats);
+	free(peer->dec_stats);
 	if (peer->opus_enc != NULL) {
 		for (i = 0; i < peer->params.send_audio_channels; i++) {
 			if (peer->opus_enc[i])
@@ -260,12 +542,6 @@ static void netjack2_cleanup(struct netjack2_peer *peer)
 	spa_zero(*peer);
 }
 
-struct data_info {
-	uint32_t id;
-	void *data;
-	bool filled;
-};
-
 static inline void fix_midi_event(uint8_t *data, size_t size)
 {
 	/* fixup NoteOn with vel 0 */
@@ -591,24 +867,7 @@ static int netjack2_send_opus(struct netjack2_peer *peer, uint32_t nframes,
 
 	encoded_data = peer->encoded_data;
 
-	for (i = 0; i < active_ports; i++) {
-		uint16_t *ap = SPA_PTROFF(encoded_data, i * max_encoded, uint16_t);
-		void *pcm;
-		int res;
-
-		if (i >= n_info || (pcm = info[i].data) == NULL)
-			pcm = peer->empty;
-
-		res = opus_custom_encode_float(peer->opus_enc[i],
-				pcm, nframes, (unsigned char*)&ap[1], max_encoded - 2);
-
-		if (res < 0 || res > 0xffff) {
-			pw_log_warn("encoding error %d", res);
-			ap[0] = 0;
-		} else {
-			ap[0] = htons(res);
-		}
-	}
+	codec_process(peer, true, nframes, info, n_info, active_ports);
 
 	strncpy(header.type, "header", sizeof(header.type));
 	header.data_type = htonl('a');
@@ -993,27 +1252,7 @@ static int netjack2_recv_opus(struct netjack2_peer *peer, struct nj2_packet_head
 	if (++(*count) < peer->sync.num_packets)
 		return 0;
 
-	for (i = 0; i < active_ports; i++) {
-		uint16_t *ap = SPA_PTROFF(encoded_data, i * max_encoded, uint16_t);
-		uint16_t encoded_len = ntohs(ap[0]);
-		void *pcm;
-		int res;
-
-		if (i >= n_info || (pcm = info[i].data) == NULL)
-			continue;
-
-		if (encoded_len > max_encoded - sizeof(uint16_t))
-			continue;
-
-		res = opus_custom_decode_float(peer->opus_dec[i],
-				(unsigned char*)&ap[1], encoded_len,
-				pcm, peer->sync.frames);
-
-		if (res < 0 || res > 0xffff || res != peer->sync.frames)
-			pw_log_warn("decoding error %d", res);
-		else
-			info[i].filled = true;
-	}
+	codec_process(peer, false, peer->sync.frames, info, n_info, active_ports);
 	return 0;
 #else
 	return -ENOTSUP;
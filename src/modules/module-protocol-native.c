@@ -92,6 +92,43 @@ PW_LOG_TOPIC(mod_topic_connection, "conn." NAME);
  *   The permissions have no effect for sockets from Systemd socket activation.
  *   Those should be configured via the systemd.socket(5) mechanism.
  *
+ * - `shm.min-size`: `<int>`
+ *
+ *   Send message payloads of at least this many bytes, such as large params,
+ *   in a sealed memfd instead of over the socket when the peer supports it.
+ *   This avoids pushing the data through the socket buffers in small chunks
+ *   and lets the peer map the payload instead of reading it. The default is
+ *   0, which sends all payloads over the socket.
+ *
+ * - `flush.coalesce-usec`: `<int>`
+ *
+ *   When a server flushes messages to a client within this many microseconds
+ *   of its previous flush, the messages are held back until the time is over
+ *   or until 32KB is queued, so that a burst of events is sent with one write.
+ *   The first messages after a quiet period are sent right away. The default
+ *   is 0, which sends the queued messages on the next main loop iteration.
+ *
+ * - `client.stats`: `<bool>`
+ *
+ *   Publish the connection statistics in the client properties. Every update
+ *   is sent to all clients that bound the client object. The default is false.
+ *
+ * ## Connection statistics
+ *
+ * The server counts the messages it sends to each client. With `client.stats`
+ * enabled, it publishes the counters in the properties of the client object,
+ * updated after a flush and at most once per second:
+ *
+ * - `protocol.native.flushes`: number of times the queued messages were
+ *   written out completely
+ * - `protocol.native.messages`: number of messages sent
+ * - `protocol.native.bytes`: number of bytes sent
+ * - `protocol.native.max-messages`: most messages sent in one flush
+ * - `protocol.native.max-bytes`: most bytes sent in one flush
+ *
+ * The average number of messages and bytes per flush can be derived from
+ * these, for example with `pw-cli info <client-id>`.
+ *
  * ## General Options
  *
  * The name of the core is obtained as:
@@ -190,6 +227,9 @@ static const struct spa_dict_item module_props[] = {
 #define LOCK_SUFFIX     ".lock"
 #define LOCK_SUFFIXLEN  5
 
+#define COALESCE_MAX_BYTES	(32u * 1024u)
+#define STATS_INTERVAL_NSEC	SPA_NSEC_PER_SEC
+
 void pw_protocol_native_init(struct pw_protocol *protocol);
 void *protocol_native_security_context_init(struct pw_impl_module *module, struct pw_protocol *protocol);
 void protocol_native_security_context_free(void *data);
@@ -199,6 +239,10 @@ struct protocol_data {
 	struct spa_hook module_listener;
 	struct pw_protocol *protocol;
 
+	uint64_t coalesce_nsec;
+	uint32_t shm_min_size;
+	bool client_stats;
+
 	struct pw_properties *props;
 	void *security;
 
@@ -253,7 +297,9 @@ struct server {
 	struct spa_source *source;
 	struct spa_source *resume;
 	struct spa_source *close;
+	struct spa_source *flush;
 	unsigned int activated:1;
+	unsigned int flush_armed:1;
 };
 
 struct client_data {
@@ -269,8 +315,13 @@ struct client_data {
 
 	struct footer_client_global_state footer_state;
 
+	uint64_t last_flush;
+	uint64_t stats_time;
+	uint64_t stats_flushes;
+
 	unsigned int busy:1;
 	unsigned int need_flush:1;
+	unsigned int flush_deferred:1;
 };
 
 static void debug_msg(const char *prefix, const struct pw_protocol_native_message *msg, bool hex)
@@ -331,7 +382,7 @@ static void pre_demarshal(struct pw_protocol_native_connection *conn,
 		if (spa_pod_parser_push_struct(&parser, &f[1]) < 0)
 			break;
 		if (opcode < n_opcodes) {
-			if ((ret = opcodes[opcode].demarshal(object, &parser)) < 0)
+			if ((ret = opcodes[opcode].demarshal(object, conn, &parser)) < 0)
 				pw_log_error("failed processing message footer (opcode %u): %d (%s)",
 						opcode, ret, spa_strerror(ret));
 		} else {
@@ -477,6 +528,69 @@ static void handle_client_error(struct pw_impl_client *client, int res, const ch
 		pw_impl_client_destroy(client);
 }
 
+/* Publish the connection counters in the client properties. Every update
+ * is sent to all clients that bound the client object so this is done at
+ * most once per STATS_INTERVAL_NSEC. */
+static void client_update_stats(struct client_data *this)
+{
+	struct pw_loop *loop = this->client->context->main_loop;
+	struct pw_protocol_native_connection_stats stats;
+	struct spa_dict_item items[5];
+	char flushes[32], messages[32], bytes[32], max_messages[16], max_bytes[16];
+	uint64_t now;
+
+	pw_protocol_native_connection_get_stats(this->connection, &stats);
+	if (stats.n_flushes == this->stats_flushes)
+		return;
+
+	now = get_time_ns(loop->system);
+	if (this->stats_time != 0 && now - this->stats_time < STATS_INTERVAL_NSEC)
+		return;
+	this->stats_time = now;
+	this->stats_flushes = stats.n_flushes;
+
+	snprintf(flushes, sizeof(flushes), "%"PRIu64, stats.n_flushes);
+	snprintf(messages, sizeof(messages), "%"PRIu64, stats.n_messages);
+	snprintf(bytes, sizeof(bytes), "%"PRIu64, stats.n_bytes);
+	snprintf(max_messages, sizeof(max_messages), "%u", stats.max_messages);
+	snprintf(max_bytes, sizeof(max_bytes), "%u", stats.max_bytes);
+
+	items[0] = SPA_DICT_ITEM_INIT("protocol.native.flushes", flushes);
+	items[1] = SPA_DICT_ITEM_INIT("protocol.native.messages", messages);
+	items[2] = SPA_DICT_ITEM_INIT("protocol.native.bytes", bytes);
+	items[3] = SPA_DICT_ITEM_INIT("protocol.native.max-messages", max_messages);
+	items[4] = SPA_DICT_ITEM_INIT("protocol.native.max-bytes", max_bytes);
+
+	pw_impl_client_update_properties(this->client, &SPA_DICT_INIT_ARRAY(items));
+}
+
+static int client_flush(struct client_data *this)
+{
+	struct protocol_data *d = pw_protocol_get_user_data(this->server->this.protocol);
+	struct pw_loop *loop = this->client->context->main_loop;
+	int res;
+
+	this->need_flush = false;
+	this->flush_deferred = false;
+	if (d->coalesce_nsec > 0)
+		this->last_flush = get_time_ns(loop->system);
+
+	res = pw_protocol_native_connection_flush(this->connection);
+	if (res >= 0) {
+		if (this->source->mask & SPA_IO_OUT)
+			pw_loop_update_io(loop, this->source,
+					this->source->mask & ~SPA_IO_OUT);
+		if (d->client_stats)
+			client_update_stats(this);
+	} else if (res == -EAGAIN) {
+		/* wait until the socket is writable again */
+		if (!(this->source->mask & SPA_IO_OUT))
+			pw_loop_update_io(loop, this->source,
+					this->source->mask | SPA_IO_OUT);
+	}
+	return res;
+}
+
 static void
 connection_data(void *data, int fd, uint32_t mask)
 {
@@ -499,12 +613,7 @@ connection_data(void *data, int fd, uint32_t mask)
 			goto error;
 	}
 	if (mask & SPA_IO_OUT || this->need_flush) {
-		this->need_flush = false;
-		res = pw_protocol_native_connection_flush(this->connection);
-		if (res >= 0) {
-			pw_loop_update_io(client->context->main_loop,
-					this->source, this->source->mask & ~SPA_IO_OUT);
-		} else if (res != -EAGAIN)
+		if ((res = client_flush(this)) < 0 && res != -EAGAIN)
 			goto error;
 	}
 done:
@@ -566,6 +675,58 @@ static void on_start(void *data, uint32_t version)
 	return;
 }
 
+static void do_flush(void *data, uint64_t expirations)
+{
+	struct server *s = data;
+	struct client_data *c, *tmp;
+	int res;
+
+	s->flush_armed = false;
+
+	spa_list_for_each_safe(c, tmp, &s->this.client_list, protocol_link) {
+		if (!c->flush_deferred)
+			continue;
+		c->client->refcount++;
+		if ((res = client_flush(c)) < 0 && res != -EAGAIN)
+			handle_client_error(c->client, res, "do_flush");
+		pw_impl_client_unref(c->client);
+	}
+}
+
+/* Returns true when the flush is postponed to the server flush timer. This
+ * happens when the client was flushed less than coalesce_nsec ago, until
+ * enough data is queued. */
+static bool coalesce_flush(struct client_data *this)
+{
+	struct server *s = this->server;
+	struct protocol_data *d = pw_protocol_get_user_data(s->this.protocol);
+	struct pw_protocol_native_connection_stats stats;
+	struct timespec value;
+
+	if (d->coalesce_nsec == 0)
+		return false;
+
+	pw_protocol_native_connection_get_stats(this->connection, &stats);
+	if (stats.pending_bytes >= COALESCE_MAX_BYTES)
+		return false;
+	if (this->flush_deferred)
+		return true;
+	if (get_time_ns(s->loop->system) - this->last_flush >= d->coalesce_nsec)
+		return false;
+
+	if (s->flush == NULL &&
+	    (s->flush = pw_loop_add_timer(s->loop, do_flush, s)) == NULL)
+		return false;
+	if (!s->flush_armed) {
+		value.tv_sec = d->coalesce_nsec / SPA_NSEC_PER_SEC;
+		value.tv_nsec = d->coalesce_nsec % SPA_NSEC_PER_SEC;
+		pw_loop_update_timer(s->loop, s->flush, &value, NULL, false);
+		s->flush_armed = true;
+	}
+	this->flush_deferred = true;
+	return true;
+}
+
 static void on_server_need_flush(void *data)
 {
 	struct client_data *this = data;
@@ -574,7 +735,8 @@ static void on_server_need_flush(void *data)
 	pw_log_trace("need flush");
 	this->need_flush = true;
 
-	if (this->source && !(this->source->mask & SPA_IO_OUT)) {
+	if (this->source && !(this->source->mask & SPA_IO_OUT) &&
+	    !coalesce_flush(this)) {
 		pw_loop_update_io(client->context->main_loop,
 				this->source, this->source->mask | SPA_IO_OUT);
 	}
@@ -732,6 +894,8 @@ static struct client_data *client_new(struct server *s, int fd)
 		res = -errno;
 		goto cleanup_client;
 	}
+	pw_protocol_native_connection_set_shm_threshold(this->connection, d->shm_min_size);
+	this->footer_state.features = pw_protocol_native_connection_get_features(this->connection);
 
 	pw_protocol_native_connection_add_listener(this->connection,
 						   &this->conn_listener,
@@ -1339,6 +1503,7 @@ impl_new_client(struct pw_protocol *protocol,
 		struct pw_core *core,
 		const struct spa_dict *props)
 {
+	struct protocol_data *d = pw_protocol_get_user_data(protocol);
 	struct client *impl;
 	struct pw_protocol_client *this;
 	const char *str = NULL;
@@ -1360,6 +1525,8 @@ impl_new_client(struct pw_protocol *protocol,
 		res = -errno;
 		goto error_free;
 	}
+	pw_protocol_native_connection_set_shm_threshold(impl->connection, d->shm_min_size);
+	impl->footer_state.features = pw_protocol_native_connection_get_features(impl->connection);
 	pw_protocol_native_connection_add_listener(impl->connection,
 						   &impl->conn_listener,
 						   &client_conn_events,
@@ -1417,6 +1584,8 @@ static void destroy_server(struct pw_protocol_server *server)
 		pw_loop_destroy_source(s->loop, s->resume);
 	if (s->close)
 		pw_loop_destroy_source(s->loop, s->close);
+	if (s->flush)
+		pw_loop_destroy_source(s->loop, s->flush);
 	if (s->addr.sun_path[0] && !s->activated)
 		unlink(s->addr.sun_path);
 	if (s->lock_addr[0])
@@ -1876,6 +2045,10 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args_str)
 	d = pw_protocol_get_user_data(this);
 	d->protocol = this;
 	d->module = module;
+	d->coalesce_nsec = pw_properties_get_uint64(args, "flush.coalesce-usec", 0) *
+		SPA_NSEC_PER_USEC;
+	d->shm_min_size = pw_properties_get_uint32(args, "shm.min-size", 0);
+	d->client_stats = pw_properties_get_bool(args, "client.stats", false);
 	d->props = pw_properties_new(NULL, NULL);
 	if (d->props == NULL) {
 		res = -ENOMEM;
@@ -2,7 +2,10 @@
 /* SPDX-FileCopyrightText: Copyright © 2018 Wim Taymans */
 /* SPDX-License-Identifier: MIT */
 
+#include "config.h"
+
 #include <stdint.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
@@ -10,6 +13,8 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <spa/utils/result.h>
 #include <spa/pod/builder.h>
@@ -34,6 +39,15 @@ PW_LOG_TOPIC_EXTERN(mod_topic_connection);
 #define HDR_SIZE_V0	8
 #define HDR_SIZE	16
 
+/* set in the n_fds field of the header when the payload is not inline
+ * but in the last fd of the message, a sealed memfd */
+#define HDR_FDS_SHM	(1u << 31)
+#define MAX_SHM_SIZE	(64u * 1024u * 1024u)
+
+#ifdef F_GET_SEALS
+#define SHM_SEALS	(F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+#endif
+
 struct buffer {
 	uint8_t *buffer_data;
 	size_t buffer_size;
@@ -51,6 +65,9 @@ struct reenter_item {
 	void *old_buffer_data;
 	struct pw_protocol_native_message return_msg;
 	struct spa_list link;
+
+	void *payload;		/**< mapped memfd payload of return_msg */
+	size_t payload_size;
 };
 
 struct impl {
@@ -65,6 +82,11 @@ struct impl {
 
 	uint32_t version;
 	size_t hdr_size;
+
+	uint32_t shm_threshold;
+	uint32_t peer_features;
+
+	struct pw_protocol_native_connection_stats stats;
 };
 
 /** \endcond */
@@ -139,7 +161,10 @@ static void *connection_ensure_size(struct pw_protocol_native_connection *conn,
 		void *np;
 		size_t ns;
 
-		ns = SPA_ROUND_UP_N(buf->buffer_size + size, MAX_BUFFER_SIZE);
+		/* grow at least by doubling so that building a large pod does
+		 * not copy the buffer on every builder overflow */
+		ns = SPA_ROUND_UP_N(SPA_MAX(buf->buffer_size + size, buf->buffer_maxsize * 2),
+				MAX_BUFFER_SIZE);
 		np = realloc(buf->buffer_data, ns);
 		if (np == NULL) {
 			res = -errno;
@@ -309,6 +334,15 @@ void pw_protocol_native_connection_enter(struct pw_protocol_native_connection *c
 	++impl->pending_reentering;
 }
 
+static void clear_payload(struct reenter_item *item)
+{
+	if (item->payload != NULL) {
+		munmap(item->payload, item->payload_size);
+		item->payload = NULL;
+		item->payload_size = 0;
+	}
+}
+
 static void pop_reenter_stack(struct impl *impl, uint32_t count)
 {
 	while (count > 0) {
@@ -317,6 +351,7 @@ static void pop_reenter_stack(struct impl *impl, uint32_t count)
 		item = spa_list_last(&impl->reenter_stack, struct reenter_item, link);
 		spa_list_remove(&item->link);
 
+		clear_payload(item);
 		free(item->return_msg.fds);
 		free(item->old_buffer_data);
 		free(item);
@@ -477,6 +512,13 @@ void pw_protocol_native_connection_destroy(struct pw_protocol_native_connection
 
 	pw_log_debug("connection %p: destroy", conn);
 
+	if (impl->stats.n_flushes > 0)
+		pw_logt_debug(mod_topic_connection,
+			"connection %p: sent %"PRIu64" messages, %"PRIu64" bytes in "
+			"%"PRIu64" flushes (max %u messages, %u bytes)", conn,
+			impl->stats.n_messages, impl->stats.n_bytes, impl->stats.n_flushes,
+			impl->stats.max_messages, impl->stats.max_bytes);
+
 	spa_hook_list_call(&conn->listener_list, struct pw_protocol_native_connection_events, destroy, 0);
 
 	spa_hook_list_clean(&conn->listener_list);
@@ -492,6 +534,56 @@ void pw_protocol_native_connection_destroy(struct pw_protocol_native_connection
 	free(impl);
 }
 
+/* map the payload of msg from fd, the mapping stays valid until the next
+ * message is read at the same reenter level */
+static int map_payload(struct pw_protocol_native_connection *conn,
+		struct pw_protocol_native_message *msg, int fd)
+{
+#ifdef F_GET_SEALS
+	struct reenter_item *item = SPA_CONTAINER_OF(msg, struct reenter_item, return_msg);
+	struct stat st;
+	void *data;
+	int seals, res;
+
+	/* the sender must not be able to change or truncate the data while
+	 * we look at it */
+	seals = fcntl(fd, F_GET_SEALS);
+	if (seals < 0 || (seals & SHM_SEALS) != SHM_SEALS) {
+		pw_log_warn("connection %p: payload fd:%d is not sealed", conn, fd);
+		res = -EPROTO;
+		goto exit;
+	}
+	if (fstat(fd, &st) < 0) {
+		res = -errno;
+		goto exit;
+	}
+	if (st.st_size < (off_t)sizeof(struct spa_pod) || st.st_size > MAX_SHM_SIZE) {
+		pw_log_warn("connection %p: invalid payload size %"PRIi64,
+				conn, (int64_t)st.st_size);
+		res = -EPROTO;
+		goto exit;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		res = -errno;
+		pw_log_error("connection %p: can't map payload fd:%d: %m", conn, fd);
+		goto exit;
+	}
+	item->payload = data;
+	item->payload_size = st.st_size;
+
+	msg->data = data;
+	msg->size = st.st_size;
+	res = 0;
+exit:
+	close(fd);
+	return res;
+#else
+	close(fd);
+	return -EPROTO;
+#endif
+}
+
 static int prepare_packet(struct pw_protocol_native_connection *conn, struct buffer *buf,
 			struct pw_protocol_native_message *msg)
 {
@@ -499,7 +591,8 @@ static int prepare_packet(struct pw_protocol_native_connection *conn, struct buf
 	uint8_t *data;
 	size_t size, len;
 	uint32_t *p;
-	int *fds;
+	int *fds, payload_fd = -1;
+	bool shm = false;
 
 	data = buf->buffer_data + buf->offset;
 	size = buf->buffer_size - buf->offset;
@@ -528,7 +621,8 @@ static int prepare_packet(struct pw_protocol_native_connection *conn, struct buf
 	}
 	if (impl->version >= 3) {
 		buf->msg.seq = p[2];
-		buf->msg.n_fds = p[3];
+		buf->msg.n_fds = p[3] & ~HDR_FDS_SHM;
+		shm = SPA_FLAG_IS_SET(p[3], HDR_FDS_SHM);
 	} else {
 		buf->msg.seq = 0;
 		buf->msg.n_fds = 0;
@@ -541,6 +635,8 @@ static int prepare_packet(struct pw_protocol_native_connection *conn, struct buf
 	if (buf->msg.n_fds > MAX_FDS ||
 	    buf->msg.n_fds + buf->fds_offset > buf->n_fds)
 		return -EPROTO;
+	if (shm && (buf->msg.n_fds == 0 || len != 0))
+		return -EPROTO;
 
 	if (size < len)
 		return len;
@@ -551,6 +647,13 @@ static int prepare_packet(struct pw_protocol_native_connection *conn, struct buf
 	buf->offset += impl->hdr_size + len;
 	buf->fds_offset += buf->msg.n_fds;
 
+	if (shm) {
+		/* the payload fd is not part of the message */
+		buf->msg.n_fds--;
+		payload_fd = buf->msg.fds[buf->msg.n_fds];
+		buf->msg.fds[buf->msg.n_fds] = -1;
+	}
+
 	fds = msg->fds;
 	*msg = buf->msg;
 	if (buf->msg.n_fds > 0)
@@ -560,6 +663,9 @@ static int prepare_packet(struct pw_protocol_native_connection *conn, struct buf
 	if (buf->offset >= buf->buffer_size)
 		clear_buffer(buf, false);
 
+	if (shm)
+		return map_payload(conn, msg, payload_fd);
+
 	return 0;
 }
 
@@ -589,6 +695,9 @@ pw_protocol_native_connection_get_next(struct pw_protocol_native_connection *con
 	if ((res = ensure_stack_level(impl, &return_msg)) < 0)
 		return res;
 
+	/* the previous message on this level is done */
+	clear_payload(SPA_CONTAINER_OF(return_msg, struct reenter_item, return_msg));
+
 	buf = &impl->in;
 
 	while (1) {
@@ -696,26 +805,80 @@ pw_protocol_native_connection_begin(struct pw_protocol_native_connection *conn,
 	return &impl->builder;
 }
 
+/* move the payload of the current message to a sealed memfd that is
+ * passed as the last fd of the message */
+static int add_shm_payload(struct impl *impl, struct buffer *buf,
+		const void *data, uint32_t size)
+{
+#if defined(HAVE_MEMFD_CREATE) && defined(F_ADD_SEALS)
+	size_t offset = 0;
+	ssize_t len;
+	int fd, res;
+
+	if (impl->shm_threshold == 0 || size < impl->shm_threshold ||
+	    size > MAX_SHM_SIZE || impl->version < 3 ||
+	    !SPA_FLAG_IS_SET(impl->peer_features, PW_PROTOCOL_NATIVE_CONNECTION_FEATURE_SHM))
+		return -ENOTSUP;
+
+	if (buf->msg.n_fds + buf->n_fds >= MAX_FDS)
+		return -ENOSPC;
+
+	fd = memfd_create("pipewire-message", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0)
+		return -errno;
+
+	while (offset < size) {
+		len = write(fd, SPA_PTROFF(data, offset, void), size - offset);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			goto error;
+		}
+		offset += len;
+	}
+	if (fcntl(fd, F_ADD_SEALS, SHM_SEALS | F_SEAL_SEAL) < 0)
+		goto error;
+
+	buf->msg.fds[buf->msg.n_fds++] = fd;
+	impl->stats.n_shm++;
+	return 0;
+error:
+	res = -errno;
+	pw_log_warn("connection %p: can't make memfd payload: %m", &impl->this);
+	close(fd);
+	return res;
+#else
+	return -ENOTSUP;
+#endif
+}
+
 int
 pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 				  struct spa_pod_builder *builder)
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
-	uint32_t *p, size = builder->state.offset;
+	uint32_t *p, size = builder->state.offset, n_fds;
 	struct buffer *buf = &impl->out;
 	int res;
 
-	if (size > 0xffffff)
+	if (size > MAX_SHM_SIZE)
 		return -ENOSPC;
 
 	if ((p = connection_ensure_size(conn, buf, impl->hdr_size + size)) == NULL)
 		return -errno;
 
+	n_fds = buf->msg.n_fds;
+	if (add_shm_payload(impl, buf, SPA_PTROFF(p, impl->hdr_size, void), size) == 0) {
+		n_fds = buf->msg.n_fds | HDR_FDS_SHM;
+		size = 0;
+	} else if (size > 0xffffff)
+		return -ENOSPC;
+
 	p[0] = buf->msg.id;
 	p[1] = (buf->msg.opcode << 24) | size;
 	if (impl->version >= 3) {
 		p[2] = buf->msg.seq;
-		p[3] = buf->msg.n_fds;
+		p[3] = n_fds;
 	}
 
 	buf->buffer_size += impl->hdr_size + size;
@@ -726,9 +889,9 @@ pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 
 	if (pw_log_topic_custom_enabled(SPA_LOG_LEVEL_DEBUG, mod_topic_connection)) {
 		pw_logt_debug(mod_topic_connection,
-			">>>>>>>>> out: id:%d op:%d size:%d seq:%d fds:%d",
+			">>>>>>>>> out: id:%d op:%d size:%d seq:%d fds:%d%s",
 				buf->msg.id, buf->msg.opcode, size, buf->msg.seq,
-				buf->msg.n_fds);
+				buf->msg.n_fds, SPA_FLAG_IS_SET(n_fds, HDR_FDS_SHM) ? " shm" : "");
 	        spa_debug_pod(0, NULL, SPA_PTROFF(p, impl->hdr_size, struct spa_pod));
 		pw_logt_debug(mod_topic_connection,
 			">>>>>>>>> out: done");
@@ -737,12 +900,96 @@ pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 	buf->seq = (buf->seq + 1) & SPA_ASYNC_SEQ_MASK;
 	res = SPA_RESULT_RETURN_ASYNC(buf->msg.seq);
 
+	impl->stats.pending_messages++;
+	impl->stats.pending_bytes = buf->buffer_size;
+
 	spa_hook_list_call(&conn->listener_list,
 			struct pw_protocol_native_connection_events, need_flush, 0);
 
 	return res;
 }
 
+static void update_stats(struct impl *impl, size_t sent, size_t left)
+{
+	struct pw_protocol_native_connection_stats *s = &impl->stats;
+
+	s->n_bytes += sent;
+	s->flush_bytes += sent;
+	s->pending_bytes = left;
+	if (left > 0)
+		return;
+
+	/* all queued messages are out, account this as one flush */
+	s->n_flushes++;
+	s->n_messages += s->pending_messages;
+	s->max_messages = SPA_MAX(s->max_messages, s->pending_messages);
+	s->max_bytes = SPA_MAX(s->max_bytes, s->flush_bytes);
+	s->pending_messages = 0;
+	s->flush_bytes = 0;
+}
+
+/** Get the features this side of the connection can receive
+ *
+ * \param conn the connection object
+ * \return a mask of PW_PROTOCOL_NATIVE_CONNECTION_FEATURE_*
+ *
+ * \memberof pw_protocol_native_connection
+ */
+uint32_t pw_protocol_native_connection_get_features(struct pw_protocol_native_connection *conn)
+{
+	uint32_t features = 0;
+#ifdef F_GET_SEALS
+	features |= PW_PROTOCOL_NATIVE_CONNECTION_FEATURE_SHM;
+#endif
+	return features;
+}
+
+/** Set the features the peer announced it can receive
+ *
+ * \param conn the connection object
+ * \param features a mask of PW_PROTOCOL_NATIVE_CONNECTION_FEATURE_*
+ *
+ * \memberof pw_protocol_native_connection
+ */
+void pw_protocol_native_connection_set_peer_features(struct pw_protocol_native_connection *conn,
+		uint32_t features)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	pw_log_debug("connection %p: peer features:%08x", conn, features);
+	impl->peer_features = features;
+}
+
+/** Send message payloads of at least \a threshold bytes in a memfd
+ *
+ * \param conn the connection object
+ * \param threshold the minimum payload size, 0 disables
+ *
+ * The payload is only sent in a memfd when the peer announced
+ * PW_PROTOCOL_NATIVE_CONNECTION_FEATURE_SHM.
+ *
+ * \memberof pw_protocol_native_connection
+ */
+void pw_protocol_native_connection_set_shm_threshold(struct pw_protocol_native_connection *conn,
+		uint32_t threshold)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	impl->shm_threshold = threshold;
+}
+
+/** Get the message counters of the connection
+ *
+ * \param conn the connection object
+ * \param stats the counters are copied here
+ *
+ * \memberof pw_protocol_native_connection
+ */
+void pw_protocol_native_connection_get_stats(struct pw_protocol_native_connection *conn,
+		struct pw_protocol_native_connection_stats *stats)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	*stats = impl->stats;
+}
+
 /** Flush the connection object
  *
  * \param conn the connection object
@@ -776,6 +1023,9 @@ int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *co
 	n_fds = buf->n_fds;
 	to_close = 0;
 
+	if (size == 0)
+		return 0;
+
 	while (size > 0) {
 		if (n_fds > MAX_FDS_MSG) {
 			outfds = MAX_FDS_MSG;
@@ -831,6 +1081,7 @@ int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *co
 	res = 0;
 
 exit:
+	update_stats(impl, buf->buffer_size - size, size);
 	if (size > 0)
 		memmove(buf->buffer_data, data, size);
 	buf->buffer_size = size;
@@ -861,6 +1112,9 @@ int pw_protocol_native_connection_clear(struct pw_protocol_native_connection *co
 
 	clear_buffer(&impl->out, true);
 	clear_buffer(&impl->in, true);
+	impl->stats.pending_messages = 0;
+	impl->stats.pending_bytes = 0;
+	impl->stats.flush_bytes = 0;
 
 	return 0;
 }
@@ -31,6 +31,24 @@ struct pw_protocol_native_connection_events {
 	void (*start) (void *data, uint32_t version);
 };
 
+/** The peer can receive message payloads in a sealed memfd */
+#define PW_PROTOCOL_NATIVE_CONNECTION_FEATURE_SHM	(1u << 0)
+
+/** Message counters of a connection. A flush is counted when all queued
+ * messages are written to the socket, which can take more than one call
+ * to pw_protocol_native_connection_flush() when the socket is full. */
+struct pw_protocol_native_connection_stats {
+	uint64_t n_flushes;		/**< flushes that emptied the queue */
+	uint64_t n_messages;		/**< messages sent */
+	uint64_t n_bytes;		/**< bytes sent */
+	uint64_t n_shm;			/**< messages sent with the payload in a memfd */
+	uint32_t max_messages;		/**< most messages in one flush */
+	uint32_t max_bytes;		/**< most bytes in one flush */
+	uint32_t pending_messages;	/**< messages waiting to be sent */
+	uint32_t pending_bytes;		/**< bytes waiting to be sent */
+	uint32_t flush_bytes;		/**< bytes sent of the current flush */
+};
+
 /** \class pw_protocol_native_connection
  *
  * \brief Manages the connection between client and server
@@ -83,6 +101,15 @@ pw_protocol_native_connection_flush(struct pw_protocol_native_connection *conn);
 int
 pw_protocol_native_connection_clear(struct pw_protocol_native_connection *conn);
 
+uint32_t pw_protocol_native_connection_get_features(struct pw_protocol_native_connection *conn);
+void pw_protocol_native_connection_set_peer_features(struct pw_protocol_native_connection *conn,
+		uint32_t features);
+void pw_protocol_native_connection_set_shm_threshold(struct pw_protocol_native_connection *conn,
+		uint32_t threshold);
+
+void pw_protocol_native_connection_get_stats(struct pw_protocol_native_connection *conn,
+		struct pw_protocol_native_connection_stats *stats);
+
 void pw_protocol_native_connection_enter(struct pw_protocol_native_connection *conn);
 void pw_protocol_native_connection_leave(struct pw_protocol_native_connection *conn);
 
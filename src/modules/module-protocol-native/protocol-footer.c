@@ -56,6 +56,16 @@ void marshal_core_footers(struct footer_core_global_state *state, struct pw_core
 {
 	struct footer_builder fb = FOOTER_BUILDER_INIT(builder);
 
+	if (!state->features_sent && state->features != 0) {
+		state->features_sent = true;
+
+		pw_log_debug("core %p: send features:%08x", core, state->features);
+
+		start_footer_entry(&fb, FOOTER_CLIENT_OPCODE_FEATURES);
+		spa_pod_builder_int(fb.builder, state->features);
+		end_footer_entry(&fb);
+	}
+
 	if (core->recv_generation != state->last_recv_generation) {
 		state->last_recv_generation = core->recv_generation;
 
@@ -75,6 +85,16 @@ void marshal_client_footers(struct footer_client_global_state *state, struct pw_
 {
 	struct footer_builder fb = FOOTER_BUILDER_INIT(builder);
 
+	if (!state->features_sent && state->features != 0) {
+		state->features_sent = true;
+
+		pw_log_debug("impl-client %p: send features:%08x", client, state->features);
+
+		start_footer_entry(&fb, FOOTER_CORE_OPCODE_FEATURES);
+		spa_pod_builder_int(fb.builder, state->features);
+		end_footer_entry(&fb);
+	}
+
 	if (client->context->generation != client->sent_generation) {
 		client->sent_generation = client->context->generation;
 
@@ -89,7 +109,8 @@ void marshal_client_footers(struct footer_client_global_state *state, struct pw_
 	end_footer(&fb);
 }
 
-static int demarshal_core_generation(void *object, struct spa_pod_parser *parser)
+static int demarshal_core_generation(void *object, struct pw_protocol_native_connection *conn,
+		struct spa_pod_parser *parser)
 {
 	struct pw_core *core = object;
 	int64_t generation;
@@ -106,7 +127,8 @@ static int demarshal_core_generation(void *object, struct spa_pod_parser *parser
 	return 0;
 }
 
-static int demarshal_client_generation(void *object, struct spa_pod_parser *parser)
+static int demarshal_client_generation(void *object, struct pw_protocol_native_connection *conn,
+		struct spa_pod_parser *parser)
 {
 	struct pw_impl_client *client = object;
 	int64_t generation;
@@ -123,10 +145,27 @@ static int demarshal_client_generation(void *object, struct spa_pod_parser *pars
 	return 0;
 }
 
+static int demarshal_features(void *object, struct pw_protocol_native_connection *conn,
+		struct spa_pod_parser *parser)
+{
+	int32_t features;
+
+	if (spa_pod_parser_get_int(parser, &features) < 0)
+		return -EINVAL;
+
+	pw_log_debug("%p: recv features:%08x", object, features);
+
+	pw_protocol_native_connection_set_peer_features(conn, features);
+
+	return 0;
+}
+
 const struct footer_demarshal footer_core_demarshal[FOOTER_CORE_OPCODE_LAST] = {
 	[FOOTER_CORE_OPCODE_GENERATION] = (struct footer_demarshal){ .demarshal = demarshal_core_generation },
+	[FOOTER_CORE_OPCODE_FEATURES] = (struct footer_demarshal){ .demarshal = demarshal_features },
 };
 
 const struct footer_demarshal footer_client_demarshal[FOOTER_CLIENT_OPCODE_LAST] = {
 	[FOOTER_CLIENT_OPCODE_GENERATION] = (struct footer_demarshal){ .demarshal = demarshal_client_generation },
+	[FOOTER_CLIENT_OPCODE_FEATURES] = (struct footer_demarshal){ .demarshal = demarshal_features },
 };
@@ -11,23 +11,30 @@
 
 enum {
 	FOOTER_CORE_OPCODE_GENERATION = 0,
+	FOOTER_CORE_OPCODE_FEATURES,
 	FOOTER_CORE_OPCODE_LAST
 };
 
 enum {
 	FOOTER_CLIENT_OPCODE_GENERATION = 0,
+	FOOTER_CLIENT_OPCODE_FEATURES,
 	FOOTER_CLIENT_OPCODE_LAST
 };
 
 struct footer_core_global_state {
 	uint64_t last_recv_generation;
+	uint32_t features;		/**< connection features to announce */
+	unsigned int features_sent:1;
 };
 
 struct footer_client_global_state {
+	uint32_t features;		/**< connection features to announce */
+	unsigned int features_sent:1;
 };
 
 struct footer_demarshal {
-	int (*demarshal)(void *object, struct spa_pod_parser *parser);
+	int (*demarshal)(void *object, struct pw_protocol_native_connection *conn,
+			struct spa_pod_parser *parser);
 };
 
 extern const struct footer_demarshal footer_core_demarshal[FOOTER_CORE_OPCODE_LAST];
@@ -4,6 +4,7 @@
 
 #include <sys/socket.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 #include <spa/pod/builder.h>
 #include <spa/pod/parser.h>
@@ -110,6 +111,182 @@ static void test_read_write(struct pw_protocol_native_connection *in,
 	spa_assert_se(read_message(in, NULL) == -1);
 }
 
+static void test_stats(struct pw_protocol_native_connection *in,
+		struct pw_protocol_native_connection *out)
+{
+	struct pw_protocol_native_connection_stats s1, s2;
+
+	pw_protocol_native_connection_get_stats(out, &s1);
+	spa_assert_se(s1.pending_messages == 0);
+	spa_assert_se(s1.pending_bytes == 0);
+
+	write_message(out, 1);
+	write_message(out, 2);
+	write_message(out, 1);
+	pw_protocol_native_connection_get_stats(out, &s2);
+	spa_assert_se(s2.pending_messages == 3);
+	spa_assert_se(s2.pending_bytes > 0);
+	spa_assert_se(s2.n_flushes == s1.n_flushes);
+
+	spa_assert_se(pw_protocol_native_connection_flush(out) == 0);
+	pw_protocol_native_connection_get_stats(out, &s1);
+	spa_assert_se(s1.n_flushes == s2.n_flushes + 1);
+	spa_assert_se(s1.n_messages == s2.n_messages + 3);
+	spa_assert_se(s1.n_bytes == s2.n_bytes + s2.pending_bytes);
+	spa_assert_se(s1.max_messages >= 3);
+	spa_assert_se(s1.max_bytes >= s2.pending_bytes);
+	spa_assert_se(s1.pending_messages == 0);
+	spa_assert_se(s1.pending_bytes == 0);
+
+	/* nothing queued, nothing counted */
+	spa_assert_se(pw_protocol_native_connection_flush(out) == 0);
+	pw_protocol_native_connection_get_stats(out, &s2);
+	spa_assert_se(s2.n_flushes == s1.n_flushes);
+
+	spa_assert_se(read_message(in, NULL) == 0);
+	spa_assert_se(read_message(in, NULL) == 0);
+	spa_assert_se(read_message(in, NULL) == 0);
+	spa_assert_se(read_message(in, NULL) == -1);
+}
+
+static void write_large_message(struct pw_protocol_native_connection *conn,
+		uint8_t *data, uint32_t size)
+{
+	struct spa_pod_builder *b;
+
+	b = pw_protocol_native_connection_begin(conn, 1, 5, NULL);
+	spa_assert_se(b != NULL);
+	spa_pod_builder_add_struct(b, SPA_POD_Bytes(data, size));
+	spa_assert_se(pw_protocol_native_connection_end(conn, b) >= 0);
+}
+
+static void check_large_message(const struct pw_protocol_native_message *msg,
+		uint8_t *data, uint32_t size)
+{
+	struct spa_pod_parser prs;
+	const void *bytes;
+	uint32_t len;
+
+	spa_assert_se(msg->n_fds == 0);
+	spa_pod_parser_init(&prs, msg->data, msg->size);
+	spa_assert_se(spa_pod_parser_get_struct(&prs,
+				SPA_POD_Bytes(&bytes, &len)) >= 0);
+	spa_assert_se(len == size);
+	spa_assert_se(memcmp(bytes, data, size) == 0);
+}
+
+static void test_shm(struct pw_protocol_native_connection *in,
+		struct pw_protocol_native_connection *out)
+{
+	struct pw_protocol_native_connection_stats stats;
+	const struct pw_protocol_native_message *msg1, *msg2;
+	uint8_t data1[64 * 1024], data2[64 * 1024];
+	uint32_t i;
+	uint64_t n_shm;
+
+	if (!(pw_protocol_native_connection_get_features(in) &
+	    PW_PROTOCOL_NATIVE_CONNECTION_FEATURE_SHM))
+		return;
+
+	for (i = 0; i < sizeof(data1); i++) {
+		data1[i] = i;
+		data2[i] = ~i;
+	}
+
+	/* the peer did not announce the feature, all inline */
+	pw_protocol_native_connection_set_shm_threshold(out, 4096);
+	pw_protocol_native_connection_get_stats(out, &stats);
+	n_shm = stats.n_shm;
+	write_large_message(out, data1, sizeof(data1));
+	pw_protocol_native_connection_get_stats(out, &stats);
+	spa_assert_se(stats.n_shm == n_shm);
+	spa_assert_se(pw_protocol_native_connection_flush(out) == 0);
+	spa_assert_se(pw_protocol_native_connection_get_next(in, &msg1) == 1);
+	check_large_message(msg1, data1, sizeof(data1));
+
+	pw_protocol_native_connection_set_peer_features(out,
+			pw_protocol_native_connection_get_features(in));
+
+	/* small messages stay inline */
+	write_message(out, 1);
+	write_large_message(out, data1, sizeof(data1));
+	write_large_message(out, data2, sizeof(data2));
+	pw_protocol_native_connection_get_stats(out, &stats);
+	spa_assert_se(stats.n_shm == n_shm + 2);
+	spa_assert_se(stats.pending_bytes < 4096);
+	spa_assert_se(pw_protocol_native_connection_flush(out) == 0);
+
+	spa_assert_se(read_message(in, NULL) == 0);
+
+	/* the payload stays valid in a reentered call */
+	spa_assert_se(pw_protocol_native_connection_get_next(in, &msg1) == 1);
+	pw_protocol_native_connection_enter(in);
+	spa_assert_se(pw_protocol_native_connection_get_next(in, &msg2) == 1);
+	check_large_message(msg2, data2, sizeof(data2));
+	check_large_message(msg1, data1, sizeof(data1));
+	pw_protocol_native_connection_leave(in);
+	check_large_message(msg1, data1, sizeof(data1));
+
+	spa_assert_se(read_message(in, NULL) == -1);
+
+	pw_protocol_native_connection_set_shm_threshold(out, 0);
+	pw_protocol_native_connection_set_peer_features(out, 0);
+}
+
+/*
+ * Test that a payload in an fd that the sender can still modify is
+ * rejected.
+ */
+static void test_unsealed_shm(struct pw_protocol_native_connection *in,
+		struct pw_protocol_native_connection *out)
+{
+	const struct pw_protocol_native_message *msg;
+	struct spa_pod_builder *b;
+	uint32_t header[4];
+	struct iovec iov[1];
+	struct msghdr mh = { 0 };
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} cmsgbuf;
+	struct cmsghdr *cmsg;
+	int pfd[2], res;
+
+	/* version handshake */
+	b = pw_protocol_native_connection_begin(out, 0, 1, NULL);
+	spa_assert_se(b != NULL);
+	spa_pod_builder_add_struct(b, SPA_POD_Int(0));
+	pw_protocol_native_connection_end(out, b);
+	pw_protocol_native_connection_flush(out);
+	spa_assert_se(pw_protocol_native_connection_get_next(in, &msg) == 1);
+
+	spa_assert_se(pipe2(pfd, O_CLOEXEC) == 0);
+
+	header[0] = 1;
+	header[1] = 5u << 24;
+	header[2] = 0;
+	header[3] = 1 | (1u << 31);		/* payload in fd 0 */
+
+	iov[0].iov_base = header;
+	iov[0].iov_len = sizeof(header);
+	mh.msg_iov = iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = &cmsgbuf;
+	mh.msg_controllen = CMSG_SPACE(sizeof(int));
+	cmsg = CMSG_FIRSTHDR(&mh);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &pfd[0], sizeof(int));
+	spa_assert_se(sendmsg(out->fd, &mh, MSG_NOSIGNAL) == sizeof(header));
+
+	close(pfd[0]);
+	close(pfd[1]);
+
+	res = pw_protocol_native_connection_get_next(in, &msg);
+	spa_assert_se(res == -EPROTO);
+}
+
 static void test_reentering(struct pw_protocol_native_connection *in,
 		struct pw_protocol_native_connection *out)
 {
@@ -276,6 +453,8 @@ int main(int argc, char *argv[])
 	test_create(in);
 	test_create(out);
 	test_read_write(in, out);
+	test_stats(in, out);
+	test_shm(in, out);
 	test_reentering(in, out);
 
 	pw_protocol_native_connection_destroy(in);
@@ -299,6 +478,23 @@ int main(int argc, char *argv[])
 		pw_protocol_native_connection_destroy(in2);
 		pw_protocol_native_connection_destroy(out2);
 	}
+	{
+		int fds2[2];
+		struct pw_protocol_native_connection *in2, *out2;
+
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds2) < 0)
+			spa_assert_not_reached();
+
+		in2 = pw_protocol_native_connection_new(context, fds2[0]);
+		spa_assert_se(in2 != NULL);
+		out2 = pw_protocol_native_connection_new(context, fds2[1]);
+		spa_assert_se(out2 != NULL);
+
+		test_unsealed_shm(in2, out2);
+
+		pw_protocol_native_connection_destroy(in2);
+		pw_protocol_native_connection_destroy(out2);
+	}
 
 	pw_context_destroy(context);
 	pw_main_loop_destroy(loop);
@@ -67,6 +67,7 @@
  *     ]
  *     #server.dbus-name       = "org.pulseaudio.Server"
  *     #pulse.allow-module-loading = true
+ *     #pulse.shared-manager  = false
  *     #pulse.min.req          = 256/48000     # 5.3ms
  *     #pulse.default.req      = 960/48000     # 20 milliseconds
  *     #pulse.min.frag         = 256/48000     # 5.3ms
@@ -140,6 +141,21 @@
  * By default, clients are allowed to load and unload modules. You can disable this
  * feature with this option.
  *
+ *\code{.unparsed}
+ *     pulse.shared-manager = false
+ *\endcode
+ *
+ * By default, every client has its own connection to PipeWire and keeps its own
+ * copy of the objects in the graph. When this option is enabled, clients with the
+ * same access properties (client.access, the flatpak app id, media.category and
+ * the snap properties) share one connection and one copy, which saves memory and
+ * CPU with many clients. The shared connection only has those properties so that
+ * the session manager gives it the permissions of that class of clients.
+ *
+ * The streams of these clients get the application properties of their client.
+ * The clients share one client object in the graph, killing it disconnects all
+ * of them.
+ *
  * ### Playback buffering options
  *
  *\code{.unparsed}
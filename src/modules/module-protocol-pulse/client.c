@@ -116,7 +116,10 @@ void client_disconnect(struct client *client)
 		client->source = NULL;
 	}
 
-	if (client->manager) {
+	if (client->shared_manager) {
+		shared_manager_remove_client(client->shared_manager, client);
+		client->manager = NULL;
+	} else if (client->manager) {
 		pw_manager_destroy(client->manager);
 		client->manager = NULL;
 	}
@@ -149,7 +152,9 @@ void client_free(struct client *client)
 	spa_list_consume(o, &client->operations, link)
 		operation_free(o);
 
-	if (client->core)
+	if (client->shared_manager)
+		shared_manager_unref(client->shared_manager);
+	else if (client->core)
 		pw_core_disconnect(client->core);
 
 	pw_map_clear(&client->streams);
@@ -7,6 +7,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #include <spa/utils/list.h>
 #include <spa/utils/hook.h>
@@ -21,6 +22,7 @@ struct pw_core;
 struct pw_manager;
 struct pw_manager_object;
 struct pw_properties;
+struct shared_manager;
 
 struct descriptor {
 	uint32_t length;
@@ -43,12 +45,16 @@ struct client {
 	uint32_t version;
 
 	struct pw_properties *props;
+	pid_t pid;				/**< from the socket credentials, 0 when unknown */
 
 	uint64_t quirks;
 
 	struct pw_core *core;
 	struct pw_manager *manager;
 	struct spa_hook manager_listener;
+	struct shared_manager *shared_manager;	/**< when manager is shared */
+	struct spa_list shared_link;		/**< link in shared_manager::clients */
+	int manager_sync_seq;			/**< pending sync on the shared manager core */
 
 	uint32_t subscribed;
 
@@ -29,11 +29,72 @@ void select_best(struct selector *s, struct pw_manager_object *o)
 	}
 }
 
+static bool select_match(struct selector *s, struct pw_manager_object *o)
+{
+	return o != NULL && !o->creating && !o->removing &&
+		(s->type == NULL || s->type(o));
+}
+
+static struct pw_manager_object *select_first(struct pw_manager_object *a,
+		struct pw_manager_object *b)
+{
+	if (a == NULL || (b != NULL && b->order < a->order))
+		return b;
+	return a;
+}
+
+struct select_named {
+	struct selector *sel;
+	struct pw_manager_object *found;
+};
+
+static int select_named(void *data, struct pw_manager_object *o)
+{
+	struct select_named *d = data;
+	if (!select_match(d->sel, o))
+		return 0;
+	d->found = o;
+	return 1;
+}
+
+/* Find the first object in the list that matches any of the keys of the
+ * selector, using the indexes of the manager. */
+static struct pw_manager_object *select_indexed(struct pw_manager *m, struct selector *s)
+{
+	struct pw_manager_object *o, *res = NULL;
+
+	if (select_match(s, o = pw_manager_find_object(m, s->id)))
+		res = o;
+	if (select_match(s, o = pw_manager_find_object_by_index(m, s->index)))
+		res = select_first(res, o);
+	if (s->value != NULL) {
+		if (s->key != NULL) {
+			struct select_named d = { .sel = s };
+			pw_manager_for_each_named(m, s->key, s->value, select_named, &d);
+			res = select_first(res, d.found);
+		}
+		if (select_match(s, o = pw_manager_find_object_by_index(m, (uint32_t)atoi(s->value))))
+			res = select_first(res, o);
+	}
+	return res;
+}
+
 struct pw_manager_object *select_object(struct pw_manager *m, struct selector *s)
 {
 	struct pw_manager_object *o;
 	const char *str;
 
+	if (s->key == NULL || s->value == NULL ||
+	    spa_streq(s->key, PW_KEY_NODE_NAME) ||
+	    spa_streq(s->key, PW_KEY_DEVICE_NAME)) {
+		/* an accumulating selector needs to see all objects, but only
+		 * when nothing matches */
+		if ((o = select_indexed(m, s)) != NULL)
+			return o;
+		if (s->accumulate == NULL)
+			return s->best;
+	}
+
 	spa_list_for_each(o, &m->object_list, link) {
 		if (o->creating || o->removing)
 			continue;
@@ -57,32 +118,18 @@ struct pw_manager_object *select_object(struct pw_manager *m, struct selector *s
 
 uint32_t id_to_index(struct pw_manager *m, uint32_t id)
 {
-	struct pw_manager_object *o;
-	spa_list_for_each(o, &m->object_list, link) {
-		if (o->id == id)
-			return o->index;
-	}
-	return SPA_ID_INVALID;
+	struct pw_manager_object *o = pw_manager_find_object(m, id);
+	return o ? o->index : SPA_ID_INVALID;
 }
 
-static bool collect_is_linked(struct pw_manager *m, uint32_t id, enum pw_direction direction)
+static int link_found(void *data, struct pw_manager_object *o)
 {
-	struct pw_manager_object *o;
-	uint32_t in_node, out_node;
-
-	spa_list_for_each(o, &m->object_list, link) {
-		if (o->props == NULL || !pw_manager_object_is_link(o))
-			continue;
-
-		if (pw_properties_fetch_uint32(o->props, PW_KEY_LINK_OUTPUT_NODE, &out_node) != 0 ||
-                    pw_properties_fetch_uint32(o->props, PW_KEY_LINK_INPUT_NODE, &in_node) != 0)
-                        continue;
+	return 1;
+}
 
-		if ((direction == PW_DIRECTION_OUTPUT && id == out_node) ||
-		    (direction == PW_DIRECTION_INPUT && id == in_node))
-			return true;
-	}
-	return false;
+static bool collect_is_linked(struct pw_manager *m, uint32_t id, enum pw_direction direction)
+{
+	return pw_manager_for_each_link(m, id, direction, link_found, NULL) > 0;
 }
 
 struct pw_manager_object *find_peer_for_link(struct pw_manager *m,
@@ -111,93 +158,254 @@ struct pw_manager_object *find_peer_for_link(struct pw_manager *m,
 	return NULL;
 }
 
+struct find_linked {
+	struct pw_manager *manager;
+	uint32_t id;
+	enum pw_direction direction;
+	struct pw_manager_object *peer;
+};
+
+static int find_linked_peer(void *data, struct pw_manager_object *o)
+{
+	struct find_linked *d = data;
+	d->peer = find_peer_for_link(d->manager, o, d->id, d->direction);
+	return d->peer != NULL;
+}
+
 struct pw_manager_object *find_linked(struct pw_manager *m, uint32_t id, enum pw_direction direction)
 {
-	struct pw_manager_object *o, *p;
+	struct find_linked d = { .manager = m, .id = id, .direction = direction };
 
-	spa_list_for_each(o, &m->object_list, link) {
-		if (!pw_manager_object_is_link(o))
-			continue;
-		if ((p = find_peer_for_link(m, o, id, direction)) != NULL)
-			return p;
+	pw_manager_for_each_link(m, id, direction, find_linked_peer, &d);
+	return d.peer;
+}
+
+struct card_route {
+	uint32_t index;
+	uint32_t device;
+	struct spa_pod *props;
+};
+
+/* The parsed profiles, ports and routes of a card, rebuilt when the params
+ * of the card change. The strings point into the params. */
+struct card_cache {
+	uint32_t generation;
+	unsigned int valid:1;
+	struct card_info info;
+	uint32_t n_profiles;
+	uint32_t n_ports;
+	uint32_t n_routes;
+	struct profile_info *profiles;
+	struct port_info *ports;
+	struct card_route *routes;
+};
+
+static bool parse_profile(struct spa_pod *param, struct profile_info *pi)
+{
+	struct spa_pod *classes = NULL;
+
+	spa_zero(*pi);
+
+	if (spa_pod_parse_object(param,
+			SPA_TYPE_OBJECT_ParamProfile, NULL,
+			SPA_PARAM_PROFILE_index, SPA_POD_Int(&pi->index),
+			SPA_PARAM_PROFILE_name,  SPA_POD_String(&pi->name),
+			SPA_PARAM_PROFILE_description,  SPA_POD_OPT_String(&pi->description),
+			SPA_PARAM_PROFILE_priority,  SPA_POD_OPT_Int(&pi->priority),
+			SPA_PARAM_PROFILE_available,  SPA_POD_OPT_Id(&pi->available),
+			SPA_PARAM_PROFILE_classes,  SPA_POD_OPT_PodStruct(&classes)) < 0)
+		return false;
+
+	if (pi->description == NULL)
+		pi->description = pi->name;
+
+	if (classes != NULL) {
+		struct spa_pod *iter;
+
+		SPA_POD_STRUCT_FOREACH(classes, iter) {
+			struct spa_pod_parser prs;
+			char *class;
+			uint32_t count;
+
+			spa_pod_parser_pod(&prs, iter);
+			if (spa_pod_parser_get_struct(&prs,
+					SPA_POD_String(&class),
+					SPA_POD_Int(&count)) < 0)
+				continue;
+
+			if (spa_streq(class, "Audio/Sink"))
+				pi->n_sinks += count;
+			else if (spa_streq(class, "Audio/Source"))
+				pi->n_sources += count;
+		}
 	}
-	return NULL;
+	return true;
 }
 
-void collect_card_info(struct pw_manager_object *card, struct card_info *info)
+static bool parse_port(struct spa_pod *param, struct port_info *pi)
 {
+	int32_t *devices = NULL, *profiles = NULL;
+	uint32_t devices_size = 0, devices_type = 0, n_devices = 0;
+	uint32_t profiles_size = 0, profiles_type = 0, n_profiles = 0;
+
+	spa_zero(*pi);
+
+	if (spa_pod_parse_object(param,
+			SPA_TYPE_OBJECT_ParamRoute, NULL,
+			SPA_PARAM_ROUTE_index, SPA_POD_Int(&pi->index),
+			SPA_PARAM_ROUTE_direction, SPA_POD_Id(&pi->direction),
+			SPA_PARAM_ROUTE_name,  SPA_POD_String(&pi->name),
+			SPA_PARAM_ROUTE_description,  SPA_POD_OPT_String(&pi->description),
+			SPA_PARAM_ROUTE_priority,  SPA_POD_OPT_Int(&pi->priority),
+			SPA_PARAM_ROUTE_available,  SPA_POD_OPT_Id(&pi->available),
+			SPA_PARAM_ROUTE_info,  SPA_POD_OPT_Pod(&pi->info),
+			SPA_PARAM_ROUTE_devices, SPA_POD_OPT_Array(&devices_size,
+				&devices_type, &n_devices, &devices),
+			SPA_PARAM_ROUTE_profiles, SPA_POD_OPT_Array(&profiles_size,
+				&profiles_type, &n_profiles, &profiles)) < 0)
+		return false;
+
+	if (pi->description == NULL)
+		pi->description = pi->name;
+	if (devices && devices_size == sizeof(pi->devices[0]) &&
+	    devices_type == SPA_TYPE_Int) {
+		pi->devices = (uint32_t*)devices;
+		pi->n_devices = n_devices;
+	}
+	if (profiles && profiles_size == sizeof(pi->profiles[0]) &&
+	    profiles_type == SPA_TYPE_Int) {
+		pi->profiles = (uint32_t*)profiles;
+		pi->n_profiles = n_profiles;
+	}
+
+	while (pi->info != NULL) {
+		struct spa_pod_parser prs;
+		struct spa_pod_frame f[1];
+		uint32_t n;
+		const char *key, *value;
+
+		spa_pod_parser_pod(&prs, pi->info);
+		if (spa_pod_parser_push_struct(&prs, &f[0]) < 0 ||
+		    spa_pod_parser_get_int(&prs, (int32_t*)&pi->n_props) < 0)
+			break;
+
+		for (n = 0; n < pi->n_props; n++) {
+			if (spa_pod_parser_get(&prs,
+					SPA_POD_String(&key),
+					SPA_POD_String(&value),
+					NULL) < 0)
+				break;
+			if (spa_streq(key, "port.availability-group"))
+				pi->availability_group = value;
+			else if (spa_streq(key, "port.type"))
+				pi->type = port_type_value(value);
+		}
+		spa_pod_parser_pop(&prs, &f[0]);
+		break;
+	}
+	return true;
+}
+
+static struct card_cache *card_cache_get(struct pw_manager_object *card)
+{
+	struct card_cache *c;
 	struct pw_manager_param *p;
+	uint32_t n_profiles = 0, n_ports = 0, n_routes = 0;
+	size_t size;
+
+	c = pw_manager_object_get_data(card, "card.cache");
+	if (c != NULL && c->valid && c->generation == card->param_generation)
+		return c;
+
+	spa_list_for_each(p, &card->param_list, link) {
+		switch (p->id) {
+		case SPA_PARAM_EnumProfile:
+			n_profiles++;
+			break;
+		case SPA_PARAM_EnumRoute:
+			n_ports++;
+			break;
+		case SPA_PARAM_Route:
+			n_routes++;
+			break;
+		}
+	}
+
+	size = sizeof(*c) + n_profiles * sizeof(struct profile_info) +
+		n_ports * sizeof(struct port_info) + n_routes * sizeof(struct card_route);
+	c = pw_manager_object_add_data(card, "card.cache", size);
+	if (c == NULL)
+		return NULL;
+
+	c->generation = card->param_generation;
+	c->valid = true;
+	c->info = CARD_INFO_INIT;
+	c->info.n_profiles = n_profiles;
+	c->info.n_ports = n_ports;
+	c->profiles = SPA_PTROFF(c, sizeof(*c), struct profile_info);
+	c->ports = SPA_PTROFF(c->profiles, n_profiles * sizeof(struct profile_info), struct port_info);
+	c->routes = SPA_PTROFF(c->ports, n_ports * sizeof(struct port_info), struct card_route);
+	c->n_profiles = c->n_ports = c->n_routes = 0;
 
 	spa_list_for_each(p, &card->param_list, link) {
 		switch (p->id) {
 		case SPA_PARAM_EnumProfile:
-			info->n_profiles++;
+			if (parse_profile(p->param, &c->profiles[c->n_profiles]))
+				c->n_profiles++;
 			break;
 		case SPA_PARAM_Profile:
 			spa_pod_parse_object(p->param,
 				SPA_TYPE_OBJECT_ParamProfile, NULL,
-				SPA_PARAM_PROFILE_index, SPA_POD_Int(&info->active_profile));
+				SPA_PARAM_PROFILE_index, SPA_POD_Int(&c->info.active_profile));
 			break;
 		case SPA_PARAM_EnumRoute:
-			info->n_ports++;
+			if (parse_port(p->param, &c->ports[c->n_ports]))
+				c->n_ports++;
+			break;
+		case SPA_PARAM_Route:
+		{
+			struct card_route *r = &c->routes[c->n_routes];
+			r->props = NULL;
+			if (spa_pod_parse_object(p->param,
+					SPA_TYPE_OBJECT_ParamRoute, NULL,
+					SPA_PARAM_ROUTE_index, SPA_POD_Int(&r->index),
+					SPA_PARAM_ROUTE_device,  SPA_POD_Int(&r->device),
+					SPA_PARAM_ROUTE_props,  SPA_POD_OPT_PodObject(&r->props)) < 0)
+				break;
+			c->n_routes++;
 			break;
 		}
+		}
 	}
+	return c;
+}
+
+void collect_card_info(struct pw_manager_object *card, struct card_info *info)
+{
+	struct card_cache *c;
+
+	if ((c = card_cache_get(card)) == NULL)
+		return;
+
+	info->n_profiles += c->info.n_profiles;
+	info->n_ports += c->info.n_ports;
+	if (c->info.active_profile != SPA_ID_INVALID)
+		info->active_profile = c->info.active_profile;
 }
 
 uint32_t collect_profile_info(struct pw_manager_object *card, struct card_info *card_info,
 			      struct profile_info *profile_info)
 {
-	struct pw_manager_param *p;
-	struct profile_info *pi;
+	struct card_cache *c;
 	uint32_t n;
 
-	n = 0;
-	spa_list_for_each(p, &card->param_list, link) {
-		struct spa_pod *classes = NULL;
-
-		if (p->id != SPA_PARAM_EnumProfile)
-			continue;
-
-		pi = &profile_info[n];
-		spa_zero(*pi);
+	if ((c = card_cache_get(card)) == NULL)
+		return 0;
 
-		if (spa_pod_parse_object(p->param,
-				SPA_TYPE_OBJECT_ParamProfile, NULL,
-				SPA_PARAM_PROFILE_index, SPA_POD_Int(&pi->index),
-				SPA_PARAM_PROFILE_name,  SPA_POD_String(&pi->name),
-				SPA_PARAM_PROFILE_description,  SPA_POD_OPT_String(&pi->description),
-				SPA_PARAM_PROFILE_priority,  SPA_POD_OPT_Int(&pi->priority),
-				SPA_PARAM_PROFILE_available,  SPA_POD_OPT_Id(&pi->available),
-				SPA_PARAM_PROFILE_classes,  SPA_POD_OPT_PodStruct(&classes)) < 0) {
-			continue;
-		}
-		if (pi->description == NULL)
-			pi->description = pi->name;
-		if (pi->index == card_info->active_profile)
-			card_info->active_profile_name = pi->name;
-
-		if (classes != NULL) {
-			struct spa_pod *iter;
-
-			SPA_POD_STRUCT_FOREACH(classes, iter) {
-				struct spa_pod_parser prs;
-				char *class;
-				uint32_t count;
-
-				spa_pod_parser_pod(&prs, iter);
-				if (spa_pod_parser_get_struct(&prs,
-						SPA_POD_String(&class),
-						SPA_POD_Int(&count)) < 0)
-					continue;
-
-				if (spa_streq(class, "Audio/Sink"))
-					pi->n_sinks += count;
-				else if (spa_streq(class, "Audio/Source"))
-					pi->n_sources += count;
-			}
-		}
-		n++;
+	for (n = 0; n < c->n_profiles; n++) {
+		profile_info[n] = c->profiles[n];
+		if (profile_info[n].index == card_info->active_profile)
+			card_info->active_profile_name = profile_info[n].name;
 	}
 	if (card_info->active_profile_name == NULL && n > 0)
 		card_info->active_profile_name = profile_info[0].name;
@@ -207,24 +415,15 @@ uint32_t collect_profile_info(struct pw_manager_object *card, struct card_info *
 
 uint32_t find_profile_index(struct pw_manager_object *card, const char *name)
 {
-	struct pw_manager_param *p;
-
-	spa_list_for_each(p, &card->param_list, link) {
-		uint32_t index;
-		const char *test_name;
-
-		if (p->id != SPA_PARAM_EnumProfile)
-			continue;
-
-		if (spa_pod_parse_object(p->param,
-				SPA_TYPE_OBJECT_ParamProfile, NULL,
-				SPA_PARAM_PROFILE_index, SPA_POD_Int(&index),
-				SPA_PARAM_PROFILE_name,  SPA_POD_String(&test_name)) < 0)
-			continue;
+	struct card_cache *c;
+	uint32_t n;
 
-		if (spa_streq(test_name, name))
-			return index;
+	if ((c = card_cache_get(card)) == NULL)
+		return SPA_ID_INVALID;
 
+	for (n = 0; n < c->n_profiles; n++) {
+		if (spa_streq(c->profiles[n].name, name))
+			return c->profiles[n].index;
 	}
 	return SPA_ID_INVALID;
 }
@@ -233,50 +432,32 @@ static void collect_device_info(struct pw_manager_object *device, struct pw_mana
 			 struct device_info *dev_info, bool monitor, struct defs *defs)
 {
 	struct pw_manager_param *p;
+	struct card_cache *c;
 	dev_info->active_port_name = NULL;
 
-	if (card) {
-		spa_list_for_each(p, &card->param_list, link) {
-			uint32_t index, dev;
-			struct spa_pod *props;
+	if (card && (c = card_cache_get(card)) != NULL) {
+		uint32_t n;
 
-			if (p->id != SPA_PARAM_Route)
-				continue;
+		for (n = 0; n < c->n_routes; n++) {
+			struct card_route *r = &c->routes[n];
 
-			if (spa_pod_parse_object(p->param,
-					SPA_TYPE_OBJECT_ParamRoute, NULL,
-					SPA_PARAM_ROUTE_index, SPA_POD_Int(&index),
-					SPA_PARAM_ROUTE_device,  SPA_POD_Int(&dev),
-					SPA_PARAM_ROUTE_props,  SPA_POD_OPT_PodObject(&props)) < 0)
-				continue;
-			if (dev != dev_info->device)
+			if (r->device != dev_info->device)
 				continue;
-			dev_info->active_port = index;
-			if (props && !monitor) {
-				volume_parse_param(props, &dev_info->volume_info, monitor);
+			dev_info->active_port = r->index;
+			if (r->props && !monitor) {
+				volume_parse_param(r->props, &dev_info->volume_info, monitor);
 				dev_info->have_volume = true;
 			}
 		}
 
 		/* Look up the port name for the active port */
 		if (dev_info->active_port != SPA_ID_INVALID) {
-			spa_list_for_each(p, &card->param_list, link) {
-				uint32_t index, direction;
-				const char *name = NULL;
-
-				if (p->id != SPA_PARAM_EnumRoute)
-					continue;
-
-				if (spa_pod_parse_object(p->param,
-						SPA_TYPE_OBJECT_ParamRoute, NULL,
-						SPA_PARAM_ROUTE_index, SPA_POD_Int(&index),
-						SPA_PARAM_ROUTE_direction, SPA_POD_Id(&direction),
-						SPA_PARAM_ROUTE_name, SPA_POD_String(&name)) < 0)
-					continue;
-
-				if (index == dev_info->active_port &&
-				    direction == dev_info->direction) {
-					dev_info->active_port_name = name;
+			for (n = 0; n < c->n_ports; n++) {
+				struct port_info *pi = &c->ports[n];
+
+				if (pi->index == dev_info->active_port &&
+				    pi->direction == dev_info->direction) {
+					dev_info->active_port_name = pi->name;
 					break;
 				}
 			}
@@ -287,15 +468,15 @@ static void collect_device_info(struct pw_manager_object *device, struct pw_mana
 		switch (p->id) {
 		case SPA_PARAM_EnumFormat:
 		{
-			struct spa_pod *to_free = NULL, *c = p->param;
-			if (!spa_pod_is_fixated(c)) {
-				to_free = spa_pod_copy(c);
+			struct spa_pod *to_free = NULL, *param = p->param;
+			if (!spa_pod_is_fixated(param)) {
+				to_free = spa_pod_copy(param);
 				if (to_free == NULL)
 					break;
 				spa_pod_fixate(to_free);
-				c = to_free;
+				param = to_free;
 			}
-			format_parse_param(c, true, &dev_info->ss, &dev_info->map,
+			format_parse_param(param, true, &dev_info->ss, &dev_info->map,
 					&defs->sample_spec, &defs->channel_map);
 			free(to_free);
 			break;
@@ -392,52 +573,15 @@ static bool array_contains(uint32_t *vals, uint32_t n_vals, uint32_t val)
 uint32_t collect_port_info(struct pw_manager_object *card, struct card_info *card_info,
 			   struct device_info *dev_info, struct port_info *port_info)
 {
-	struct pw_manager_param *p;
-	uint32_t n;
+	struct card_cache *c;
+	uint32_t i, n;
 
-	if (card == NULL)
+	if (card == NULL || (c = card_cache_get(card)) == NULL)
 		return 0;
 
 	n = 0;
-	spa_list_for_each(p, &card->param_list, link) {
-		int32_t *devices = NULL, *profiles = NULL;
-		uint32_t devices_size = 0, devices_type = 0, n_devices = 0;
-		uint32_t profiles_size = 0, profiles_type = 0, n_profiles = 0;
-		struct port_info *pi;
-
-		if (p->id != SPA_PARAM_EnumRoute)
-			continue;
-
-		pi = &port_info[n];
-		spa_zero(*pi);
-
-		if (spa_pod_parse_object(p->param,
-				SPA_TYPE_OBJECT_ParamRoute, NULL,
-				SPA_PARAM_ROUTE_index, SPA_POD_Int(&pi->index),
-				SPA_PARAM_ROUTE_direction, SPA_POD_Id(&pi->direction),
-				SPA_PARAM_ROUTE_name,  SPA_POD_String(&pi->name),
-				SPA_PARAM_ROUTE_description,  SPA_POD_OPT_String(&pi->description),
-				SPA_PARAM_ROUTE_priority,  SPA_POD_OPT_Int(&pi->priority),
-				SPA_PARAM_ROUTE_available,  SPA_POD_OPT_Id(&pi->available),
-				SPA_PARAM_ROUTE_info,  SPA_POD_OPT_Pod(&pi->info),
-				SPA_PARAM_ROUTE_devices, SPA_POD_OPT_Array(&devices_size,
-					&devices_type, &n_devices, &devices),
-				SPA_PARAM_ROUTE_profiles, SPA_POD_OPT_Array(&profiles_size,
-					&profiles_type, &n_profiles, &profiles)) < 0)
-			continue;
-
-		if (pi->description == NULL)
-			pi->description = pi->name;
-		if (devices && devices_size == sizeof(pi->devices[0]) &&
-		    devices_type == SPA_TYPE_Int) {
-			pi->devices = (uint32_t*)devices;
-			pi->n_devices = n_devices;
-		}
-		if (profiles && profiles_size == sizeof(pi->profiles[0]) &&
-		    profiles_type == SPA_TYPE_Int) {
-			pi->profiles = (uint32_t*)profiles;
-			pi->n_profiles = n_profiles;
-		}
+	for (i = 0; i < c->n_ports; i++) {
+		struct port_info *pi = &c->ports[i];
 
 		if (dev_info != NULL) {
 			if (pi->direction != dev_info->direction)
@@ -449,33 +593,7 @@ uint32_t collect_port_info(struct pw_manager_object *card, struct card_info *car
 			if (pi->index == dev_info->active_port)
 				dev_info->active_port_name = pi->name;
 		}
-
-		while (pi->info != NULL) {
-			struct spa_pod_parser prs;
-			struct spa_pod_frame f[1];
-			uint32_t n;
-			const char *key, *value;
-
-			spa_pod_parser_pod(&prs, pi->info);
-			if (spa_pod_parser_push_struct(&prs, &f[0]) < 0 ||
-			    spa_pod_parser_get_int(&prs, (int32_t*)&pi->n_props) < 0)
-				break;
-
-			for (n = 0; n < pi->n_props; n++) {
-				if (spa_pod_parser_get(&prs,
-						SPA_POD_String(&key),
-						SPA_POD_String(&value),
-						NULL) < 0)
-					break;
-				if (spa_streq(key, "port.availability-group"))
-					pi->availability_group = value;
-				else if (spa_streq(key, "port.type"))
-					pi->type = port_type_value(value);
-			}
-			spa_pod_parser_pop(&prs, &f[0]);
-			break;
-		}
-		n++;
+		port_info[n++] = *pi;
 	}
 	if (dev_info != NULL && dev_info->active_port_name == NULL && n > 0)
 		dev_info->active_port_name = port_info[0].name;
@@ -484,26 +602,16 @@ uint32_t collect_port_info(struct pw_manager_object *card, struct card_info *car
 
 uint32_t find_port_index(struct pw_manager_object *card, uint32_t direction, const char *port_name)
 {
-	struct pw_manager_param *p;
-
-	spa_list_for_each(p, &card->param_list, link) {
-		uint32_t index, dir;
-		const char *name;
-
-		if (p->id != SPA_PARAM_EnumRoute)
-			continue;
+	struct card_cache *c;
+	uint32_t n;
 
-		if (spa_pod_parse_object(p->param,
-				SPA_TYPE_OBJECT_ParamRoute, NULL,
-				SPA_PARAM_ROUTE_index, SPA_POD_Int(&index),
-				SPA_PARAM_ROUTE_direction, SPA_POD_Id(&dir),
-				SPA_PARAM_ROUTE_name, SPA_POD_String(&name)) < 0)
-			continue;
-		if (dir != direction)
-			continue;
-		if (spa_streq(name, port_name))
-			return index;
+	if ((c = card_cache_get(card)) == NULL)
+		return SPA_ID_INVALID;
 
+	for (n = 0; n < c->n_ports; n++) {
+		if (c->ports[n].direction == direction &&
+		    spa_streq(c->ports[n].name, port_name))
+			return c->ports[n].index;
 	}
 	return SPA_ID_INVALID;
 }
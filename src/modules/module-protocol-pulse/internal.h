@@ -23,9 +23,12 @@ struct pw_loop;
 struct pw_context;
 struct pw_work_queue;
 struct pw_properties;
+struct client;
+struct shared_manager;
 
 struct defs {
 	bool allow_module_loading;
+	bool shared_manager;
 	struct spa_fraction min_req;
 	struct spa_fraction default_req;
 	struct spa_fraction min_frag;
@@ -65,6 +68,8 @@ struct impl {
 	struct pw_work_queue *work_queue;
 	struct spa_list cleanup_clients;
 
+	struct spa_list shared_managers;
+
 	struct pw_map samples;
 	struct pw_map modules;
 
@@ -86,6 +91,10 @@ void impl_add_listener(struct impl *impl,
 		struct spa_hook *listener,
 		const struct impl_events *events, void *data);
 
+void shared_manager_remove_client(struct shared_manager *sm, struct client *client);
+void shared_manager_unref(struct shared_manager *sm);
+int client_manager_sync(struct client *client);
+
 void broadcast_subscribe_event(struct impl *impl, uint32_t facility, uint32_t type, uint32_t id);
 
 #endif
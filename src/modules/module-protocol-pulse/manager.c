@@ -21,6 +21,19 @@
 #define manager_emit_disconnect(m) spa_hook_list_call(&(m)->hooks, struct pw_manager_events, disconnect, 0)
 #define manager_emit_object_data_timeout(m,o,k) spa_hook_list_call(&(m)->hooks, struct pw_manager_events, object_data_timeout,0,o,k)
 
+#define INDEX_MIN_SIZE	64u
+
+enum {
+	INDEX_ID,
+	INDEX_INDEX,
+	INDEX_NODE_NAME,
+	INDEX_DEVICE_NAME,
+	INDEX_LINK_OUTPUT,
+	INDEX_LINK_INPUT,
+	INDEX_CARD,
+	INDEX_N,
+};
+
 struct object;
 
 struct manager {
@@ -34,6 +47,10 @@ struct manager {
 	int sync_seq;
 
 	struct spa_hook_list hooks;
+
+	uint64_t order;
+	uint32_t index_size;		/* buckets per index, power of 2 */
+	struct spa_list *index;		/* INDEX_N * index_size buckets */
 };
 
 struct object_info {
@@ -52,6 +69,14 @@ struct object_data {
 	struct pw_timer timer;
 };
 
+struct metadata_entry {
+	struct spa_list link;
+	uint32_t subject;
+	char *key;
+	char *type;
+	char *value;
+};
+
 struct object {
 	struct pw_manager_object this;
 
@@ -66,8 +91,175 @@ struct object {
 	struct spa_hook object_listener;
 
 	struct spa_list data_list;
+	struct spa_list metadata_list;
+
+	uint32_t index_mask;		/* keys that are set, and linked in the index when there is one */
+	uint32_t index_hash[INDEX_N];
+	uint32_t index_key[INDEX_N];
+	const char *index_name[INDEX_N];
+	struct spa_list index_link[INDEX_N];
 };
 
+static inline uint32_t hash_uint32(uint32_t v)
+{
+	v ^= v >> 16;
+	v *= 0x7feb352du;
+	v ^= v >> 15;
+	v *= 0x846ca68bu;
+	v ^= v >> 16;
+	return v;
+}
+
+static inline uint32_t hash_string(const char *str)
+{
+	uint32_t h = 2166136261u;
+	while (*str)
+		h = (h ^ (uint8_t)*str++) * 16777619u;
+	return h;
+}
+
+static inline struct spa_list *index_bucket(struct manager *m, uint32_t type, uint32_t hash)
+{
+	return &m->index[type * m->index_size + (hash & (m->index_size - 1))];
+}
+
+static void object_index_remove(struct object *o, uint32_t type)
+{
+	if (SPA_FLAG_IS_SET(o->index_mask, 1u << type)) {
+		if (o->manager->index != NULL)
+			spa_list_remove(&o->index_link[type]);
+		SPA_FLAG_CLEAR(o->index_mask, 1u << type);
+	}
+}
+
+static void object_index_add(struct object *o, uint32_t type, uint32_t key, const char *name)
+{
+	struct manager *m = o->manager;
+	struct spa_list *bucket;
+	struct object *t;
+
+	object_index_remove(o, type);
+
+	o->index_hash[type] = name ? hash_string(name) : hash_uint32(key);
+	o->index_key[type] = key;
+	o->index_name[type] = name;
+	SPA_FLAG_SET(o->index_mask, 1u << type);
+
+	if (m->index == NULL)
+		return;
+
+	/* keep the bucket in list order, new objects go at the end */
+	bucket = index_bucket(m, type, o->index_hash[type]);
+	spa_list_for_each_reverse(t, bucket, index_link[type]) {
+		if (t->this.order < o->this.order)
+			break;
+	}
+	spa_list_insert(&t->index_link[type], &o->index_link[type]);
+}
+
+static struct object *index_next(struct manager *m, struct object *o,
+		uint32_t type, uint32_t hash)
+{
+	struct spa_list *head, *next;
+
+	if (m->index != NULL) {
+		head = index_bucket(m, type, hash);
+		next = o ? o->index_link[type].next : head->next;
+		return next == head ? NULL :
+			SPA_CONTAINER_OF(next, struct object, index_link[type]);
+	}
+
+	/* the index could not be allocated, scan all objects */
+	head = &m->this.object_list;
+	for (next = o ? o->this.link.next : head->next; next != head; next = next->next) {
+		struct object *t = SPA_CONTAINER_OF(next, struct object, this.link);
+		if (SPA_FLAG_IS_SET(t->index_mask, 1u << type) &&
+		    t->index_hash[type] == hash)
+			return t;
+	}
+	return NULL;
+}
+
+#define index_for_each(o,m,type,hash) \
+	for (o = index_next(m, NULL, type, hash); o != NULL; o = index_next(m, o, type, hash))
+
+static struct object *index_find(struct manager *m, uint32_t type, uint32_t key)
+{
+	struct object *o;
+	index_for_each(o, m, type, hash_uint32(key)) {
+		if (o->index_key[type] == key)
+			return o;
+	}
+	return NULL;
+}
+
+static void object_index_card(struct object *o)
+{
+	struct pw_node_info *info = o->this.info;
+	const char *str;
+	uint32_t card_id;
+
+	if (info != NULL && info->props != NULL &&
+	    (str = spa_dict_lookup(info->props, PW_KEY_DEVICE_ID)) != NULL &&
+	    (card_id = (uint32_t)atoi(str)) != SPA_ID_INVALID)
+		object_index_add(o, INDEX_CARD, card_id, NULL);
+	else
+		object_index_remove(o, INDEX_CARD);
+}
+
+static void object_index_keys(struct object *o)
+{
+	const char *str;
+	uint32_t out_node, in_node;
+
+	if (spa_streq(o->this.type, PW_TYPE_INTERFACE_Node))
+		object_index_card(o);
+
+	object_index_add(o, INDEX_ID, o->this.id, NULL);
+	if (o->this.index != SPA_ID_INVALID)
+		object_index_add(o, INDEX_INDEX, o->this.index, NULL);
+
+	if (o->this.props == NULL)
+		return;
+
+	if ((str = pw_properties_get(o->this.props, PW_KEY_NODE_NAME)) != NULL)
+		object_index_add(o, INDEX_NODE_NAME, 0, str);
+	if ((str = pw_properties_get(o->this.props, PW_KEY_DEVICE_NAME)) != NULL)
+		object_index_add(o, INDEX_DEVICE_NAME, 0, str);
+
+	if (pw_manager_object_is_link(&o->this) &&
+	    pw_properties_fetch_uint32(o->this.props, PW_KEY_LINK_OUTPUT_NODE, &out_node) == 0 &&
+	    pw_properties_fetch_uint32(o->this.props, PW_KEY_LINK_INPUT_NODE, &in_node) == 0) {
+		object_index_add(o, INDEX_LINK_OUTPUT, out_node, NULL);
+		object_index_add(o, INDEX_LINK_INPUT, in_node, NULL);
+	}
+}
+
+static int manager_index_grow(struct manager *m)
+{
+	struct spa_list *index;
+	struct object *o;
+	uint32_t i, size;
+
+	size = SPA_MAX(m->index_size * 2, INDEX_MIN_SIZE);
+	index = calloc(INDEX_N * size, sizeof(struct spa_list));
+	if (index == NULL)
+		return -errno;
+	for (i = 0; i < INDEX_N * size; i++)
+		spa_list_init(&index[i]);
+
+	free(m->index);
+	m->index = index;
+	m->index_size = size;
+
+	/* add in list order, the buckets are kept in list order */
+	spa_list_for_each(o, &m->this.object_list, this.link) {
+		o->index_mask = 0;
+		object_index_keys(o);
+	}
+	return 0;
+}
+
 static int core_sync(struct manager *m)
 {
 	m->sync_seq = pw_core_sync(m->this.core, PW_ID_CORE, m->sync_seq);
@@ -137,12 +329,7 @@ static bool has_param(struct spa_list *param_list, struct pw_manager_param *p)
 
 static struct object *find_object_by_id(struct manager *m, uint32_t id)
 {
-	struct object *o;
-	spa_list_for_each(o, &m->this.object_list, this.link) {
-		if (o->this.id == id)
-			return o;
-	}
-	return NULL;
+	return index_find(m, INDEX_ID, id);
 }
 
 static void object_update_params(struct object *o)
@@ -161,6 +348,9 @@ static void object_update_params(struct object *o)
 		}
 	}
 
+	if (!spa_list_is_empty(&o->pending_list))
+		o->this.param_generation++;
+
 	spa_list_consume(p, &o->pending_list, link) {
 		spa_list_remove(&p->link);
 		if (p->param == NULL) {
@@ -185,10 +375,26 @@ static void object_data_free(struct object_data *d)
 	free(d);
 }
 
+static void metadata_clear(struct object *o, uint32_t subject, const char *key)
+{
+	struct metadata_entry *e, *t;
+
+	spa_list_for_each_safe(e, t, &o->metadata_list, link) {
+		if ((subject == PW_ID_ANY || e->subject == subject) &&
+		    (key == NULL || spa_streq(e->key, key))) {
+			spa_list_remove(&e->link);
+			free(e);
+		}
+	}
+}
+
 static void object_destroy(struct object *o)
 {
 	struct manager *m = o->manager;
 	struct object_data *d;
+	uint32_t i;
+	for (i = 0; i < INDEX_N; i++)
+		object_index_remove(o, i);
 	spa_list_remove(&o->this.link);
 	m->this.n_objects--;
 	if (o->this.proxy)
@@ -200,6 +406,7 @@ static void object_destroy(struct object *o)
 	clear_params(&o->pending_list, SPA_ID_INVALID);
 	spa_list_consume(d, &o->data_list, link)
 		object_data_free(d);
+	metadata_clear(o, PW_ID_ANY, NULL);
 	free(o);
 }
 
@@ -349,16 +556,14 @@ static struct object *find_device(struct manager *m, uint32_t card_id, uint32_t
 {
 	struct object *o;
 
-	spa_list_for_each(o, &m->this.object_list, this.link) {
+	index_for_each(o, m, INDEX_CARD, hash_uint32(card_id)) {
 		struct pw_node_info *info;
 		const char *str;
 
-		if (!spa_streq(o->this.type, PW_TYPE_INTERFACE_Node))
+		if (o->index_key[INDEX_CARD] != card_id)
 			continue;
 
 		if ((info = o->this.info) != NULL &&
-		    (str = spa_dict_lookup(info->props, PW_KEY_DEVICE_ID)) != NULL &&
-		    (uint32_t)atoi(str) == card_id &&
 		    (str = spa_dict_lookup(info->props, "card.profile.device")) != NULL &&
 		    (uint32_t)atoi(str) == device)
 			return o;
@@ -434,8 +639,10 @@ static void node_event_info(void *data, const struct pw_node_info *info)
 	if (info->change_mask & PW_NODE_CHANGE_MASK_STATE)
 		changed++;
 
-	if (info->change_mask & PW_NODE_CHANGE_MASK_PROPS)
+	if (info->change_mask & PW_NODE_CHANGE_MASK_PROPS) {
+		object_index_card(o);
 		changed++;
+	}
 
 	if (info->change_mask & PW_NODE_CHANGE_MASK_PARAMS) {
 		for (i = 0; i < info->n_params; i++) {
@@ -522,6 +729,27 @@ static int metadata_property(void *data,
 {
 	struct object *o = data;
 	struct manager *m = o->manager;
+	struct metadata_entry *e;
+	size_t len;
+
+	/* keep a copy of the properties so that listeners that are added
+	 * later can catch up, see pw_manager_object_for_each_metadata() */
+	metadata_clear(o, subject, key);
+	if (key != NULL && value != NULL) {
+		len = strlen(key) + 1 + strlen(value) + 1 + (type ? strlen(type) + 1 : 0);
+		if ((e = calloc(1, sizeof(*e) + len)) != NULL) {
+			e->subject = subject;
+			e->key = SPA_PTROFF(e, sizeof(*e), char);
+			e->value = stpcpy(e->key, key) + 1;
+			if (type != NULL) {
+				e->type = stpcpy(e->value, value) + 1;
+				strcpy(e->type, type);
+			} else {
+				strcpy(e->value, value);
+			}
+			spa_list_append(&o->metadata_list, &e->link);
+		}
+	}
 	manager_emit_metadata(m, &o->this, subject, key, type, value);
 	return 0;
 }
@@ -637,12 +865,17 @@ static void registry_event_global(void *data, uint32_t id,
 	spa_list_init(&o->this.param_list);
 	spa_list_init(&o->pending_list);
 	spa_list_init(&o->data_list);
+	spa_list_init(&o->metadata_list);
 
 	o->manager = m;
 	o->info = info;
+	o->this.order = m->order++;
 	spa_list_append(&m->this.object_list, &o->this.link);
 	m->this.n_objects++;
 
+	if (m->this.n_objects <= m->index_size || manager_index_grow(m) < 0)
+		object_index_keys(o);
+
 	if (info->events)
 		pw_proxy_add_object_listener(proxy,
 				&o->object_listener,
@@ -832,6 +1065,85 @@ int pw_manager_for_each_object(struct pw_manager *manager,
 	return 0;
 }
 
+struct pw_manager_object *pw_manager_find_object(struct pw_manager *manager, uint32_t id)
+{
+	struct manager *m = SPA_CONTAINER_OF(manager, struct manager, this);
+	struct object *o = index_find(m, INDEX_ID, id);
+	return o ? &o->this : NULL;
+}
+
+struct pw_manager_object *pw_manager_find_object_by_index(struct pw_manager *manager,
+		uint32_t index)
+{
+	struct manager *m = SPA_CONTAINER_OF(manager, struct manager, this);
+	struct object *o;
+
+	if (index == SPA_ID_INVALID)
+		return NULL;
+	o = index_find(m, INDEX_INDEX, index);
+	return o ? &o->this : NULL;
+}
+
+int pw_manager_for_each_named(struct pw_manager *manager, const char *key, const char *name,
+		int (*callback) (void *data, struct pw_manager_object *object),
+		void *data)
+{
+	struct manager *m = SPA_CONTAINER_OF(manager, struct manager, this);
+	struct object *o;
+	uint32_t type;
+	int res;
+
+	if (spa_streq(key, PW_KEY_NODE_NAME))
+		type = INDEX_NODE_NAME;
+	else if (spa_streq(key, PW_KEY_DEVICE_NAME))
+		type = INDEX_DEVICE_NAME;
+	else
+		return -ENOTSUP;
+
+	index_for_each(o, m, type, hash_string(name)) {
+		if (!spa_streq(o->index_name[type], name))
+			continue;
+		if ((res = callback(data, &o->this)) != 0)
+			return res;
+	}
+	return 0;
+}
+
+int pw_manager_for_each_link(struct pw_manager *manager, uint32_t node_id,
+		enum pw_direction direction,
+		int (*callback) (void *data, struct pw_manager_object *object),
+		void *data)
+{
+	struct manager *m = SPA_CONTAINER_OF(manager, struct manager, this);
+	uint32_t type = direction == PW_DIRECTION_OUTPUT ? INDEX_LINK_OUTPUT : INDEX_LINK_INPUT;
+	struct object *o;
+	int res;
+
+	index_for_each(o, m, type, hash_uint32(node_id)) {
+		if (o->index_key[type] != node_id)
+			continue;
+		if ((res = callback(data, &o->this)) != 0)
+			return res;
+	}
+	return 0;
+}
+
+int pw_manager_object_for_each_metadata(struct pw_manager_object *metadata,
+		int (*callback) (void *data, uint32_t subject, const char *key,
+			const char *type, const char *value),
+		void *data)
+{
+	struct object *o = SPA_CONTAINER_OF(metadata, struct object, this);
+	struct metadata_entry *e;
+	int res;
+
+	spa_list_for_each(e, &o->metadata_list, link) {
+		if ((res = callback(data, e->subject, e->key, e->type, e->value)) != 0)
+			return res;
+	}
+	return 0;
+}
+
 void pw_manager_destroy(struct pw_manager *manager)
 {
 	struct manager *m = SPA_CONTAINER_OF(manager, struct manager, this);
@@ -850,6 +1162,7 @@ void pw_manager_destroy(struct pw_manager *manager)
 	if (m->this.info)
 		pw_core_info_free(m->this.info);
 
+	free(m->index);
 	free(m);
 }
 
@@ -63,6 +63,7 @@ struct pw_manager_param {
 struct pw_manager_object {
 	struct spa_list link;           /**< link in manager object_list */
 	uint64_t serial;
+	uint64_t order;			/**< position in manager object_list */
 	uint32_t id;
 	uint32_t permissions;
 	const char *type;
@@ -82,6 +83,7 @@ struct pw_manager_object {
 #define PW_MANAGER_OBJECT_FLAG_SINK	(1<<1)
 	uint64_t change_mask;	/* object specific params change mask */
 	struct spa_list param_list;
+	uint32_t param_generation;	/**< incremented when param_list changes */
 	unsigned int creating:1;
 	unsigned int removing:1;
 };
@@ -105,6 +107,25 @@ int pw_manager_for_each_object(struct pw_manager *manager,
 		int (*callback) (void *data, struct pw_manager_object *object),
 		void *data);
 
+struct pw_manager_object *pw_manager_find_object(struct pw_manager *manager, uint32_t id);
+
+struct pw_manager_object *pw_manager_find_object_by_index(struct pw_manager *manager,
+		uint32_t index);
+
+int pw_manager_for_each_named(struct pw_manager *manager, const char *key, const char *name,
+		int (*callback) (void *data, struct pw_manager_object *object),
+		void *data);
+
+int pw_manager_for_each_link(struct pw_manager *manager, uint32_t node_id,
+		enum pw_direction direction,
+		int (*callback) (void *data, struct pw_manager_object *object),
+		void *data);
+
+int pw_manager_object_for_each_metadata(struct pw_manager_object *metadata,
+		int (*callback) (void *data, uint32_t subject, const char *key,
+			const char *type, const char *value),
+		void *data);
+
 void *pw_manager_object_add_data(struct pw_manager_object *o, const char *key, size_t size);
 void *pw_manager_object_get_data(struct pw_manager_object *obj, const char *key);
 void *pw_manager_object_add_temporary_data(struct pw_manager_object *o, const char *key,
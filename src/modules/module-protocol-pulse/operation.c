@@ -9,6 +9,7 @@
 
 #include "client.h"
 #include "defs.h"
+#include "internal.h"
 #include "log.h"
 #include "manager.h"
 #include "operation.h"
@@ -33,7 +34,7 @@ int operation_new_cb(struct client *client, uint32_t tag,
 
 	spa_list_append(&client->operations, &o->link);
 	client->n_operations++;
-	pw_manager_sync(client->manager);
+	client_manager_sync(client);
 
 	pw_log_debug("client %p [%s]: new operation tag:%u", client, client->name, tag);
 
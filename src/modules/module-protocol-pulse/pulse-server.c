@@ -53,11 +53,13 @@
 #include "reply.h"
 #include "sample.h"
 #include "server.h"
+#include "snap-policy.h"
 #include "stream.h"
 #include "utils.h"
 #include "volume.h"
 
 #define DEFAULT_ALLOW_MODULE_LOADING 	"true"
+#define DEFAULT_SHARED_MANAGER		"false"
 #define DEFAULT_MIN_REQ			"256/48000"
 #define DEFAULT_DEFAULT_REQ		"960/48000"
 #define DEFAULT_MIN_FRAG		"256/48000"
@@ -81,7 +83,9 @@
 
 struct latency_offset_data {
 	int64_t prev_latency_offset;
+	uint32_t card_id;
 	uint8_t initialized:1;
+	uint8_t changed:1;
 };
 
 struct temporary_move_data {
@@ -89,6 +93,38 @@ struct temporary_move_data {
 	uint8_t used:1;
 };
 
+/* A core and registry mirror shared by clients with the same access
+ * properties. It is connected with only those properties so that the session
+ * manager gives it the permissions of that class of clients. The clients
+ * create their streams and samples on the shared core. Events are fanned out
+ * to the clients in the list. */
+struct shared_manager {
+	struct spa_list link;
+	struct impl *impl;
+	int ref;
+
+	struct pw_properties *props;
+
+	struct pw_core *core;
+	struct spa_hook core_listener;
+	struct pw_manager *manager;
+	struct spa_hook manager_listener;
+
+	struct spa_list clients;
+};
+
+/* The properties that server.c sets from the socket credentials and that
+ * the session manager uses to decide on the permissions of a client. Clients
+ * share a manager when they are all equal. */
+static const char * const shared_manager_keys[] = {
+	PW_KEY_CLIENT_ACCESS,
+	"pipewire.access.portal.app_id",
+	PW_KEY_MEDIA_CATEGORY,
+	PW_KEY_SNAP_ID,
+	PW_KEY_SNAP_PLAYBACK_ALLOWED,
+	PW_KEY_SNAP_RECORD_ALLOWED,
+};
+
 static struct sample *find_sample(struct impl *impl, uint32_t index, const char *name)
 {
 	union pw_map_item *item;
@@ -256,6 +292,19 @@ static uint32_t get_temporary_move_target(struct client *client, struct pw_manag
 	return d->peer_index;
 }
 
+static void clear_temporary_move_target(struct pw_manager_object *o)
+{
+	struct temporary_move_data *d;
+
+	d = pw_manager_object_get_data(o, "temporary_move_data");
+	if (d == NULL)
+		return;
+	if (d->peer_index != SPA_ID_INVALID)
+		pw_log_debug("cleared temporary move target for index:%d", o->index);
+	d->peer_index = SPA_ID_INVALID;
+	d->used = false;
+}
+
 static void set_temporary_move_target(struct client *client, struct pw_manager_object *o, uint32_t index)
 {
 	struct temporary_move_data *d;
@@ -264,13 +313,7 @@ static void set_temporary_move_target(struct client *client, struct pw_manager_o
 		return;
 
 	if (index == SPA_ID_INVALID) {
-		d = pw_manager_object_get_data(o, "temporary_move_data");
-		if (d == NULL)
-			return;
-		if (d->peer_index != SPA_ID_INVALID)
-			pw_log_debug("cleared temporary move target for index:%d", o->index);
-		d->peer_index = SPA_ID_INVALID;
-		d->used = false;
+		clear_temporary_move_target(o);
 		return;
 	}
 
@@ -297,7 +340,7 @@ static void temporary_move_target_timeout(struct client *client, struct pw_manag
 	 */
 
 	if (d == NULL || d->peer_index == SPA_ID_INVALID || !d->used)
-		goto done;
+		return;
 
 	peer = find_linked(client->manager, o->id, pw_manager_object_is_sink_input(o) ?
 			PW_DIRECTION_OUTPUT : PW_DIRECTION_INPUT);
@@ -306,9 +349,6 @@ static void temporary_move_target_timeout(struct client *client, struct pw_manag
 				client->name, o->index);
 		send_object_event(client, o, SUBSCRIPTION_EVENT_CHANGE);
 	}
-
-done:
-	set_temporary_move_target(client, o, SPA_ID_INVALID);
 }
 
 static struct pw_manager_object *find_device(struct client *client,
@@ -330,22 +370,20 @@ static int64_t get_node_latency_offset(struct pw_manager_object *o)
 	return latency_offset;
 }
 
-static void send_latency_offset_subscribe_event(struct client *client, struct pw_manager_object *o)
+static void update_latency_offset(struct pw_manager_object *o)
 {
-	struct pw_manager *manager = client->manager;
 	struct latency_offset_data *d;
 	struct pw_node_info *info;
 	const char *str;
 	uint32_t card_id = SPA_ID_INVALID;
 	int64_t latency_offset = 0LL;
-	bool changed = false;
+
+	if ((d = pw_manager_object_get_data(o, "latency_offset_data")) != NULL)
+		d->changed = false;
 
 	if (!pw_manager_object_is_sink(o) && !pw_manager_object_is_source_or_monitor(o))
 		return;
 
-	/*
-	 * Pulseaudio sends card change events on latency offset change.
-	 */
 	if ((info = o->info) == NULL || info->props == NULL)
 		return;
 	if ((str = spa_dict_lookup(info->props, PW_KEY_DEVICE_ID)) != NULL)
@@ -358,16 +396,28 @@ static void send_latency_offset_subscribe_event(struct client *client, struct pw
 		return;
 
 	latency_offset = get_node_latency_offset(o);
-	changed = (!d->initialized || latency_offset != d->prev_latency_offset);
 
+	d->changed = (!d->initialized || latency_offset != d->prev_latency_offset);
 	d->prev_latency_offset = latency_offset;
+	d->card_id = card_id;
 	d->initialized = true;
+}
 
-	if (changed)
-		client_queue_subscribe_event(client,
-				SUBSCRIPTION_EVENT_CARD,
-				SUBSCRIPTION_EVENT_CHANGE,
-				id_to_index(manager, card_id));
+static void send_latency_offset_subscribe_event(struct client *client, struct pw_manager_object *o)
+{
+	struct latency_offset_data *d;
+
+	/*
+	 * Pulseaudio sends card change events on latency offset change.
+	 */
+	d = pw_manager_object_get_data(o, "latency_offset_data");
+	if (d == NULL || !d->changed)
+		return;
+
+	client_queue_subscribe_event(client,
+			SUBSCRIPTION_EVENT_CARD,
+			SUBSCRIPTION_EVENT_CHANGE,
+			id_to_index(client->manager, d->card_id));
 }
 
 static void send_default_change_subscribe_event(struct client *client, bool sink, bool source)
@@ -818,25 +868,42 @@ static int reply_create_stream(struct stream *stream, struct pw_manager_object *
 			reply_create_record_stream(stream, peer);
 }
 
-static void manager_added(void *data, struct pw_manager_object *o)
+/* Update the state that is kept on the manager objects, this is done once
+ * per event, before it is passed to the clients. */
+static void manager_object_update(struct impl *impl, struct pw_manager *manager,
+		struct pw_manager_object *o, bool added)
 {
-	struct client *client = data;
-	struct pw_manager *manager = client->manager;
-	struct impl *impl = client->impl;
 	const char *str;
 
-	register_object_message_handlers(o);
+	if (added) {
+		register_object_message_handlers(o);
 
-	if (strcmp(o->type, PW_TYPE_INTERFACE_Core) == 0 && manager->info != NULL) {
-		struct pw_core_info *info = manager->info;
-		if (info->props) {
-			if ((str = spa_dict_lookup(info->props, "default.clock.rate")) != NULL)
-				client->impl->defs.sample_spec.rate = atoi(str);
-			if ((str = spa_dict_lookup(info->props, "default.clock.quantum-limit")) != NULL)
-				client->impl->defs.quantum_limit = atoi(str);
+		if (strcmp(o->type, PW_TYPE_INTERFACE_Core) == 0 && manager->info != NULL) {
+			struct pw_core_info *info = manager->info;
+			if (info->props) {
+				if ((str = spa_dict_lookup(info->props, "default.clock.rate")) != NULL)
+					impl->defs.sample_spec.rate = atoi(str);
+				if ((str = spa_dict_lookup(info->props, "default.clock.quantum-limit")) != NULL)
+					impl->defs.quantum_limit = atoi(str);
+			}
 		}
+	} else {
+		update_latency_offset(o);
 	}
 
+	o->change_mask = 0;
+	update_object_info(manager, o, &impl->defs);
+}
+
+static void manager_added(void *data, struct pw_manager_object *o)
+{
+	struct client *client = data;
+	struct pw_manager *manager = client->manager;
+	const char *str;
+
+	if (client->shared_manager == NULL)
+		manager_object_update(client->impl, manager, o, true);
+
 	if (spa_streq(o->type, PW_TYPE_INTERFACE_Metadata)) {
 		if (o->props != NULL &&
 		    (str = pw_properties_get(o->props, PW_KEY_METADATA_NAME)) != NULL)
@@ -889,12 +956,8 @@ static void manager_added(void *data, struct pw_manager_object *o)
 		}
 	}
 
-	update_object_info(manager, o, &impl->defs);
-
 	send_object_event(client, o, SUBSCRIPTION_EVENT_NEW);
 
-	o->change_mask = 0;
-
 	/* Adding sinks etc. may also change defaults */
 	send_default_change_subscribe_event(client, pw_manager_object_is_sink(o), pw_manager_object_is_source_or_monitor(o));
 }
@@ -902,15 +965,12 @@ static void manager_added(void *data, struct pw_manager_object *o)
 static void manager_updated(void *data, struct pw_manager_object *o)
 {
 	struct client *client = data;
-	struct pw_manager *manager = client->manager;
-	struct impl *impl = client->impl;
 
-	update_object_info(manager, o, &impl->defs);
+	if (client->shared_manager == NULL)
+		manager_object_update(client->impl, client->manager, o, false);
 
 	send_object_event(client, o, SUBSCRIPTION_EVENT_CHANGE);
 
-	o->change_mask = 0;
-
 	set_temporary_move_target(client, o, SPA_ID_INVALID);
 
 	send_latency_offset_subscribe_event(client, o);
@@ -937,8 +997,10 @@ static void manager_object_data_timeout(void *data, struct pw_manager_object *o,
 {
 	struct client *client = data;
 
-	if (spa_streq(key, "temporary_move_data"))
+	if (spa_streq(key, "temporary_move_data")) {
 		temporary_move_target_timeout(client, o);
+		clear_temporary_move_target(o);
+	}
 }
 
 static void manager_metadata(void *data, struct pw_manager_object *o,
@@ -1062,6 +1124,291 @@ static const struct pw_manager_events manager_events = {
 	.object_data_timeout = manager_object_data_timeout,
 };
 
+static void shared_manager_added(void *data, struct pw_manager_object *o)
+{
+	struct shared_manager *sm = data;
+	struct client *client, *t;
+
+	manager_object_update(sm->impl, sm->manager, o, true);
+
+	spa_list_for_each_safe(client, t, &sm->clients, shared_link)
+		manager_added(client, o);
+}
+
+static void shared_manager_updated(void *data, struct pw_manager_object *o)
+{
+	struct shared_manager *sm = data;
+	struct client *client, *t;
+
+	manager_object_update(sm->impl, sm->manager, o, false);
+
+	spa_list_for_each_safe(client, t, &sm->clients, shared_link)
+		manager_updated(client, o);
+}
+
+static void shared_manager_removed(void *data, struct pw_manager_object *o)
+{
+	struct shared_manager *sm = data;
+	struct client *client, *t;
+
+	spa_list_for_each_safe(client, t, &sm->clients, shared_link)
+		manager_removed(client, o);
+}
+
+static void shared_manager_metadata(void *data, struct pw_manager_object *o,
+		uint32_t subject, const char *key, const char *type, const char *value)
+{
+	struct shared_manager *sm = data;
+	struct client *client, *t;
+
+	spa_list_for_each_safe(client, t, &sm->clients, shared_link)
+		manager_metadata(client, o, subject, key, type, value);
+}
+
+static void shared_manager_object_data_timeout(void *data, struct pw_manager_object *o,
+		const char *key)
+{
+	struct shared_manager *sm = data;
+	struct client *client, *t;
+
+	if (spa_streq(key, "temporary_move_data")) {
+		spa_list_for_each_safe(client, t, &sm->clients, shared_link)
+			temporary_move_target_timeout(client, o);
+		clear_temporary_move_target(o);
+	}
+}
+
+/* every client holds a reference, the manager goes away with the last one */
+void shared_manager_unref(struct shared_manager *sm)
+{
+	if (--sm->ref > 0)
+		return;
+
+	pw_log_debug("%p: free shared manager", sm);
+
+	spa_assert(spa_list_is_empty(&sm->clients));
+
+	spa_list_remove(&sm->link);
+
+	spa_hook_remove(&sm->manager_listener);
+	pw_manager_destroy(sm->manager);
+	spa_hook_remove(&sm->core_listener);
+	pw_core_disconnect(sm->core);
+	pw_properties_free(sm->props);
+	free(sm);
+}
+
+static void shared_manager_disconnect(void *data)
+{
+	struct shared_manager *sm = data;
+	struct client *client, *t;
+
+	pw_log_debug("%p: shared manager disconnect", sm);
+
+	spa_list_for_each_safe(client, t, &sm->clients, shared_link)
+		manager_disconnect(client);
+
+	/* new clients will create a new manager, this one goes away when the
+	 * last client is freed */
+	spa_list_remove(&sm->link);
+	spa_list_init(&sm->link);
+}
+
+static const struct pw_manager_events shared_manager_events = {
+	PW_VERSION_MANAGER_EVENTS,
+	.added = shared_manager_added,
+	.updated = shared_manager_updated,
+	.removed = shared_manager_removed,
+	.metadata = shared_manager_metadata,
+	.disconnect = shared_manager_disconnect,
+	.object_data_timeout = shared_manager_object_data_timeout,
+};
+
+static void shared_manager_core_done(void *data, uint32_t id, int seq)
+{
+	struct shared_manager *sm = data;
+	struct client *client, *t;
+
+	if (id != PW_ID_CORE)
+		return;
+
+	/* only complete the client that started this sync, the others
+	 * wait for their own */
+	spa_list_for_each_safe(client, t, &sm->clients, shared_link) {
+		if (client->manager_sync_seq == seq) {
+			client->manager_sync_seq = 0;
+			manager_sync(client);
+		}
+	}
+}
+
+static const struct pw_core_events shared_manager_core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.done = shared_manager_core_done,
+};
+
+static struct shared_manager *shared_manager_new(struct impl *impl, struct client *client)
+{
+	struct shared_manager *sm;
+	int res;
+
+	sm = calloc(1, sizeof(*sm));
+	if (sm == NULL)
+		return NULL;
+
+	sm->impl = impl;
+	spa_list_init(&sm->clients);
+
+	sm->props = pw_properties_new(PW_KEY_APP_NAME, "pipewire-pulse shared client", NULL);
+	if (sm->props == NULL)
+		goto error;
+	pw_properties_update_keys(sm->props, &client->props->dict, shared_manager_keys);
+
+	/* connect with the access properties so that the session manager
+	 * applies the permissions of this class of clients */
+	sm->core = pw_context_connect(impl->context,
+			pw_properties_copy(sm->props), 0);
+	if (sm->core == NULL)
+		goto error_free;
+
+	pw_core_add_listener(sm->core, &sm->core_listener,
+			&shared_manager_core_events, sm);
+
+	sm->manager = pw_manager_new(sm->core);
+	if (sm->manager == NULL)
+		goto error_disconnect;
+
+	pw_manager_add_listener(sm->manager, &sm->manager_listener,
+			&shared_manager_events, sm);
+
+	spa_list_append(&impl->shared_managers, &sm->link);
+
+	pw_log_info("%p: created shared manager for access:%s", sm,
+			pw_properties_get(sm->props, PW_KEY_CLIENT_ACCESS));
+
+	return sm;
+
+error_disconnect:
+	res = -errno;
+	spa_hook_remove(&sm->core_listener);
+	pw_core_disconnect(sm->core);
+	errno = -res;
+error_free:
+	res = -errno;
+	pw_properties_free(sm->props);
+	errno = -res;
+error:
+	free(sm);
+	return NULL;
+}
+
+static bool shared_manager_matches(struct shared_manager *sm, struct client *client)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(shared_manager_keys, k) {
+		if (!spa_streq(pw_properties_get(sm->props, *k),
+				pw_properties_get(client->props, *k)))
+			return false;
+	}
+	return true;
+}
+
+int client_manager_sync(struct client *client)
+{
+	struct shared_manager *sm = client->shared_manager;
+
+	if (sm == NULL)
+		return pw_manager_sync(client->manager);
+
+	/* sync on the shared core but only for this client, see
+	 * shared_manager_core_done() */
+	client->manager_sync_seq = pw_core_sync(sm->core, PW_ID_CORE,
+			client->manager_sync_seq);
+	return client->manager_sync_seq;
+}
+
+struct replay_data {
+	struct client *client;
+	struct pw_manager_object *object;
+};
+
+static int replay_metadata(void *data, uint32_t subject, const char *key,
+		const char *type, const char *value)
+{
+	struct replay_data *d = data;
+	manager_metadata(d->client, d->object, subject, key, type, value);
+	return 0;
+}
+
+static int replay_object(void *data, struct pw_manager_object *o)
+{
+	struct replay_data d = { .client = data, .object = o };
+
+	manager_added(d.client, o);
+
+	if (spa_streq(o->type, PW_TYPE_INTERFACE_Metadata))
+		pw_manager_object_for_each_metadata(o, replay_metadata, &d);
+	return 0;
+}
+
+static int shared_manager_add_client(struct impl *impl, struct client *client)
+{
+	struct shared_manager *sm = NULL, *s;
+
+	spa_list_for_each(s, &impl->shared_managers, link) {
+		if (shared_manager_matches(s, client)) {
+			sm = s;
+			break;
+		}
+	}
+	if (sm == NULL) {
+		if ((sm = shared_manager_new(impl, client)) == NULL)
+			return -errno;
+	}
+	sm->ref++;
+
+	client->shared_manager = sm;
+	client->core = sm->core;
+	client->manager = sm->manager;
+	spa_list_append(&sm->clients, &client->shared_link);
+
+	/* catch up with what the manager already knows */
+	pw_manager_for_each_object(sm->manager, replay_object, client);
+
+	client_manager_sync(client);
+
+	pw_log_debug("%p: client %p uses shared manager", sm, client);
+
+	return 0;
+}
+
+/* the client keeps its reference until it is freed, its samples can still
+ * play on the shared core */
+void shared_manager_remove_client(struct shared_manager *sm, struct client *client)
+{
+	spa_list_remove(&client->shared_link);
+	spa_list_init(&client->shared_link);
+}
+
+/* Streams of clients that share a core can't get the application properties
+ * from their client object, add them to the stream. */
+static void stream_add_client_props(struct client *client, struct pw_properties *props)
+{
+	const struct spa_dict_item *it;
+	const char *str;
+
+	if (client->shared_manager == NULL)
+		return;
+
+	spa_dict_for_each(it, &client->props->dict) {
+		if (spa_strstartswith(it->key, "application.") &&
+		    pw_properties_get(props, it->key) == NULL)
+			pw_properties_set(props, it->key, it->value);
+	}
+	if (pw_properties_get(props, PW_KEY_NODE_NAME) == NULL &&
+	    (str = pw_properties_get(client->props, PW_KEY_APP_NAME)) != NULL)
+		pw_properties_set(props, PW_KEY_NODE_NAME, str);
+}
+
 static int do_set_client_name(struct client *client, uint32_t command, uint32_t tag, struct message *m)
 {
 	struct impl *impl = client->impl;
@@ -1091,22 +1438,27 @@ static int do_set_client_name(struct client *client, uint32_t command, uint32_t
 			commands[command].name, tag);
 
 	if (client->core == NULL) {
-		client->core = pw_context_connect(impl->context,
-				pw_properties_copy(client->props), 0);
-		if (client->core == NULL) {
-			res = -errno;
-			goto error;
-		}
-		client->manager = pw_manager_new(client->core);
-		if (client->manager == NULL) {
-			res = -errno;
-			goto error;
-		}
 		client->connect_tag = tag;
-		pw_manager_add_listener(client->manager, &client->manager_listener,
-				&manager_events, client);
+		if (impl->defs.shared_manager) {
+			if ((res = shared_manager_add_client(impl, client)) < 0)
+				goto error;
+		} else {
+			client->core = pw_context_connect(impl->context,
+					pw_properties_copy(client->props), 0);
+			if (client->core == NULL) {
+				res = -errno;
+				goto error;
+			}
+			client->manager = pw_manager_new(client->core);
+			if (client->manager == NULL) {
+				res = -errno;
+				goto error;
+			}
+			pw_manager_add_listener(client->manager, &client->manager_listener,
+					&manager_events, client);
+		}
 	} else {
-		if (changed)
+		if (changed && client->shared_manager == NULL)
 			pw_core_update_properties(client->core, &client->props->dict);
 
 		if (client->connect_tag == SPA_ID_INVALID)
@@ -1868,6 +2220,8 @@ static int do_create_playback_stream(struct client *client, uint32_t command, ui
 	if ((str = pw_properties_get(client->props, "pulse.zeroramp.gap")) != NULL)
 		pw_properties_set(props, "zeroramp.gap", str);
 
+	stream_add_client_props(client, props);
+
 	stream->stream = pw_stream_new(client->core, name, spa_steal_ptr(props));
 	if (stream->stream == NULL)
 		goto error_errno;
@@ -2167,6 +2521,8 @@ static int do_create_record_stream(struct client *client, uint32_t command, uint
 	if (dont_inhibit_auto_suspend)
 		pw_properties_set(props, PW_KEY_NODE_PASSIVE, "in-follow");
 
+	stream_add_client_props(client, props);
+
 	stream->stream = pw_stream_new(client->core, name, spa_steal_ptr(props));
 	if (stream->stream == NULL)
 		goto error_errno;
@@ -3331,7 +3687,8 @@ static int do_update_proplist(struct client *client, uint32_t command, uint32_t
 		if (pw_properties_update(client->props, &props->dict) > 0) {
 			client_update_quirks(client);
 			client->name = pw_properties_get(client->props, PW_KEY_APP_NAME);
-			pw_core_update_properties(client->core, &client->props->dict);
+			if (client->shared_manager == NULL)
+				pw_core_update_properties(client->core, &client->props->dict);
 		}
 	}
 
@@ -3387,8 +3744,10 @@ static int do_remove_proplist(struct client *client, uint32_t command, uint32_t
 			return -ENOENT;
 
 		pw_stream_update_properties(stream->stream, &dict);
-	} else {
+	} else if (client->shared_manager == NULL) {
 		pw_core_update_properties(client->core, &dict);
+	} else {
+		pw_properties_update(client->props, &dict);
 	}
 
 	return reply_simple_ack(client, tag);
@@ -4168,9 +4527,11 @@ static int fill_node_info_proplist(struct message *m, const struct spa_dict *nod
 			    spa_streq(it->key, PW_KEY_OBJECT_SERIAL))
 				continue;
 
-			if ((it2 = (struct spa_dict_item*)spa_dict_lookup_item(&dict, it->key)))
-				it2->value = it->value;
-			else
+			if ((it2 = (struct spa_dict_item*)spa_dict_lookup_item(&dict, it->key))) {
+				/* streams on a shared core have their own application */
+				if (!spa_strstartswith(it->key, "application."))
+					it2->value = it->value;
+			} else
 				items[n++] = *it;
 		}
 		dict.n_items = n;
@@ -5550,6 +5911,7 @@ static void impl_clear(struct impl *impl)
 	struct message *msg;
 	struct server *s;
 	struct client *c;
+	struct shared_manager *sm;
 
 	pw_map_for_each(&impl->modules, impl_unload_module, impl);
 	pw_map_clear(&impl->modules);
@@ -5560,6 +5922,12 @@ static void impl_clear(struct impl *impl)
 	spa_list_consume(c, &impl->cleanup_clients, link)
 		client_free(c);
 
+	/* the clients free the shared managers */
+	spa_list_consume(sm, &impl->shared_managers, link) {
+		spa_list_remove(&sm->link);
+		spa_list_init(&sm->link);
+	}
+
 	spa_list_consume(msg, &impl->free_messages, link)
 		message_free(msg, true, true);
 
@@ -5674,6 +6042,8 @@ static void load_defaults(struct defs *def, struct pw_properties *props)
 {
 	parse_bool(props, "pulse.allow-module-loading", DEFAULT_ALLOW_MODULE_LOADING,
 			&def->allow_module_loading);
+	parse_bool(props, "pulse.shared-manager", DEFAULT_SHARED_MANAGER,
+			&def->shared_manager);
 	parse_frac(props, "pulse.min.req", DEFAULT_MIN_REQ, &def->min_req);
 	parse_frac(props, "pulse.default.req", DEFAULT_DEFAULT_REQ, &def->default_req);
 	parse_frac(props, "pulse.min.frag", DEFAULT_MIN_FRAG, &def->min_frag);
@@ -5710,6 +6080,7 @@ struct pw_protocol_pulse *pw_protocol_pulse_new(struct pw_context *context,
 	pw_map_init(&impl->samples, 16, 16);
 	pw_map_init(&impl->modules, 16, 16);
 	spa_list_init(&impl->cleanup_clients);
+	spa_list_init(&impl->shared_managers);
 	spa_list_init(&impl->free_messages);
 
 	impl->main_loop = pw_context_get_main_loop(context);
@@ -46,7 +46,8 @@
  * packets using the sendspin protocol to a client.
  *
  * The sender will listen on a specific port (8927) and create a stream for
- * each connection.
+ * each connection. Clients that request the same format share a stream, the
+ * audio is then sent to all of them from that stream.
  *
  * In combination with a virtual sink, each of the client streams can be sent
  * the same data in the client specific format.
@@ -71,6 +72,8 @@
  * - `sendspin.group-id`: the group-id of the server, default random
  * - `sendspin.group-name`: the group-name of the server, default "PipeWire"
  * - `sendspin.delay`: the delay to add to clients in seconds. Default 5.0
+ * - `sendspin.share-streams`: let clients that use the same format, target and
+ *                  stream rule share one stream, default false
  * - `node.always-process = <bool>`: true to send silence even when not connected.
  * - `stream.props = {}`: properties to be passed to all the stream
  * - `stream.rules` = \<rules\>: match rules, use the create-stream action to
@@ -108,6 +111,7 @@
  *         #sendspin.group-id = "abcded"
  *         #sendspin.group-name = "PipeWire"
  *         #sendspin.delay = 5.0
+ *         #sendspin.share-streams = false
  *         #node.always-process = false
  *         #audio.position = [ FL FR ]
  *         stream.props = {
@@ -174,21 +178,41 @@ static const struct spa_dict_item module_info[] = {
 	{ PW_KEY_MODULE_VERSION, PACKAGE_VERSION },
 };
 
+/* a playback stream, shared by all clients that use the same format */
+struct stream {
+	struct impl *impl;
+	struct spa_list link;
+
+	struct spa_audio_info info;
+	char *target;
+	char *props;
+
+	struct pw_stream *stream;
+	struct spa_hook stream_listener;
+	enum pw_stream_state state;
+	unsigned int have_format:1;
+
+	struct spa_io_position *io_position;
+
+	struct spa_list clients;
+	uint32_t n_clients;
+};
+
 struct client {
 	struct impl *impl;
 	struct spa_list link;
 
 	char *name;
 	struct pw_properties *props;
+	char *stream_props;	/* of the create-stream action */
 
 	struct pw_websocket_connection *conn;
 	struct spa_hook conn_listener;
 
 	struct spa_audio_info info;
-	struct pw_stream *stream;
-	struct spa_hook stream_listener;
+	struct stream *stream;
+	struct spa_list stream_link;
 
-	struct spa_io_position *io_position;
 	struct pw_timer timer;
 
 	uint64_t delay_usec;
@@ -236,6 +260,7 @@ struct impl {
 
 	float delay;
 	bool always_process;
+	bool share_streams;
 
 	struct pw_properties *stream_props;
 
@@ -243,7 +268,7 @@ struct impl {
 	struct spa_hook websocket_listener;
 
 	struct spa_list clients;
-
+	struct spa_list streams;
 };
 
 static int send_group_update(struct client *c, bool playing);
@@ -252,32 +277,38 @@ static int send_server_state(struct client *c, const struct spa_pod *tag);
 
 static void on_stream_destroy(void *d)
 {
-	struct client *c = d;
-	spa_hook_remove(&c->stream_listener);
-	c->stream = NULL;
+	struct stream *s = d;
+	spa_hook_remove(&s->stream_listener);
+	s->stream = NULL;
 }
 
 static void on_stream_state_changed(void *d, enum pw_stream_state old,
 		enum pw_stream_state state, const char *error)
 {
-	struct client *c = d;
+	struct stream *s = d;
+	struct client *c;
+
+	s->state = state;
+
 	switch (state) {
 	case PW_STREAM_STATE_ERROR:
 	case PW_STREAM_STATE_UNCONNECTED:
 		//pw_impl_module_schedule_destroy(c->impl->module);
 		break;
 	case PW_STREAM_STATE_PAUSED:
-		send_group_update(c, false);
+		spa_list_for_each(c, &s->clients, stream_link)
+			send_group_update(c, false);
 		break;
 	case PW_STREAM_STATE_STREAMING:
-		send_group_update(c, true);
+		spa_list_for_each(c, &s->clients, stream_link)
+			send_group_update(c, true);
 		break;
 	default:
 		break;
 	}
 }
 
-static uint64_t get_time_us(struct client *c)
+static uint64_t get_time_us(void)
 {
 	struct timespec now;
 	if (clock_gettime(CLOCK_MONOTONIC, &now) < 0)
@@ -287,28 +318,40 @@ static uint64_t get_time_us(struct client *c)
 
 static void on_playback_stream_process(void *d)
 {
-	struct client *c = d;
+	struct stream *s = d;
+	struct client *c;
 	struct pw_buffer *b;
 	struct spa_buffer *buf;
 	uint8_t *p;
 	struct iovec iov[2];
 	uint8_t header[9];
-	uint64_t timestamp;
+	uint64_t now, timestamp;
 
-	if ((b = pw_stream_dequeue_buffer(c->stream)) == NULL) {
+	if ((b = pw_stream_dequeue_buffer(s->stream)) == NULL) {
 		pw_log_debug("out of buffers: %m");
 		return;
 	}
 
-	if (c->playing) {
-		buf = b->buffer;
-		if ((p = buf->datas[0].data) == NULL)
-			return;
+	buf = b->buffer;
+	if ((p = buf->datas[0].data) == NULL)
+		goto done;
+
+	now = s->io_position ?
+		s->io_position->clock.nsec / 1000 :
+		get_time_us();
 
-		timestamp = c->io_position ?
-			c->io_position->clock.nsec / 1000 :
-			get_time_us(c);
-		timestamp += c->delay_usec;
+	iov[0].iov_base = header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = p;
+	iov[1].iov_len = buf->datas[0].chunk->size;
+
+	/* all clients get the same chunk, only the timestamp is
+	 * specific to the client */
+	spa_list_for_each(c, &s->clients, stream_link) {
+		if (!c->playing || c->conn == NULL)
+			continue;
+
+		timestamp = now + c->delay_usec;
 
 		header[0] = 4;
 		header[1] = (timestamp >> 56) & 0xff;
@@ -320,21 +363,19 @@ static void on_playback_stream_process(void *d)
 		header[7] = (timestamp >>  8) & 0xff;
 		header[8] = (timestamp      ) & 0xff;
 
-		iov[0].iov_base = header;
-		iov[0].iov_len = sizeof(header);
-		iov[1].iov_base = p;
-		iov[1].iov_len = buf->datas[0].chunk->size;
-
 		pw_websocket_connection_send(c->conn,
 				PW_WEBSOCKET_OPCODE_BINARY, iov, 2);
 	}
-	pw_stream_queue_buffer(c->stream, b);
+done:
+	pw_stream_queue_buffer(s->stream, b);
 }
 
 static void
 on_stream_param_changed(void *d, uint32_t id, const struct spa_pod *param)
 {
-	struct client *c = d;
+	struct stream *s = d;
+	struct spa_audio_info info;
+	struct client *c;
 	int res;
 
 	if (param == NULL)
@@ -342,25 +383,30 @@ on_stream_param_changed(void *d, uint32_t id, const struct spa_pod *param)
 
 	switch (id) {
 	case SPA_PARAM_Format:
-		if ((res = spa_format_audio_parse(param, &c->info)) < 0) {
+		if ((res = spa_format_audio_parse(param, &info)) < 0) {
 			pw_log_error("can't parse audio format: %s", spa_strerror(res));
 			return;
 		}
-		if ((res = send_stream_start(c)) < 0)
-			pw_log_error("can't send stream/start: %s", spa_strerror(res));
+		s->have_format = true;
+		spa_list_for_each(c, &s->clients, stream_link) {
+			c->info = info;
+			if ((res = send_stream_start(c)) < 0)
+				pw_log_error("can't send stream/start: %s", spa_strerror(res));
+		}
 		break;
 	case SPA_PARAM_Tag:
-		send_server_state(c, param);
+		spa_list_for_each(c, &s->clients, stream_link)
+			send_server_state(c, param);
 		break;
 	}
 }
 
 static void on_stream_io_changed(void *d, uint32_t id, void *area, uint32_t size)
 {
-	struct client *c = d;
+	struct stream *s = d;
 	switch (id) {
 	case SPA_IO_Position:
-		c->io_position = area;
+		s->io_position = area;
 		break;
 	}
 }
@@ -374,9 +420,9 @@ static const struct pw_stream_events playback_stream_events = {
 	.process = on_playback_stream_process
 };
 
-static int create_stream(struct client *c)
+static int create_stream(struct stream *s, struct client *c)
 {
-	struct impl *impl = c->impl;
+	struct impl *impl = s->impl;
 	int res;
 	uint32_t n_params;
 	const struct spa_pod *params[1];
@@ -400,20 +446,20 @@ static int create_stream(struct client *c)
 		pw_properties_setf(props, PW_KEY_MEDIA_NAME, "Sendspin to %s", client_name);
 
 
-	c->stream = pw_stream_new(impl->core, "sendspin sender", props);
-	if (c->stream == NULL)
+	s->stream = pw_stream_new(impl->core, "sendspin sender", props);
+	if (s->stream == NULL)
 		return -errno;
 
-	pw_stream_add_listener(c->stream,
-			&c->stream_listener,
-			&playback_stream_events, c);
+	pw_stream_add_listener(s->stream,
+			&s->stream_listener,
+			&playback_stream_events, s);
 
 	n_params = 0;
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 	params[n_params++] = spa_format_audio_build(&b,
-			SPA_PARAM_EnumFormat, &c->info);
+			SPA_PARAM_EnumFormat, &s->info);
 
-	if ((res = pw_stream_connect(c->stream,
+	if ((res = pw_stream_connect(s->stream,
 			PW_DIRECTION_INPUT,
 			PW_ID_ANY,
 			PW_STREAM_FLAG_AUTOCONNECT |
@@ -425,6 +471,139 @@ static int create_stream(struct client *c)
 	return 0;
 }
 
+static void stream_free(struct stream *s)
+{
+	spa_list_remove(&s->link);
+	if (s->stream)
+		pw_stream_destroy(s->stream);
+	free(s->target);
+	free(s->props);
+	free(s);
+}
+
+static struct stream *stream_find(struct impl *impl, struct client *c)
+{
+	const char *target = pw_properties_get(c->props, PW_KEY_TARGET_OBJECT);
+	struct stream *s;
+
+	if (!impl->share_streams)
+		return NULL;
+
+	spa_list_for_each(s, &impl->streams, link) {
+		if (memcmp(&s->info, &c->info, sizeof(s->info)) == 0 &&
+		    spa_streq(s->target, target) &&
+		    spa_streq(s->props, c->stream_props))
+			return s;
+	}
+	return NULL;
+}
+
+static int do_add_client(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct client *c = user_data;
+	spa_list_append(&c->stream->clients, &c->stream_link);
+	return 0;
+}
+
+static int do_remove_client(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct client *c = user_data;
+	spa_list_remove(&c->stream_link);
+	return 0;
+}
+
+static void update_stream_description(struct stream *s)
+{
+	struct client *c;
+	const char *name;
+	char str[256];
+
+	if (s->stream == NULL || s->n_clients == 0)
+		return;
+
+	c = spa_list_first(&s->clients, struct client, stream_link);
+	name = pw_properties_get(c->props, "sendspin.client-name");
+
+	if (s->n_clients == 1)
+		snprintf(str, sizeof(str), "Sendspin to %s", name);
+	else
+		snprintf(str, sizeof(str), "Sendspin to %s and %u more",
+				name, s->n_clients - 1);
+
+	if (pw_properties_get(c->props, PW_KEY_NODE_DESCRIPTION) == NULL)
+		pw_stream_update_properties(s->stream, &SPA_DICT_ITEMS(
+				SPA_DICT_ITEM(PW_KEY_NODE_DESCRIPTION, str)));
+	if (pw_properties_get(c->props, PW_KEY_MEDIA_NAME) == NULL)
+		pw_stream_update_properties(s->stream, &SPA_DICT_ITEMS(
+				SPA_DICT_ITEM(PW_KEY_MEDIA_NAME, str)));
+}
+
+/* Clients that request the same format share one stream. The audio is
+ * then converted once for all of them and the same chunk is sent to
+ * each client. */
+static int client_join_stream(struct client *c)
+{
+	struct impl *impl = c->impl;
+	struct stream *s;
+	int res;
+
+	if ((s = stream_find(impl, c)) == NULL) {
+		const char *target = pw_properties_get(c->props, PW_KEY_TARGET_OBJECT);
+
+		if ((s = calloc(1, sizeof(*s))) == NULL)
+			return -errno;
+
+		s->impl = impl;
+		s->info = c->info;
+		s->target = target ? strdup(target) : NULL;
+		s->props = c->stream_props ? strdup(c->stream_props) : NULL;
+		spa_list_init(&s->clients);
+		spa_list_append(&impl->streams, &s->link);
+
+		if ((res = create_stream(s, c)) < 0) {
+			stream_free(s);
+			return res;
+		}
+	}
+	c->stream = s;
+	s->n_clients++;
+	pw_loop_locked(impl->data_loop, do_add_client, 0, NULL, 0, c);
+
+	pw_log_info("client %p joins stream %p with %u clients", c, s, s->n_clients);
+
+	if (s->n_clients > 1)
+		update_stream_description(s);
+
+	/* the stream is already running, start the client right away */
+	if (s->have_format) {
+		if ((res = send_stream_start(c)) < 0)
+			pw_log_error("can't send stream/start: %s", spa_strerror(res));
+		if (s->state == PW_STREAM_STATE_STREAMING)
+			send_group_update(c, true);
+	}
+	return 0;
+}
+
+static void client_leave_stream(struct client *c)
+{
+	struct stream *s = c->stream;
+
+	if (s == NULL)
+		return;
+
+	pw_loop_locked(c->impl->data_loop, do_remove_client, 0, NULL, 0, c);
+	c->stream = NULL;
+
+	pw_log_info("client %p leaves stream %p with %u clients", c, s, s->n_clients - 1);
+
+	if (--s->n_clients == 0)
+		stream_free(s);
+	else
+		update_stream_description(s);
+}
+
 static int send_server_hello(struct client *c)
 {
 	struct impl *impl = c->impl;
@@ -483,7 +662,7 @@ static int send_server_state(struct client *c, const struct spa_pod *tag)
 				dict.n_items = 0;
 		}
 		spa_json_builder_object_push(&b,     "metadata", "{");
-		spa_json_builder_object_uint(&b,       "timestamp", get_time_us(c));
+		spa_json_builder_object_uint(&b,       "timestamp", get_time_us());
 		spa_json_builder_object_string(&b,     "title", spa_dict_lookup(&dict, "media.title"));
 		spa_json_builder_object_string(&b,     "artist", spa_dict_lookup(&dict, "media.artist"));
 		spa_json_builder_object_string(&b,     "album", spa_dict_lookup(&dict, "media.album"));
@@ -514,7 +693,7 @@ static int send_server_time(struct client *c, uint64_t t1, uint64_t t2)
 	size_t size;
 	spa_autofree char *mem = NULL;
 
-	t3 = get_time_us(c);
+	t3 = get_time_us();
 
 	if ((res = spa_json_builder_memstream(&b, &mem, &size, 0)) < 0)
 		return res;
@@ -917,7 +1096,7 @@ static int handle_client_state(struct client *c, struct spa_json *payload)
 		}
 	}
 	if (c->stream == NULL)
-		create_stream(c);
+		client_join_stream(c);
 	return 0;
 }
 
@@ -943,7 +1122,7 @@ static int handle_client_time(struct client *c, struct spa_json *payload)
 	int l;
 	uint64_t t1 = 0,t2;
 
-	t2 = get_time_us(c);
+	t2 = get_time_us();
 
 	while ((l = spa_json_object_next(payload, key, sizeof(key), &v)) > 0) {
 		if (spa_streq(key, "client_transmitted")) {
@@ -969,13 +1148,22 @@ static int handle_stream_request_format(struct client *c, struct spa_json *paylo
 	char key[256];
         const char *v;
 	int l;
+	struct spa_audio_info info;
 
 	while ((l = spa_json_object_next(payload, key, sizeof(key), &v)) > 0) {
 		if (spa_streq(key, "player")) {
 			if (!spa_json_is_object(v, l))
 				return -EPROTO;
 			spa_json_enter(payload, &it[0]);
-			parse_codec(c, &it[0], &c->info);
+			if (parse_codec(c, &it[0], &info) < 0)
+				continue;
+			c->info = info;
+			/* move to a stream with the new format */
+			if (c->stream != NULL &&
+			    memcmp(&c->stream->info, &info, sizeof(info)) != 0) {
+				client_leave_stream(c);
+				client_join_stream(c);
+			}
 		}
 	}
 	return 0;
@@ -983,10 +1171,7 @@ static int handle_stream_request_format(struct client *c, struct spa_json *paylo
 
 static int handle_client_goodbye(struct client *c, struct spa_json *payload)
 {
-	if (c->stream != NULL) {
-		pw_stream_destroy(c->stream);
-		c->stream = NULL;
-	}
+	client_leave_stream(c);
 	return 0;
 }
 
@@ -1063,6 +1248,7 @@ static void client_free(struct client *c)
 	}
 	pw_timer_queue_cancel(&c->timer);
 	pw_properties_free(c->props);
+	free(c->stream_props);
 	free(c->name);
 	free(c);
 }
@@ -1158,6 +1344,9 @@ static int rule_matched(void *data, const char *location, const char *action,
 		pw_properties_update_string(i->props, str, len);
 		if ((c = client_new(impl, i->name, spa_steal_ptr(i->props))) == NULL)
 			return -errno;
+		/* only clients that were given the same stream properties
+		 * can share a stream */
+		c->stream_props = strndup(str, len);
 		if (i->conn)
 			client_connected(c, i->conn);
 		else
@@ -1393,6 +1582,7 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	impl->data_loop = pw_context_acquire_loop(context, &props->dict);
 	impl->timer_queue = pw_context_get_timer_queue(context);
 	spa_list_init(&impl->clients);
+	spa_list_init(&impl->streams);
 
 	pw_properties_set(props, PW_KEY_NODE_LOOP_NAME, impl->data_loop->name);
 
@@ -1457,6 +1647,8 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 		str = SPA_STRINGIFY(DEFAULT_SENDSPIN_DELAY);
 	impl->delay = pw_properties_parse_float(str);
 
+	impl->share_streams = pw_properties_get_bool(props, "sendspin.share-streams", false);
+
 #ifdef HAVE_AVAHI
 	if ((impl->zeroconf = pw_zeroconf_new(context, NULL)) != NULL) {
 		pw_zeroconf_add_listener(impl->zeroconf, &impl->zeroconf_listener,
@@ -621,6 +621,149 @@ static int load_module(struct pw_context *context, const char *key, const char *
 	return 0;
 }
 
+/* one <key> = <value> of a match object, with the modifiers and the string
+ * to compare with decoded once */
+struct match_value {
+	struct match_value *next;
+	const char *key;
+	const char *value;	/**< the JSON value, for logging */
+	int len;
+	const char *val;	/**< decoded value, NULL when it could not be decoded */
+	unsigned int negate:1;
+	unsigned int is_null:1;
+	unsigned int reg:1;
+	unsigned int compiled:1;
+	regex_t preg;
+};
+
+/* Decode value into buf. Returns < 0 when the value should be skipped. */
+static int match_value_init(struct match_value *m, const char *key,
+		const char *value, int len, char *buf, size_t size,
+		const char *as, int az)
+{
+	char tmp[1024];
+	bool parse_string = true;
+	int skip = 0;
+
+	spa_zero(*m);
+	m->key = key;
+	m->value = value;
+	m->len = len;
+
+	/* first decode a string, when there was a string, we assume it
+	 * can not be null but the "null" string, unless there is a modifier,
+	 * see below. */
+	if (spa_json_is_string(value, len)) {
+		if (spa_json_parse_stringn(value, len, tmp, sizeof(tmp)) < 0) {
+			pw_log_warn("invalid string '%.*s' in '%.*s'",
+					len, value, az, as);
+			return -EINVAL;
+		}
+		value = tmp;
+		len = strlen(tmp);
+		parse_string = false;
+	}
+
+	/* parse the modifiers, after the modifier we unescape the string
+	 * again to be able to detect and handle null and "null" */
+	if (len > skip && value[skip] == '!') {
+		m->negate = true;
+		skip++;
+		parse_string = true;
+	}
+	if (len > skip && value[skip] == '~') {
+		m->reg = true;
+		skip++;
+		parse_string = true;
+	}
+
+	/* parse the remaining part of the string, if there was a modifier,
+	 * we need to check for null again. Otherwise null was in quotes without
+	 * a modifier. */
+	m->is_null = parse_string && spa_json_is_null(value+skip, len-skip);
+	if (m->is_null)
+		return 0;
+
+	/* only unescape string once or again after modifier */
+	if (!parse_string) {
+		if ((size_t)(len-skip) >= size)
+			return 0;
+		memcpy(buf, value+skip, len-skip);
+		buf[len-skip] = '\0';
+	} else if (spa_json_parse_stringn(value+skip, len-skip, buf, size) < 0) {
+		pw_log_warn("invalid string '%.*s' in '%.*s'",
+				len-skip, value+skip, az, as);
+		return 0;
+	}
+	m->val = buf;
+	return 0;
+}
+
+static void match_value_clear(struct match_value *m)
+{
+	if (m->compiled)
+		regfree(&m->preg);
+	m->compiled = false;
+}
+
+static void match_value_compile(struct match_value *m, const char *as, int az)
+{
+	int res;
+
+	if (!m->reg || m->compiled || m->val == NULL)
+		return;
+
+	if ((res = regcomp(&m->preg, m->val, REG_EXTENDED | REG_NOSUB)) != 0) {
+		char errbuf[1024];
+		regerror(res, &m->preg, errbuf, sizeof(errbuf));
+		pw_log_warn("invalid regex %s: %s in '%.*s'",
+				m->val, errbuf, az, as);
+		m->reg = false;
+	} else {
+		m->compiled = true;
+	}
+}
+
+/* Returns 1 on match, 0 on mismatch and < 0 when the value should be skipped.
+ * The regex is compiled on first use unless it was compiled already. */
+static int match_value_check(struct match_value *m, const struct spa_dict *props,
+		const char *as, int az)
+{
+	const char *str = spa_dict_lookup(props, m->key);
+	bool success = m->negate;
+	struct spa_json it[1];
+	char v[1024];
+
+	if (m->is_null || str == NULL) {
+		if (m->is_null && str == NULL)
+			success = !success;
+	} else {
+		if (m->val == NULL)
+			return -EINVAL;
+
+		match_value_compile(m, as, az);
+
+		if (spa_json_begin_array(&it[0], str, strlen(str)) > 0) {
+			while (spa_json_get_string(&it[0], v, sizeof(v)) > 0) {
+				if ((m->reg && regexec(&m->preg, v, 0, NULL, 0) == 0) ||
+						spa_streq(v, m->val)) {
+					success = !success;
+					break;
+				}
+			}
+		}
+		else if ((m->reg && regexec(&m->preg, str, 0, NULL, 0) == 0) ||
+				spa_streq(str, m->val))
+			success = !success;
+	}
+	if (success)
+		pw_log_debug("'%s' match '%s' < > '%.*s'", m->key, str, m->len, m->value);
+	else
+		pw_log_debug("'%s' fail '%s' < > '%.*s'", m->key, str, m->len, m->value);
+
+	return success ? 1 : 0;
+}
+
 /*
  * {
  *     # all keys must match the value. ~ in value starts regex.
@@ -640,100 +783,28 @@ static int load_module(struct pw_context *context, const char *key, const char *
 SPA_EXPORT
 bool pw_conf_find_match(struct spa_json *arr, const struct spa_dict *props, bool condition)
 {
-	struct spa_json it[2];
+	struct spa_json it[1];
 	const char *as = arr->cur;
 	int az = (int)(arr->end - arr->cur), r, count = 0;
 
 	while ((r = spa_json_enter_object(arr, &it[0])) > 0) {
-		char key[256], val[1024], v[1024];
-		const char *str, *value;
+		char key[256], val[1024];
+		struct match_value m;
+		const char *value;
 		int match = 0, fail = 0;
-		int len;
+		int len, res;
 
 		while ((len = spa_json_object_next(&it[0], key, sizeof(key), &value)) > 0) {
-			bool success = false, is_null, reg = false, parse_string = true;
-			int skip = 0;
-
-			/* first decode a string, when there was a string, we assume it
-			 * can not be null but the "null" string, unless there is a modifier,
-			 * see below. */
-			if (spa_json_is_string(value, len)) {
-				if (spa_json_parse_stringn(value, len, val, sizeof(val)) < 0) {
-					pw_log_warn("invalid string '%.*s' in '%.*s'",
-							len, value, az, as);
-					continue;
-				}
-				value = val;
-				len = strlen(val);
-				parse_string = false;
-			}
+			if (match_value_init(&m, key, value, len, val, sizeof(val), as, az) < 0)
+				continue;
 
-			/* parse the modifiers, after the modifier we unescape the string
-			 * again to be able to detect and handle null and "null" */
-			if (len > skip && value[skip] == '!') {
-				success = !success;
-				skip++;
-				parse_string = true;
-			}
-			if (len > skip && value[skip] == '~') {
-				reg = true;
-				skip++;
-				parse_string = true;
-			}
-
-			str = spa_dict_lookup(props, key);
-
-			/* parse the remaining part of the string, if there was a modifier,
-			 * we need to check for null again. Otherwise null was in quotes without
-			 * a modifier. */
-			is_null = parse_string && spa_json_is_null(value+skip, len-skip);
-			if (is_null || str == NULL) {
-				if (is_null && str == NULL)
-					success = !success;
-			} else {
-				regex_t preg;
-				/* only unescape string once or again after modifier */
-				if (!parse_string) {
-					memmove(val, value+skip, len-skip);
-					val[len-skip] = '\0';
-				} else if (spa_json_parse_stringn(value+skip, len-skip, val, sizeof(val)) < 0) {
-					pw_log_warn("invalid string '%.*s' in '%.*s'",
-							len-skip, value+skip, az, as);
-					continue;
-				}
-
-				if (reg) {
-					int res;
-					if ((res = regcomp(&preg, val, REG_EXTENDED | REG_NOSUB)) != 0) {
-						char errbuf[1024];
-						regerror(res, &preg, errbuf, sizeof(errbuf));
-						pw_log_warn("invalid regex %s: %s in '%.*s'",
-								val, errbuf, az, as);
-						reg = false;
-					}
-				}
-				if (spa_json_begin_array(&it[1], str, strlen(str)) > 0) {
-					while (spa_json_get_string(&it[1], v, sizeof(v)) > 0) {
-						if ((reg && regexec(&preg, v, 0, NULL, 0) == 0) ||
-								spa_streq(v, val)) {
-							success = !success;
-							break;
-						}
-					}
-				}
-				else if ((reg && regexec(&preg, str, 0, NULL, 0) == 0) ||
-						spa_streq(str, val))
-					success = !success;
-
-				if (reg)
-					regfree(&preg);
-			}
-			if (success) {
+			res = match_value_check(&m, props, as, az);
+			match_value_clear(&m);
+			if (res < 0)
+				continue;
+			if (res > 0) {
 				match++;
-				pw_log_debug("'%s' match '%s' < > '%.*s'", key, str, len, value);
-			}
-			else {
-				pw_log_debug("'%s' fail '%s' < > '%.*s'", key, str, len, value);
+			} else {
 				fail++;
 				break;
 			}
@@ -1157,10 +1228,16 @@ static int update_props(void *user_data, const char *location, const char *key,
 	return 0;
 }
 
-SPA_EXPORT
-int pw_conf_section_update_props_rules(const struct spa_dict *conf,
-		const struct spa_dict *context, const char *section,
-		struct pw_properties *props)
+static int section_match_rules(struct pw_context *context,
+		const struct spa_dict *conf, const char *section,
+		const struct spa_dict *props,
+		int (*callback) (void *data, const char *location, const char *action,
+			const char *str, size_t len),
+		void *data);
+
+static int section_update_props_rules(struct pw_context *context,
+		const struct spa_dict *conf, const struct spa_dict *dict,
+		const char *section, struct pw_properties *props)
 {
 	struct data data = { .props = props };
 	int res;
@@ -1176,13 +1253,21 @@ int pw_conf_section_update_props_rules(const struct spa_dict *conf,
 		res = pw_conf_section_for_each(conf, key,
 				update_props, &data);
 	}
-	if (res == 0 && context != NULL) {
+	if (res == 0 && dict != NULL) {
 		snprintf(key, sizeof(key), "%s.rules", section);
-		res = pw_conf_section_match_rules(conf, key, context, update_props, &data);
+		res = section_match_rules(context, conf, key, dict, update_props, &data);
 	}
 	return res == 0 ? data.count : res;
 }
 
+SPA_EXPORT
+int pw_conf_section_update_props_rules(const struct spa_dict *conf,
+		const struct spa_dict *context, const char *section,
+		struct pw_properties *props)
+{
+	return section_update_props_rules(NULL, conf, context, section, props);
+}
+
 SPA_EXPORT
 int pw_conf_section_update_props(const struct spa_dict *conf,
 		const char *section, struct pw_properties *props)
@@ -1278,6 +1363,352 @@ int pw_conf_load_conf_for_context(struct pw_properties *props, struct pw_propert
 	return res;
 }
 
+/*
+ * The rules are parsed once into a tree of matches and actions, allocated
+ * from chunks that are freed together. The match values keep their decoded
+ * string and compiled regex, the actions point into the JSON string.
+ */
+#define RULES_CHUNK_SIZE	4096
+
+struct rules_chunk {
+	struct rules_chunk *next;
+	size_t size;
+	size_t used;
+};
+#define RULES_CHUNK_HDR		SPA_ROUND_UP_N(sizeof(struct rules_chunk), 16)
+
+struct rule_match {
+	struct rule_match *next;
+	struct match_value *values;
+};
+
+struct rule_action {
+	struct rule_action *next;
+	const char *key;
+	const char *val;
+	int len;
+};
+
+struct rule {
+	struct rule *next;
+	const char *as;		/**< the matches array, for logging */
+	int az;
+	struct rule_match *matches;
+	struct rule_action *actions;
+};
+
+struct conf_rules {
+	struct spa_list link;
+	const char *str;
+	size_t len;
+	struct rules_chunk *chunks;
+	struct rule *rules;
+};
+
+static void *rules_alloc(struct conf_rules *r, size_t size)
+{
+	struct rules_chunk *c = r->chunks;
+	void *p;
+
+	size = SPA_ROUND_UP_N(size, 16);
+	if (c == NULL || c->size - c->used < size) {
+		size_t csize = SPA_MAX(size, (size_t)RULES_CHUNK_SIZE);
+		if ((c = malloc(RULES_CHUNK_HDR + csize)) == NULL)
+			return NULL;
+		c->next = r->chunks;
+		c->size = csize;
+		c->used = 0;
+		r->chunks = c;
+	}
+	p = SPA_PTROFF(c, RULES_CHUNK_HDR + c->used, void);
+	c->used += size;
+	return memset(p, 0, size);
+}
+
+static char *rules_strdup(struct conf_rules *r, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *s;
+	if ((s = rules_alloc(r, len)) == NULL)
+		return NULL;
+	return memcpy(s, str, len);
+}
+
+static int rules_parse_matches(struct conf_rules *r, struct rule *rule,
+		struct spa_json *arr)
+{
+	struct rule_match **tail = &rule->matches;
+	struct spa_json it[1];
+	int res;
+
+	rule->as = arr->cur;
+	rule->az = (int)(arr->end - arr->cur);
+	rule->matches = NULL;
+
+	while ((res = spa_json_enter_object(arr, &it[0])) > 0) {
+		struct match_value **vtail, *v;
+		struct rule_match *m;
+		char key[256], val[1024];
+		const char *value;
+		int len;
+
+		if ((m = rules_alloc(r, sizeof(*m))) == NULL)
+			return -errno;
+		vtail = &m->values;
+
+		while ((len = spa_json_object_next(&it[0], key, sizeof(key), &value)) > 0) {
+			if ((v = rules_alloc(r, sizeof(*v))) == NULL)
+				return -errno;
+			if (match_value_init(v, key, value, len, val, sizeof(val),
+						rule->as, rule->az) < 0)
+				continue;
+			if ((v->key = rules_strdup(r, key)) == NULL)
+				return -errno;
+			if (v->val != NULL &&
+			    (v->val = rules_strdup(r, val)) == NULL)
+				return -errno;
+			/* compile now so that matching does not change the rules */
+			match_value_compile(v, rule->as, rule->az);
+			*vtail = v;
+			vtail = &v->next;
+		}
+		*tail = m;
+		tail = &m->next;
+	}
+	if (res < 0)
+		pw_log_warn("malformed object array in '%.*s'", rule->az, rule->as);
+	return 0;
+}
+
+static int rules_parse_actions(struct conf_rules *r, struct rule *rule,
+		struct spa_json *obj)
+{
+	struct rule_action **tail = &rule->actions;
+	const char *val;
+	char key[64];
+	int len;
+
+	rule->actions = NULL;
+
+	while ((len = spa_json_object_next(obj, key, sizeof(key), &val)) > 0) {
+		struct rule_action *a;
+
+		if (spa_json_is_container(val, len))
+			len = spa_json_container_len(obj, val, len);
+
+		if ((a = rules_alloc(r, sizeof(*a))) == NULL ||
+		    (a->key = rules_strdup(r, key)) == NULL)
+			return -errno;
+		a->val = val;
+		a->len = len;
+		*tail = a;
+		tail = &a->next;
+	}
+	return 0;
+}
+
+static int rules_parse(struct conf_rules *r)
+{
+	const char *str = r->str, *val;
+	size_t len = r->len;
+	struct rule **tail = &r->rules;
+	struct spa_json it[3];
+	int res, l;
+
+	if (spa_json_begin_array(&it[0], str, len) < 0) {
+		pw_log_warn("expect array of match rules in: '%.*s'", (int)len, str);
+		return 0;
+	}
+
+	while ((res = spa_json_enter_object(&it[0], &it[1])) > 0) {
+		bool have_match = false, have_actions = false;
+		struct rule *rule;
+		char key[64];
+
+		if ((rule = rules_alloc(r, sizeof(*rule))) == NULL)
+			return -errno;
+
+		while ((l = spa_json_object_next(&it[1], key, sizeof(key), &val)) > 0) {
+			if (spa_streq(key, "matches")) {
+				if (!spa_json_is_array(val, l)) {
+					pw_log_warn("expected array as matches in '%.*s'",
+							(int)len, str);
+					break;
+				}
+				spa_json_enter(&it[1], &it[2]);
+				if ((res = rules_parse_matches(r, rule, &it[2])) < 0)
+					return res;
+				have_match = true;
+			}
+			else if (spa_streq(key, "actions")) {
+				if (!spa_json_is_object(val, l)) {
+					pw_log_warn("expected object as match actions in '%.*s'",
+							(int)len, str);
+				} else {
+					spa_json_enter(&it[1], &it[2]);
+					if ((res = rules_parse_actions(r, rule, &it[2])) < 0)
+						return res;
+					have_actions = true;
+				}
+			}
+			else {
+				pw_log_warn("unknown match key '%s'", key);
+			}
+		}
+		/* a rule without matches can never match */
+		if (!have_match || rule->matches == NULL)
+			continue;
+		if (!have_actions) {
+			pw_log_warn("no actions for match rule '%.*s'", (int)len, str);
+			continue;
+		}
+		*tail = rule;
+		tail = &rule->next;
+	}
+	if (res < 0)
+		pw_log_warn("malformed object array in '%.*s'", (int)len, str);
+	return 0;
+}
+
+static void rules_free(struct conf_rules *r)
+{
+	struct rules_chunk *c;
+	struct rule *rule;
+	struct rule_match *m;
+	struct match_value *v;
+
+	for (rule = r->rules; rule; rule = rule->next)
+		for (m = rule->matches; m; m = m->next)
+			for (v = m->values; v; v = v->next)
+				match_value_clear(v);
+
+	while ((c = r->chunks) != NULL) {
+		r->chunks = c->next;
+		free(c);
+	}
+	free(r);
+}
+
+static struct conf_rules *rules_new(const char *str, size_t len)
+{
+	struct conf_rules *r;
+	int res;
+
+	if ((r = calloc(1, sizeof(*r))) == NULL)
+		return NULL;
+	r->str = str;
+	r->len = len;
+
+	if ((res = rules_parse(r)) < 0) {
+		rules_free(r);
+		errno = -res;
+		return NULL;
+	}
+	return r;
+}
+
+static bool rule_find_match(struct rule *rule, const struct spa_dict *props)
+{
+	struct rule_match *m;
+	struct match_value *v;
+
+	for (m = rule->matches; m; m = m->next) {
+		int match = 0, fail = 0, res;
+
+		for (v = m->values; v; v = v->next) {
+			if ((res = match_value_check(v, props, rule->as, rule->az)) < 0)
+				continue;
+			if (res > 0) {
+				match++;
+			} else {
+				fail++;
+				break;
+			}
+		}
+		if (match > 0 && fail == 0)
+			return true;
+	}
+	return false;
+}
+
+static int rules_match(struct conf_rules *r, const char *location,
+		const struct spa_dict *props,
+		int (*callback) (void *data, const char *location, const char *action,
+			const char *str, size_t len),
+		void *data)
+{
+	struct rule *rule;
+	struct rule_action *a;
+	int res;
+
+	for (rule = r->rules; rule; rule = rule->next) {
+		if (!rule_find_match(rule, props))
+			continue;
+
+		for (a = rule->actions; a; a = a->next) {
+			pw_log_debug("action %s", a->key);
+
+			if ((res = callback(data, location, a->key, a->val, a->len)) < 0)
+				return res;
+		}
+	}
+	return 0;
+}
+
+/* The rules sections of the context config are parsed when the context is
+ * created and kept until it is destroyed. The config is not changed after
+ * that so the section string identifies the rules. Matching only reads
+ * the rules and needs no locking. */
+static struct conf_rules *context_find_rules(struct pw_context *context,
+		const char *str, size_t len)
+{
+	struct conf_rules *r;
+
+	spa_list_for_each(r, &context->conf_rules, link) {
+		if (r->str == str && r->len == len)
+			return r;
+	}
+	return NULL;
+}
+
+/* node.rules, alsa.rules.<ext>, override.<n>.pulse.rules, ... */
+static bool is_rules_section(const char *key)
+{
+	const char *s = key;
+
+	while ((s = strstr(s, ".rules")) != NULL) {
+		s += strlen(".rules");
+		if (*s == '\0' || *s == '.')
+			return true;
+	}
+	return false;
+}
+
+int pw_conf_init_rules(struct pw_context *context)
+{
+	const struct spa_dict_item *it;
+	struct conf_rules *r;
+
+	spa_dict_for_each(it, &context->conf->dict) {
+		if (!is_rules_section(it->key))
+			continue;
+		if ((r = rules_new(it->value, strlen(it->value))) == NULL)
+			return -errno;
+		spa_list_append(&context->conf_rules, &r->link);
+	}
+	return 0;
+}
+
+void pw_conf_clear_rules(struct pw_context *context)
+{
+	struct conf_rules *r;
+
+	spa_list_consume(r, &context->conf_rules, link) {
+		spa_list_remove(&r->link);
+		rules_free(r);
+	}
+}
+
 /**
  * [
  *     {
@@ -1366,6 +1797,7 @@ int pw_conf_match_rules(const char *str, size_t len, const char *location,
 }
 
 struct match {
+	struct pw_context *context;
 	const struct spa_dict *props;
 	int (*matched) (void *data, const char *location, const char *action,
 			const char *val, size_t len);
@@ -1376,18 +1808,29 @@ static int match_rules(void *data, const char *location, const char *section,
 		const char *str, size_t len)
 {
 	struct match *match = data;
-	return pw_conf_match_rules(str, len, location,
-		match->props, match->matched, match->data);
+	struct conf_rules *r;
+
+	if (match->context == NULL)
+		return pw_conf_match_rules(str, len, location,
+			match->props, match->matched, match->data);
+
+	/* not a rules section of the context config */
+	if ((r = context_find_rules(match->context, str, len)) == NULL)
+		return pw_conf_match_rules(str, len, location,
+			match->props, match->matched, match->data);
+
+	return rules_match(r, location, match->props, match->matched, match->data);
 }
 
-SPA_EXPORT
-int pw_conf_section_match_rules(const struct spa_dict *conf, const char *section,
+static int section_match_rules(struct pw_context *context,
+		const struct spa_dict *conf, const char *section,
 		const struct spa_dict *props,
 		int (*callback) (void *data, const char *location, const char *action,
 			const char *str, size_t len),
 		void *data)
 {
 	struct match match = {
+		.context = context,
 		.props = props,
 		.matched = callback,
 		.data = data };
@@ -1407,11 +1850,21 @@ int pw_conf_section_match_rules(const struct spa_dict *conf, const char *section
 	return res;
 }
 
+SPA_EXPORT
+int pw_conf_section_match_rules(const struct spa_dict *conf, const char *section,
+		const struct spa_dict *props,
+		int (*callback) (void *data, const char *location, const char *action,
+			const char *str, size_t len),
+		void *data)
+{
+	return section_match_rules(NULL, conf, section, props, callback, data);
+}
+
 SPA_EXPORT
 int pw_context_conf_update_props(struct pw_context *context,
 		const char *section, struct pw_properties *props)
 {
-	return pw_conf_section_update_props_rules(&context->conf->dict,
+	return section_update_props_rules(context, &context->conf->dict,
 			&context->properties->dict, section, props);
 }
 
@@ -1457,6 +1910,6 @@ int pw_context_conf_section_match_rules(struct pw_context *context, const char *
 			const char *str, size_t len),
 		void *data)
 {
-	return pw_conf_section_match_rules(&context->conf->dict, section,
+	return section_match_rules(context, &context->conf->dict, section,
 			props, callback, data);
 }
@@ -437,6 +437,8 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	spa_list_init(&this->factory_list);
 	spa_list_init(&this->metadata_list);
 	spa_list_init(&this->link_list);
+	spa_list_init(&this->format_cache);
+	spa_list_init(&this->conf_rules);
 	spa_list_init(&this->control_list[0]);
 	spa_list_init(&this->control_list[1]);
 	spa_list_init(&this->export_list);
@@ -464,8 +466,10 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	this->conf = conf;
 	if ((res = pw_conf_load_conf_for_context (properties, conf)) < 0)
 		goto error_free;
+	if ((res = pw_conf_init_rules(this)) < 0)
+		goto error_free;
 
-	n_support = pw_get_support(this->support, SPA_N_ELEMENTS(this->support) - 6);
+	n_support = pw_get_support(this->support, SPA_N_ELEMENTS(this->support) - 8);
 	cpu = spa_support_find(this->support, n_support, SPA_TYPE_INTERFACE_CPU);
 
 	vm_type = SPA_CPU_VM_NONE;
@@ -655,6 +659,8 @@ void pw_context_destroy(struct pw_context *context)
 	spa_list_consume(core_impl, &context->core_impl_list, link)
 		pw_impl_core_destroy(core_impl);
 
+	pw_impl_link_clear_format_cache(context);
+
 	pw_log_debug("%p: free", context);
 	pw_context_emit_free(context);
 
@@ -673,6 +679,7 @@ void pw_context_destroy(struct pw_context *context)
 		pw_timer_queue_destroy(context->timer_queue);
 
 	pw_properties_free(context->properties);
+	pw_conf_clear_rules(context);
 	pw_properties_free(context->conf);
 
 	pw_settings_clean(context);
@@ -722,6 +729,8 @@ const struct spa_support *context_get_support(struct pw_context *context, uint32
 		context->support[n++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_DataSystem, loop->system);
 		context->support[n++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_DataLoop, loop->loop);
 	}
+	context->support[n++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_ThreadUtils,
+			context->thread_utils ? context->thread_utils : pw_thread_utils_get());
 	*n_support = n;
 	return context->support;
 }
@@ -7,8 +7,10 @@
 
 #include <spa/utils/defs.h>
 #include <spa/utils/hook.h>
+#include <spa/utils/atomic.h>
 
 #include <errno.h>
+#include <string.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -129,6 +131,119 @@ PW_API_METADATA_IMPL int pw_metadata_clear(struct pw_metadata *object)
 
 #define PW_KEY_METADATA_NAME		"metadata.name"
 #define PW_KEY_METADATA_VALUES		"metadata.values"
+#define PW_KEY_METADATA_SHM		"metadata.shm"		/**< keep a shared memory
+								  *  snapshot of the metadata */
+
+/** Keys of the bound_props of a metadata proxy that announce the shared
+ * memory snapshot of the client. The memory is in the mempool of the core
+ * and can be mapped read-only with pw_mempool_map_id(). */
+#define PW_KEY_METADATA_SHM_MEM_ID	"metadata.shm.mem-id"	/**< id of the snapshot memory */
+#define PW_KEY_METADATA_SHM_SIZE	"metadata.shm.size"	/**< size of the snapshot memory */
+
+#define PW_METADATA_SHM_MAGIC		0x444d5750u	/* "PWMD" */
+#define PW_METADATA_SHM_VERSION		0
+
+/** Header of the shared memory snapshot of a metadata object.
+ *
+ * Every client has its own snapshot with the items it is allowed to see,
+ * the same items as the property events it receives. The snapshot is
+ * written by the server only, readers use the seqlock in \a seq to get a
+ * consistent view. Property events are still emitted for all changes and
+ * can be used as a change notification. */
+struct pw_metadata_shm_header {
+	uint32_t magic;			/**< PW_METADATA_SHM_MAGIC */
+	uint32_t version;		/**< PW_METADATA_SHM_VERSION */
+	uint32_t seq;			/**< seqlock, odd while the snapshot is updated */
+	uint32_t flags;
+#define PW_METADATA_SHM_FLAG_OVERFLOW	(1<<0)	/**< not all items fit, use the events */
+	uint32_t serial;		/**< incremented for each change */
+	uint32_t n_items;		/**< number of items */
+	uint32_t size;			/**< size of the items after the header */
+	uint32_t padding;
+};
+
+/** An item in the shared memory snapshot. The key, type and value follow
+ * the item as NUL terminated strings. */
+struct pw_metadata_shm_item {
+	uint32_t subject;
+	uint32_t size;			/**< total size of the item, multiple of 8 */
+	uint32_t key_size;		/**< size of the key including the NUL byte */
+	uint32_t type_size;		/**< size of the type including the NUL byte */
+	uint32_t value_size;		/**< size of the value including the NUL byte */
+	uint32_t padding;
+};
+
+PW_API_METADATA_IMPL int pw_metadata_shm_find(const struct pw_metadata_shm_header *h,
+		size_t size, uint32_t subject, const char *key,
+		char *value, size_t max_value)
+{
+	uint32_t offset = 0, used = h->size;
+	const uint8_t *items = (const uint8_t *)(h + 1);
+
+	if (used > size - sizeof(*h))
+		return -EINVAL;
+	if (h->flags & PW_METADATA_SHM_FLAG_OVERFLOW)
+		return -E2BIG;
+
+	while (offset + sizeof(struct pw_metadata_shm_item) <= used) {
+		const struct pw_metadata_shm_item *it =
+			(const struct pw_metadata_shm_item *)(items + offset);
+		uint32_t isize = it->size, ksize = it->key_size;
+		uint32_t tsize = it->type_size, vsize = it->value_size;
+		const char *k = (const char *)(it + 1);
+
+		if (isize < sizeof(*it) || isize > used - offset ||
+		    (uint64_t)ksize + tsize + vsize > isize - sizeof(*it) ||
+		    ksize == 0 || vsize == 0)
+			return -EINVAL;
+
+		if (it->subject == subject &&
+		    strnlen(k, ksize) == ksize - 1 && strcmp(k, key) == 0) {
+			if (vsize > max_value)
+				return -ENOSPC;
+			memcpy(value, k + ksize + tsize, vsize);
+			value[vsize - 1] = '\0';
+			return 1;
+		}
+		offset += isize;
+	}
+	return 0;
+}
+
+/** Get the value of \a key for \a subject from a shared memory snapshot
+ * of size \a size mapped at \a data, without any IPC.
+ *
+ * This function does not allocate memory or block and can be used from a
+ * realtime thread.
+ *
+ * \return 1 when the key was found and copied into \a value, 0 when the
+ *   key was not found, -EAGAIN when no consistent snapshot could be read,
+ *   -ENOSPC when \a value is too small, -E2BIG when the snapshot is
+ *   incomplete and the property events should be used and -EINVAL for an
+ *   invalid snapshot. */
+PW_API_METADATA_IMPL int pw_metadata_shm_get(const void *data, size_t size,
+		uint32_t subject, const char *key, char *value, size_t max_value)
+{
+	const struct pw_metadata_shm_header *h =
+		(const struct pw_metadata_shm_header *)data;
+	uint32_t s1, s2, retry;
+	int res;
+
+	if (size < sizeof(*h) || h->magic != PW_METADATA_SHM_MAGIC ||
+	    h->version != PW_METADATA_SHM_VERSION)
+		return -EINVAL;
+
+	for (retry = 0; retry < 64; retry++) {
+		s1 = SPA_SEQ_READ(h->seq);
+		if (s1 & 1)
+			continue;
+		res = pw_metadata_shm_find(h, size, subject, key, value, max_value);
+		s2 = SPA_SEQ_READ(h->seq);
+		if (SPA_SEQ_READ_SUCCESS(s1, s2))
+			return res;
+	}
+	return -EAGAIN;
+}
 
 /**
  * \}
@@ -22,6 +22,7 @@ PW_LOG_TOPIC_EXTERN(log_link);
 #define PW_LOG_TOPIC_DEFAULT log_link
 
 #define MAX_HOPS	32
+#define MAX_FORMAT_CACHE	64
 
 #define pw_link_resource_info(r,...)      pw_resource_call(r,struct pw_link_events,info,0,__VA_ARGS__)
 
@@ -54,6 +55,13 @@ struct impl {
 	struct spa_io_buffers io[2];
 };
 
+struct format_cache_entry {
+	struct spa_list link;
+	uint64_t key[2];
+	enum pw_direction direction;
+	struct spa_pod *format;
+};
+
 /** \endcond */
 
 static void info_changed(struct pw_impl_link *link)
@@ -219,6 +227,47 @@ static void complete_sync(void *obj, void *data, int res, uint32_t id)
 			port->state, spa_strerror(res));
 }
 
+struct enum_format_data {
+	struct spa_pod_builder *builder;
+	struct spa_pod *param;
+	uint32_t next;
+};
+
+static int enum_format_result(void *data, int seq, uint32_t id, uint32_t index,
+		uint32_t next, struct spa_pod *param)
+{
+	struct enum_format_data *d = data;
+	uint32_t offset = d->builder->state.offset;
+
+	if (param == NULL || d->param != NULL)
+		return 0;
+	if (spa_pod_builder_raw_padded(d->builder, param, SPA_POD_SIZE(param)) < 0)
+		return -ENOSPC;
+	d->param = spa_pod_builder_deref(d->builder, offset);
+	d->next = next;
+	return 0;
+}
+
+/* Like spa_node_port_enum_params_sync() for EnumFormat but uses the param
+ * cache of the port when it is filled, for example by the format cache key,
+ * so that the node is not asked for its formats again. */
+static int port_enum_format_sync(struct pw_impl_port *port, uint32_t *index,
+		const struct spa_pod *filter, struct spa_pod **param,
+		struct spa_pod_builder *builder)
+{
+	struct enum_format_data d = { builder, NULL, 0 };
+	int res;
+
+	res = pw_impl_port_for_each_param(port, 0, SPA_PARAM_EnumFormat,
+			*index, 1, filter, enum_format_result, &d);
+	if (d.param == NULL)
+		return res > 0 ? 0 : res;
+
+	*index = d.next;
+	*param = d.param;
+	return 1;
+}
+
 /* find a common format. info[0] has the higher priority.
  * Either the format contains a valid common format or error is set. */
 static int link_find_format(struct pw_impl_link *this,
@@ -273,9 +322,7 @@ static int link_find_format(struct pw_impl_link *this,
 		pw_log_debug("%p: Got %s format:", this, dir[1]);
 		pw_log_pod(SPA_LOG_LEVEL_DEBUG, filter);
 
-		if ((res = spa_node_port_enum_params_sync(node[0],
-						     info[0]->port->direction, port_id[0],
-						     SPA_PARAM_EnumFormat, &idx[0],
+		if ((res = port_enum_format_sync(info[0]->port, &idx[0],
 						     filter, format, builder)) <= 0) {
 			if (res == -ENOENT || res == 0) {
 				pw_log_debug("%p: no %s format filter, using %s format: %s",
@@ -312,9 +359,7 @@ static int link_find_format(struct pw_impl_link *this,
 		pw_log_debug("%p: Got %s format:", this, dir[0]);
 		pw_log_pod(SPA_LOG_LEVEL_DEBUG, filter);
 
-		if ((res = spa_node_port_enum_params_sync(node[1],
-						     info[1]->port->direction, port_id[1],
-						     SPA_PARAM_EnumFormat, &idx[1],
+		if ((res = port_enum_format_sync(info[1]->port, &idx[1],
 						     filter, format, builder)) <= 0) {
 			if (res == -ENOENT || res == 0) {
 				pw_log_debug("%p: no %s format filter, using %s format: %s",
@@ -343,9 +388,7 @@ static int link_find_format(struct pw_impl_link *this,
 		 * defaults will be prefered. */
 		pw_log_debug("%p: do enum %s %d", this, dir[0], idx[0]);
 		spa_pod_builder_init(&fb, fbuf, sizeof(fbuf));
-		if ((res = spa_node_port_enum_params_sync(node[0],
-						     info[0]->port->direction, port_id[0],
-						     SPA_PARAM_EnumFormat, &idx[0],
+		if ((res = port_enum_format_sync(info[0]->port, &idx[0],
 						     NULL, &filter, &fb)) != 1) {
 			if (res == -ENOENT) {
 				pw_log_debug("%p: no %s filter", this, dir[0]);
@@ -371,9 +414,7 @@ static int link_find_format(struct pw_impl_link *this,
 		pw_log_debug("%p: enum %s %d with filter: %p", this, dir[1], idx[1], filter);
 		pw_log_pod(SPA_LOG_LEVEL_DEBUG, filter);
 
-		if ((res = spa_node_port_enum_params_sync(node[1],
-						     info[1]->port->direction, port_id[1],
-						     SPA_PARAM_EnumFormat, &idx[1],
+		if ((res = port_enum_format_sync(info[1]->port, &idx[1],
 						     filter, format, builder)) != 1) {
 			if (res == 0 && filter != NULL) {
 				idx[1] = 0;
@@ -397,6 +438,105 @@ error:
 	return res;
 }
 
+static int format_cache_key(struct pw_impl_link *this, struct port_info *info[2],
+		uint64_t key[2])
+{
+	int res;
+
+	if (!this->context->settings.link_format_cache)
+		return -ENOTSUP;
+
+	if ((res = pw_impl_port_get_param_hash(info[0]->port,
+					SPA_PARAM_EnumFormat, &key[0])) < 0 ||
+	    (res = pw_impl_port_get_param_hash(info[1]->port,
+					SPA_PARAM_EnumFormat, &key[1])) < 0) {
+		pw_log_debug("%p: can't get format cache key: %s", this,
+				spa_strerror(res));
+		return res;
+	}
+	return 0;
+}
+
+static struct format_cache_entry *format_cache_find(struct pw_context *context,
+		uint64_t key[2], enum pw_direction direction)
+{
+	struct format_cache_entry *e;
+
+	spa_list_for_each(e, &context->format_cache, link) {
+		if (e->key[0] == key[0] && e->key[1] == key[1] &&
+		    e->direction == direction) {
+			/* keep most recently used entries in front */
+			spa_list_remove(&e->link);
+			spa_list_prepend(&context->format_cache, &e->link);
+			return e;
+		}
+	}
+	return NULL;
+}
+
+static void format_cache_add(struct pw_context *context,
+		uint64_t key[2], enum pw_direction direction, const struct spa_pod *format)
+{
+	struct format_cache_entry *e;
+
+	if (context->n_format_cache >= MAX_FORMAT_CACHE) {
+		e = spa_list_last(&context->format_cache, struct format_cache_entry, link);
+		spa_list_remove(&e->link);
+		free(e);
+		context->n_format_cache--;
+	}
+
+	e = malloc(sizeof(*e) + SPA_POD_SIZE(format));
+	if (e == NULL)
+		return;
+
+	e->key[0] = key[0];
+	e->key[1] = key[1];
+	e->direction = direction;
+	e->format = SPA_PTROFF(e, sizeof(*e), struct spa_pod);
+	memcpy(e->format, format, SPA_POD_SIZE(format));
+
+	spa_list_prepend(&context->format_cache, &e->link);
+	context->n_format_cache++;
+}
+
+static void format_cache_remove(struct pw_context *context,
+		uint64_t key[2], enum pw_direction direction)
+{
+	struct format_cache_entry *e;
+
+	if ((e = format_cache_find(context, key, direction)) == NULL)
+		return;
+
+	spa_list_remove(&e->link);
+	free(e);
+	context->n_format_cache--;
+}
+
+void pw_impl_link_format_cache_remove_hash(struct pw_context *context, uint64_t hash)
+{
+	struct format_cache_entry *e, *t;
+
+	spa_list_for_each_safe(e, t, &context->format_cache, link) {
+		if (e->key[0] != hash && e->key[1] != hash)
+			continue;
+		spa_list_remove(&e->link);
+		free(e);
+		context->n_format_cache--;
+	}
+}
+
+void pw_impl_link_clear_format_cache(struct pw_context *context)
+{
+	struct format_cache_entry *e;
+
+	spa_list_consume(e, &context->format_cache, link) {
+		spa_list_remove(&e->link);
+		free(e);
+	}
+	context->n_format_cache = 0;
+}
+
 static int do_negotiate(struct pw_impl_link *this)
 {
 	struct pw_context *context = this->context;
@@ -413,6 +553,9 @@ static int do_negotiate(struct pw_impl_link *this)
 	struct spa_node *node[2];
 	uint32_t port_id[2];
 	const char *dir[2];
+	uint64_t key[2];
+	bool use_cache = false, cached = false;
+	struct format_cache_entry *entry = NULL;
 
 	if (this->info.state >= PW_LINK_STATE_NEGOTIATING)
 		return 0;
@@ -451,8 +594,26 @@ static int do_negotiate(struct pw_impl_link *this)
 	port_id[1] = info[1]->port->port_id;
 #endif
 
-	/* find a common format for the ports */
-	if ((res = link_find_format(this, info, port_id, &format, &b, &error)) < 0) {
+	/* when both ports need a format, the result only depends on the
+	 * EnumFormat params of both ports and can be reused */
+	if (state[0] == PW_IMPL_PORT_STATE_CONFIGURE &&
+	    state[1] == PW_IMPL_PORT_STATE_CONFIGURE &&
+	    format_cache_key(this, info, key) >= 0) {
+		use_cache = true;
+		entry = format_cache_find(context, key, info[0]->port->direction);
+		if (entry != NULL)
+			context->format_cache_hits++;
+		else
+			context->format_cache_misses++;
+		pw_log_debug("%p: format cache %s hits:%u misses:%u", this,
+				entry ? "hit" : "miss",
+				context->format_cache_hits, context->format_cache_misses);
+	}
+
+	if (entry != NULL) {
+		format = entry->format;
+		cached = true;
+	} else if ((res = link_find_format(this, info, port_id, &format, &b, &error)) < 0) {
 		format = NULL;
 		goto error;
 	}
@@ -467,6 +628,9 @@ static int do_negotiate(struct pw_impl_link *this)
 	spa_pod_fixate(format);
 	pw_log_pod(SPA_LOG_LEVEL_DEBUG, format);
 
+	if (use_cache && !cached)
+		format_cache_add(context, key, info[0]->port->direction, format);
+
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 
 	/* if port 1 had format and is idle, check if it changed. If so, renegotiate */
@@ -604,6 +768,9 @@ static int do_negotiate(struct pw_impl_link *this)
 	return res;
 
 error:
+	if (cached)
+		format_cache_remove(context, key, info[0]->port->direction);
+
 	pw_context_debug_port_params(context, node[0],
 			info[0]->port->direction, port_id[0],
 			SPA_PARAM_EnumFormat, res, "%s format (%s)", dir[0], error);
@@ -3,6 +3,7 @@
 /* SPDX-License-Identifier: MIT */
 
 #include <errno.h>
+#include <fcntl.h>
 
 #include <spa/debug/types.h>
 #include <spa/utils/cleanup.h>
@@ -22,6 +23,8 @@ PW_LOG_TOPIC_EXTERN(log_metadata);
 
 #define pw_metadata_emit_property(hooks,...)	pw_metadata_emit(hooks,property, 0, ##__VA_ARGS__)
 
+#define DEFAULT_SHM_SIZE	(64 * 1024)
+
 struct metadata {
 	struct spa_interface iface;
 	struct pw_array storage;
@@ -246,6 +249,22 @@ struct impl {
 	struct pw_impl_metadata this;
 
 	struct metadata def;
+
+	/* shared memory snapshots, the mirror keeps the items when the
+	 * implementation is not the default one */
+	unsigned int shm:1;
+	struct metadata mirror;
+	struct spa_list subjects;
+};
+
+/* a subject with items, used to follow the permissions of the clients */
+struct subject {
+	struct spa_list link;
+	struct impl *impl;
+	uint32_t id;
+	struct pw_global *global;
+	struct spa_hook global_listener;
+	unsigned int active:1;
 };
 
 struct resource_data {
@@ -255,13 +274,248 @@ struct resource_data {
 	struct spa_hook resource_listener;
 	struct spa_hook object_listener;
 	struct spa_hook metadata_listener;
+
+	/* snapshot with the items of the client, the server writes it
+	 * with shm and the client maps mem read-only */
+	struct pw_memblock *shm;
+	struct pw_memblock *mem;
 };
 
+static struct pw_array *shm_storage(struct impl *impl)
+{
+	return impl->this.metadata == (struct pw_metadata*)&impl->def.iface ?
+		&impl->def.storage : &impl->mirror.storage;
+}
+
+static void shm_write(struct impl *impl, struct resource_data *d)
+{
+	struct pw_impl_client *client = pw_resource_get_client(d->resource);
+	struct pw_metadata_shm_header *h = d->shm->map->ptr;
+	uint8_t *items = (uint8_t *)(h + 1);
+	uint32_t offset = 0, n_items = 0, flags = 0;
+	size_t max = d->shm->size - sizeof(*h);
+	struct item *item;
+
+	SPA_SEQ_WRITE(h->seq);
+
+	pw_array_for_each(item, shm_storage(impl)) {
+		struct pw_metadata_shm_item *it;
+		uint32_t ksize, tsize, vsize, isize;
+
+		/* only what the property events would show */
+		if (pw_impl_client_check_permissions(client, item->subject, PW_PERM_R) < 0)
+			continue;
+
+		ksize = strlen(item->key) + 1;
+		tsize = item->type ? strlen(item->type) + 1 : 0;
+		vsize = strlen(item->value) + 1;
+		isize = SPA_ROUND_UP_N(sizeof(*it) + ksize + tsize + vsize, 8);
+
+		if (offset + isize > max) {
+			flags |= PW_METADATA_SHM_FLAG_OVERFLOW;
+			break;
+		}
+		it = (struct pw_metadata_shm_item *)(items + offset);
+		it->subject = item->subject;
+		it->size = isize;
+		it->key_size = ksize;
+		it->type_size = tsize;
+		it->value_size = vsize;
+		it->padding = 0;
+		memcpy(SPA_PTROFF(it, sizeof(*it), char), item->key, ksize);
+		if (tsize > 0)
+			memcpy(SPA_PTROFF(it, sizeof(*it) + ksize, char), item->type, tsize);
+		memcpy(SPA_PTROFF(it, sizeof(*it) + ksize + tsize, char), item->value, vsize);
+
+		offset += isize;
+		n_items++;
+	}
+	h->flags = flags;
+	h->n_items = n_items;
+	h->size = offset;
+	h->serial++;
+
+	SPA_SEQ_WRITE(h->seq);
+
+	if (flags & PW_METADATA_SHM_FLAG_OVERFLOW)
+		pw_log_warn("%p: shared memory snapshot of client %p full, %u items",
+				impl, client, n_items);
+}
+
+static void shm_write_client(struct impl *impl, struct pw_impl_client *client)
+{
+	struct pw_resource *resource;
+
+	if (impl->this.global == NULL)
+		return;
+
+	spa_list_for_each(resource, &impl->this.global->resource_list, link) {
+		struct resource_data *d = pw_resource_get_user_data(resource);
+		if (d->shm != NULL && (client == NULL || resource->client == client))
+			shm_write(impl, d);
+	}
+}
+
+static void subject_free(struct subject *s)
+{
+	spa_list_remove(&s->link);
+	if (s->global != NULL)
+		spa_hook_remove(&s->global_listener);
+	free(s);
+}
+
+static void subject_permissions_changed(void *data, struct pw_impl_client *client,
+		uint32_t old_permissions, uint32_t new_permissions)
+{
+	struct subject *s = data;
+
+	if (PW_PERM_IS_R(old_permissions) != PW_PERM_IS_R(new_permissions))
+		shm_write_client(s->impl, client);
+}
+
+static void subject_global_destroy(void *data)
+{
+	struct subject *s = data;
+	spa_hook_remove(&s->global_listener);
+	s->global = NULL;
+}
+
+static const struct pw_global_events subject_global_events = {
+	PW_VERSION_GLOBAL_EVENTS,
+	.permissions_changed = subject_permissions_changed,
+	.destroy = subject_global_destroy,
+};
+
+/* Follow the permission changes of the globals that have items so that the
+ * snapshots of the clients only have the items they can see. */
+static void shm_update_subjects(struct impl *impl)
+{
+	struct pw_context *context = impl->this.context;
+	struct subject *s, *t;
+	struct item *item;
+
+	spa_list_for_each(s, &impl->subjects, link)
+		s->active = false;
+
+	pw_array_for_each(item, shm_storage(impl)) {
+		bool found = false;
+
+		spa_list_for_each(s, &impl->subjects, link) {
+			if (s->id == item->subject) {
+				s->active = found = true;
+				break;
+			}
+		}
+		if (!found) {
+			if ((s = calloc(1, sizeof(*s))) == NULL)
+				continue;
+			s->impl = impl;
+			s->id = item->subject;
+			s->active = true;
+			spa_list_append(&impl->subjects, &s->link);
+		}
+		/* the global can appear after the items */
+		if (s->global == NULL &&
+		    (s->global = pw_context_find_global(context, s->id)) != NULL)
+			pw_global_add_listener(s->global, &s->global_listener,
+					&subject_global_events, s);
+	}
+	spa_list_for_each_safe(s, t, &impl->subjects, link) {
+		if (!s->active)
+			subject_free(s);
+	}
+}
+
+static int shm_init(struct impl *impl, struct resource_data *d)
+{
+	struct pw_impl_metadata *this = &impl->this;
+	struct pw_impl_client *client = pw_resource_get_client(d->resource);
+	struct pw_metadata_shm_header *h;
+	int res;
+
+	d->shm = pw_mempool_alloc(this->context->pool,
+			PW_MEMBLOCK_FLAG_READWRITE |
+			PW_MEMBLOCK_FLAG_MAP,
+			SPA_DATA_MemFd, DEFAULT_SHM_SIZE);
+	if (d->shm == NULL)
+		return -errno;
+
+	/* we keep our writable mapping, the client can only map it readonly */
+#if defined(F_ADD_SEALS) && defined(F_SEAL_FUTURE_WRITE)
+	if (fcntl(d->shm->fd, F_ADD_SEALS, F_SEAL_GROW | F_SEAL_SHRINK |
+				F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) < 0) {
+		res = -errno;
+		goto error;
+	}
+#else
+	res = -ENOTSUP;
+	goto error;
+#endif
+	h = d->shm->map->ptr;
+	h->magic = PW_METADATA_SHM_MAGIC;
+	h->version = PW_METADATA_SHM_VERSION;
+	shm_write(impl, d);
+
+	d->mem = pw_mempool_import(client->pool,
+			PW_MEMBLOCK_FLAG_READABLE | PW_MEMBLOCK_FLAG_DONT_CLOSE,
+			d->shm->type, d->shm->fd);
+	if (d->mem == NULL) {
+		res = -errno;
+		goto error;
+	}
+	return 0;
+
+error:
+	pw_memblock_unref(d->shm);
+	d->shm = NULL;
+	return res;
+}
+
+static void shm_clear(struct resource_data *d)
+{
+	if (d->mem != NULL) {
+		pw_memblock_unref(d->mem);
+		d->mem = NULL;
+	}
+	if (d->shm != NULL) {
+		pw_memblock_unref(d->shm);
+		d->shm = NULL;
+	}
+}
+
+/* Tell the client where its snapshot is, with the bound_props of the
+ * proxy. The property events don't carry it so that it does not end up
+ * in the metadata of the client. */
+static void shm_announce(struct impl *impl, struct resource_data *d)
+{
+	struct pw_impl_client *client = pw_resource_get_client(d->resource);
+	struct pw_global *global = impl->this.global;
+	struct pw_properties *props;
+
+	if (client->core_resource == NULL || client->core_resource->version < 4)
+		return;
+
+	if ((props = pw_properties_copy(global->properties)) == NULL)
+		return;
+	pw_properties_setf(props, PW_KEY_METADATA_SHM_MEM_ID, "%u", d->mem->id);
+	pw_properties_setf(props, PW_KEY_METADATA_SHM_SIZE, "%u", d->shm->size);
+	pw_core_resource_bound_props(client->core_resource, d->resource->id,
+			global->id, &props->dict);
+	pw_properties_free(props);
+}
 
 static int metadata_property(void *data, uint32_t subject, const char *key,
 		const char *type, const char *value)
 {
 	struct pw_impl_metadata *this = data;
+	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
+
+	if (impl->shm) {
+		if (this->metadata != (struct pw_metadata*)&impl->def.iface)
+			impl_set_property(&impl->mirror, subject, key, type, value);
+		shm_update_subjects(impl);
+		shm_write_client(impl, NULL);
+	}
 	pw_impl_metadata_emit_property(this, subject, key, type, value);
 	return 0;
 }
@@ -300,6 +554,10 @@ struct pw_impl_metadata *pw_context_create_metadata(struct pw_context *context,
 
 	spa_hook_list_init(&this->listener_list);
 
+	spa_list_init(&impl->subjects);
+	metadata_init(&impl->mirror);
+	impl->shm = pw_properties_get_bool(properties, PW_KEY_METADATA_SHM, false);
+
 	pw_impl_metadata_set_implementation(this, metadata_init(&impl->def));
 
 	if (user_data_size > 0)
@@ -336,6 +594,13 @@ int pw_impl_metadata_set_implementation(struct pw_impl_metadata *metadata,
 		meta = (struct pw_metadata*)&impl->def.iface;
 
 	metadata->metadata = meta;
+
+	if (impl->shm) {
+		/* refilled by the events from the new implementation */
+		clear_items(&impl->mirror);
+		shm_update_subjects(impl);
+		shm_write_client(impl, NULL);
+	}
 	pw_metadata_add_listener(meta, &metadata->metadata_listener,
 			&metadata_events, metadata);
 
@@ -351,6 +616,7 @@ SPA_EXPORT
 void pw_impl_metadata_destroy(struct pw_impl_metadata *metadata)
 {
 	struct impl *impl = SPA_CONTAINER_OF(metadata, struct impl, this);
+	struct subject *s;
 
 	pw_log_debug("%p: destroy", metadata);
 	pw_impl_metadata_emit_destroy(metadata);
@@ -368,6 +634,9 @@ void pw_impl_metadata_destroy(struct pw_impl_metadata *metadata)
 	pw_log_debug("%p: free", metadata);
 
 	metadata_reset(&impl->def);
+	metadata_reset(&impl->mirror);
+	spa_list_consume(s, &impl->subjects, link)
+		subject_free(s);
 
 	spa_hook_list_clean(&metadata->listener_list);
 
@@ -450,6 +719,7 @@ static void global_unbind(void *data)
 	        spa_hook_remove(&d->object_listener);
 	        spa_hook_remove(&d->metadata_listener);
 	}
+	shm_clear(d);
 }
 
 static const struct pw_resource_events resource_events = {
@@ -462,9 +732,11 @@ global_bind(void *object, struct pw_impl_client *client, uint32_t permissions,
 		  uint32_t version, uint32_t id)
 {
 	struct pw_impl_metadata *this = object;
+	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
 	struct pw_global *global = this->global;
 	struct pw_resource *resource;
 	struct resource_data *data;
+	int res;
 
 	resource = pw_resource_new(client, id, permissions, global->type, version, sizeof(*data));
 	if (resource == NULL)
@@ -492,6 +764,13 @@ global_bind(void *object, struct pw_impl_client *client, uint32_t permissions,
 			&data->metadata_listener,
 			&metadata_resource_events, data);
 
+	if (impl->shm) {
+		if ((res = shm_init(impl, data)) < 0)
+			pw_log_warn("%p: can't create shared memory snapshot for client %p: %s",
+					this, client, spa_strerror(res));
+		else
+			shm_announce(impl, data);
+	}
 	return 0;
 
 error_resource:
@@ -55,6 +55,8 @@ struct impl {
 	char *group;
 	char *link_group;
 	char *sync_group;
+
+	struct pw_memblock *meter;
 };
 
 static const char * const global_keys[] = {
@@ -96,6 +98,8 @@ struct resource_data {
 	int seq;
 	int end;
 	struct spa_hook listener;
+
+	struct pw_memblock *meter;
 };
 
 SPA_EXPORT
@@ -718,6 +722,8 @@ static void resource_destroy(void *data)
 {
 	struct resource_data *d = data;
 	remove_busy_resource(d);
+	if (d->meter)
+		pw_memblock_unref(d->meter);
 	spa_hook_remove(&d->resource_listener);
 	spa_hook_remove(&d->object_listener);
 }
@@ -736,11 +742,47 @@ static const struct pw_resource_events resource_events = {
 	.pong = resource_pong,
 };
 
+/* share the meter area with the client of the resource and tell it where
+ * to find it. An empty announcement removes the area again. */
+static void meter_announce(struct pw_impl_node *node, struct resource_data *d)
+{
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
+	struct pw_impl_client *client = d->resource->client;
+	struct pw_properties *props;
+
+	if (d->meter) {
+		pw_memblock_unref(d->meter);
+		d->meter = NULL;
+	}
+	if (impl->meter) {
+		d->meter = pw_mempool_import(client->pool,
+				PW_MEMBLOCK_FLAG_READABLE | PW_MEMBLOCK_FLAG_DONT_CLOSE,
+				impl->meter->type, impl->meter->fd);
+		if (d->meter == NULL) {
+			pw_log_warn("%p: can't share meter with client %p: %m", node, client);
+			return;
+		}
+	}
+	if (client->core_resource == NULL || client->core_resource->version < 4)
+		return;
+
+	if ((props = pw_properties_copy(node->global->properties)) == NULL)
+		return;
+	if (d->meter) {
+		pw_properties_setf(props, PW_KEY_NODE_METER_MEM_ID, "%u", d->meter->id);
+		pw_properties_setf(props, PW_KEY_NODE_METER_SIZE, "%u", impl->meter->size);
+	}
+	pw_core_resource_bound_props(client->core_resource, d->resource->id,
+			node->global->id, &props->dict);
+	pw_properties_free(props);
+}
+
 static int
 global_bind(void *object, struct pw_impl_client *client, uint32_t permissions,
 	    uint32_t version, uint32_t id)
 {
 	struct pw_impl_node *this = object;
+	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
 	struct pw_global *global = this->global;
 	struct pw_resource *resource;
 	struct resource_data *data;
@@ -768,6 +810,9 @@ global_bind(void *object, struct pw_impl_client *client, uint32_t permissions,
 	pw_node_resource_info(resource, &this->info);
 	this->info.change_mask = 0;
 
+	if (impl->meter)
+		meter_announce(this, data);
+
 	return 0;
 
 error_resource:
@@ -955,6 +1000,51 @@ static void update_io(struct pw_impl_node *node)
                             sizeof(struct spa_io_position));
 }
 
+/* The meter area is allocated by the server, where it can be shared with
+ * the clients. Remote nodes get it in set_io from the client-node. */
+static void update_meter(struct pw_impl_node *node)
+{
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
+	struct pw_memblock *old = impl->meter;
+	struct pw_resource *resource;
+	bool meter;
+	int res;
+
+	meter = node->registered && !node->exported && node->node != NULL &&
+		pw_properties_get_bool(node->properties, PW_KEY_NODE_METER, false);
+	if (meter == (old != NULL))
+		return;
+
+	if (meter) {
+		impl->meter = pw_mempool_alloc(node->context->pool,
+				PW_MEMBLOCK_FLAG_READWRITE |
+				PW_MEMBLOCK_FLAG_SEAL |
+				PW_MEMBLOCK_FLAG_MAP,
+				SPA_DATA_MemFd, sizeof(struct spa_io_meter));
+		if (impl->meter == NULL) {
+			pw_log_warn("%p: can't allocate meter: %m", node);
+			return;
+		}
+		if ((res = spa_node_set_io(node->node, SPA_IO_Meter,
+				impl->meter->map->ptr, sizeof(struct spa_io_meter))) < 0) {
+			pw_log_warn("%p: can't set meter: %s", node, spa_strerror(res));
+			pw_memblock_unref(impl->meter);
+			impl->meter = NULL;
+			return;
+		}
+	} else {
+		spa_node_set_io(node->node, SPA_IO_Meter, NULL, 0);
+		impl->meter = NULL;
+	}
+	pw_log_debug("%p: meter %d", node, meter);
+
+	spa_list_for_each(resource, &node->global->resource_list, link)
+		meter_announce(node, pw_resource_get_user_data(resource));
+
+	if (old)
+		pw_memblock_unref(old);
+}
+
 SPA_EXPORT
 int pw_impl_node_register(struct pw_impl_node *this,
 		     struct pw_properties *properties)
@@ -1002,6 +1092,7 @@ int pw_impl_node_register(struct pw_impl_node *this,
 
 	if (this->node)
 		update_io(this);
+	update_meter(this);
 
 	spa_list_for_each(port, &this->input_ports, link)
 		pw_impl_port_register(port, NULL);
@@ -1337,6 +1428,8 @@ static void check_properties(struct pw_impl_node *node)
 		recalc_reason = "force rate changed";
 	}
 
+	update_meter(node);
+
 	pw_log_debug("%p: driver:%d recalc:%s active:%d passive:%s:%s", node, node->driver,
 			recalc_reason, node->active,
 			passive_mode_to_string(node->passive_mode[0]),
@@ -2342,6 +2435,7 @@ again:
 
 	if (node->registered)
 		update_io(node);
+	update_meter(node);
 
 	return res;
 }
@@ -2482,6 +2576,8 @@ void pw_impl_node_destroy(struct pw_impl_node *node)
 	spa_hook_list_clean(&node->listener_list);
 
 	pw_memblock_unref(node->activation);
+	if (impl->meter)
+		pw_memblock_unref(impl->meter);
 
 	pw_param_clear(&impl->param_list, SPA_ID_INVALID);
 	pw_param_clear(&impl->pending_list, SPA_ID_INVALID);
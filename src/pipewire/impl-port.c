@@ -857,11 +857,23 @@ static int process_tag_param(void *data, int seq,
 	return 0;
 }
 
+/* Forget that the params are cached. The negotiated link formats that were
+ * derived from the old EnumFormat params can't be used anymore. */
+static void reset_param_cache(struct pw_impl_port *port, struct spa_param_info *pi)
+{
+	uint64_t hash;
+
+	if (pi->id == SPA_PARAM_EnumFormat && pi->user == 1 && port->node != NULL &&
+	    pw_impl_port_get_param_hash(port, pi->id, &hash) >= 0)
+		pw_impl_link_format_cache_remove_hash(port->node->context, hash);
+	pi->user = 0;
+}
+
 static void check_params(struct pw_impl_port *port)
 {
 	uint32_t i;
 	for (i = 0; i < port->info.n_params; i++)
-		port->info.params[i].user = 0;
+		reset_param_cache(port, &port->info.params[i]);
 
 	port->flags &= ~(PW_IMPL_PORT_FLAG_CONTROL |
 			PW_IMPL_PORT_FLAG_ASYNC |
@@ -908,6 +920,7 @@ static void update_info(struct pw_impl_port *port, const struct spa_port_info *i
 				continue;
 
 			pw_log_debug("%p: update param %d", port, id);
+			reset_param_cache(port, &port->info.params[i]);
 			port->info.params[i] = info->params[i];
 			port->info.params[i].user = 0;
 
@@ -1764,6 +1777,59 @@ int pw_impl_port_for_each_param(struct pw_impl_port *port,
 	return res;
 }
 
+static void hash_param(uint64_t *hash, const struct spa_pod *param)
+{
+	const uint8_t *data = (const uint8_t *)param;
+	uint32_t i, size = SPA_POD_SIZE(param);
+
+	/* FNV-1a */
+	for (i = 0; i < size; i++) {
+		*hash ^= data[i];
+		*hash *= 0x100000001b3ULL;
+	}
+}
+
+static int hash_param_result(void *data, int seq, uint32_t id, uint32_t index, uint32_t next,
+		struct spa_pod *param)
+{
+	if (param != NULL)
+		hash_param(data, param);
+	return 0;
+}
+
+int pw_impl_port_get_param_hash(struct pw_impl_port *port, uint32_t param_id,
+		uint64_t *hash)
+{
+	struct impl *impl = SPA_CONTAINER_OF(port, struct impl, this);
+	struct spa_param_info *pi;
+	struct pw_param *p;
+	uint64_t h = 0xcbf29ce484222325ULL;
+	int res;
+
+	pi = pw_param_info_find(port->info.params, port->info.n_params, param_id);
+	if (pi == NULL)
+		return -ENOENT;
+
+	if (pi->user == 1) {
+		spa_list_for_each(p, &impl->param_list, link) {
+			if (p->id == param_id && p->param != NULL)
+				hash_param(&h, p->param);
+		}
+	} else {
+		/* Not cached (yet), hash the params as they are enumerated. The
+		 * enumeration fills the param cache so that the next hash and
+		 * the link negotiation don't need to ask the node again. */
+		res = pw_impl_port_for_each_param(port, 0, param_id, 0, 0, NULL,
+				hash_param_result, &h);
+		if (res < 0)
+			return res;
+		if (SPA_RESULT_IS_ASYNC(res))
+			return -EAGAIN;
+	}
+	*hash = h;
+	return 0;
+}
+
 struct param_filter {
 	struct pw_impl_port *in_port;
 	struct pw_impl_port *out_port;
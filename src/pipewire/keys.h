@@ -237,6 +237,15 @@ extern "C" {
 #define PW_KEY_NODE_TERMINAL		"node.terminal"		/**< ports from the node are terminal */
 
 #define PW_KEY_NODE_RELIABLE		"node.reliable"		/**< node uses reliable transport 1.6.0 */
+#define PW_KEY_NODE_METER		"node.meter"		/**< measure the levels of the node in a
+								  *  shared struct spa_io_meter area. Clients
+								  *  that bind the node get the area in the
+								  *  bound_props event with the
+								  *  node.meter.mem-id and node.meter.size
+								  *  keys. */
+#define PW_KEY_NODE_METER_MEM_ID	"node.meter.mem-id"	/**< memory id of the meter area in the
+								  *  client memory pool */
+#define PW_KEY_NODE_METER_SIZE		"node.meter.size"	/**< size of the meter area */
 
 /** Port keys */
 #define PW_KEY_PORT_ID			"port.id"		/**< port id */
@@ -343,6 +352,12 @@ extern "C" {
 								  *  ports (since 0.3.71).
 								  */
 #define PW_KEY_STREAM_DONT_REMIX	"stream.dont-remix"	/**< don't remix channels */
+#define PW_KEY_STREAM_METER		"stream.meter"		/**< Measure the peak, RMS and loudness
+								  *  of an audio stream. This sets
+								  *  node.meter, the levels are passed
+								  *  to the io_changed event as a
+								  *  struct spa_io_meter with id
+								  *  SPA_IO_Meter. */
 #define PW_KEY_STREAM_CAPTURE_SINK	"stream.capture.sink"	/**< Try to capture the sink output instead of
 								  *  source output */
 
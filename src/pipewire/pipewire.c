@@ -512,7 +512,7 @@ SPA_EXPORT
 void pw_init(int *argc, char **argv[])
 {
 	const char *str;
-	struct spa_dict_item items[6];
+	struct spa_dict_item items[7];
 	uint32_t n_items;
 	struct spa_dict info;
 	struct support *support = &global_support;
@@ -564,6 +564,8 @@ void pw_init(int *argc, char **argv[])
 			items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_TIMESTAMP, "local");
 		if ((str = getenv("PIPEWIRE_LOG_LINE")) == NULL || spa_atob(str))
 			items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_LINE, "true");
+		if ((str = getenv("PIPEWIRE_LOG_DEFERRED")) != NULL)
+			items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_DEFERRED, str);
 		snprintf(level, sizeof(level), "%d", pw_log_level);
 		items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_LEVEL, level);
 		if ((str = getenv("PIPEWIRE_LOG")) != NULL)
@@ -47,6 +47,7 @@ struct settings {
 	struct spa_rectangle video_size;
 	struct spa_fraction video_rate;
 	uint32_t link_max_buffers;
+	unsigned int link_format_cache:1;
 	unsigned int mem_warn_mlock:1;
 	unsigned int mem_allow_mlock:1;
 	unsigned int clock_power_of_two_quantum:1;
@@ -371,6 +372,7 @@ struct pw_context {
 	struct pw_impl_core *core;		/**< core object */
 
 	struct pw_properties *conf;		/**< configuration of the context */
+	struct spa_list conf_rules;		/**< parsed rules sections of conf */
 	struct pw_properties *properties;	/**< properties of the context */
 
 	struct settings defaults;		/**< default parameters */
@@ -401,6 +403,11 @@ struct pw_context {
 	struct spa_list export_list;		/**< list of export types */
 	struct spa_list driver_list;		/**< list of driver nodes */
 
+	struct spa_list format_cache;		/**< negotiated link formats */
+	uint32_t n_format_cache;
+	uint32_t format_cache_hits;
+	uint32_t format_cache_misses;
+
 	struct spa_hook_list driver_listener_list;
 	struct spa_hook_list listener_list;
 
@@ -1373,6 +1380,13 @@ int pw_impl_port_set_param(struct pw_impl_port *port,
 int pw_impl_port_use_buffers(struct pw_impl_port *port, struct pw_impl_port_mix *mix, uint32_t flags,
 		struct spa_buffer **buffers, uint32_t n_buffers);
 
+/** Get a hash of the params with \a param_id of the port. The cached params
+ * are used when available, otherwise the params are enumerated once, which
+ * also fills the param cache of the port. Returns -EAGAIN when the port
+ * enumerates asynchronously. */
+int pw_impl_port_get_param_hash(struct pw_impl_port *port, uint32_t param_id,
+		uint64_t *hash);
+
 int pw_impl_port_recalc_capability(struct pw_impl_port *port);
 int pw_impl_port_recalc_latency(struct pw_impl_port *port);
 int pw_impl_port_recalc_tag(struct pw_impl_port *port);
@@ -1401,6 +1415,13 @@ int pw_impl_link_activate(struct pw_impl_link *link);
 /** Deactivate a link */
 int pw_impl_link_deactivate(struct pw_impl_link *link);
 
+/** Clear the cache of negotiated link formats */
+void pw_impl_link_clear_format_cache(struct pw_context *context);
+
+/** Remove the negotiated link formats of ports with EnumFormat params
+ * that hash to \a hash */
+void pw_impl_link_format_cache_remove_hash(struct pw_context *context, uint64_t hash);
+
 struct pw_control *
 pw_control_new(struct pw_context *context,
 	       struct pw_impl_port *owner,		/**< can be NULL */
@@ -1440,6 +1461,10 @@ void pw_log_deinit(void);
 
 void pw_random_init(void);
 
+/** Free the parsed rules sections of the context config */
+int pw_conf_init_rules(struct pw_context *context);
+void pw_conf_clear_rules(struct pw_context *context);
+
 void pw_settings_init(struct pw_context *context);
 int pw_settings_expose(struct pw_context *context);
 void pw_settings_clean(struct pw_context *context);
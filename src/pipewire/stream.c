@@ -2052,6 +2052,8 @@ pw_stream_connect(struct pw_stream *stream,
 	impl->port_info.flags = 0;
 	if (SPA_FLAG_IS_SET(flags, PW_STREAM_FLAG_ALLOC_BUFFERS))
 		impl->port_info.flags |= SPA_PORT_FLAG_CAN_ALLOC_BUFFERS;
+	if (SPA_FLAG_IS_SET(flags, PW_STREAM_FLAG_DYNAMIC_DATA))
+		impl->port_info.flags |= SPA_PORT_FLAG_DYNAMIC_DATA;
 	impl->port_params[PORT_EnumFormat] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, 0);
 	impl->port_params[PORT_Meta] = SPA_PARAM_INFO(SPA_PARAM_Meta, 0);
 	impl->port_params[PORT_IO] = SPA_PARAM_INFO(SPA_PARAM_IO, 0);
@@ -2197,6 +2199,11 @@ pw_stream_connect(struct pw_stream *stream,
 	}
 	if (pw_properties_get(props, PW_KEY_PORT_GROUP) == NULL)
 		pw_properties_set(props, PW_KEY_PORT_GROUP, "stream.0");
+	/* the server shares the meter area with us and the clients that
+	 * bind the node, we get it in set_io */
+	if (impl->media_type == SPA_MEDIA_TYPE_audio &&
+	    pw_properties_get_bool(props, PW_KEY_STREAM_METER, false))
+		pw_properties_set(props, PW_KEY_NODE_METER, "true");
 
 	if (impl->media_type == SPA_MEDIA_TYPE_audio ||
 	    impl->media_type == SPA_MEDIA_TYPE_video) {
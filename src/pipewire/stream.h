@@ -501,6 +501,11 @@ enum pw_stream_flags {
 	PW_STREAM_FLAG_RT_TRIGGER_DONE	= (1 << 12),	/**< Call trigger_done from the realtime
 							  *  thread. You MUST use RT safe functions
 							  *  in the trigger_done callback. Since 1.1.0 */
+	PW_STREAM_FLAG_DYNAMIC_DATA	= (1 << 13),	/**< The application may replace the data
+							  *  pointer of buffer datas that have the
+							  *  SPA_DATA_FLAG_DYNAMIC flag with memory
+							  *  that stays valid until the next process
+							  *  call. Since 1.7.0 */
 };
 
 /** Create a new unconnected \ref pw_stream
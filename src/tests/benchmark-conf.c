@@ -0,0 +1,163 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/conf.h>
+
+#include <spa/utils/string.h>
+
+#define MAX_RULES	2000
+#define MAX_LOAD	20
+#define MAX_MATCH	200
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+/* a config with a large node.rules section, like generated configs
+ * that have a rule per application */
+static int gen_config(char *path, size_t size)
+{
+	FILE *f;
+	int fd, i;
+
+	snprintf(path, size, "/tmp/pw-benchmark-conf-XXXXXX.conf");
+	if ((fd = mkstemps(path, 5)) < 0)
+		return -errno;
+	if ((f = fdopen(fd, "w")) == NULL) {
+		close(fd);
+		return -errno;
+	}
+	fprintf(f, "context.properties = { log.level = 0 }\n");
+	fprintf(f, "node.rules = [\n");
+	for (i = 0; i < MAX_RULES; i++) {
+		fprintf(f, "  { matches = [\n"
+			"      { application.name = \"app-%d\" media.role = \"!null\" }\n"
+			"      { node.name = \"~^bench-%d\\\\.(sink|source)$\" }\n"
+			"    ]\n"
+			"    actions = { update-props = { node.latency = %d/48000 "
+					"priority.session = %d } }\n"
+			"  }\n", i, i, 256 + i, i);
+	}
+	fprintf(f, "]\n");
+	fclose(f);
+	return 0;
+}
+
+static void test_load(void)
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	uint64_t t1, t2;
+	int i;
+
+	loop = pw_main_loop_new(NULL);
+	spa_assert_se(loop != NULL);
+
+	t1 = get_time_ns();
+	for (i = 0; i < MAX_LOAD; i++) {
+		context = pw_context_new(pw_main_loop_get_loop(loop), NULL, 0);
+		spa_assert_se(context != NULL);
+		pw_context_destroy(context);
+	}
+	t2 = get_time_ns();
+
+	fprintf(stderr, "load: elapsed %"PRIu64" count %u = %"PRIu64"/sec\n",
+			t2 - t1, MAX_LOAD, MAX_LOAD * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
+
+	pw_main_loop_destroy(loop);
+}
+
+static int match_count(void *data, const char *location, const char *action,
+		const char *str, size_t len)
+{
+	int *count = data;
+	if (spa_streq(action, "update-props"))
+		(*count)++;
+	return 0;
+}
+
+static void test_match(const char *path)
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct pw_properties *conf, *props;
+	uint64_t t1, t2, t3;
+	char name[64];
+	int i, res, count;
+
+	loop = pw_main_loop_new(NULL);
+	spa_assert_se(loop != NULL);
+	context = pw_context_new(pw_main_loop_get_loop(loop), NULL, 0);
+	spa_assert_se(context != NULL);
+
+	conf = pw_properties_new(NULL, NULL);
+	spa_assert_se(conf != NULL);
+	res = pw_conf_load_conf(NULL, path, conf);
+	spa_assert_se(res >= 0);
+
+	props = pw_properties_new(PW_KEY_MEDIA_CLASS, "Audio/Sink", NULL);
+	spa_assert_se(props != NULL);
+
+	/* every node is matched against the rules when it is created and
+	 * when its properties change, this parses the rules every time */
+	t1 = get_time_ns();
+	for (i = 0, count = 0; i < MAX_MATCH; i++) {
+		snprintf(name, sizeof(name), "bench-%d.sink", i % MAX_RULES);
+		pw_properties_set(props, PW_KEY_NODE_NAME, name);
+		res = pw_conf_section_match_rules(&conf->dict, "node.rules",
+				&props->dict, match_count, &count);
+		spa_assert_se(res == 0);
+	}
+	spa_assert_se(count == MAX_MATCH);
+	t2 = get_time_ns();
+
+	/* the same with the rules that the context parsed when it was created */
+	for (i = 0, count = 0; i < MAX_MATCH; i++) {
+		snprintf(name, sizeof(name), "bench-%d.sink", i % MAX_RULES);
+		pw_properties_set(props, PW_KEY_NODE_NAME, name);
+		res = pw_context_conf_section_match_rules(context, "node.rules",
+				&props->dict, match_count, &count);
+		spa_assert_se(res == 0);
+	}
+	spa_assert_se(count == MAX_MATCH);
+	t3 = get_time_ns();
+
+	fprintf(stderr, "match json: elapsed %"PRIu64" count %u = %"PRIu64"/sec\n",
+			t2 - t1, MAX_MATCH, MAX_MATCH * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
+	fprintf(stderr, "match parsed: elapsed %"PRIu64" count %u = %"PRIu64"/sec\n",
+			t3 - t2, MAX_MATCH, MAX_MATCH * (uint64_t)SPA_NSEC_PER_SEC / (t3 - t2));
+	fprintf(stderr, "speedup %f\n", (double)(t2 - t1) / (t3 - t2));
+
+	pw_properties_free(props);
+	pw_properties_free(conf);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+}
+
+int main(int argc, char *argv[])
+{
+	char path[PATH_MAX];
+
+	pw_init(&argc, &argv);
+
+	spa_assert_se(gen_config(path, sizeof(path)) == 0);
+	setenv("PIPEWIRE_CONFIG_NAME", path, 1);
+
+	test_load();
+	test_match(path);
+
+	unlink(path);
+	pw_deinit();
+
+	return 0;
+}
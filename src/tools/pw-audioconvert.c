@@ -11,6 +11,9 @@
 #include <errno.h>
 #include <getopt.h>
 #include <limits.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <sndfile.h>
 
@@ -27,16 +30,55 @@
 #include <pipewire/pipewire.h>
 
 #define MAX_SAMPLES	4096u
+#define MAX_JOB_SAMPLES	32768u
+#define SEGMENT_SECONDS	4u
 
 enum {
 	OPT_CHANNELMAP = 1000,
 };
 
+struct segment {
+	uint64_t start;
+	uint64_t end;
+	bool last;
+	bool done;
+	int res;
+
+	uint32_t channels;
+	float *data;
+	uint64_t n_frames;
+	uint64_t max_frames;
+};
+
+struct convert {
+	struct data *d;
+	struct spa_handle *handle;
+	struct spa_node *node;
+	bool started;
+
+	SNDFILE *ifile;
+	float *ibuf;
+	float *obuf;
+
+	struct spa_chunk in_chunk, out_chunk;
+	struct spa_data in_sdata, out_sdata;
+	struct spa_buffer in_buffer, out_buffer;
+	struct spa_buffer *in_buffers[1];
+	struct spa_buffer *out_buffers[1];
+	struct spa_io_buffers in_io, out_io;
+	struct spa_io_rate_match rate_match;
+
+	pthread_t thread;
+	uint64_t read_total;
+};
+
 struct data {
 	bool verbose;
 	int rate;
 	int format;
 	uint32_t blocksize;
+	uint32_t out_blocksize;
+	uint32_t jobs;
 	int out_channels;
 	const char *channel_map;
 	struct pw_properties *props;
@@ -52,13 +94,29 @@ struct data {
 	struct pw_main_loop *loop;
 	struct pw_context *context;
 
-	struct spa_handle *handle;
-	struct spa_node *node;
+	uint32_t in_rate;
+	uint32_t out_rate;
+	uint32_t in_channels;
+	uint64_t read_total;
+	uint64_t written_total;
+
+	/* parallel conversion */
+	struct convert *converts;
+	struct segment *segments;
+	uint32_t n_segments;
+	uint32_t next_segment;
+	uint32_t n_written;
+	uint32_t max_pending;
+	uint64_t preroll;
+	uint64_t max_frames;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int res;
 };
 
 #define STR_FMTS "(s8|s16|s32|f32|f64)"
 
-#define OPTIONS		"hvr:f:b:P:c:"
+#define OPTIONS		"hvr:f:b:P:c:j:"
 static const struct option long_options[] = {
 	{ "help",	no_argument,		NULL, 'h' },
 	{ "verbose",	no_argument,		NULL, 'v' },
@@ -69,6 +127,7 @@ static const struct option long_options[] = {
 	{ "properties",	required_argument,	NULL, 'P' },
 	{ "channels",	required_argument,	NULL, 'c' },
 	{ "channel-map", required_argument,	NULL, OPT_CHANNELMAP },
+	{ "jobs",	required_argument,	NULL, 'j' },
 
 	{ NULL, 0, NULL, 0 }
 };
@@ -92,7 +151,9 @@ static void show_usage(const char *name, bool is_error)
 		"                                        Use @filename to read from file\n"
 		"  -c  --channels                        Output channel count\n"
 		"      --channel-map                     Output channel layout (e.g. \"stereo\", \"5.1\",\n"
-		"                                        \"FL,FR,FC,LFE,SL,SR\")\n",
+		"                                        \"FL,FR,FC,LFE,SL,SR\")\n"
+		"  -j  --jobs                            Number of parallel jobs, 0 for the\n"
+		"                                        number of CPUs (default 1)\n",
 		STR_FMTS, MAX_SAMPLES);
 	fprintf(fp, "\n");
 }
@@ -255,18 +316,461 @@ static int setup_convert_direction(struct spa_node *node,
 	return res;
 }
 
-static int do_filter(struct data *d)
+static int convert_init(struct data *d, struct convert *c, SNDFILE *ifile,
+		struct spa_audio_info_raw *in_info, struct spa_audio_info_raw *out_info)
 {
 	void *iface;
-	struct spa_node *node;
+	int res;
+
+	c->d = d;
+	c->ifile = ifile;
+	c->in_buffers[0] = &c->in_buffer;
+	c->out_buffers[0] = &c->out_buffer;
+
+	c->handle = pw_context_load_spa_handle(d->context,
+			SPA_NAME_AUDIO_CONVERT, &d->props->dict);
+	if (c->handle == NULL) {
+		res = -errno;
+		fprintf(stderr, "can't load %s: %m\n", SPA_NAME_AUDIO_CONVERT);
+		return res;
+	}
+
+	res = spa_handle_get_interface(c->handle,
+			SPA_TYPE_INTERFACE_Node, &iface);
+	if (res < 0 || iface == NULL) {
+		fprintf(stderr, "can't get Node interface: %s\n",
+				spa_strerror(res));
+		return res < 0 ? res : -EINVAL;
+	}
+	c->node = iface;
+
+	/* set up convert directions */
+	res = setup_convert_direction(c->node, SPA_DIRECTION_INPUT, in_info);
+	if (res < 0) {
+		fprintf(stderr, "can't set input format: %s\n",
+				spa_strerror(res));
+		return res;
+	}
+	res = setup_convert_direction(c->node, SPA_DIRECTION_OUTPUT, out_info);
+	if (res < 0) {
+		fprintf(stderr, "can't set output format: %s\n",
+				spa_strerror(res));
+		return res;
+	}
+
+	/* the rate match area reports the resampler delay */
+	res = spa_node_port_set_io(c->node, SPA_DIRECTION_OUTPUT, 0,
+			SPA_IO_RateMatch, &c->rate_match, sizeof(c->rate_match));
+	if (res < 0 && res != -ENOENT) {
+		fprintf(stderr, "can't set rate match IO: %s\n",
+				spa_strerror(res));
+		return res;
+	}
+
+	/* send Start command */
+	{
+		struct spa_command cmd =
+			SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Start);
+		res = spa_node_send_command(c->node, &cmd);
+		if (res < 0) {
+			fprintf(stderr, "can't start node: %s\n",
+					spa_strerror(res));
+			return res;
+		}
+		c->started = true;
+	}
+
+	c->ibuf = aligned_alloc(64, SPA_ROUND_UP_N(d->blocksize * d->in_channels *
+				sizeof(float), 64));
+	c->obuf = aligned_alloc(64, SPA_ROUND_UP_N(d->out_blocksize * d->out_channels *
+				sizeof(float), 64));
+	if (c->ibuf == NULL || c->obuf == NULL)
+		return -errno;
+
+	/* setup input buffer */
+	c->in_sdata.type = SPA_DATA_MemPtr;
+	c->in_sdata.flags = SPA_DATA_FLAG_READABLE;
+	c->in_sdata.fd = -1;
+	c->in_sdata.maxsize = d->blocksize * d->in_channels * sizeof(float);
+	c->in_sdata.data = c->ibuf;
+	c->in_sdata.chunk = &c->in_chunk;
+
+	c->in_buffer.datas = &c->in_sdata;
+	c->in_buffer.n_datas = 1;
+
+	res = spa_node_port_use_buffers(c->node,
+			SPA_DIRECTION_INPUT, 0, 0,
+			c->in_buffers, 1);
+	if (res < 0) {
+		fprintf(stderr, "can't set input buffers: %s\n",
+				spa_strerror(res));
+		return res;
+	}
+
+	/* setup output buffer */
+	c->out_sdata.type = SPA_DATA_MemPtr;
+	c->out_sdata.flags = SPA_DATA_FLAG_READWRITE;
+	c->out_sdata.fd = -1;
+	c->out_sdata.maxsize = d->out_blocksize * d->out_channels * sizeof(float);
+	c->out_sdata.data = c->obuf;
+	c->out_sdata.chunk = &c->out_chunk;
+
+	c->out_buffer.datas = &c->out_sdata;
+	c->out_buffer.n_datas = 1;
+
+	res = spa_node_port_use_buffers(c->node,
+			SPA_DIRECTION_OUTPUT, 0, 0,
+			c->out_buffers, 1);
+	if (res < 0) {
+		fprintf(stderr, "can't set output buffers: %s\n",
+				spa_strerror(res));
+		return res;
+	}
+
+	/* setup IO */
+	res = spa_node_port_set_io(c->node, SPA_DIRECTION_INPUT, 0,
+			SPA_IO_Buffers, &c->in_io, sizeof(c->in_io));
+	if (res < 0) {
+		fprintf(stderr, "can't set input IO: %s\n",
+				spa_strerror(res));
+		return res;
+	}
+	res = spa_node_port_set_io(c->node, SPA_DIRECTION_OUTPUT, 0,
+			SPA_IO_Buffers, &c->out_io, sizeof(c->out_io));
+	if (res < 0) {
+		fprintf(stderr, "can't set output IO: %s\n",
+				spa_strerror(res));
+		return res;
+	}
+	return 0;
+}
+
+static void convert_clear(struct convert *c)
+{
+	if (c->started) {
+		struct spa_command cmd =
+			SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Suspend);
+		spa_node_send_command(c->node, &cmd);
+	}
+	if (c->handle)
+		pw_unload_spa_handle(c->handle);
+	if (c->ifile && c->ifile != c->d->ifile)
+		sf_close(c->ifile);
+	free(c->ibuf);
+	free(c->obuf);
+	spa_zero(*c);
+}
+
+static int convert_reset(struct convert *c)
+{
+	struct spa_command cmd;
+	int res;
+
+	/* suspend clears the resampler history, start sets it up again */
+	cmd = SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Suspend);
+	if ((res = spa_node_send_command(c->node, &cmd)) < 0)
+		return res;
+	cmd = SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Start);
+	return spa_node_send_command(c->node, &cmd);
+}
+
+/* Convert from the current position of the input file until the end of the
+ * file or until max frames were produced. The first skip output frames are
+ * dropped, the others are passed to sink. Returns the number of frames passed
+ * to sink or a negative error. */
+static int64_t convert_run(struct convert *c, uint64_t skip, uint64_t max,
+		int (*sink) (void *data, const float *buf, uint32_t n_frames), void *data)
+{
+	struct data *d = c->d;
+	uint64_t total = 0;
+	int res;
+
+	while (total < max) {
+		sf_count_t n_read;
+		uint32_t n_frames;
+		const float *buf;
+
+		n_read = sf_readf_float(c->ifile, c->ibuf, d->blocksize);
+
+		c->read_total += n_read;
+
+		c->in_chunk.offset = 0;
+		c->in_chunk.size = n_read * d->in_channels * sizeof(float);
+		c->in_chunk.stride = 0;
+
+		c->out_chunk.offset = 0;
+		c->out_chunk.size = 0;
+		c->out_chunk.stride = 0;
+
+		c->in_io.status = n_read > 0 ? SPA_STATUS_HAVE_DATA : SPA_STATUS_DRAINED;
+		c->in_io.buffer_id = 0;
+		c->out_io.status = SPA_STATUS_NEED_DATA;
+		c->out_io.buffer_id = 0;
+
+		res = spa_node_process(c->node);
+		if (res < 0) {
+			fprintf(stderr, "process error: %s\n",
+					spa_strerror(res));
+			return res;
+		}
+
+		if (c->out_io.status == SPA_STATUS_HAVE_DATA &&
+		    c->out_io.buffer_id == 0) {
+			n_frames = c->out_chunk.size /
+				(d->out_channels * sizeof(float));
+			buf = c->obuf;
+
+			if (skip > 0) {
+				uint32_t n = SPA_MIN(skip, (uint64_t)n_frames);
+				skip -= n;
+				n_frames -= n;
+				buf += n * d->out_channels;
+			}
+			n_frames = SPA_MIN((uint64_t)n_frames, max - total);
+			if (n_frames > 0) {
+				if ((res = sink(data, buf, n_frames)) < 0)
+					return res;
+				total += n_frames;
+			}
+		}
+		if (n_read == 0)
+			break;
+	}
+	return total;
+}
+
+static int file_sink(void *data, const float *buf, uint32_t n_frames)
+{
+	struct data *d = data;
+	if (sf_writef_float(d->ofile, buf, n_frames) != n_frames)
+		return -EIO;
+	return 0;
+}
+
+static int segment_sink(void *data, const float *buf, uint32_t n_frames)
+{
+	struct segment *s = data;
+	size_t stride = s->channels * sizeof(float);
+
+	if (s->n_frames + n_frames > s->max_frames) {
+		uint64_t max_frames = SPA_MAX(s->max_frames * 2, s->n_frames + n_frames);
+		float *p = realloc(s->data, max_frames * stride);
+		if (p == NULL)
+			return -errno;
+		s->data = p;
+		s->max_frames = max_frames;
+	}
+	memcpy(s->data + s->n_frames * s->channels, buf, n_frames * stride);
+	s->n_frames += n_frames;
+	return 0;
+}
+
+/* the converter pads the output with silence when draining, limit the
+ * output to the resampled input and the resampler delay */
+static uint64_t output_frames(struct data *d, uint32_t delay)
+{
+	if (d->iinfo.frames <= 0)
+		return UINT64_MAX;
+	return ((uint64_t)d->iinfo.frames * d->out_rate + d->in_rate - 1) / d->in_rate + delay;
+}
+
+static int process_segment(struct convert *c, struct segment *s)
+{
+	struct data *d = c->d;
+	uint64_t start, skip, max;
+	int64_t res;
+
+	/* start a little earlier so that the resampler history and the
+	 * filters have settled when we reach the segment. The start is always
+	 * a multiple of the resampler period so that the phase matches what
+	 * a single pass over the file would have. */
+	start = s->start - SPA_MIN(s->start, d->preroll);
+	skip = (s->start - start) * d->out_rate / d->in_rate;
+	if (s->last)
+		max = d->max_frames - s->start * d->out_rate / d->in_rate;
+	else
+		max = (s->end - s->start) * d->out_rate / d->in_rate;
+
+	if (sf_seek(c->ifile, start, SEEK_SET) < 0)
+		return -EIO;
+	if ((res = convert_reset(c)) < 0)
+		return res;
+
+	s->channels = d->out_channels;
+	if ((res = convert_run(c, skip, max, segment_sink, s)) < 0)
+		return res;
+	return 0;
+}
+
+static void *convert_thread(void *arg)
+{
+	struct convert *c = arg;
+	struct data *d = c->d;
+	struct segment *s;
+	int res;
+
+	pthread_mutex_lock(&d->lock);
+	while (d->res == 0 && d->next_segment < d->n_segments) {
+		/* don't run too far ahead of the writer */
+		if (d->next_segment >= d->n_written + d->max_pending) {
+			pthread_cond_wait(&d->cond, &d->lock);
+			continue;
+		}
+		s = &d->segments[d->next_segment++];
+		pthread_mutex_unlock(&d->lock);
+
+		res = process_segment(c, s);
+
+		pthread_mutex_lock(&d->lock);
+		s->res = res;
+		s->done = true;
+		pthread_cond_broadcast(&d->cond);
+	}
+	pthread_mutex_unlock(&d->lock);
+	return NULL;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+	while (b != 0) {
+		uint64_t t = b;
+		b = a % b;
+		a = t;
+	}
+	return a;
+}
+
+static uint64_t round_up(uint64_t val, uint64_t step)
+{
+	return ((val + step - 1) / step) * step;
+}
+
+static int run_parallel(struct data *d, struct spa_audio_info_raw *in_info,
+		struct spa_audio_info_raw *out_info)
+{
+	uint32_t i, n_threads = 0;
+	uint64_t step, delay, seg_frames;
+	int res = 0;
+
+	/* segments must start on a multiple of the resampler period */
+	step = d->in_rate / gcd(d->in_rate, d->out_rate);
+	seg_frames = round_up((uint64_t)d->in_rate * SEGMENT_SECONDS, step);
+
+	d->n_segments = (d->iinfo.frames + seg_frames - 1) / seg_frames;
+	d->segments = calloc(d->n_segments, sizeof(struct segment));
+	d->converts = calloc(d->jobs, sizeof(struct convert));
+	if (d->segments == NULL || d->converts == NULL)
+		return -errno;
+
+	for (i = 0; i < d->n_segments; i++) {
+		struct segment *s = &d->segments[i];
+		s->start = i * seg_frames;
+		s->end = SPA_MIN(s->start + seg_frames, (uint64_t)d->iinfo.frames);
+		s->last = i + 1 == d->n_segments;
+	}
+
+	for (i = 0; i < d->jobs; i++) {
+		SF_INFO info;
+		SNDFILE *f;
+
+		spa_zero(info);
+		if ((f = sf_open(d->iname, SFM_READ, &info)) == NULL) {
+			fprintf(stderr, "error: failed to open input file \"%s\": %s\n",
+					d->iname, sf_strerror(NULL));
+			res = -EIO;
+			goto done;
+		}
+		if ((res = convert_init(d, &d->converts[i], f, in_info, out_info)) < 0)
+			goto done;
+	}
+
+	/* delay is at the output rate, we need twice that at the input rate
+	 * to fill the history, and some more to let the filters settle */
+	delay = (uint64_t)d->converts[0].rate_match.delay * d->in_rate / d->out_rate + 1;
+	d->preroll = round_up(SPA_MAX(2 * delay, (uint64_t)d->in_rate / 10), step);
+	d->max_pending = d->jobs * 2;
+	d->max_frames = output_frames(d, d->converts[0].rate_match.delay);
+
+	if (d->verbose)
+		fprintf(stdout, "parallel: jobs:%u segments:%u segment-size:%"PRIu64
+				" preroll:%"PRIu64"\n", d->jobs, d->n_segments,
+				seg_frames, d->preroll);
+
+	pthread_mutex_init(&d->lock, NULL);
+	pthread_cond_init(&d->cond, NULL);
+
+	for (i = 0; i < d->jobs; i++) {
+		if ((res = -pthread_create(&d->converts[i].thread, NULL,
+				convert_thread, &d->converts[i])) < 0) {
+			fprintf(stderr, "can't create thread: %s\n", spa_strerror(res));
+			break;
+		}
+		n_threads++;
+	}
+
+	/* write the segments in order as they complete */
+	for (i = 0; res == 0 && i < d->n_segments; i++) {
+		struct segment *s = &d->segments[i];
+
+		pthread_mutex_lock(&d->lock);
+		while (!s->done && n_threads > 0)
+			pthread_cond_wait(&d->cond, &d->lock);
+		pthread_mutex_unlock(&d->lock);
+
+		if (!s->done)
+			res = -EIO;
+		else if ((res = s->res) >= 0 && s->n_frames > 0)
+			res = file_sink(d, s->data, s->n_frames);
+		if (res >= 0)
+			d->written_total += s->n_frames;
+
+		free(s->data);
+		s->data = NULL;
+
+		pthread_mutex_lock(&d->lock);
+		d->n_written++;
+		pthread_cond_broadcast(&d->cond);
+		pthread_mutex_unlock(&d->lock);
+	}
+
+	pthread_mutex_lock(&d->lock);
+	d->res = res < 0 ? res : 0;
+	pthread_cond_broadcast(&d->cond);
+	pthread_mutex_unlock(&d->lock);
+
+	for (i = 0; i < n_threads; i++)
+		pthread_join(d->converts[i].thread, NULL);
+
+	pthread_cond_destroy(&d->cond);
+	pthread_mutex_destroy(&d->lock);
+
+done:
+	for (i = 0; i < d->jobs; i++) {
+		struct convert *c = &d->converts[i];
+		d->read_total += c->read_total;
+		if (c->d != NULL)
+			convert_clear(c);
+	}
+	for (i = 0; i < d->n_segments; i++)
+		free(d->segments[i].data);
+	free(d->segments);
+	free(d->converts);
+	d->segments = NULL;
+	d->converts = NULL;
+	return res;
+}
+
+static int do_filter(struct data *d)
+{
 	int in_channels = d->iinfo.channels;
 	int out_channels;
 	int in_rate = d->iinfo.samplerate;
 	int out_rate = d->rate > 0 ? d->rate : in_rate;
-	uint32_t blocksize = d->blocksize > 0 ? d->blocksize : MAX_SAMPLES;
 	int res;
 	struct spa_audio_info_raw in_info, out_info;
 	struct spa_audio_layout_info in_layout, out_layout;
+	struct timespec t1, t2;
+	double elapsed, seconds;
 
 	/* determine output channels */
 	out_channels = d->out_channels > 0 ? d->out_channels : in_channels;
@@ -300,32 +804,29 @@ static int do_filter(struct data *d)
 	if (res < 0)
 		return res;
 
+	/* segments are converted independently, this needs a seekable input
+	 * with a known length */
+	if (d->jobs > 1 && (!d->iinfo.seekable || d->iinfo.frames <= 0)) {
+		fprintf(stderr, "warning: input is not seekable, using 1 job\n");
+		d->jobs = 1;
+	}
+
+	d->in_rate = in_rate;
+	d->out_rate = out_rate;
+	d->in_channels = in_channels;
+	d->out_channels = out_channels;
+	if (d->blocksize == 0)
+		d->blocksize = d->jobs > 1 ? MAX_JOB_SAMPLES : MAX_SAMPLES;
+
 	/* calculate output buffer size accounting for resampling */
-	uint32_t out_blocksize = (uint32_t)((uint64_t)blocksize *
+	d->out_blocksize = (uint32_t)((uint64_t)d->blocksize *
 			out_rate / in_rate) + 64;
 
-	uint32_t quant_limit = SPA_ROUND_UP_N(SPA_MAX(out_blocksize, blocksize), 4096);
+	uint32_t quant_limit = SPA_ROUND_UP_N(SPA_MAX(d->out_blocksize, d->blocksize), 4096);
 
 	pw_properties_setf(d->props, "clock.quantum-limit", "%u", quant_limit);
 	pw_properties_set(d->props, "convert.direction", "output");
 
-	d->handle = pw_context_load_spa_handle(d->context,
-			SPA_NAME_AUDIO_CONVERT, &d->props->dict);
-
-	if (d->handle == NULL) {
-		fprintf(stderr, "can't load %s: %m\n", SPA_NAME_AUDIO_CONVERT);
-		return -errno;
-	}
-
-	res = spa_handle_get_interface(d->handle,
-			SPA_TYPE_INTERFACE_Node, &iface);
-	if (res < 0 || iface == NULL) {
-		fprintf(stderr, "can't get Node interface: %s\n",
-				spa_strerror(res));
-		return res;
-	}
-	node = d->node = iface;
-
 	/* build input format: interleaved F32 */
 	spa_zero(in_info);
 	in_info.format = SPA_AUDIO_FORMAT_F32;
@@ -344,167 +845,50 @@ static int do_filter(struct data *d)
 			i < SPA_AUDIO_MAX_CHANNELS; i++)
 		out_info.position[i] = out_layout.position[i];
 
-	/* set up convert directions */
-	res = setup_convert_direction(node, SPA_DIRECTION_INPUT, &in_info);
-	if (res < 0) {
-		fprintf(stderr, "can't set input format: %s\n",
-				spa_strerror(res));
-		return res;
-	}
-	res = setup_convert_direction(node, SPA_DIRECTION_OUTPUT, &out_info);
-	if (res < 0) {
-		fprintf(stderr, "can't set output format: %s\n",
-				spa_strerror(res));
-		return res;
-	}
-
-	/* send Start command */
-	{
-		struct spa_command cmd =
-			SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Start);
-		res = spa_node_send_command(node, &cmd);
-		if (res < 0) {
-			fprintf(stderr, "can't start node: %s\n",
-					spa_strerror(res));
-			return res;
-		}
-	}
-
 	if (d->verbose)
 		fprintf(stdout, "convert: in:%dch@%dHz -> out:%dch@%dHz "
-				"blocksize:%u\n",
+				"blocksize:%u jobs:%u\n",
 				in_channels, in_rate,
-				out_channels, out_rate, blocksize);
+				out_channels, out_rate, d->blocksize, d->jobs);
 
-	/* process audio */
-	{
-		float ibuf[blocksize * in_channels] SPA_ALIGNED(64);
-		float obuf[out_blocksize * out_channels] SPA_ALIGNED(64);
-
-		struct spa_chunk in_chunk, out_chunk;
-		struct spa_data in_sdata, out_sdata;
-		struct spa_buffer in_buffer, out_buffer;
-		struct spa_buffer *in_buffers[1] = { &in_buffer };
-		struct spa_buffer *out_buffers[1] = { &out_buffer };
-		struct spa_io_buffers in_io, out_io;
-		size_t read_total = 0, written_total = 0;
-
-		/* setup input buffer */
-		spa_zero(in_chunk);
-		spa_zero(in_sdata);
-		in_sdata.type = SPA_DATA_MemPtr;
-		in_sdata.flags = SPA_DATA_FLAG_READABLE;
-		in_sdata.fd = -1;
-		in_sdata.maxsize = sizeof(ibuf);
-		in_sdata.data = ibuf;
-		in_sdata.chunk = &in_chunk;
-
-		spa_zero(in_buffer);
-		in_buffer.datas = &in_sdata;
-		in_buffer.n_datas = 1;
-
-		res = spa_node_port_use_buffers(node,
-				SPA_DIRECTION_INPUT, 0, 0,
-				in_buffers, 1);
-		if (res < 0) {
-			fprintf(stderr, "can't set input buffers: %s\n",
-					spa_strerror(res));
-			goto stop;
-		}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
 
-		/* setup output buffer */
-		spa_zero(out_chunk);
-		spa_zero(out_sdata);
-		out_sdata.type = SPA_DATA_MemPtr;
-		out_sdata.flags = SPA_DATA_FLAG_READWRITE;
-		out_sdata.fd = -1;
-		out_sdata.maxsize = sizeof(obuf);
-		out_sdata.data = obuf;
-		out_sdata.chunk = &out_chunk;
-
-		spa_zero(out_buffer);
-		out_buffer.datas = &out_sdata;
-		out_buffer.n_datas = 1;
-
-		res = spa_node_port_use_buffers(node,
-				SPA_DIRECTION_OUTPUT, 0, 0,
-				out_buffers, 1);
-		if (res < 0) {
-			fprintf(stderr, "can't set output buffers: %s\n",
-					spa_strerror(res));
-			goto stop;
-		}
-
-		/* setup IO */
-		res = spa_node_port_set_io(node, SPA_DIRECTION_INPUT, 0,
-				SPA_IO_Buffers, &in_io, sizeof(in_io));
-		if (res < 0) {
-			fprintf(stderr, "can't set input IO: %s\n",
-					spa_strerror(res));
-			goto stop;
-		}
-		res = spa_node_port_set_io(node, SPA_DIRECTION_OUTPUT, 0,
-				SPA_IO_Buffers, &out_io, sizeof(out_io));
-		if (res < 0) {
-			fprintf(stderr, "can't set output IO: %s\n",
-					spa_strerror(res));
-			goto stop;
-		}
-
-		/* process loop */
-		while (true) {
-			sf_count_t n_read;
-
-			n_read = sf_readf_float(d->ifile, ibuf, blocksize);
-
-			read_total += n_read;
-
-			in_chunk.offset = 0;
-			in_chunk.size = n_read * in_channels * sizeof(float);
-			in_chunk.stride = 0;
-
-			out_chunk.offset = 0;
-			out_chunk.size = 0;
-			out_chunk.stride = 0;
-
-			in_io.status = n_read > 0 ? SPA_STATUS_HAVE_DATA : SPA_STATUS_DRAINED;
-			in_io.buffer_id = 0;
-			out_io.status = SPA_STATUS_NEED_DATA;
-			out_io.buffer_id = 0;
-
-			res = spa_node_process(node);
-			if (res < 0) {
-				fprintf(stderr, "process error: %s\n",
-						spa_strerror(res));
-				break;
-			}
-
-			if (out_io.status == SPA_STATUS_HAVE_DATA &&
-			    out_io.buffer_id == 0) {
-				uint32_t out_frames = out_chunk.size /
-					(out_channels * sizeof(float));
-				if (out_frames > 0)
-					written_total += sf_writef_float(
-							d->ofile, obuf,
-							out_frames);
-			}
-			if (n_read == 0)
-				break;
+	if (d->jobs > 1) {
+		res = run_parallel(d, &in_info, &out_info);
+	} else {
+		struct convert c;
+		int64_t written;
+
+		spa_zero(c);
+		if ((res = convert_init(d, &c, d->ifile, &in_info, &out_info)) >= 0) {
+			written = convert_run(&c, 0, output_frames(d, c.rate_match.delay),
+					file_sink, d);
+			if (written >= 0)
+				d->written_total = written;
+			res = written < 0 ? (int)written : 0;
 		}
-		if (d->verbose)
-			fprintf(stdout, "read %zu samples, wrote %zu samples\n",
-					read_total, written_total);
+		d->read_total = c.read_total;
+		if (c.d != NULL)
+			convert_clear(&c);
 	}
+	if (res < 0)
+		return res;
 
-	res = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t2);
 
-stop:
-	{
-		struct spa_command cmd =
-			SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Suspend);
-		spa_node_send_command(node, &cmd);
+	if (d->verbose) {
+		elapsed = (SPA_TIMESPEC_TO_NSEC(&t2) - SPA_TIMESPEC_TO_NSEC(&t1)) / (double)SPA_NSEC_PER_SEC;
+		seconds = (double)d->iinfo.frames / in_rate;
+
+		fprintf(stdout, "read %"PRIu64" samples, wrote %"PRIu64" samples\n",
+				d->read_total, d->written_total);
+		fprintf(stdout, "converted %.1fs of audio in %.3fs: %.1fx realtime, "
+				"%.1f MB/s in, %.1f MB/s out\n", seconds, elapsed,
+				elapsed > 0.0 ? seconds / elapsed : 0.0,
+				elapsed > 0.0 ? d->iinfo.frames * in_channels * sizeof(float) / elapsed / 1e6 : 0.0,
+				elapsed > 0.0 ? d->written_total * out_channels * sizeof(float) / elapsed / 1e6 : 0.0);
 	}
-	return res;
+	return 0;
 }
 
 static char *read_file(const char *path)
@@ -546,6 +930,7 @@ int main(int argc, char *argv[])
 	char *file_content = NULL, *str;
 
 	spa_zero(data);
+	data.jobs = 1;
 	data.props = pw_properties_new(NULL, NULL);
 
 	pw_init(&argc, &argv);
@@ -614,6 +999,16 @@ int main(int argc, char *argv[])
 		case OPT_CHANNELMAP:
 			data.channel_map = optarg;
 			break;
+		case 'j':
+			ret = strtol(optarg, NULL, 10);
+			if (ret < 0) {
+				fprintf(stderr, "error: bad jobs %s\n", optarg);
+				goto error_usage;
+			}
+			if (ret == 0)
+				ret = sysconf(_SC_NPROCESSORS_ONLN);
+			data.jobs = SPA_MAX(ret, 1);
+			break;
 		default:
 			fprintf(stderr, "error: unknown option '%c'\n", c);
 			goto error_usage;
@@ -654,8 +1049,6 @@ done:
 		sf_close(data.ofile);
 	if (data.props)
 		pw_properties_free(data.props);
-	if (data.handle)
-		pw_unload_spa_handle(data.handle);
 	if (data.context)
 		pw_context_destroy(data.context);
 	if (data.loop)
@@ -3941,6 +3941,202 @@ PWTEST(avb_sequence_number_wrapping)
 	return PWTEST_PASS;
 }
 
+static ssize_t test_ring_pdu(uint8_t *pdu, uint8_t seq, int payload_size)
+{
+	static const uint8_t dest[6] = { 0x91, 0xe0, 0xf0, 0x00, 0x01, 0x00 };
+	static const uint8_t src[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+	struct avb_frame_header *h = (struct avb_frame_header *)pdu;
+	struct avb_packet_aaf *p = SPA_PTROFF(h, sizeof(*h), void);
+
+	memset(pdu, 0, sizeof(*h) + sizeof(*p) + payload_size);
+	memcpy(h->dest, dest, 6);
+	memcpy(h->src, src, 6);
+	h->type = htons(0x8100);
+	h->prio_cfi_id = htons((3 << 13) | 2);
+	h->etype = htons(0x22f0);
+
+	p->subtype = AVB_SUBTYPE_AAF;
+	p->sv = 1;
+	p->tv = 1;
+	p->seq_num = seq;
+	p->data_len = htons(payload_size);
+	memset(p->payload, seq, payload_size);
+
+	return sizeof(*h) + sizeof(*p) + payload_size;
+}
+
+static struct stream *test_ring_stream_new(struct server *server,
+		enum spa_direction direction, int *fd)
+{
+	struct stream *stream;
+
+	stream = calloc(1, sizeof(*stream));
+	pwtest_ptr_notnull(stream);
+	stream->server = server;
+	stream->direction = direction;
+
+	*fd = avb_server_stream_setup_socket(server, stream);
+	pwtest_int_ge(*fd, 0);
+	/* only talkers use a ring */
+	pwtest_bool_eq(stream->packet_ring.data != NULL,
+			direction == SPA_DIRECTION_OUTPUT);
+
+	return stream;
+}
+
+static void test_ring_stream_free(struct server *server, struct stream *stream, int fd)
+{
+	avb_server_stream_close(server, stream);
+	pwtest_ptr_null(stream->packet_ring.data);
+	close(fd);
+	free(stream);
+}
+
+/*
+ * Test: with packet_mmap, PDUs sent on a talker stream are queued in the
+ * TX ring and only leave, in order, with one kick per flush.
+ */
+PWTEST(avb_packet_ring_tx_batch)
+{
+	struct impl *impl;
+	struct server *server;
+	struct stream *stream;
+	uint8_t pdu[2048], buf[2048];
+	struct iovec iov[2];
+	struct msghdr msg;
+	int i, fd, payload_size = 8 * 4 * 6;
+	ssize_t size = 0, hdr_size;
+
+	impl = test_impl_new();
+	server = avb_test_server_new(impl);
+	pwtest_ptr_notnull(server);
+	server->packet_mmap = true;
+
+	stream = test_ring_stream_new(server, SPA_DIRECTION_OUTPUT, &fd);
+	avb_loopback_clear_packets(server);
+
+	hdr_size = sizeof(struct avb_frame_header) + sizeof(struct avb_packet_aaf);
+	spa_zero(msg);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+
+	for (i = 0; i < 10; i++) {
+		size = test_ring_pdu(pdu, i, payload_size);
+		iov[0].iov_base = pdu;
+		iov[0].iov_len = hdr_size;
+		iov[1].iov_base = SPA_PTROFF(pdu, hdr_size, void);
+		iov[1].iov_len = size - hdr_size;
+		pwtest_int_eq(avb_server_stream_send(server, stream, &msg, MSG_NOSIGNAL), size);
+	}
+
+	/* nothing leaves before the kick */
+	pwtest_int_eq(avb_loopback_get_packet_count(server), 0);
+	pwtest_int_eq(stream->packet_ring.pending, 10u);
+
+	pwtest_int_eq(avb_server_stream_flush(server, stream), 0);
+	pwtest_int_eq(avb_loopback_get_ring_kicks(server), 1u);
+	pwtest_int_eq(stream->packet_ring.pending, 0u);
+	pwtest_int_eq(avb_loopback_get_packet_count(server), 10);
+
+	for (i = 0; i < 10; i++) {
+		struct avb_packet_aaf *p;
+
+		pwtest_int_eq(avb_loopback_get_packet(server, buf, sizeof(buf)), size);
+		test_ring_pdu(pdu, i, payload_size);
+		pwtest_int_eq(memcmp(buf, pdu, size), 0);
+
+		p = SPA_PTROFF(buf, sizeof(struct avb_frame_header), void);
+		pwtest_int_eq(p->seq_num, i);
+	}
+
+	/* an empty flush does not kick */
+	pwtest_int_eq(avb_server_stream_flush(server, stream), 0);
+	pwtest_int_eq(avb_loopback_get_ring_kicks(server), 1u);
+
+	test_ring_stream_free(server, stream, fd);
+	test_impl_free(impl);
+
+	return PWTEST_PASS;
+}
+
+/*
+ * Test: a full TX ring is drained with an extra kick instead of
+ * failing the send.
+ */
+PWTEST(avb_packet_ring_tx_full)
+{
+	struct impl *impl;
+	struct server *server;
+	struct stream *stream;
+	uint8_t pdu[2048];
+	struct iovec iov[1];
+	struct msghdr msg;
+	uint32_t i, frame_nr;
+	int fd;
+	ssize_t size;
+
+	impl = test_impl_new();
+	server = avb_test_server_new(impl);
+	pwtest_ptr_notnull(server);
+	server->packet_mmap = true;
+
+	stream = test_ring_stream_new(server, SPA_DIRECTION_OUTPUT, &fd);
+	avb_loopback_clear_packets(server);
+	frame_nr = stream->packet_ring.frame_nr;
+
+	size = test_ring_pdu(pdu, 0, 8 * 4 * 6);
+	iov[0].iov_base = pdu;
+	iov[0].iov_len = size;
+	spa_zero(msg);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 1;
+
+	for (i = 0; i < frame_nr; i++)
+		pwtest_int_eq(avb_server_stream_send(server, stream, &msg, 0), size);
+	pwtest_int_eq(avb_loopback_get_ring_kicks(server), 0u);
+	pwtest_int_eq(stream->packet_ring.pending, frame_nr);
+
+	/* the ring wrapped onto a slot the kernel still owns */
+	pwtest_int_eq(avb_server_stream_send(server, stream, &msg, 0), size);
+	pwtest_int_eq(avb_loopback_get_ring_kicks(server), 1u);
+	pwtest_int_eq(avb_loopback_get_packet_count(server),
+			(int)SPA_MIN(frame_nr, (uint32_t)AVB_LOOPBACK_MAX_PACKETS));
+
+	/* frames that don't fit a slot are refused */
+	iov[0].iov_len = AVB_PACKET_RING_FRAME_SIZE;
+	pwtest_int_eq(avb_server_stream_send(server, stream, &msg, 0), -1);
+	pwtest_int_eq(errno, EMSGSIZE);
+
+	test_ring_stream_free(server, stream, fd);
+	test_impl_free(impl);
+
+	return PWTEST_PASS;
+}
+
+/*
+ * Test: with packet_mmap, a listener stream keeps its plain socket. The RX
+ * ring would hand over PDUs too late for class A.
+ */
+PWTEST(avb_packet_ring_rx_none)
+{
+	struct impl *impl;
+	struct server *server;
+	struct stream *stream;
+	int fd;
+
+	impl = test_impl_new();
+	server = avb_test_server_new(impl);
+	pwtest_ptr_notnull(server);
+	server->packet_mmap = true;
+
+	stream = test_ring_stream_new(server, SPA_DIRECTION_INPUT, &fd);
+
+	test_ring_stream_free(server, stream, fd);
+	test_impl_free(impl);
+
+	return PWTEST_PASS;
+}
+
 PWTEST_SUITE(avb)
 {
 	/* Phase 2: ADP and basic tests */
@@ -4033,5 +4229,10 @@ PWTEST_SUITE(avb)
 	pwtest_add(avb_ringbuffer_overrun, PWTEST_NOARG);
 	pwtest_add(avb_sequence_number_wrapping, PWTEST_NOARG);
 
+	/* packet_mmap TX/RX rings */
+	pwtest_add(avb_packet_ring_tx_batch, PWTEST_NOARG);
+	pwtest_add(avb_packet_ring_tx_full, PWTEST_NOARG);
+	pwtest_add(avb_packet_ring_rx_none, PWTEST_NOARG);
+
 	return PWTEST_PASS;
 }
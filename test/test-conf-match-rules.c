@@ -533,6 +533,67 @@ PWTEST(match_rules_regex_array_property)
 	return PWTEST_PASS;
 }
 
+PWTEST(match_rules_context)
+{
+	char path[PATH_MAX];
+	struct match_result r;
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct spa_dict props = SPA_DICT_ITEMS(
+		SPA_DICT_ITEM_INIT("node.name", "alsa_output.pci"));
+	struct spa_dict props_ext = SPA_DICT_ITEMS(
+		SPA_DICT_ITEM_INIT("node.name", "alsa_output.pci"),
+		SPA_DICT_ITEM_INIT("config.ext", "test"));
+	struct spa_dict props_no_match = SPA_DICT_ITEMS(
+		SPA_DICT_ITEM_INIT("node.name", "bluez_sink"));
+	FILE *fp;
+	int i;
+
+	pwtest_mkstemp(path);
+	fp = fopen(path, "we");
+	fputs("node.rules = [ { matches = [ { node.name = \"~alsa_.*\" } ]"
+	      "    actions = { update-props = { priority = 100 } } } ]\n"
+	      "node.rules.test = [ { matches = [ { node.name = alsa_output.pci } ]"
+	      "    actions = { update-props = { priority = 200 } } } ]\n", fp);
+	fclose(fp);
+
+	pw_init(0, NULL);
+	setenv("PIPEWIRE_CONFIG_NAME", path, 1);
+
+	loop = pw_main_loop_new(NULL);
+	pwtest_ptr_notnull(loop);
+	context = pw_context_new(pw_main_loop_get_loop(loop), NULL, 0);
+	pwtest_ptr_notnull(context);
+
+	/* the rules are parsed on the first match and reused after that */
+	for (i = 0; i < 2; i++) {
+		spa_zero(r);
+		pwtest_int_eq(pw_context_conf_section_match_rules(context, "node.rules",
+					&props, match_callback, &r), 0);
+		pwtest_int_eq(r.count, 1);
+		pwtest_str_eq(r.value, "{ priority = 100 }");
+
+		spa_zero(r);
+		pwtest_int_eq(pw_context_conf_section_match_rules(context, "node.rules",
+					&props_ext, match_callback, &r), 0);
+		pwtest_int_eq(r.count, 2);
+		pwtest_str_eq(r.value, "{ priority = 200 }");
+
+		spa_zero(r);
+		pwtest_int_eq(pw_context_conf_section_match_rules(context, "node.rules",
+					&props_no_match, match_callback, &r), 0);
+		pwtest_int_eq(r.count, 0);
+	}
+
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+	unsetenv("PIPEWIRE_CONFIG_NAME");
+	unlink(path);
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
 PWTEST_SUITE(context)
 {
 	pwtest_add(match_rules_basic, PWTEST_NOARG);
@@ -560,6 +621,7 @@ PWTEST_SUITE(context)
 	pwtest_add(match_rules_array_property_and, PWTEST_NOARG);
 	pwtest_add(match_rules_array_property_no_match, PWTEST_NOARG);
 	pwtest_add(match_rules_regex_array_property, PWTEST_NOARG);
+	pwtest_add(match_rules_context, PWTEST_NOARG);
 
 	return PWTEST_PASS;
 }
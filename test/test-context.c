@@ -7,9 +7,14 @@
 #include <spa/utils/string.h>
 #include <spa/support/dbus.h>
 #include <spa/support/cpu.h>
+#include <spa/node/node.h>
+#include <spa/node/utils.h>
+#include <spa/pod/filter.h>
+#include <spa/param/audio/format-utils.h>
 
 #include <pipewire/pipewire.h>
 #include <pipewire/global.h>
+#include <pipewire/impl.h>
 
 #define TEST_FUNC(a,b,func)	\
 do {				\
@@ -261,12 +266,268 @@ PWTEST(context_support)
 	return PWTEST_PASS;
 }
 
+/* a node with one audio port that counts how often its formats are
+ * enumerated with a filter, which is what the link does to find a
+ * common format */
+struct test_node {
+	struct spa_node node;
+	struct spa_hook_list hooks;
+	enum spa_direction direction;
+	struct spa_port_info info;
+	struct spa_param_info params[3];
+	struct spa_audio_info_raw format;
+	int enum_formats;
+};
+
+static int test_node_add_listener(void *object, struct spa_hook *listener,
+		const struct spa_node_events *events, void *data)
+{
+	struct test_node *n = object;
+	struct spa_hook_list save;
+
+	spa_hook_list_isolate(&n->hooks, &save, listener, events, data);
+	n->info.change_mask = SPA_PORT_CHANGE_MASK_FLAGS | SPA_PORT_CHANGE_MASK_PARAMS;
+	spa_node_emit_port_info(&n->hooks, n->direction, 0, &n->info);
+	n->info.change_mask = 0;
+	spa_hook_list_join(&n->hooks, &save);
+	return 0;
+}
+
+static int test_node_ok(void *object)
+{
+	return 0;
+}
+
+static int test_node_set_io(void *object, uint32_t id, void *data, size_t size)
+{
+	return 0;
+}
+
+static int test_node_send_command(void *object, const struct spa_command *command)
+{
+	return 0;
+}
+
+static int test_node_port_enum_params(void *object, int seq,
+		enum spa_direction direction, uint32_t port_id,
+		uint32_t id, uint32_t start, uint32_t num,
+		const struct spa_pod *filter)
+{
+	struct test_node *n = object;
+	struct spa_pod *param;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_result_node_params result;
+
+	if (id == SPA_PARAM_EnumFormat)
+		n->enum_formats++;
+
+	result.id = id;
+	result.index = start;
+	result.next = start + 1;
+
+	if (start > 0)
+		return 0;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	switch (id) {
+	case SPA_PARAM_EnumFormat:
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_Format, id,
+			SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_audio),
+			SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+			SPA_FORMAT_AUDIO_format,   SPA_POD_CHOICE_ENUM_Id(3,
+							SPA_AUDIO_FORMAT_F32,
+							SPA_AUDIO_FORMAT_F32,
+							SPA_AUDIO_FORMAT_S16),
+			SPA_FORMAT_AUDIO_channels, SPA_POD_CHOICE_RANGE_Int(2, 1, 8),
+			SPA_FORMAT_AUDIO_rate,     SPA_POD_CHOICE_RANGE_Int(48000, 1, 384000));
+		break;
+	case SPA_PARAM_Format:
+		if (n->format.format == 0)
+			return 0;
+		param = spa_format_audio_raw_build(&b, id, &n->format);
+		break;
+	case SPA_PARAM_Buffers:
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamBuffers, id,
+			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(1, 1, 32),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_CHOICE_RANGE_Int(4096, 32, INT32_MAX),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(8));
+		break;
+	default:
+		return 0;
+	}
+
+	if (spa_pod_filter(&b, &result.param, param, filter) < 0)
+		return 0;
+
+	spa_node_emit_result(&n->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+	return 0;
+}
+
+static int test_node_port_set_param(void *object,
+		enum spa_direction direction, uint32_t port_id,
+		uint32_t id, uint32_t flags, const struct spa_pod *param)
+{
+	struct test_node *n = object;
+
+	if (id != SPA_PARAM_Format)
+		return -ENOENT;
+
+	spa_zero(n->format);
+	if (param != NULL && spa_format_audio_raw_parse(param, &n->format) < 0)
+		return -EINVAL;
+	return 0;
+}
+
+static int test_node_port_use_buffers(void *object,
+		enum spa_direction direction, uint32_t port_id,
+		uint32_t flags, struct spa_buffer **buffers, uint32_t n_buffers)
+{
+	return 0;
+}
+
+static int test_node_port_set_io(void *object,
+		enum spa_direction direction, uint32_t port_id,
+		uint32_t id, void *data, size_t size)
+{
+	return 0;
+}
+
+static const struct spa_node_methods test_node_methods = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = test_node_add_listener,
+	.set_io = test_node_set_io,
+	.send_command = test_node_send_command,
+	.port_enum_params = test_node_port_enum_params,
+	.port_set_param = test_node_port_set_param,
+	.port_use_buffers = test_node_port_use_buffers,
+	.port_set_io = test_node_port_set_io,
+	.process = test_node_ok,
+};
+
+static struct pw_impl_port *test_node_init(struct test_node *n,
+		struct pw_context *context, enum spa_direction direction)
+{
+	struct pw_impl_node *node;
+
+	spa_zero(*n);
+	n->node.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE, &test_node_methods, n);
+	spa_hook_list_init(&n->hooks);
+	n->direction = direction;
+	n->params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
+	n->params[1] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_READWRITE);
+	n->params[2] = SPA_PARAM_INFO(SPA_PARAM_Buffers, SPA_PARAM_INFO_READ);
+	n->info = SPA_PORT_INFO_INIT();
+	n->info.params = n->params;
+	n->info.n_params = SPA_N_ELEMENTS(n->params);
+
+	node = pw_context_create_node(context, NULL, 0);
+	pwtest_ptr_notnull(node);
+	pwtest_int_eq(pw_impl_node_set_implementation(node, &n->node), 0);
+	pwtest_int_eq(pw_impl_node_register(node, NULL), 0);
+
+	return pw_impl_node_find_port(node, direction, 0);
+}
+
+static struct pw_impl_link *test_link_negotiate(struct pw_main_loop *loop,
+		struct pw_context *context, struct pw_impl_port *output, struct pw_impl_port *input)
+{
+	struct pw_loop *l = pw_main_loop_get_loop(loop);
+	struct pw_impl_link *link;
+	int i;
+
+	link = pw_context_create_link(context, output, input, NULL, NULL, 0);
+	pwtest_ptr_notnull(link);
+	pwtest_int_eq(pw_impl_link_register(link, NULL), 0);
+
+	pw_loop_enter(l);
+	for (i = 0; i < 10; i++)
+		pw_loop_iterate(l, 0);
+	pw_loop_leave(l);
+
+	pwtest_int_ge(pw_impl_link_get_info(link)->state, PW_LINK_STATE_NEGOTIATING);
+	return link;
+}
+
+PWTEST(context_link_format_cache)
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct test_node src, sink;
+	struct pw_impl_port *output, *input;
+	struct pw_impl_link *link;
+
+	pw_init(0, NULL);
+
+	loop = pw_main_loop_new(NULL);
+	pwtest_ptr_notnull(loop);
+	context = pw_context_new(pw_main_loop_get_loop(loop),
+			pw_properties_new(
+				PW_KEY_CONFIG_NAME, "null",
+				"link.format-cache", "true",
+				NULL), 0);
+	pwtest_ptr_notnull(context);
+
+	output = test_node_init(&src, context, SPA_DIRECTION_OUTPUT);
+	pwtest_ptr_notnull(output);
+	input = test_node_init(&sink, context, SPA_DIRECTION_INPUT);
+	pwtest_ptr_notnull(input);
+
+	/* the first link enumerates the formats of both ports, the result
+	 * ends up in the param cache of the ports */
+	link = test_link_negotiate(loop, context, output, input);
+	pwtest_int_gt(sink.enum_formats, 0);
+	pwtest_int_gt(src.enum_formats, 0);
+	pwtest_int_eq(src.format.format, (uint32_t)SPA_AUDIO_FORMAT_F32);
+	pwtest_int_eq(sink.format.format, (uint32_t)SPA_AUDIO_FORMAT_F32);
+
+	/* removing the link clears the formats */
+	pw_impl_link_destroy(link);
+	pwtest_int_eq(src.format.format, 0U);
+	pwtest_int_eq(sink.format.format, 0U);
+
+	/* a second link between the same ports reuses the cached format
+	 * and does not enumerate the formats again */
+	sink.enum_formats = src.enum_formats = 0;
+	link = test_link_negotiate(loop, context, output, input);
+	pwtest_int_eq(sink.enum_formats, 0);
+	pwtest_int_eq(src.enum_formats, 0);
+	pwtest_int_eq(src.format.format, (uint32_t)SPA_AUDIO_FORMAT_F32);
+	pwtest_int_eq(sink.format.format, (uint32_t)SPA_AUDIO_FORMAT_F32);
+	pw_impl_link_destroy(link);
+
+	/* when the formats of a port change, the cached format is dropped */
+	sink.params[0].flags ^= SPA_PARAM_INFO_SERIAL;
+	sink.info.change_mask = SPA_PORT_CHANGE_MASK_PARAMS;
+	spa_node_emit_port_info(&sink.hooks, sink.direction, 0, &sink.info);
+	sink.info.change_mask = 0;
+
+	sink.enum_formats = src.enum_formats = 0;
+	link = test_link_negotiate(loop, context, output, input);
+	pwtest_int_gt(sink.enum_formats, 0);
+	pwtest_int_eq(sink.format.format, (uint32_t)SPA_AUDIO_FORMAT_F32);
+	pw_impl_link_destroy(link);
+
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
 PWTEST_SUITE(context)
 {
 	pwtest_add(context_abi, PWTEST_NOARG);
 	pwtest_add(context_create, PWTEST_NOARG);
 	pwtest_add(context_properties, PWTEST_NOARG);
 	pwtest_add(context_support, PWTEST_NOARG);
+	pwtest_add(context_link_format_cache, PWTEST_NOARG);
 
 	return PWTEST_PASS;
 }
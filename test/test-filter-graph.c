@@ -0,0 +1,107 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include "pwtest.h"
+
+#include <spa/utils/string.h>
+#include <spa/param/audio/raw.h>
+#include <spa/filter-graph/filter-graph.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
+
+#define N_SAMPLES	1024
+
+/* a biquad chain a -> b -> c with the nodes declared out of order so that b
+ * is seen before a */
+static const char graph_fmt[] =
+	"{ optimize = %s"
+	"  nodes = ["
+	"    { type = builtin name = b label = bq_peaking"
+	"      control = { Freq = 1000.0 Q = 1.0 Gain = 6.0 } }"
+	"    { type = builtin name = c label = bq_lowpass"
+	"      control = { Freq = 3000.0 Q = 0.7 } }"
+	"    { type = builtin name = a label = bq_highshelf"
+	"      control = { Freq = 5000.0 Q = 0.7 Gain = -3.0 } }"
+	"  ]"
+	"  links = ["
+	"    { output = \"a:Out\" input = \"b:In\" }"
+	"    { output = \"b:Out\" input = \"c:In\" }"
+	"  ]"
+	"  inputs = [ \"a:In\" ]"
+	"  outputs = [ \"c:Out\" ]"
+	"}";
+
+static void run_graph(struct pw_context *context, bool optimize, float *out)
+{
+	struct spa_handle *handle;
+	struct spa_filter_graph *graph;
+	static float in[N_SAMPLES];
+	const void *ins[1] = { in };
+	void *outs[1] = { out };
+	char json[1024];
+	void *iface;
+
+	spa_scnprintf(json, sizeof(json), graph_fmt, optimize ? "true" : "false");
+
+	handle = pw_context_load_spa_handle(context, "filter.graph",
+			&SPA_DICT_ITEMS(
+				SPA_DICT_ITEM(SPA_KEY_LIBRARY_NAME, "filter-graph/libspa-filter-graph"),
+				SPA_DICT_ITEM("clock.quantum-limit", "8192"),
+				SPA_DICT_ITEM("filter-graph.n_inputs", "1"),
+				SPA_DICT_ITEM("filter-graph.n_outputs", "1"),
+				SPA_DICT_ITEM("filter.graph", json)));
+	pwtest_ptr_notnull(handle);
+	pwtest_neg_errno_ok(spa_handle_get_interface(handle,
+				SPA_TYPE_INTERFACE_FilterGraph, &iface));
+	graph = iface;
+
+	pwtest_neg_errno_ok(spa_filter_graph_activate(graph,
+				&SPA_DICT_ITEMS(SPA_DICT_ITEM(SPA_KEY_AUDIO_RATE, "48000"))));
+
+	spa_memzero(in, sizeof(in));
+	in[0] = 1.0f;
+	spa_filter_graph_process(graph, ins, outs, N_SAMPLES);
+
+	spa_filter_graph_deactivate(graph);
+	pw_unload_spa_handle(handle);
+}
+
+PWTEST(filter_graph_fuse_out_of_order)
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	static float ref[N_SAMPLES], out[N_SAMPLES];
+	uint32_t i;
+
+	pw_init(0, NULL);
+
+	loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(loop),
+			pw_properties_new(
+				PW_KEY_CONFIG_NAME, "null",
+				NULL), 0);
+	pwtest_ptr_notnull(context);
+
+	/* the fused chain must give the same impulse response as the
+	 * nodes that are run one by one */
+	run_graph(context, false, ref);
+	run_graph(context, true, out);
+
+	for (i = 0; i < N_SAMPLES; i++)
+		pwtest_double_eq(out[i], ref[i]);
+
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
+PWTEST_SUITE(filter_graph)
+{
+	pwtest_add(filter_graph_fuse_out_of_order, PWTEST_NOARG);
+
+	return PWTEST_PASS;
+}
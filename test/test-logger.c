@@ -7,6 +7,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
 
 #include <spa/utils/ansi.h>
 #include <spa/utils/names.h>
@@ -615,6 +616,101 @@ cleanup:
 	return result;
 }
 
+PWTEST(logger_deferred_format)
+{
+	struct pwtest_spa_plugin *plugin;
+	void *iface;
+	char fname[PATH_MAX];
+	struct spa_dict_item items[3];
+	struct spa_dict info;
+	char buffer[1024];
+	char expected[16][256];
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	char *page, *str;
+	FILE *fp;
+	int i, n = 0;
+
+	pw_init(0, NULL);
+
+	pwtest_mkstemp(fname);
+	items[0] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_FILE, fname);
+	items[1] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_LEVEL, "5");
+	items[2] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_DEFERRED, "true");
+	info = SPA_DICT_INIT(items, 3);
+	plugin = pwtest_spa_plugin_new();
+	pwtest_ptr_notnull(pwtest_spa_plugin_load_interface(plugin, "support/libspa-support",
+						 SPA_NAME_SUPPORT_SYSTEM, SPA_TYPE_INTERFACE_System,
+						 NULL));
+	pwtest_ptr_notnull(pwtest_spa_plugin_load_interface(plugin, "support/libspa-support",
+						 SPA_NAME_SUPPORT_LOOP, SPA_TYPE_INTERFACE_Loop,
+						 NULL));
+	iface = pwtest_spa_plugin_load_interface(plugin, "support/libspa-support",
+						 SPA_NAME_SUPPORT_LOG, SPA_TYPE_INTERFACE_Log,
+						 &info);
+	pwtest_ptr_notnull(iface);
+
+	/* a string that is not terminated, right before an inaccessible page */
+	page = mmap(NULL, 2 * page_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	pwtest_ptr_ne(page, MAP_FAILED);
+	pwtest_errno_ok(mprotect(page + page_size, page_size, PROT_NONE));
+	str = page + page_size - 3;
+	memcpy(str, "abc", 3);
+
+#define CHECK(fmt, ...)								\
+	do {									\
+		errno = EAGAIN;							\
+		spa_log_trace(iface, "MARK%d: " fmt, n, __VA_ARGS__);		\
+		errno = EAGAIN;							\
+		snprintf(expected[n], sizeof(expected[n]), "MARK%d: " fmt,	\
+				n, __VA_ARGS__);				\
+		n++;								\
+	} while (0)
+
+	CHECK("%.*s|", 3, str);
+	CHECK("%.3s|%.2s|%.0s|", str, "abcdef", "abc");
+	CHECK("%-*.*s|%*s|%s", 6, 2, "abcdef", -4, "ab", "end");
+	CHECK("100%% %s %%", "done");
+	CHECK("%lld %llu %lli %llx", -1LL, 2ULL, 3LL, 0xabcdefULL);
+	CHECK("%zd %zu %jd %ju %td", (ssize_t)-4, (size_t)5, (intmax_t)-6, (uintmax_t)7, (ptrdiff_t)-8);
+	CHECK("%hhd %hhu %hd %hu %ld %lu", -9, 250, -10, 65000, -11L, 12UL);
+	CHECK("%d %+d % d %05d %-5d| %x %#X %o %#o", 1, 2, 3, 4, 5, 255, 255, 8, 8);
+	CHECK("%f %.2f %10.3e %g %G %a %Lf", 1.5, 2.25, 3.5, 4.0, 5e-10, 1.0, (long double)6.5);
+	CHECK("%c%c %p %s", 'x', 'y', (void*)&n, (char*)NULL);
+	CHECK("%m %s", "errno");
+
+#undef CHECK
+
+	/* clear the logger before the loop that it uses, this writes out the
+	 * deferred messages */
+	spa_handle_clear(plugin->handles[2]);
+	free(plugin->handles[2]);
+	plugin->handles[2] = NULL;
+
+	fp = fopen(fname, "re");
+	pwtest_ptr_notnull(fp);
+	i = 0;
+	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+		char *mark, *nl;
+
+		if ((mark = strstr(buffer, "MARK")) == NULL)
+			continue;
+		if ((nl = strchr(mark, '\n')) != NULL)
+			*nl = '\0';
+		pwtest_int_lt(i, n);
+		pwtest_str_eq(mark, expected[i]);
+		i++;
+	}
+	fclose(fp);
+	pwtest_int_eq(i, n);
+
+	munmap(page, 2 * page_size);
+	pwtest_spa_plugin_destroy(plugin);
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
 PWTEST_SUITE(logger)
 {
 	pwtest_add(logger_truncate_long_lines, PWTEST_NOARG);
@@ -637,6 +733,7 @@ PWTEST_SUITE(logger)
 	pwtest_add(logger_topics, PWTEST_NOARG);
 	pwtest_add(logger_journal, PWTEST_NOARG);
 	pwtest_add(logger_journal_chain, PWTEST_NOARG);
+	pwtest_add(logger_deferred_format, PWTEST_NOARG);
 
 	return PWTEST_PASS;
 }
@@ -25,6 +25,7 @@ PWTEST(node_io_abi_sizes)
 
 	pwtest_int_eq(sizeof(struct spa_io_position), 1688U);
 	pwtest_int_eq(sizeof(struct spa_io_rate_match), 48U);
+	pwtest_int_eq(sizeof(struct spa_io_meter), 1072U);
 
 	spa_assert_se(sizeof(struct spa_node_info) == 48);
 	spa_assert_se(sizeof(struct spa_port_info) == 48);
@@ -46,6 +47,7 @@ PWTEST(node_io_abi_sizes)
 
 	fprintf(stderr, "%zd\n", sizeof(struct spa_io_position));
 	fprintf(stderr, "%zd\n", sizeof(struct spa_io_rate_match));
+	fprintf(stderr, "%zd\n", sizeof(struct spa_io_meter));
 
 	fprintf(stderr, "%zd\n", sizeof(struct spa_node_info));
 	fprintf(stderr, "%zd\n", sizeof(struct spa_port_info));
@@ -72,6 +74,7 @@ PWTEST(node_io_abi)
 	pwtest_int_eq(SPA_IO_RateMatch, 8);
 	pwtest_int_eq(SPA_IO_Memory, 9);
 	pwtest_int_eq(SPA_IO_AsyncBuffers, 10);
+	pwtest_int_eq(SPA_IO_Meter, 11);
 
 	/* position state */
 	pwtest_int_eq(SPA_IO_POSITION_STATE_STOPPED, 0);